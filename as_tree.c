@@ -5,6 +5,7 @@
 #include "as_tree.h"
 #include "macros.h"
 #include "umalloc.h"
+#include "symbol.h"
 
 static struct ast_node*
 ast_node_new(size_t size)
@@ -56,9 +57,6 @@ ast_node_const_free(struct ast_node *node)
 	
 	_const = (struct ast_node_const *)node;
 	
-	if (_const->v_type == VALUE_TYPE_STRING)	
-		ufree(_const->string);
-
 	ufree(_const);
 }
 
@@ -74,7 +72,7 @@ ast_node_const(value_t v_type, void *data)
 		_const->digit = *(double *)data;
 		break;
 	case VALUE_TYPE_STRING:
-		_const->string = ustrdup((char *)data);
+		_const->string = (char *)data;
 		break;
 	default:
 		error(1, "incompatible value type");
@@ -98,17 +96,17 @@ ast_node_id_free(struct ast_node *node)
 		
 	id = (struct ast_node_id *)node;
 
-	ufree(id->name);
 	ufree(id);
 }	
 
 struct ast_node_id*
-ast_node_id(char *name)
+ast_node_id(char *name, int slot)
 {
 	struct ast_node_id *node;
 	
 	node = (struct ast_node_id *)ast_node_new(sizeof(*node));
-	node->name = strdup(name);
+	node->name = name;
+	node->slot = slot;
 
 	AST_NODE(node)->type = NODE_TYPE_ID;
 	AST_NODE(node)->destructor = ast_node_id_free;
@@ -228,7 +226,6 @@ ast_node_func_call_free(struct ast_node *node)
 	for(i = 0; i < func_call->nargs; i++)
 		ast_node_unref(func_call->args[i]);
 	
-	ufree(func_call->name);	
 	ufree(func_call);
 }
 
@@ -242,7 +239,7 @@ ast_node_func_call(char *name)
 	AST_NODE(func_call)->type = NODE_TYPE_FUNC_CALL;
 	AST_NODE(func_call)->destructor = ast_node_func_call_free;
 
-	func_call->name = ustrdup(name);
+	func_call->name = name;
 	
 	return func_call;
 	
@@ -484,6 +481,81 @@ ast_node_for(struct ast_node *expr1, struct ast_node *expr2, struct ast_node *ex
 	return for_node;	
 }
 
+static void
+ast_node_parfor_free(struct ast_node *node)
+{
+	struct ast_node_parfor *parfor;
+	struct ast_node *stmt, *next;
+
+	return_if_fail(node != NULL);
+
+	parfor = (struct ast_node_parfor *)node;
+
+	ast_node_unref(parfor->from);
+	ast_node_unref(parfor->to);
+	ast_node_unref(parfor->step);
+
+	for (stmt = parfor->stmt; stmt != NULL; stmt = next) {
+		next = stmt->next;
+		ast_node_unref(stmt);
+	}
+
+	if (parfor->scope)
+		symbol_table_destroy(&parfor->scope);
+
+	if (parfor->red)
+		ufree(parfor->red);
+
+	ufree(parfor);
+}
+
+/* the body and its scope are set by the parser */
+struct ast_node_parfor*
+ast_node_parfor(int var, struct ast_node *from, struct ast_node *to,
+		struct ast_node *step, opcode_type_t cmp)
+{
+	struct ast_node_parfor *parfor;
+
+	return_val_if_fail(from != NULL && to != NULL && step != NULL, NULL);
+
+	parfor = (struct ast_node_parfor *)ast_node_new(sizeof(*parfor));
+
+	parfor->var  = var;
+	parfor->from = from;
+	parfor->to   = to;
+	parfor->step = step;
+	parfor->cmp  = cmp;
+
+	AST_NODE(parfor)->type  = NODE_TYPE_PARFOR;
+	AST_NODE(parfor)->child = from;
+	AST_NODE(parfor)->destructor = ast_node_parfor_free;
+
+	from->parent = AST_NODE(parfor);
+	to->parent   = AST_NODE(parfor);
+	step->parent = AST_NODE(parfor);
+
+	return parfor;
+}
+
+void
+ast_node_parfor_add_reduction(struct ast_node_parfor *parfor,
+		opcode_type_t opcode, char *name, int slot, int outer)
+{
+	struct par_reduction *red;
+
+	return_if_fail(parfor != NULL);
+
+	parfor->red = urealloc(parfor->red,
+				(parfor->nred + 1) * sizeof(*parfor->red));
+
+	red = &parfor->red[parfor->nred++];
+
+	red->opcode = opcode;
+	red->name   = name;
+	red->slot   = slot;
+	red->outer  = outer;
+}
+
 static void
 ast_node_while_free(struct ast_node *node)
 {
@@ -684,8 +756,6 @@ ast_node_access_free(struct ast_node *node)
 		
 	ac_node = (struct ast_node_access *)node;
 	
-	ufree(ac_node->name);
-	
 	if (ac_node->dims)
 		ufree(ac_node->dims);
 	
@@ -693,7 +763,7 @@ ast_node_access_free(struct ast_node *node)
 }
 
 struct ast_node_access*
-ast_node_access(value_t v_type, char *name)
+ast_node_access(value_t v_type, char *name, int slot)
 {
 	struct ast_node_access *ac_node;
 	
@@ -705,7 +775,8 @@ ast_node_access(value_t v_type, char *name)
 	AST_NODE(ac_node)->destructor = ast_node_access_free;
 	
 	ac_node->v_type = v_type;
-	ac_node->name   = ustrdup(name);
+	ac_node->name   = name;
+	ac_node->slot   = slot;
 
 	return ac_node;
 }
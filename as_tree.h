@@ -4,6 +4,7 @@
 #include "common.h"
 
 struct ast_node;
+struct symbol_table;
 
 typedef enum {
 	NODE_TYPE_ID,
@@ -20,6 +21,7 @@ typedef enum {
 	NODE_TYPE_RETURN,	
 	NODE_TYPE_IF,
 	NODE_TYPE_FOR,
+	NODE_TYPE_PARFOR,
 	NODE_TYPE_WHILE,
 	NODE_TYPE_BREAK,
 	NODE_TYPE_CONTINUE,
@@ -83,9 +85,12 @@ struct ast_node_const {
 	};
 };
 
+/* names are interned (see intern.h) and not owned by the nodes */
+/* slot is the index in the function scope, -1 for a global */
 struct ast_node_id {
 	struct ast_node base;
 	char *name;
+	int slot;
 };
 
 struct ast_node_op {
@@ -131,6 +136,34 @@ struct ast_node_for {
 	struct ast_node *stmt;
 };
 
+/* sum, product, min, max: OPCODE_ADD, OPCODE_MULT, OPCODE_LT, OPCODE_GT */
+struct par_reduction {
+	opcode_type_t	opcode;
+	char		*name;
+	int		slot;		/* private copy in the frame */
+	int		outer;		/* slot outside the loop, -1 for a global */
+};
+
+/*
+ * parfor (var = from; var cmp to; var = var + step; reductions) stmt
+ *
+ * The body runs in frames of scope: the slots of the enclosing function
+ * are shared, the loop variable, reduction variables and locals of the
+ * body are private.
+ */
+struct ast_node_parfor {
+	struct ast_node base;
+	int			var;
+	struct ast_node		*from;
+	struct ast_node		*to;
+	struct ast_node		*step;
+	opcode_type_t		cmp;
+	struct ast_node		*stmt;
+	struct symbol_table	*scope;
+	int			nred;
+	struct par_reduction	*red;
+};
+
 struct ast_node_while {
 	struct ast_node base;
 	struct ast_node *expr;
@@ -167,6 +200,7 @@ struct ast_node_access {
 	struct ast_node base;
 	value_t		v_type;
 	char		*name;
+	int		slot;
 	int 		ndims;
 	struct ast_node	**dims;	
 };
@@ -181,7 +215,7 @@ struct ast_node_const*
 ast_node_const(value_t v_type, void *data);
 
 struct ast_node_id*
-ast_node_id(char *name);
+ast_node_id(char *name, int slot);
 
 struct ast_node_op*
 ast_node_op(char op_helper, struct ast_node *left, struct ast_node *right);
@@ -213,6 +247,14 @@ ast_node_if(struct ast_node *expr, struct ast_node *stmt, struct ast_node *_else
 struct ast_node_for*
 ast_node_for(struct ast_node *expr1, struct ast_node *expr2, struct ast_node *expr3, struct ast_node *stmt);
 
+struct ast_node_parfor*
+ast_node_parfor(int var, struct ast_node *from, struct ast_node *to,
+		struct ast_node *step, opcode_type_t cmp);
+
+void
+ast_node_parfor_add_reduction(struct ast_node_parfor *parfor,
+		opcode_type_t opcode, char *name, int slot, int outer);
+
 struct ast_node_while*
 ast_node_while(struct ast_node *expr, struct ast_node *stmt);
 
@@ -232,7 +274,7 @@ struct ast_node_include*
 ast_node_include(char *fname);
 
 struct ast_node_access*
-ast_node_access(value_t v_type, char *name);
+ast_node_access(value_t v_type, char *name, int slot);
 
 void
 ast_node_access_add(struct ast_node_access *ac_node, struct ast_node *idx);
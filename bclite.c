@@ -0,0 +1,467 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "bclite.h"
+#include "context.h"
+#include "syntax.h"
+#include "traverse.h"
+#include "symbol.h"
+#include "eval.h"
+#include "macros.h"
+#include "umalloc.h"
+#include "intern.h"
+#include "as_tree.h"
+#include "function.h"
+#include "vmath.h"
+
+/* the parsed statements of a script, run without lexing it again */
+struct bclite_program {
+	struct bclite_ctx	*ctx;
+	struct ast_node		**stmts;
+	int			nstmts;
+	struct symbol		*result;	/* copy of the last value */
+	int			has_result;
+};
+
+static void
+program_add(struct bclite_program *prog, struct ast_node *tree)
+{
+	int i;
+
+	i = prog->nstmts++;
+
+	prog->stmts = urealloc(prog->stmts, prog->nstmts * sizeof(*prog->stmts));
+
+	prog->stmts[i] = tree;
+}
+
+struct bclite_program*
+bclite_compile(struct bclite_ctx *ctx, const char *src, size_t len)
+{
+	struct bclite_program *prog;
+	struct ast_node *tree;
+	int eof, errors;
+	FILE *in;
+
+	return_val_if_fail(ctx != NULL, NULL);
+	return_val_if_fail(src != NULL, NULL);
+
+	prog = umalloc0(sizeof(*prog));
+
+	prog->ctx    = ctx;
+	prog->result = symbol_new(intern("result"), VALUE_TYPE_UNKNOWN);
+
+	if (len == 0)
+		return prog;
+
+	in = fmemopen((void *)src, len, "r");
+
+	if (in == NULL) {
+		bclite_program_destroy(&prog);
+		return NULL;
+	}
+
+	set_file(ctx, in);
+
+	do {
+		errors = programme(ctx, &tree, &eof);
+
+		if (errors) {
+			ast_node_unref(tree);
+			bclite_program_destroy(&prog);
+			break;
+		}
+
+		/* empty lines and function definitions leave nothing to run */
+		if (tree->child == NULL || (tree->child->type == NODE_TYPE_STUB
+						&& tree->child->next == NULL))
+			ast_node_unref(tree);
+		else
+			program_add(prog, tree);
+
+	} while (!eof);
+
+	fclose(in);
+
+	return prog;
+}
+
+void
+bclite_program_destroy(struct bclite_program **prog)
+{
+	int i;
+
+	return_if_fail(prog != NULL && *prog != NULL);
+
+	for (i = 0; i < (*prog)->nstmts; i++)
+		ast_node_unref((*prog)->stmts[i]);
+
+	if ((*prog)->stmts)
+		ufree((*prog)->stmts);
+
+	symbol_destroy((*prog)->result);
+
+	ufree(*prog);
+	(*prog) = NULL;
+}
+
+static void
+keep_result(struct bclite_program *prog, struct eval *res)
+{
+	switch(res->v_type) {
+	case VALUE_TYPE_DIGIT:
+		symbol_set_val(prog->result, res->v_type, &res->digit);
+		break;
+	case VALUE_TYPE_STRING:
+		symbol_set_val(prog->result, res->v_type, res->string);
+		break;
+	case VALUE_TYPE_VECTOR:
+		symbol_set_val(prog->result, res->v_type, res->vector);
+		break;
+	case VALUE_TYPE_MATRIX:
+		symbol_set_val(prog->result, res->v_type, res->matrix);
+		break;
+	default:
+		return;
+	}
+
+	prog->has_result = TRUE;
+}
+
+static int
+program_run(struct bclite_program *prog, FILE *out)
+{
+	struct bclite_ctx *ctx;
+	struct eval *res;
+	int i, ok;
+
+	return_val_if_fail(prog != NULL, FALSE);
+
+	ctx = prog->ctx;
+
+	prog->has_result = FALSE;
+
+	ok = TRUE;
+
+	for (i = 0; i < prog->nstmts; i++) {
+		traversal_statement(ctx, prog->stmts[i]);
+
+		if (!traversal_result(ctx, &res)) {
+			/* printing, go on to the next statement like the interpreter */
+			if (out == NULL)
+				return FALSE;
+
+			ok = FALSE;
+			continue;
+		}
+
+		if (res == NULL)
+			continue;
+
+		if (out != NULL)
+			eval_print(out, res);
+
+		keep_result(prog, res);
+		eval_free(res);
+	}
+
+	return ok;
+}
+
+int
+bclite_run(struct bclite_program *prog)
+{
+	return program_run(prog, NULL);
+}
+
+int
+bclite_run_print(struct bclite_program *prog, FILE *out)
+{
+	return_val_if_fail(out != NULL, FALSE);
+
+	return program_run(prog, out);
+}
+
+void
+bclite_reset(struct bclite_ctx *ctx)
+{
+	return_if_fail(ctx != NULL);
+
+	symbol_table_restore_globals(ctx);
+}
+
+static int
+is_input(char *name, const char **names, int n)
+{
+	int i;
+
+	for (i = 0; i < n; i++)
+		if (STREQ(name, names[i]))
+			return TRUE;
+
+	return FALSE;
+}
+
+/*
+ * Only operations that act on each element of a vector as they act on a
+ * digit and round the same way; dep tells whether the value depends on
+ * the inputs, i.e. becomes a vector.
+ */
+static int
+elementwise(struct bclite_ctx *ctx, struct ast_node *node, const char **names,
+							int n, int *dep)
+{
+	struct ast_node_const *_const;
+	struct ast_node_id *id;
+	struct ast_node_func_call *call;
+	struct ast_node_op *op;
+	struct function *func;
+	struct symbol *sym;
+	int ldep, rdep;
+
+	switch(node->type) {
+	case NODE_TYPE_CONST:
+		_const = AST_CONST(node);
+		*dep = FALSE;
+		return _const->v_type == VALUE_TYPE_DIGIT;
+	case NODE_TYPE_ID:
+		id = (struct ast_node_id *)node;
+
+		if (id->slot >= 0)
+			return FALSE;
+
+		*dep = is_input(id->name, names, n);
+
+		if (*dep)
+			return TRUE;
+
+		sym = symbol_table_lookup_global(ctx, id->name);
+
+		return sym != NULL && sym->v_type == VALUE_TYPE_DIGIT;
+	case NODE_TYPE_ADD_OP:
+	case NODE_TYPE_MULT_OP:
+		op = (struct ast_node_op *)node;
+
+		if (!elementwise(ctx, op->left, names, n, &ldep) ||
+		    !elementwise(ctx, op->right, names, n, &rdep))
+			return FALSE;
+
+		*dep = ldep || rdep;
+
+		switch(op->opcode) {
+		case OPCODE_ADD:
+		case OPCODE_SUB:
+			return TRUE;
+		case OPCODE_MULT:
+			/* vector * vector is the dot product */
+			return !(ldep && rdep);
+		default:
+			/* a vector is divided through its reciprocal */
+			return !(*dep);
+		}
+	case NODE_TYPE_FUNC_CALL:
+		call = (struct ast_node_func_call *)node;
+
+		/* builtins that map vectors element by element */
+		if (call->nargs != 1 || vmath_builtin(call->name) == NULL)
+			return FALSE;
+
+		func = function_table_lookup(ctx, call->name);
+
+		if (func == NULL || !func->is_lib)
+			return FALSE;
+
+		return elementwise(ctx, call->args[0], names, n, dep);
+	default:
+		return FALSE;
+	}
+}
+
+int
+bclite_program_elementwise(struct bclite_program *prog, const char **names,
+								int n)
+{
+	struct ast_node *stmt;
+	int dep;
+
+	return_val_if_fail(prog != NULL, FALSE);
+	return_val_if_fail(names != NULL || n == 0, FALSE);
+
+	if (prog->nstmts != 1)
+		return FALSE;
+
+	stmt = prog->stmts[0]->child;
+
+	if (stmt == NULL || stmt->next != NULL)
+		return FALSE;
+
+	return elementwise(prog->ctx, stmt, names, n, &dep);
+}
+
+/* a global, created unbound if the scripts have not used it yet */
+static struct symbol*
+global_symbol(struct bclite_ctx *ctx, const char *name)
+{
+	struct symbol *sym;
+	char *str;
+
+	str = intern_local(ctx->strings, name);
+	sym = symbol_table_lookup_global(ctx, str);
+
+	if (sym == NULL) {
+		sym = symbol_new(str, VALUE_TYPE_UNKNOWN);
+		symbol_table_global_put_symbol(ctx, sym);
+	}
+
+	return sym;
+}
+
+/* a name never interned is not the name of a symbol, nor interned now */
+static struct symbol*
+lookup_global(struct bclite_ctx *ctx, const char *name)
+{
+	char *str;
+
+	str = intern_lookup(ctx->strings, name);
+
+	if (str == NULL)
+		return NULL;
+
+	return symbol_table_lookup_global(ctx, str);
+}
+
+int
+bclite_set_digit(struct bclite_ctx *ctx, const char *name, double value)
+{
+	return_val_if_fail(ctx != NULL, FALSE);
+	return_val_if_fail(name != NULL, FALSE);
+
+	symbol_set_val(global_symbol(ctx, name), VALUE_TYPE_DIGIT, &value);
+
+	return TRUE;
+}
+
+int
+bclite_bind_vector(struct bclite_ctx *ctx, const char *name, double *data,
+						size_t size)
+{
+	return_val_if_fail(ctx != NULL, FALSE);
+	return_val_if_fail(name != NULL, FALSE);
+	return_val_if_fail(data != NULL && size > 0, FALSE);
+
+	symbol_bind_vector(global_symbol(ctx, name), data, size);
+
+	return TRUE;
+}
+
+int
+bclite_bind_matrix(struct bclite_ctx *ctx, const char *name, double *data,
+						size_t rows, size_t cols)
+{
+	return_val_if_fail(ctx != NULL, FALSE);
+	return_val_if_fail(name != NULL, FALSE);
+	return_val_if_fail(data != NULL && rows > 0 && cols > 0, FALSE);
+
+	symbol_bind_matrix(global_symbol(ctx, name), data, rows, cols);
+
+	return TRUE;
+}
+
+static int
+get_digit(struct symbol *sym, double *value)
+{
+	if (sym == NULL || sym->v_type != VALUE_TYPE_DIGIT)
+		return FALSE;
+
+	*value = sym->digit;
+
+	return TRUE;
+}
+
+static int
+get_vector(struct symbol *sym, const double **data, size_t *size)
+{
+	if (sym == NULL || sym->v_type != VALUE_TYPE_VECTOR)
+		return FALSE;
+
+	if (sym->vector->stride != 1)
+		return FALSE;
+
+	*data = sym->vector->data;
+	*size = sym->vector->size;
+
+	return TRUE;
+}
+
+static int
+get_matrix(struct symbol *sym, const double **data, size_t *rows,
+						size_t *cols)
+{
+	if (sym == NULL || sym->v_type != VALUE_TYPE_MATRIX)
+		return FALSE;
+
+	if (sym->matrix->tda != sym->matrix->size2)
+		return FALSE;
+
+	*data = sym->matrix->data;
+	*rows = sym->matrix->size1;
+	*cols = sym->matrix->size2;
+
+	return TRUE;
+}
+
+int
+bclite_get_digit(struct bclite_ctx *ctx, const char *name, double *value)
+{
+	return_val_if_fail(ctx != NULL, FALSE);
+	return_val_if_fail(name != NULL, FALSE);
+
+	return get_digit(lookup_global(ctx, name), value);
+}
+
+int
+bclite_get_vector(struct bclite_ctx *ctx, const char *name,
+				const double **data, size_t *size)
+{
+	return_val_if_fail(ctx != NULL, FALSE);
+	return_val_if_fail(name != NULL, FALSE);
+
+	return get_vector(lookup_global(ctx, name), data, size);
+}
+
+int
+bclite_get_matrix(struct bclite_ctx *ctx, const char *name,
+				const double **data, size_t *rows, size_t *cols)
+{
+	return_val_if_fail(ctx != NULL, FALSE);
+	return_val_if_fail(name != NULL, FALSE);
+
+	return get_matrix(lookup_global(ctx, name), data, rows, cols);
+}
+
+int
+bclite_result_digit(struct bclite_program *prog, double *value)
+{
+	return_val_if_fail(prog != NULL, FALSE);
+
+	return prog->has_result && get_digit(prog->result, value);
+}
+
+int
+bclite_result_vector(struct bclite_program *prog, const double **data,
+						size_t *size)
+{
+	return_val_if_fail(prog != NULL, FALSE);
+
+	return prog->has_result && get_vector(prog->result, data, size);
+}
+
+int
+bclite_result_matrix(struct bclite_program *prog, const double **data,
+					size_t *rows, size_t *cols)
+{
+	return_val_if_fail(prog != NULL, FALSE);
+
+	return prog->has_result && get_matrix(prog->result, data, rows, cols);
+}
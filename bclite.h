@@ -0,0 +1,123 @@
+#ifndef BCLITE_H_
+#define BCLITE_H_
+
+/*
+ * Embedding API, built as libbclite.a and libbclite.so (make lib).
+ *
+ * A script is compiled once into a program and then run as many times
+ * as needed; running does not lex or parse again.  Inputs are global
+ * variables bound before a run, results are read back from globals or
+ * from the value of the last statement.
+ *
+ *	ctx  = bclite_ctx_new();
+ *	prog = bclite_compile(ctx, src, strlen(src));
+ *
+ *	bclite_bind_vector(ctx, "x", x, n);
+ *	bclite_set_digit(ctx, "a", 2.0);
+ *	if (bclite_run(prog))
+ *		bclite_result_digit(prog, &y);
+ *
+ *	bclite_program_destroy(&prog);
+ *	bclite_ctx_destroy(&ctx);
+ *
+ * Functions return TRUE (1) on success and FALSE (0) otherwise.  A
+ * context and its programs belong to one thread at a time; separate
+ * contexts may run concurrently.
+ *
+ * The first context installs a GSL error handler that prints the error
+ * instead of aborting the process, unless the host has set a handler of
+ * its own before.
+ */
+
+#include <stddef.h>
+#include <stdio.h>
+
+struct bclite_ctx;
+struct bclite_program;
+
+struct bclite_ctx*
+bclite_ctx_new(void);
+
+void
+bclite_ctx_destroy(struct bclite_ctx **ctx);
+
+/*
+ * Compile all statements in src.  Functions defined there are added to
+ * the context right away.  NULL on a syntax error.
+ */
+struct bclite_program*
+bclite_compile(struct bclite_ctx *ctx, const char *src, size_t len);
+
+void
+bclite_program_destroy(struct bclite_program **prog);
+
+/* evaluate the statements in order, stops at the first failing one */
+int
+bclite_run(struct bclite_program *prog);
+
+/*
+ * Run printing the value of each statement to out, as the interpreter
+ * does; a failing statement does not stop the ones after it.
+ */
+int
+bclite_run_print(struct bclite_program *prog, FILE *out);
+
+/* unset every global, functions stay defined */
+void
+bclite_reset(struct bclite_ctx *ctx);
+
+/*
+ * TRUE if the program is a single expression that treats each element of
+ * the named inputs on its own: running it once with the inputs bound to
+ * vectors gives, element by element, what runs with each digit would.
+ * Other globals it uses must be digits at the time of the call.
+ */
+int
+bclite_program_elementwise(struct bclite_program *prog, const char **names,
+								int n);
+
+int
+bclite_set_digit(struct bclite_ctx *ctx, const char *name, double value);
+
+/*
+ * Zero-copy bindings: the variable becomes a view of the caller's array,
+ * which must outlive its use.  Element assignments in the script write
+ * through to it; assigning the whole variable drops the view.  Matrices
+ * are row-major and dense.
+ */
+int
+bclite_bind_vector(struct bclite_ctx *ctx, const char *name, double *data,
+						size_t size);
+
+int
+bclite_bind_matrix(struct bclite_ctx *ctx, const char *name, double *data,
+						size_t rows, size_t cols);
+
+/*
+ * Read a global.  Vector and matrix data stay owned by the context and
+ * are valid until the variable changes.
+ */
+int
+bclite_get_digit(struct bclite_ctx *ctx, const char *name, double *value);
+
+int
+bclite_get_vector(struct bclite_ctx *ctx, const char *name,
+				const double **data, size_t *size);
+
+int
+bclite_get_matrix(struct bclite_ctx *ctx, const char *name,
+				const double **data, size_t *rows, size_t *cols);
+
+/* value of the last statement of the last run that had one */
+int
+bclite_result_digit(struct bclite_program *prog, double *value);
+
+int
+bclite_result_vector(struct bclite_program *prog, const double **data,
+						size_t *size);
+
+int
+bclite_result_matrix(struct bclite_program *prog, const double **data,
+					size_t *rows, size_t *cols);
+
+#endif /* BCLITE_H_ */
@@ -0,0 +1,225 @@
+/*
+ * hash_bench - hash.c against the old chained table (bench/hash_chained.c)
+ * on symbol-table-like workloads:
+ *
+ *   ptr	interned names, pointer hash and compare (symbol, function
+ *		and keyword tables)
+ *   str	string keys with djb2 and strcmp (the intern table)
+ *
+ * For every table size it times insert_unique, lookups that hit, lookups
+ * that miss and a full iteration, and prints nanoseconds per operation.
+ * "worst" is the slowest single insert, where a resize shows up.
+ * Lookups go in a shuffled order: keys are allocated one after another,
+ * and walking them in that order would favour a pointer hash taken
+ * modulo the table size.
+ *
+ * usage: hash_bench [max_size]
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "hash.h"
+
+struct hash_table *chained_hash_table_new(size_t hint_size, hash_callback_t hash, hash_compare_t key_cmp);
+void chained_hash_table_destroy(struct hash_table **table);
+ret_t chained_hash_table_insert_unique(struct hash_table *table, void *key, void *data);
+ret_t chained_hash_table_lookup(struct hash_table *table, void *key, void **res_data);
+struct hash_table_iter *chained_hash_table_iterate_init(struct hash_table *table);
+void chained_hash_table_iterate_deinit(struct hash_table_iter **iter);
+boolean_t chained_hash_table_iterate(struct hash_table_iter *iter, void **res_key, void **res_data);
+
+struct impl {
+	const char *name;
+	struct hash_table *(*new)(size_t, hash_callback_t, hash_compare_t);
+	void (*destroy)(struct hash_table **);
+	ret_t (*insert_unique)(struct hash_table *, void *, void *);
+	ret_t (*lookup)(struct hash_table *, void *, void **);
+	struct hash_table_iter *(*iterate_init)(struct hash_table *);
+	void (*iterate_deinit)(struct hash_table_iter **);
+	boolean_t (*iterate)(struct hash_table_iter *, void **, void **);
+};
+
+static const struct impl impls[] = {
+	{ "chained", chained_hash_table_new, chained_hash_table_destroy,
+	  chained_hash_table_insert_unique, chained_hash_table_lookup,
+	  chained_hash_table_iterate_init, chained_hash_table_iterate_deinit,
+	  chained_hash_table_iterate },
+	{ "open", hash_table_new, hash_table_destroy,
+	  hash_table_insert_unique, hash_table_lookup,
+	  hash_table_iterate_init, hash_table_iterate_deinit,
+	  hash_table_iterate },
+};
+
+#define NIMPLS	(sizeof(impls) / sizeof(impls[0]))
+
+/* total lookups per measurement, spread over the keys */
+#define LOOKUPS	(1 << 22)
+
+static unsigned long
+str_hash(const void *data)
+{
+	const unsigned char *str = data;
+	unsigned long hash = 5381;
+	int c;
+
+	while ((c = *str++) != 0)
+		hash = ((hash << 5) + hash) + c;
+
+	return hash;
+}
+
+static int
+str_cmp(const void *a, const void *b)
+{
+	return strcmp(a, b);
+}
+
+static double
+now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+
+	return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+/* names like a script would use, each malloc'd separately */
+static char**
+make_keys(int n, const char *prefix)
+{
+	char buf[32], **keys;
+	int i;
+
+	keys = malloc(n * sizeof(*keys));
+
+	for (i = 0; i < n; i++) {
+		snprintf(buf, sizeof(buf), "%s%d", prefix, i);
+		keys[i] = strdup(buf);
+	}
+
+	return keys;
+}
+
+static void
+shuffle(char **keys, int n)
+{
+	char *tmp;
+	int i, j;
+
+	for (i = n - 1; i > 0; i--) {
+		j = rand() % (i + 1);
+		tmp = keys[i];
+		keys[i] = keys[j];
+		keys[j] = tmp;
+	}
+}
+
+static void
+run(const struct impl *impl, const char *workload, int n,
+		char **keys, char **hit, char **miss, int by_string)
+{
+	struct hash_table *table;
+	struct hash_table_iter *iter;
+	double t0, t1, t_ins, t_hit, t_miss, t_iter, t_worst = 0;
+	void *data, *key;
+	unsigned long sum = 0;
+	int i, laps, rounds;
+
+	laps = (LOOKUPS / n) ? LOOKUPS / n : 1;
+
+	t0 = now();
+
+	if (by_string)
+		table = impl->new(0, str_hash, str_cmp);
+	else
+		table = impl->new(0, NULL, NULL);
+
+	for (i = 0, t1 = now(); i < n; i++) {
+		impl->insert_unique(table, keys[i], keys[i]);
+
+		if (now() - t1 > t_worst)
+			t_worst = now() - t1;
+		t1 = now();
+	}
+
+	t_ins = (now() - t0) / n;
+
+	t0 = now();
+
+	for (rounds = 0; rounds < laps; rounds++)
+		for (i = 0; i < n; i++)
+			if (impl->lookup(table, hit[i], &data) == ret_ok)
+				sum += (unsigned long)data;
+
+	t_hit = (now() - t0) / ((double)laps * n);
+
+	t0 = now();
+
+	for (rounds = 0; rounds < laps; rounds++)
+		for (i = 0; i < n; i++)
+			if (impl->lookup(table, miss[i], &data) == ret_ok)
+				sum++;
+
+	t_miss = (now() - t0) / ((double)laps * n);
+
+	t0 = now();
+
+	for (rounds = 0; rounds < 16; rounds++) {
+		iter = impl->iterate_init(table);
+		while (impl->iterate(iter, &key, &data))
+			sum += (unsigned long)key & 1;
+		impl->iterate_deinit(&iter);
+	}
+
+	t_iter = (now() - t0) / (16.0 * n);
+
+	impl->destroy(&table);
+
+	printf("%-8s %-4s %8d %10.1f %10.1f %10.1f %10.1f %10.1f   (%lu)\n",
+		impl->name, workload, n, t_ins, t_worst / 1000, t_hit, t_miss,
+		t_iter, sum % 10);
+}
+
+int
+main(int argc, char **argv)
+{
+	char **keys, **hit, **miss;
+	int n, max, i;
+
+	max = (argc > 1) ? atoi(argv[1]) : 1 << 16;
+
+	printf("%-8s %-4s %8s %10s %10s %10s %10s %10s\n", "table", "keys",
+		"size", "insert", "worst", "hit", "miss", "iterate");
+	printf("%-8s %-4s %8s %10s %10s %10s %10s %10s\n", "", "", "",
+		"ns/op", "us", "ns/op", "ns/op", "ns/elem");
+
+	for (n = 16; n <= max; n *= 4) {
+		keys = make_keys(n, "sym_");
+		miss = make_keys(n, "other_");
+		hit  = malloc(n * sizeof(*hit));
+
+		memcpy(hit, keys, n * sizeof(*hit));
+		shuffle(hit, n);
+		shuffle(miss, n);
+
+		for (i = 0; i < NIMPLS; i++)
+			run(&impls[i], "ptr", n, keys, hit, miss, 0);
+
+		for (i = 0; i < NIMPLS; i++)
+			run(&impls[i], "str", n, keys, hit, miss, 1);
+
+		for (i = 0; i < n; i++) {
+			free(keys[i]);
+			free(miss[i]);
+		}
+
+		free(keys);
+		free(hit);
+		free(miss);
+	}
+
+	return 0;
+}
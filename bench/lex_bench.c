@@ -0,0 +1,115 @@
+/*
+ * lex_bench - lexer throughput on a generated script library.
+ *
+ * The library is a few thousand functions in the style of the scripts
+ * in test/: locals, loops, conditionals, calls and arithmetic, so
+ * keywords, repeated identifiers and numbers are mixed like in real
+ * scripts.  The whole text is lexed from memory several times and the
+ * best pass is reported.
+ *
+ * usage: lex_bench [functions]
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "lex.h"
+#include "keyword.h"
+#include "context.h"
+
+#define PASSES	5
+
+static double
+now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+
+	return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static char*
+make_library(int nfuncs, size_t *size)
+{
+	char *buf;
+	FILE *out;
+	int i;
+
+	out = open_memstream(&buf, size);
+
+	for (i = 0; i < nfuncs; i++) {
+		fprintf(out,
+			"# helper number %d\n"
+			"function step_%d(x, y, count) {\n"
+			"\tlocal i, acc, tmp\n"
+			"\n"
+			"\tacc = 0\n"
+			"\tfor (i = 0; i < count; i = i + 1) {\n"
+			"\t\ttmp = x * %d.5 + y / 2\n"
+			"\t\tif (tmp > acc) {\n"
+			"\t\t\tacc = tmp\n"
+			"\t\t} else {\n"
+			"\t\t\tacc = acc - 1e-3\n"
+			"\t\t}\n"
+			"\t\twhile (acc > 100) {\n"
+			"\t\t\tacc = sqrt(acc)\n"
+			"\t\t\tif (acc < 1) {\n"
+			"\t\t\t\tbreak\n"
+			"\t\t\t}\n"
+			"\t\t}\n"
+			"\t}\n"
+			"\treturn acc + step_%d(y, x, count - 1)\n"
+			"}\n\n", i, i, i, i / 2);
+	}
+
+	fclose(out);
+
+	return buf;
+}
+
+int
+main(int argc, char **argv)
+{
+	/* only the lexer fields are used */
+	struct bclite_ctx ctx = { 0 };
+	double t0, t, best = 0;
+	unsigned long tokens;
+	size_t size;
+	FILE *in;
+	char *lib;
+	int nfuncs, pass;
+
+	nfuncs = (argc > 1) ? atoi(argv[1]) : 5000;
+
+	keyword_table_create();
+
+	lib = make_library(nfuncs, &size);
+
+	for (pass = 0; pass < PASSES; pass++) {
+		in = fmemopen(lib, size, "r");
+		set_file(&ctx, in);
+
+		tokens = 0;
+		t0 = now();
+
+		while (get_next_token(&ctx) != TOKEN_EOF)
+			tokens++;
+
+		t = now() - t0;
+
+		if (pass == 0 || t < best)
+			best = t;
+
+		fclose(in);
+	}
+
+	printf("%lu bytes, %lu tokens: %.2f ms, %.1f Mtokens/s, %.1f MB/s\n",
+		(unsigned long)size, tokens, best * 1e3,
+		tokens / best * 1e-6, size / best * 1e-6);
+
+	free(lib);
+
+	return 0;
+}
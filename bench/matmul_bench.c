@@ -0,0 +1,176 @@
+/*
+ * matmul_bench - c = a * b on every BLAS backend of blas.h.
+ *
+ * Square products from 8 to the given size, GFLOP/s of the best of a
+ * few runs for each backend and the largest difference from ref.  Where
+ * native or a loaded library first beats ref is where BLAS_MIN in blas.c
+ * should be.  A backend is left out at the sizes after one that took
+ * longer than a few seconds.
+ *
+ * usage: matmul_bench [max size]
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+#include <time.h>
+
+#include <gsl/gsl_matrix.h>
+
+#include "blas.h"
+
+#define MIN_TIME	0.2
+#define MAX_TIME	5.0
+
+static const char *backends[] = {
+	"ref", "native", "openblas", "blis", "mkl", NULL
+};
+
+static const int sizes[] = {
+	8, 16, 32, 48, 64, 96, 128, 192, 256, 384, 512, 768, 1000, 1500,
+	2000, 3000, 4000, 0
+};
+
+static double
+now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+
+	return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+/* all 53 bits used, or the sums come out exact and hide rounding */
+static void
+fill(gsl_matrix *mx, unsigned long long seed)
+{
+	size_t i, j;
+
+	for (i = 0; i < mx->size1; i++)
+		for (j = 0; j < mx->size2; j++) {
+			seed = seed * 6364136223846793005ULL + 1442695040888963407ULL;
+			gsl_matrix_set(mx, i, j, (seed >> 11) * 0x1p-53 - 0.5);
+		}
+}
+
+static double
+max_diff(gsl_matrix *a, gsl_matrix *b)
+{
+	double d, max;
+	size_t i, j;
+
+	max = 0.0;
+
+	for (i = 0; i < a->size1; i++)
+		for (j = 0; j < a->size2; j++) {
+			d = fabs(gsl_matrix_get(a, i, j) - gsl_matrix_get(b, i, j));
+			if (d > max)
+				max = d;
+		}
+
+	return max;
+}
+
+/* best seconds per product */
+static double
+run(gsl_matrix *a, gsl_matrix *b, gsl_matrix *c)
+{
+	double start, t, best, total;
+
+	best  = HUGE_VAL;
+	total = 0.0;
+
+	do {
+		start = now();
+		blas_dgemm(a, b, c);
+		t = now() - start;
+
+		if (t < best)
+			best = t;
+
+		total += t;
+	} while (total < MIN_TIME);
+
+	return best;
+}
+
+int
+main(int argc, char *argv[])
+{
+	gsl_matrix *a, *b, *c, *ref;
+	double t, diff[8], slow[8];
+	int i, k, n, max, nb, present[8];
+
+	max = (argc > 1) ? atoi(argv[1]) : 2000;
+
+	/* every size on the backend asked for */
+	setenv("BCLITE_BLAS_MIN", "0", 1);
+
+	printf("%6s", "n");
+
+	for (k = nb = 0; backends[k]; k++, nb++) {
+		present[k] = blas_select(backends[k]);
+		slow[k]    = 0.0;
+
+		if (present[k])
+			printf(" %9s", backends[k]);
+	}
+
+	printf(" %10s\n", "max diff");
+
+	for (i = 0; sizes[i] && sizes[i] <= max; i++) {
+		n = sizes[i];
+
+		a   = gsl_matrix_alloc(n, n);
+		b   = gsl_matrix_alloc(n, n);
+		c   = gsl_matrix_alloc(n, n);
+		ref = NULL;
+
+		fill(a, 1);
+		fill(b, 2);
+
+		printf("%6d", n);
+
+		for (k = 0; k < nb; k++) {
+			diff[k] = 0.0;
+
+			if (!present[k])
+				continue;
+
+			if (slow[k] > MAX_TIME) {
+				printf(" %9s", "-");
+				continue;
+			}
+
+			blas_select(backends[k]);
+
+			t = run(a, b, c);
+
+			slow[k] = t;
+
+			printf(" %9.2f", 2.0 * n * n * n / t * 1e-9);
+
+			if (k == 0) {
+				ref = gsl_matrix_alloc(n, n);
+				gsl_matrix_memcpy(ref, c);
+			} else if (ref) {
+				diff[k] = max_diff(c, ref);
+			}
+		}
+
+		for (t = 0.0, k = 0; k < nb; k++)
+			t = (diff[k] > t) ? diff[k] : t;
+
+		printf(" %10.2g\n", t);
+		fflush(stdout);
+
+		gsl_matrix_free(a);
+		gsl_matrix_free(b);
+		gsl_matrix_free(c);
+
+		if (ref)
+			gsl_matrix_free(ref);
+	}
+
+	return 0;
+}
@@ -0,0 +1,545 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+
+#ifdef USE_DLBLAS
+#include <dlfcn.h>
+#endif
+
+#include <gsl/gsl_errno.h>
+#include <gsl/gsl_cblas.h>
+
+#include "blas.h"
+#include "tpool.h"
+#include "umalloc.h"
+#include "macros.h"
+#include "misc.h"
+
+/* products with fewer multiply-adds than BLAS_MIN cubed go to ref, see bench */
+#define BLAS_MIN	16
+
+#if defined(__x86_64__) && !defined(__clang__)
+#define BLAS_CLONES \
+	__attribute__((target_clones("arch=x86-64-v4", "arch=x86-64-v3", "default")))
+#else
+#define BLAS_CLONES
+#endif
+
+#define INLINE		static inline __attribute__((always_inline))
+
+typedef void (*dgemm_fn_t)(const enum CBLAS_ORDER order,
+		const enum CBLAS_TRANSPOSE transa,
+		const enum CBLAS_TRANSPOSE transb, const int m, const int n,
+		const int k, const double alpha, const double *a, const int lda,
+		const double *b, const int ldb, const double beta, double *c,
+		const int ldc);
+
+typedef void (*dgemv_fn_t)(const enum CBLAS_ORDER order,
+		const enum CBLAS_TRANSPOSE trans, const int m, const int n,
+		const double alpha, const double *a, const int lda,
+		const double *x, const int incx, const double beta, double *y,
+		const int incy);
+
+typedef double (*ddot_fn_t)(const int n, const double *x, const int incx,
+					const double *y, const int incy);
+
+typedef void (*dtrsm_fn_t)(const enum CBLAS_ORDER order,
+		const enum CBLAS_SIDE side, const enum CBLAS_UPLO uplo,
+		const enum CBLAS_TRANSPOSE transa, const enum CBLAS_DIAG diag,
+		const int m, const int n, const double alpha, const double *a,
+		const int lda, double *b, const int ldb);
+
+struct blas_backend {
+	const char	*name;
+	dgemm_fn_t	dgemm;
+	dgemv_fn_t	dgemv;
+	ddot_fn_t	ddot;
+	dtrsm_fn_t	dtrsm;
+};
+
+static void native_dgemm(const enum CBLAS_ORDER order,
+		const enum CBLAS_TRANSPOSE transa,
+		const enum CBLAS_TRANSPOSE transb, const int m, const int n,
+		const int k, const double alpha, const double *a, const int lda,
+		const double *b, const int ldb, const double beta, double *c,
+		const int ldc);
+
+static void native_dtrsm(const enum CBLAS_ORDER order,
+		const enum CBLAS_SIDE side, const enum CBLAS_UPLO uplo,
+		const enum CBLAS_TRANSPOSE transa, const enum CBLAS_DIAG diag,
+		const int m, const int n, const double alpha, const double *a,
+		const int lda, double *b, const int ldb);
+
+static struct blas_backend ref = {
+	"ref", cblas_dgemm, cblas_dgemv, cblas_ddot, cblas_dtrsm
+};
+
+/* vector products are bound by memory, blocking gains nothing there */
+static struct blas_backend native = {
+	"native", native_dgemm, cblas_dgemv, cblas_ddot, native_dtrsm
+};
+
+static struct {
+	struct blas_backend	*backend;
+	struct blas_backend	loaded;
+	long			min;	/* multiply-adds */
+} blas;
+
+static pthread_once_t blas_once = PTHREAD_ONCE_INIT;
+
+/*
+ * Native dgemm: the blocking of Goto and van de Geijn.  A kc x nc panel
+ * of b and an mc x kc block of a are copied into contiguous strips the
+ * kernel reads in order, the kernel keeps an MR x NR tile of c in
+ * registers.  The blocks of a are shared out over the thread pool; each
+ * element of c is summed by one worker in the same order, so the result
+ * does not depend on the number of threads.
+ */
+#define MR	8
+#define NR	8
+#define KC	256
+#define MC	128
+#define NC	2048
+
+#define ROUND_UP(x, r)	(((x) + (r) - 1) / (r) * (r))
+
+typedef double vnr __attribute__((vector_size(NR * sizeof(double)), aligned(8)));
+
+struct gemm {
+	int		m;
+	int		kc;
+	int		nc;
+	double		alpha;
+	const double	*a;		/* at the current column of blocks */
+	int		lda;
+	double		*c;		/* at the current column of blocks */
+	int		ldc;
+	double		*bp;		/* packed panel of b */
+	double		*ap;		/* packed block of a for each worker */
+	size_t		apsize;		/* doubles of it per worker */
+	int		by_block;	/* fewer blocks than workers, one each */
+};
+
+/* tile = a strip (MR rows, by columns) * b strip (NR columns, by rows) */
+INLINE void
+kernel(int kc, const double *a, const double *b, double *tile)
+{
+	vnr c0, c1, c2, c3, c4, c5, c6, c7, bv;
+	int p;
+
+	c0 = c1 = c2 = c3 = c4 = c5 = c6 = c7 = (vnr){ 0 };
+
+	for (p = 0; p < kc; p++, a += MR, b += NR) {
+		bv = *(const vnr *)b;
+
+		c0 += a[0] * bv;
+		c1 += a[1] * bv;
+		c2 += a[2] * bv;
+		c3 += a[3] * bv;
+		c4 += a[4] * bv;
+		c5 += a[5] * bv;
+		c6 += a[6] * bv;
+		c7 += a[7] * bv;
+	}
+
+	*(vnr *)(tile + 0 * NR) = c0;
+	*(vnr *)(tile + 1 * NR) = c1;
+	*(vnr *)(tile + 2 * NR) = c2;
+	*(vnr *)(tile + 3 * NR) = c3;
+	*(vnr *)(tile + 4 * NR) = c4;
+	*(vnr *)(tile + 5 * NR) = c5;
+	*(vnr *)(tile + 6 * NR) = c6;
+	*(vnr *)(tile + 7 * NR) = c7;
+}
+
+/* c += alpha * ap * bp for an mc x nc block of c */
+static void BLAS_CLONES
+macro_kernel(struct gemm *g, const double *ap, int mc, double *c)
+{
+	double tile[MR * NR] __attribute__((aligned(64)));
+	int i, j, ir, jr, m, n;
+
+	for (jr = 0; jr < g->nc; jr += NR) {
+		n = MIN(NR, g->nc - jr);
+
+		for (ir = 0; ir < mc; ir += MR) {
+			m = MIN(MR, mc - ir);
+
+			kernel(g->kc, ap + ir * g->kc, g->bp + jr * g->kc, tile);
+
+			for (i = 0; i < m; i++)
+				for (j = 0; j < n; j++)
+					c[(ir + i) * g->ldc + jr + j] +=
+						g->alpha * tile[i * NR + j];
+		}
+	}
+}
+
+/* rows of a into strips of MR, by columns, zero past the last row */
+static void
+pack_a(const double *a, int lda, int mc, int kc, double *ap)
+{
+	int i, ir, p;
+
+	for (ir = 0; ir < mc; ir += MR, ap += MR * kc)
+		for (p = 0; p < kc; p++)
+			for (i = 0; i < MR; i++)
+				ap[p * MR + i] = (ir + i < mc) ?
+						a[(ir + i) * lda + p] : 0.0;
+}
+
+static void
+pack_b(const double *b, int ldb, int kc, int nc, double *bp)
+{
+	int j, jr, p;
+
+	for (jr = 0; jr < nc; jr += NR, bp += NR * kc)
+		for (p = 0; p < kc; p++)
+			for (j = 0; j < NR; j++)
+				bp[p * NR + j] = (jr + j < nc) ?
+						b[p * ldb + jr + j] : 0.0;
+}
+
+static void
+gemm_blocks(void *arg, int worker, long lo, long hi)
+{
+	struct gemm *g = arg;
+	double *ap;
+	long blk;
+	int ic, mc;
+
+	for (blk = lo; blk < hi; blk++) {
+		ap = g->ap + (size_t)(g->by_block ? blk : worker) * g->apsize;
+		ic = blk * MC;
+		mc = MIN(MC, g->m - ic);
+
+		pack_a(g->a + (size_t)ic * g->lda, g->lda, mc, g->kc, ap);
+
+		macro_kernel(g, ap, mc, g->c + (size_t)ic * g->ldc);
+	}
+}
+
+/* row-major, no transposes: all libm.c asks for */
+static void
+native_dgemm(const enum CBLAS_ORDER order, const enum CBLAS_TRANSPOSE transa,
+		const enum CBLAS_TRANSPOSE transb, const int m, const int n,
+		const int k, const double alpha, const double *a, const int lda,
+		const double *b, const int ldb, const double beta, double *c,
+		const int ldc)
+{
+	struct gemm g;
+	double *buf;
+	size_t bpsize;
+	long nblocks;
+	int i, j, jc, pc, nap;
+
+	if (order != CblasRowMajor || transa != CblasNoTrans ||
+					transb != CblasNoTrans) {
+		cblas_dgemm(order, transa, transb, m, n, k, alpha, a, lda, b,
+						ldb, beta, c, ldc);
+		return;
+	}
+
+	for (i = 0; i < m; i++)
+		for (j = 0; j < n; j++)
+			c[(size_t)i * ldc + j] = (beta == 0.0) ? 0.0 :
+						beta * c[(size_t)i * ldc + j];
+
+	if (m == 0 || n == 0 || k == 0)
+		return;
+
+	/* as large as the blocks of this product, padded to whole strips */
+	bpsize   = (size_t)MIN(KC, k) * ROUND_UP(MIN(NC, n), NR);
+	g.apsize = (size_t)ROUND_UP(MIN(MC, m), MR) * MIN(KC, k);
+
+	nblocks    = (m + MC - 1) / MC;
+	g.by_block = nblocks < tpool_size();
+	nap        = g.by_block ? nblocks : tpool_size();
+
+	buf = umalloc((bpsize + nap * g.apsize) * sizeof(double));
+
+	g.m     = m;
+	g.alpha = alpha;
+	g.lda   = lda;
+	g.ldc   = ldc;
+	g.bp    = buf;
+	g.ap    = buf + bpsize;
+
+	for (jc = 0; jc < n; jc += NC) {
+		g.nc = MIN(NC, n - jc);
+		g.c  = c + jc;
+
+		for (pc = 0; pc < k; pc += KC) {
+			g.kc = MIN(KC, k - pc);
+			g.a  = a + pc;
+
+			pack_b(b + (size_t)pc * ldb + jc, ldb, g.kc, g.nc, g.bp);
+
+			tpool_run(nblocks, 1, gemm_blocks, &g);
+		}
+	}
+
+	ufree(buf);
+}
+
+/*
+ * b = a \ b for a triangular a: the diagonal blocks of TRSM_BLOCK rows
+ * are solved by ref, what they contribute to the other rows is taken
+ * off with native_dgemm(), where nearly all the work is.
+ */
+#define TRSM_BLOCK	128
+
+static void
+native_dtrsm(const enum CBLAS_ORDER order, const enum CBLAS_SIDE side,
+		const enum CBLAS_UPLO uplo, const enum CBLAS_TRANSPOSE transa,
+		const enum CBLAS_DIAG diag, const int m, const int n,
+		const double alpha, const double *a, const int lda, double *b,
+		const int ldb)
+{
+	const double *ad;
+	double *bd;
+	int ib, nb, i, j;
+
+	if (order != CblasRowMajor || side != CblasLeft ||
+					transa != CblasNoTrans) {
+		cblas_dtrsm(order, side, uplo, transa, diag, m, n, alpha, a,
+							lda, b, ldb);
+		return;
+	}
+
+	if (alpha != 1.0)
+		for (i = 0; i < m; i++)
+			for (j = 0; j < n; j++)
+				b[(size_t)i * ldb + j] *= alpha;
+
+	for (i = 0; i < m; i += TRSM_BLOCK) {
+		nb = MIN(TRSM_BLOCK, m - i);
+
+		/* forward for lower, backward for upper */
+		ib = (uplo == CblasLower) ? i : m - i - nb;
+		ad = a + (size_t)ib * lda + ib;
+		bd = b + (size_t)ib * ldb;
+
+		cblas_dtrsm(order, side, uplo, transa, diag, nb, n, 1.0, ad,
+							lda, bd, ldb);
+
+		if (uplo == CblasLower && ib + nb < m)
+			native_dgemm(order, CblasNoTrans, CblasNoTrans,
+				m - ib - nb, n, nb, -1.0, ad + (size_t)nb * lda,
+				lda, bd, ldb, 1.0, bd + (size_t)nb * ldb, ldb);
+		else if (uplo == CblasUpper && ib > 0)
+			native_dgemm(order, CblasNoTrans, CblasNoTrans, ib, n,
+				nb, -1.0, a + ib, lda, bd, ldb, 1.0, b, ldb);
+	}
+}
+
+#ifdef USE_DLBLAS
+static const struct {
+	const char	*name;
+	const char	*lib;
+} libraries[] = {
+	{ "openblas",	"libopenblas.so.0" },
+	{ "blis",	"libblis.so.4" },
+	{ "mkl",	"libmkl_rt.so" },
+	{ NULL,		NULL }
+};
+
+static const char *thread_setters[] = {
+	"openblas_set_num_threads",
+	"bli_thread_set_num_threads",
+	"MKL_Set_Num_Threads",
+	NULL
+};
+
+static int
+load(const char *name)
+{
+	void (*set_threads)(int);
+	void *handle;
+	char *env;
+	int i;
+
+	for (i = 0; libraries[i].name; i++)
+		if (STREQ(name, libraries[i].name))
+			name = libraries[i].lib;
+
+	handle = dlopen(name, RTLD_NOW | RTLD_LOCAL);
+
+	if (handle == NULL)
+		return FALSE;
+
+	blas.loaded.dgemm = (dgemm_fn_t)dlsym(handle, "cblas_dgemm");
+	blas.loaded.dgemv = (dgemv_fn_t)dlsym(handle, "cblas_dgemv");
+	blas.loaded.ddot  = (ddot_fn_t)dlsym(handle, "cblas_ddot");
+	blas.loaded.dtrsm = (dtrsm_fn_t)dlsym(handle, "cblas_dtrsm");
+
+	if (!blas.loaded.dgemm || !blas.loaded.dgemv || !blas.loaded.ddot ||
+							!blas.loaded.dtrsm) {
+		dlclose(handle);
+		return FALSE;
+	}
+
+	blas.loaded.name = name;
+	blas.backend     = &blas.loaded;
+
+	env = getenv("BCLITE_BLAS_THREADS");
+
+	for (i = 0; env && thread_setters[i]; i++) {
+		set_threads = (void (*)(int))dlsym(handle, thread_setters[i]);
+
+		if (set_threads) {
+			set_threads(MAX(1, atoi(env)));
+			break;
+		}
+	}
+
+	return TRUE;
+}
+#else
+static int
+load(const char *name)
+{
+	return FALSE;
+}
+#endif
+
+static int
+select_backend(const char *name)
+{
+	if (STREQ(name, "ref"))
+		blas.backend = &ref;
+	else if (STREQ(name, "native"))
+		blas.backend = &native;
+	else
+		return load(name);
+
+	return TRUE;
+}
+
+static void
+blas_init(void)
+{
+	char *env;
+
+	env = getenv("BCLITE_BLAS_MIN");
+
+	blas.min = env ? atol(env) : BLAS_MIN;
+	blas.min = blas.min * blas.min * blas.min;
+
+	blas.backend = &native;
+
+	env = getenv("BCLITE_BLAS");
+
+	if (env != NULL) {
+		if (!select_backend(env))
+			message("BCLITE_BLAS: no backend %s, using %s", env,
+							blas.backend->name);
+		return;
+	}
+
+#ifdef USE_DLBLAS
+	{
+		int i;
+
+		for (i = 0; libraries[i].name; i++)
+			if (load(libraries[i].lib))
+				break;
+	}
+#endif
+}
+
+static struct blas_backend*
+backend(double madds)
+{
+	pthread_once(&blas_once, blas_init);
+
+	return (madds < blas.min) ? &ref : blas.backend;
+}
+
+int
+blas_select(const char *name)
+{
+	return_val_if_fail(name != NULL, FALSE);
+
+	pthread_once(&blas_once, blas_init);
+
+	return select_backend(name);
+}
+
+const char*
+blas_backend(void)
+{
+	pthread_once(&blas_once, blas_init);
+
+	return blas.backend->name;
+}
+
+int
+blas_dgemm(const gsl_matrix *a, const gsl_matrix *b, gsl_matrix *c)
+{
+	size_t m, n, k;
+
+	m = a->size1;
+	n = b->size2;
+	k = a->size2;
+
+	if (b->size1 != k || c->size1 != m || c->size2 != n)
+		GSL_ERROR("invalid length", GSL_EBADLEN);
+
+	backend((double)m * n * k)->dgemm(CblasRowMajor, CblasNoTrans,
+		CblasNoTrans, m, n, k, 1.0, a->data, a->tda, b->data, b->tda,
+		0.0, c->data, c->tda);
+
+	return GSL_SUCCESS;
+}
+
+int
+blas_dgemv(CBLAS_TRANSPOSE_t trans, const gsl_matrix *a, const gsl_vector *x,
+								gsl_vector *y)
+{
+	size_t m, n;
+
+	m = (trans == CblasNoTrans) ? a->size1 : a->size2;
+	n = (trans == CblasNoTrans) ? a->size2 : a->size1;
+
+	if (x->size != n || y->size != m)
+		GSL_ERROR("invalid length", GSL_EBADLEN);
+
+	backend((double)m * n)->dgemv(CblasRowMajor, trans, a->size1,
+		a->size2, 1.0, a->data, a->tda, x->data, x->stride, 0.0,
+		y->data, y->stride);
+
+	return GSL_SUCCESS;
+}
+
+double
+blas_ddot(const gsl_vector *x, const gsl_vector *y)
+{
+	if (x->size != y->size) {
+		gsl_error("invalid length", __FILE__, __LINE__, GSL_EBADLEN);
+		return 0.0;
+	}
+
+	return backend(x->size)->ddot(x->size, x->data, x->stride, y->data,
+								y->stride);
+}
+
+int
+blas_dtrsm(CBLAS_UPLO_t uplo, CBLAS_DIAG_t diag, const gsl_matrix *a,
+								gsl_matrix *b)
+{
+	size_t m, n;
+
+	m = b->size1;
+	n = b->size2;
+
+	if (a->size1 != m || a->size2 != m)
+		GSL_ERROR("invalid length", GSL_EBADLEN);
+
+	backend((double)m * m * n)->dtrsm(CblasRowMajor, CblasLeft, uplo,
+		CblasNoTrans, diag, m, n, 1.0, a->data, a->tda, b->data,
+								b->tda);
+
+	return GSL_SUCCESS;
+}
@@ -0,0 +1,50 @@
+#ifndef BLAS_H_
+#define BLAS_H_
+
+#include <gsl/gsl_matrix.h>
+#include <gsl/gsl_vector.h>
+#include <gsl/gsl_blas.h>
+
+/*
+ * The BLAS behind the matrix products of libm.c, chosen on first use by
+ * BCLITE_BLAS:
+ *
+ *	ref	the CBLAS the binary is linked with, GSL's by default
+ *	native	the blocked dgemm of blas.c, run on the thread pool
+ *	<lib>	a CBLAS shared library such as libopenblas.so.0, loaded
+ *		at run time; only in builds with DLBLAS=1
+ *
+ * Unset, the first of OpenBLAS, BLIS and MKL that loads is used, else
+ * native.  BCLITE_BLAS_THREADS sets the threads of a loaded library,
+ * native runs on the BCLITE_THREADS workers of tpool.h.
+ *
+ * Products too small to gain from blocking go to ref whatever is chosen.
+ * Bad sizes are reported through the GSL error handler, as gsl_blas_*
+ * do, and return GSL_EBADLEN.
+ */
+
+/* c = a * b */
+int
+blas_dgemm(const gsl_matrix *a, const gsl_matrix *b, gsl_matrix *c);
+
+/* y = op(a) * x */
+int
+blas_dgemv(CBLAS_TRANSPOSE_t trans, const gsl_matrix *a, const gsl_vector *x,
+								gsl_vector *y);
+
+double
+blas_ddot(const gsl_vector *x, const gsl_vector *y);
+
+/* b = a \ b for a triangular a, with CblasUnit its diagonal is taken as ones */
+int
+blas_dtrsm(CBLAS_UPLO_t uplo, CBLAS_DIAG_t diag, const gsl_matrix *a,
+								gsl_matrix *b);
+
+/* FALSE if there is no such backend, the last choice stays */
+int
+blas_select(const char *name);
+
+const char*
+blas_backend(void);
+
+#endif /* BLAS_H_ */
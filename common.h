@@ -9,6 +9,7 @@ typedef enum {
 	VALUE_TYPE_STRING,
 	VALUE_TYPE_VECTOR,
 	VALUE_TYPE_MATRIX,
+	VALUE_TYPE_SPMATRIX,
 	VALUE_TYPE_VOID
 } value_t;
 
@@ -0,0 +1,127 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <pthread.h>
+
+#include "context.h"
+#include "keyword.h"
+#include "function.h"
+#include "eval.h"
+#include "intern.h"
+#include "macros.h"
+#include "umalloc.h"
+
+static pthread_once_t context_once = PTHREAD_ONCE_INIT;
+
+static void
+gsl_handler(const char *reason, const char *file, int line, int gsl_errno)
+{
+	switch(gsl_errno) {
+	case GSL_ENOMEM:
+		fprintf(stderr, "Reason: %s File: %s line: %d",
+			reason, file, line);		
+		/* aborts the current statement, or exits outside of one */
+		umem_fail(0);
+		break;
+	default:
+		fprintf(stderr, "Reason: %s File: %s line: %d",
+			reason, file, line);
+		break;
+	}
+}
+
+/*
+ * State shared by all contexts.  GSL aborts the process on an error
+ * unless a handler is set, so the interpreter's own is installed; one
+ * the host set before the first context is left in place.
+ */
+static void
+context_init(void)
+{
+	gsl_error_handler_t *prev;
+
+	keyword_table_create();
+
+	prev = gsl_set_error_handler(gsl_handler);
+
+	if (prev != NULL)
+		gsl_set_error_handler(prev);
+}
+
+struct bclite_ctx*
+bclite_ctx_new(void)
+{
+	return bclite_ctx_new_from(NULL);
+}
+
+static struct bclite_ctx*
+context_new(struct bclite_ctx *base)
+{
+	struct bclite_ctx *ctx;
+
+	/* the keyword table is shared and never changes after this */
+	pthread_once(&context_once, context_init);
+
+	ctx = umalloc0(sizeof(*ctx));
+
+	ctx->out  = stdout;
+	ctx->base = base;
+
+	symbol_table_create_global(ctx);
+	function_table_create(ctx);
+
+	return ctx;
+}
+
+struct bclite_ctx*
+bclite_ctx_new_from(struct bclite_ctx *base)
+{
+	struct bclite_ctx *ctx;
+
+	ctx = context_new(base);
+
+	/* a context of a request: what it interns goes with it */
+	if (base != NULL)
+		ctx->strings = intern_local_new();
+
+	return ctx;
+}
+
+struct bclite_ctx*
+bclite_ctx_new_frame(struct bclite_ctx *parent)
+{
+	struct bclite_ctx *ctx;
+
+	return_val_if_fail(parent != NULL, NULL);
+
+	ctx = context_new(parent);
+
+	ctx->out   = parent->out;
+	ctx->frame = TRUE;
+
+	return ctx;
+}
+
+void
+bclite_ctx_destroy(struct bclite_ctx **ctx)
+{
+	struct eval *eval;
+
+	return_if_fail(ctx != NULL && *ctx != NULL);
+
+	while ((*ctx)->list) {
+		eval = pop(*ctx);
+		eval_free(eval);
+	}
+
+	function_table_destroy(*ctx);
+	symbol_table_destroy(&(*ctx)->global);
+
+	if ((*ctx)->id_buf)
+		ufree((*ctx)->id_buf);
+
+	if ((*ctx)->strings)
+		intern_local_destroy(&(*ctx)->strings);
+
+	ufree(*ctx);
+	(*ctx) = NULL;
+}
@@ -0,0 +1,85 @@
+#ifndef CONTEXT_H_
+#define CONTEXT_H_
+
+#include <stdio.h>
+#include <setjmp.h>
+
+#include "lex.h"
+#include "list.h"
+#include "symbol.h"
+#include "hash.h"
+#include "pool.h"
+
+struct loop_ctx {
+	int is_break;
+	int is_continue;
+	int is_return;
+};
+
+/*
+ * Everything one interpreter instance owns.  A context is used by one
+ * thread at a time; independent contexts run concurrently.  What is
+ * shared between them is read-only after start-up (keywords) or locked
+ * (interned strings, the block pool, the memory budget).
+ */
+struct bclite_ctx {
+	/* lex.c */
+	FILE			*input;
+	int			peek;
+	char			*id_buf;	/* identifier being read */
+	int			id_size;
+	struct lex		lex;
+
+	/* syntax.c */
+	struct lex		lex_prev;
+	token_t			current_token;
+	int			parse_errors;
+	struct symbol_table	*par_scope;	/* frame of the parfor body */
+
+	/* traverse.c */
+	FILE			*out;		/* statement values are printed here */
+	struct list_of_val	*list;		/* value stack */
+	struct loop_ctx		helper;
+	int			errors;
+	jmp_buf			oom_env;	/* where an aborted statement unwinds to */
+	struct pool_temps	temps;		/* its vectors and matrices, see pool.h */
+	struct symbol_frame	*frames;	/* slots of recursive calls, see symbol.h */
+
+	/* symbol.c, function.c */
+	struct symbol_table	*global;
+	struct symbol_table	*top;
+	struct symbol		*ans;
+	struct hash_table	*function_table;
+	unsigned int		functions_version;	/* bumped on every change */
+
+	/*
+	 * Read-only context shared by many: globals and functions missing
+	 * here are copied from it when first referenced, see server.c
+	 */
+	struct bclite_ctx	*base;
+
+	/* names and constants of its scripts unless global, see intern.h */
+	struct hash_table	*strings;
+
+	/* a parfor worker, uses the globals of base rather than copies */
+	unsigned int		frame;
+};
+
+struct bclite_ctx*
+bclite_ctx_new(void);
+
+struct bclite_ctx*
+bclite_ctx_new_from(struct bclite_ctx *base);
+
+/*
+ * For another thread running part of what parent runs: the globals of
+ * parent are used in place, functions get frames of their own.  Parent
+ * must not add globals meanwhile.
+ */
+struct bclite_ctx*
+bclite_ctx_new_frame(struct bclite_ctx *parent);
+
+void
+bclite_ctx_destroy(struct bclite_ctx **ctx);
+
+#endif /* CONTEXT_H_ */
@@ -6,8 +6,11 @@
 #include "eval.h"
 #include "macros.h"
 #include "umalloc.h"
+#include "pool.h"
 #include "misc.h"
 #include "libm.h"
+#include "symbol.h"
+#include "spmatrix.h"
 
 #define err_msg_ret(ret, fmt, arg...) \
 do { \
@@ -22,7 +25,7 @@ eval_new(tag_type_t tag, value_t v_type, void *val)
 
 	return_val_if_fail(val != NULL, NULL);
 	
-	eval = umalloc0(sizeof(*eval));
+	eval = uslab_alloc0(sizeof(*eval));
 		
 	switch(tag) {
 	case TAG_CONST:
@@ -40,7 +43,7 @@ eval_new(tag_type_t tag, value_t v_type, void *val)
 		break;
 	case VALUE_TYPE_STRING:
 		eval->v_type = v_type;
-		eval->string =ustrdup((char *)val);
+		eval->string = (char *)val;	/* interned */
 		break;
 	case VALUE_TYPE_VECTOR:
 		eval->v_type = v_type;
@@ -50,6 +53,10 @@ eval_new(tag_type_t tag, value_t v_type, void *val)
 		eval->v_type = v_type;
 		eval->matrix = (gsl_matrix *)val;
 		break;
+	case VALUE_TYPE_SPMATRIX:
+		eval->v_type   = v_type;
+		eval->spmatrix = (struct spmatrix *)val;
+		break;
 	case VALUE_TYPE_VOID:	
 		eval->v_type = v_type;
 		break;
@@ -95,8 +102,12 @@ eval_add_op(struct eval *a, struct eval *b, opcode_type_t op)
 		break;
 	case VALUE_TYPE_VECTOR:
 		switch(b->v_type) {
-		case VALUE_TYPE_DIGIT: /* vector op digit */
-			vc = libm_digit_vector_add_op(b->digit, a->vector, op);
+		case VALUE_TYPE_DIGIT: /* vector op digit, v - d is -d + v */
+			if (op == OPCODE_SUB)
+				vc = libm_digit_vector_add_op(-b->digit, a->vector,
+								OPCODE_ADD);
+			else
+				vc = libm_digit_vector_add_op(b->digit, a->vector, op);
 			c  = eval_new(tag, VALUE_TYPE_VECTOR, vc);
 			break;			
 		case VALUE_TYPE_VECTOR: /* vector op vector */
@@ -111,8 +122,12 @@ eval_add_op(struct eval *a, struct eval *b, opcode_type_t op)
 		break;
 	case VALUE_TYPE_MATRIX: 
 		switch(b->v_type) {
-		case VALUE_TYPE_DIGIT: /* matrix op digit */
-			mx = libm_digit_matrix_add_op(b->digit,a->matrix, op);
+		case VALUE_TYPE_DIGIT: /* matrix op digit, m - d is -d + m */
+			if (op == OPCODE_SUB)
+				mx = libm_digit_matrix_add_op(-b->digit, a->matrix,
+								OPCODE_ADD);
+			else
+				mx = libm_digit_matrix_add_op(b->digit, a->matrix, op);
 			c  = eval_new(tag, VALUE_TYPE_MATRIX, mx);
 			break;
 		case VALUE_TYPE_MATRIX: /* matrix op matrix */
@@ -132,17 +147,43 @@ eval_add_op(struct eval *a, struct eval *b, opcode_type_t op)
 	return c;
 }
 
+/*
+ * Where factors of a divisor are kept: by the variable that holds it,
+ * unless its memory belongs to the host, which may change it unseen.
+ */
+static struct libm_lu**
+divisor_lu(struct eval *b, unsigned int *version)
+{
+	struct symbol *sym;
+
+	*version = 0;
+
+	sym = b->symbol;
+
+	if (b->tag != TAG_SYMBOL || sym == NULL || sym->borrowed)
+		return NULL;
+
+	*version = sym->version;
+
+	return &sym->lu;
+}
+
 struct eval*
 eval_mult_op(struct eval *a, struct eval *b, opcode_type_t op)
 {
+	struct libm_lu **lu;
+	struct spmatrix *sp;
 	struct eval *c;
 	gsl_vector *vc;
 	gsl_matrix *mx;
+	unsigned int version;
 	double dg;
 	tag_type_t tag;
 
 	return_val_if_fail(a != NULL, NULL);
 	return_val_if_fail(b != NULL, NULL);
+
+	lu = divisor_lu(b, &version);
 	
 	tag = TAG_CONST;
 	
@@ -161,6 +202,10 @@ eval_mult_op(struct eval *a, struct eval *b, opcode_type_t op)
 			mx = libm_digit_matrix_mult_op(a->digit, b->matrix, op);
 			c  = eval_new(tag, VALUE_TYPE_MATRIX, mx);
 			break;
+		case VALUE_TYPE_SPMATRIX:
+			sp = libm_digit_spmatrix_mult_op(a->digit, b->spmatrix, op);
+			c  = eval_new(tag, VALUE_TYPE_SPMATRIX, sp);
+			break;
 		default:	
 			err_msg_ret(NULL, "incompatible value type");
 		}
@@ -176,7 +221,17 @@ eval_mult_op(struct eval *a, struct eval *b, opcode_type_t op)
 			c  = eval_new(tag, VALUE_TYPE_DIGIT, &dg);
 			break;	
 		case VALUE_TYPE_MATRIX:
-			vc = libm_vector_matrix_mult_op(a->vector, b->matrix, op);
+			if (op == OPCODE_DIV)
+				vc = libm_vector_matrix_div(a->vector, b->matrix,
+						lu, version);
+			else
+				vc = libm_vector_matrix_mult_op(a->vector,
+							b->matrix, op);
+			c  = eval_new(tag, VALUE_TYPE_VECTOR, vc);
+			break;
+		case VALUE_TYPE_SPMATRIX:
+			vc = libm_vector_spmatrix_mult_op(a->vector,
+							b->spmatrix, op);
 			c  = eval_new(tag, VALUE_TYPE_VECTOR, vc);
 			break;
 		default:	
@@ -194,13 +249,52 @@ eval_mult_op(struct eval *a, struct eval *b, opcode_type_t op)
 			c  = eval_new(tag, VALUE_TYPE_VECTOR, vc);
 			break;
 		case VALUE_TYPE_MATRIX:
-			mx = libm_matrix_mult_op(a->matrix, b->matrix, op);
+			if (op == OPCODE_DIV)
+				mx = libm_matrix_div(a->matrix, b->matrix,
+						lu, version);
+			else
+				mx = libm_matrix_mult_op(a->matrix, b->matrix, op);
+			c  = eval_new(tag, VALUE_TYPE_MATRIX, mx);
+			break;
+		case VALUE_TYPE_SPMATRIX:
+			mx = libm_matrix_spmatrix_mult_op(a->matrix,
+							b->spmatrix, op);
 			c  = eval_new(tag, VALUE_TYPE_MATRIX, mx);
 			break;
 		default:
 			err_msg_ret(NULL, "incompatible value type");
 		}
 		break;	
+	case VALUE_TYPE_SPMATRIX:
+		switch(b->v_type) {
+		case VALUE_TYPE_DIGIT:
+			sp = libm_spmatrix_digit_mult_op(a->spmatrix, b->digit, op);
+			c  = eval_new(tag, VALUE_TYPE_SPMATRIX, sp);
+			break;
+		case VALUE_TYPE_VECTOR:
+			vc = libm_spmatrix_vector_mult_op(a->spmatrix,
+							b->vector, op);
+			c  = eval_new(tag, VALUE_TYPE_VECTOR, vc);
+			break;
+		case VALUE_TYPE_MATRIX:
+			mx = libm_spmatrix_matrix_mult_op(a->spmatrix,
+							b->matrix, op);
+			c  = eval_new(tag, VALUE_TYPE_MATRIX, mx);
+			break;
+		case VALUE_TYPE_SPMATRIX:
+			if (op == OPCODE_DIV) {
+				mx = libm_spmatrix_div(a->spmatrix, b->spmatrix);
+				c  = eval_new(tag, VALUE_TYPE_MATRIX, mx);
+			} else {
+				sp = libm_spmatrix_mult_op(a->spmatrix,
+							b->spmatrix, op);
+				c  = eval_new(tag, VALUE_TYPE_SPMATRIX, sp);
+			}
+			break;
+		default:
+			err_msg_ret(NULL, "incompatible value type");
+		}
+		break;
 	default:
 		err_msg_ret(NULL, "incompatible value type");
 	}
@@ -369,7 +463,11 @@ eval_exp_op(struct eval *a, struct eval *b, opcode_type_t op)
 		c  = eval_new(tag, VALUE_TYPE_DIGIT, &dg);
 		break;	
 	case VALUE_TYPE_MATRIX:
-		mx = libm_matrix_exp(a->matrix, pow);
+		/* a fractional power is not cut to an integer one */
+		if (b->digit != pow)
+			mx = libm_matrix_powm(a->matrix, b->digit);
+		else
+			mx = libm_matrix_exp(a->matrix, pow);
 		c  = eval_new(tag, VALUE_TYPE_MATRIX, mx);
 		break;
 	default:
@@ -400,22 +498,25 @@ matrix_fprintf(FILE *stream, const gsl_matrix *mx)
 }
 
 void
-eval_print(struct eval *eval)
+eval_print(FILE *out, struct eval *eval)
 {
 	return_if_fail(eval != NULL);
 	
 	switch(eval->v_type) {
 	case VALUE_TYPE_DIGIT:
-		fprintf(stdout, "%f\n", eval->digit);
+		fprintf(out, "%f\n", eval->digit);
 		break;
 	case VALUE_TYPE_STRING:
-		fprintf(stdout, "%s\n", eval->string);
+		fprintf(out, "%s\n", eval->string);
 		break;
 	case VALUE_TYPE_VECTOR:
-		gsl_vector_fprintf(stdout, eval->vector, "%f");
+		gsl_vector_fprintf(out, eval->vector, "%f");
 		break;
 	case VALUE_TYPE_MATRIX:
-		matrix_fprintf(stdout, eval->matrix);
+		matrix_fprintf(out, eval->matrix);
+		break;
+	case VALUE_TYPE_SPMATRIX:
+		spmatrix_fprintf(out, eval->spmatrix);
 		break;
 	case VALUE_TYPE_VOID:
 		break;
@@ -434,20 +535,20 @@ eval_free(struct eval *eval)
 		goto free;
 	
 	switch(eval->v_type) {
-	case VALUE_TYPE_STRING:
-		ufree(eval->string);
-		break;
 	case VALUE_TYPE_VECTOR:
-		gsl_vector_free(eval->vector);
+		pool_vector_free(eval->vector);
 		break;
 	case VALUE_TYPE_MATRIX:
-		gsl_matrix_free(eval->matrix);
+		pool_matrix_free(eval->matrix);
+		break;
+	case VALUE_TYPE_SPMATRIX:
+		spmatrix_unref(eval->spmatrix);
 		break;
 	default:	
 		break;
 	}
 free:	
-	ufree(eval);
+	uslab_free(eval, sizeof(*eval));
 }
 
 
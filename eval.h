@@ -1,12 +1,17 @@
 #ifndef EVAL_H_
 #define EVAL_H_
 
+#include <stdio.h>
+
 #include <gsl/gsl_vector.h>
 #include <gsl/gsl_matrix.h>
 
 #include "common.h"
 #include "as_tree.h"
 
+struct symbol;
+struct spmatrix;
+
 typedef enum {
 	TAG_CONST,
 	TAG_SYMBOL
@@ -20,7 +25,9 @@ struct eval {
 		char		*string;
 		gsl_vector	*vector;
 		gsl_matrix	*matrix;
+		struct spmatrix	*spmatrix;
 	};
+	struct symbol		*symbol;	/* TAG_SYMBOL: holder of the value */
 };
 
 struct eval*
@@ -42,7 +49,7 @@ struct eval*
 eval_exp_op(struct eval *a, struct eval *b, opcode_type_t op);
 
 void
-eval_print(struct eval *eval);
+eval_print(FILE *out, struct eval *eval);
 	
 void
 eval_free(struct eval *eval);
@@ -9,6 +9,9 @@
 #include "umalloc.h"
 #include "libcall.h"
 #include "misc.h"
+#include "intern.h"
+#include "context.h"
+#include "vkernel.h"
 
 #define err_msg_ret(ret, fmt, arg...) \
 do { \
@@ -21,9 +24,7 @@ do { \
 	message(fmt, ##arg); \
 } while(0)
 	
-static struct hash_table *function_table;
-
-static void function_init_lib(void);
+static void function_init_lib(struct bclite_ctx *ctx);
 
 /* names for functions arguments */
 static char *names[] = {
@@ -53,67 +54,136 @@ static struct {
 	{ "matrix",	2,	libcall_matrix },
 	{ "vector",	1,	libcall_vector },
 	{ "sqrt",	1,	libcall_sqrt },
+	{ "sum",	1,	libcall_sum },
+	{ "norm",	1,	libcall_norm },
+	{ "expm",	1,	libcall_expm },
+	{ "logm",	1,	libcall_logm },
+	{ "powm",	2,	libcall_powm },
+	{ "sparse",	5,	libcall_sparse },
+	{ "full",	1,	libcall_full },
+	{ "nnz",	1,	libcall_nnz },
+	{ "memstat",	0,	libcall_memstat },
 	{ NULL,		-1,	NULL }
 };
 
-static int
-function_hash(unsigned char *name)
+void
+function_table_create(struct bclite_ctx *ctx)
 {
-	unsigned long hash = 5381;
-	int c;
-		
-	while ((c = *name++) != 0)
-		hash = ((hash << 5) + hash) + c;
+	/* function names are interned: hash and compare by address */
+	ctx->function_table = hash_table_new(0, NULL, NULL);
+	if (ctx->function_table == NULL)
+		error(1, "can't create function table");
 	
-	return hash;
+	function_init_lib(ctx);
 }
 
-static int
-function_strcmp(const void *a, const void *b)
+/*
+ * A function of the base context is shared by everybody using it, but
+ * its scope holds the values of arguments and locals.  The caller gets
+ * its own copy of the scope and shares the body.
+ */
+static struct function*
+function_import(struct bclite_ctx *ctx, char *name)
 {
-	int ret;
-		
-	ret = strcmp((char *)a, (char *)b);
-	
-	return ret;
+	struct bclite_ctx *from;
+	struct function *base, *func;
+	ret_t ret;
+	int i;
+
+	ret = ret_not_found;
+
+	for (from = ctx->base; from != NULL && ret != ret_ok; from = from->base)
+		ret = hash_table_lookup(from->function_table, name,
+							(void **)&base);
+
+	if (ret != ret_ok || base->is_lib || base->scope == NULL)
+		return NULL;
+
+	func = function_new(base->name);
+
+	func->scope  = symbol_table_clone_scope(base->scope);
+	func->body   = base->body;
+	func->shared = TRUE;
+
+	for (i = 0; i < base->nargs; i++)
+		function_add_arg(func, func->scope->slots[i]);
+
+	function_table_insert(ctx, func);
+
+	return func;
 }
 
 void
-function_table_create(void)
+function_table_destroy(struct bclite_ctx *ctx)
 {
-	function_table = hash_table_new(0,(hash_callback_t)function_hash,
-					(hash_compare_t)function_strcmp);
-	if (function_table == NULL)
-		error(1, "can't create function table");
-	
-	function_init_lib();
+	struct hash_table_iter *iter;
+	struct function *func;
+	char *name;
+
+	return_if_fail(ctx->function_table != NULL);
+
+	iter = hash_table_iterate_init(ctx->function_table);
+
+	if (!iter)
+		error(1, "hash iterator");
+
+	while (hash_table_iterate(iter, (void **)&name, (void **)&func))
+		function_destroy(func);
+
+	hash_table_iterate_deinit(&iter);
+	hash_table_destroy(&ctx->function_table);
+}
+
+void
+function_table_unwind(struct bclite_ctx *ctx)
+{
+	struct hash_table_iter *iter;
+	struct function *func;
+	char *name;
+
+	return_if_fail(ctx->function_table != NULL);
+
+	iter = hash_table_iterate_init(ctx->function_table);
+
+	if (!iter)
+		error(1, "hash iterator");
+
+	while (hash_table_iterate(iter, (void **)&name, (void **)&func))
+		func->active = 0;
+
+	hash_table_iterate_deinit(&iter);
 }
 
 struct function*
-function_table_lookup(char *name)
+function_table_lookup(struct bclite_ctx *ctx, char *name)
 {
 	struct function *func = NULL;
 	ret_t ret;
 
 	return_val_if_fail(name != NULL, NULL);
 
-	ret = hash_table_lookup(function_table, name, (void **)&func);
+	ret = hash_table_lookup(ctx->function_table, name, (void **)&func);
+
+	if (func == NULL && ctx->base != NULL)
+		func = function_import(ctx, name);
 	
 	return func;
 }
 
 int
-function_table_insert(struct function *function)
+function_table_insert(struct bclite_ctx *ctx, struct function *function)
 {
 	ret_t ret;
 
-	return_val_if_fail(function_table != NULL, -1);
+	return_val_if_fail(ctx->function_table != NULL, -1);
 	return_val_if_fail(function != NULL, -1);
 	
-	ret = hash_table_insert_unique(function_table, function->name, function);
+	ret = hash_table_insert_unique(ctx->function_table, function->name, function);
 	
 	if (ret != ret_ok)
 		error(1, "insert in function table fail");	
+
+	ctx->functions_version++;
 	
 	return ret;	
 }
@@ -127,7 +197,7 @@ function_new(char *name)
 	
 	func = umalloc0(sizeof(*func));
 	
-	func->name   = ustrdup(name);
+	func->name   = name;
 	func->is_lib = FALSE;
 
 	return func;	
@@ -136,9 +206,14 @@ function_new(char *name)
 void
 function_destroy(struct function *func)
 {
+	int i;
+
 	return_if_fail(func != NULL);
-	
-	ufree(func->name);
+
+	/* library arguments are not in any scope */
+	if (func->is_lib)
+		for (i = 0; i < func->nargs; i++)
+			symbol_destroy(func->args[i]);
 
 	if (func->args)
 		ufree(func->args);
@@ -146,9 +221,12 @@ function_destroy(struct function *func)
 	if (func->scope)
 		symbol_table_destroy(&func->scope);
 	
-	if (func->body)
+	if (func->body && !func->shared)
 		ast_node_unref(func->body);
 
+	if (func->kernel)
+		vkernel_destroy(&func->kernel);
+
 	ufree(func);
 }
 
@@ -168,27 +246,29 @@ function_add_arg(struct function *function, struct symbol *arg)
 }
 
 void
-function_table_delete_function(char *name)
+function_table_delete_function(struct bclite_ctx *ctx, char *name)
 {
 	struct function *func;
 	ret_t ok;
 
 	return_if_fail(name != NULL);
 
-	func = function_table_lookup(name);
+	func = function_table_lookup(ctx, name);
 	
 	if (!func) {
 		err_msg("not entry for this function");
 		return;
 	}
 
-	ok = hash_table_remove(function_table, func->name);
+	ok = hash_table_remove(ctx->function_table, func->name);
 
 	if (!ok) {
 		err_msg("no entry for this function");
 		return;
 	}
 
+	ctx->functions_version++;
+
 	function_destroy(func);
 }
 
@@ -201,14 +281,14 @@ function_init_args(struct function *lib, int nargs)
 	return_if_fail(lib != NULL);
 
 	for (i = 0; i < nargs; i++) {
-		symbol = symbol_new(names[i], VALUE_TYPE_UNKNOWN);
+		symbol = symbol_new(intern(names[i]), VALUE_TYPE_UNKNOWN);
 	
 		function_add_arg(lib, symbol);
 	}	
 }
 
 static void
-function_init_lib(void)
+function_init_lib(struct bclite_ctx *ctx)
 {	
 	struct function *lib;
 	ret_t ret;
@@ -218,12 +298,12 @@ function_init_lib(void)
 		lib = umalloc0(sizeof(*lib));
 		
 		lib->is_lib  = TRUE;
-		lib->name    = ustrdup(functions[i].name);
+		lib->name    = intern(functions[i].name);
 		lib->handler = functions[i].handler;
 		
 		function_init_args(lib, functions[i].nargs);
 
-		ret = hash_table_insert_unique(function_table, lib->name, lib);
+		ret = hash_table_insert_unique(ctx->function_table, lib->name, lib);
 	
 		if (ret != ret_ok)
 			error(1, "init lib failed");		
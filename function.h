@@ -5,7 +5,12 @@
 #include "as_tree.h"
 
 struct function;
+struct bclite_ctx;
 
+/*
+ * *result points to a double of the caller: a digit is stored there, a
+ * vector or a matrix replaces the pointer.
+ */
 typedef int (*lib_handler_type_t)(struct function *, value_t *, void **);
 
 struct function {
@@ -15,18 +20,29 @@ struct function {
 	struct symbol		**args;
 	struct symbol_table	*scope;
 	struct ast_node		*body;
+	unsigned int		shared;	/* body belongs to a base context */
 	lib_handler_type_t 	handler;
+	unsigned int		active;	/* calls in progress */
+
+	/* element-wise form, compiled at functions_version, see vkernel.h */
+	struct vkernel		*kernel;
+	unsigned int		kernel_version;
 };
 
 void
-function_table_create(void);
+function_table_create(struct bclite_ctx *ctx);
+
+void
+function_table_destroy(struct bclite_ctx *ctx);
 
+/* name must be interned */
 struct function*
-function_table_lookup(char *name);
+function_table_lookup(struct bclite_ctx *ctx, char *name);
 
 int
-function_table_insert(struct function *function);
+function_table_insert(struct bclite_ctx *ctx, struct function *function);
 
+/* name must be interned */
 struct function*
 function_new(char *name);
 
@@ -37,6 +53,10 @@ void
 function_add_arg(struct function *function, struct symbol *arg);
 	
 void
-function_table_delete_function(char *name);
+function_table_delete_function(struct bclite_ctx *ctx, char *name);
+
+/* no call is in progress any more, after an aborted statement */
+void
+function_table_unwind(struct bclite_ctx *ctx);
 
 #endif /*FUNCTION_H_*/
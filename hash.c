@@ -1,40 +1,74 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/types.h>
 
 #include "macros.h"
 #include "hash.h"
-#include "primes.h"
 #include "common.h"
 
-#define HASH_SIZE	31
-
-#define COLLISION_RATE(t)	((float)(t)->count / (float)(t)->collision)
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+/*
+ * Open addressing in the style of a Swiss table.  Every slot has a
+ * control byte: CTRL_EMPTY, CTRL_DELETED or the low 7 bits of the slot's
+ * hash.  Control bytes are probed a group of GROUP_SIZE at a time, so
+ * one SSE2 compare filters 16 slots and the full hash stored in the slot
+ * is checked before the key compare callback is called.
+ *
+ * The number of groups is a power of two and doubles on growth.  A
+ * resize does not move everything at once: the old array is kept and
+ * every insert or remove migrates MIGRATE_GROUPS of its groups, lookups
+ * look in both arrays meanwhile.  Doubling leaves room for 7/8 of the old
+ * capacity of inserts, far more than the migration needs.
+ */
+#define GROUP_SIZE	16
+#define HASH_GROUPS	2	/* default size, in groups */
+#define MIGRATE_GROUPS	4
+
+#define CTRL_EMPTY	0x80
+#define CTRL_DELETED	0xfe
+
+#define H1(hash)	((hash) >> 7)
+#define H2(hash)	((unsigned char)((hash) & 0x7f))
+
+/* grow when 7/8 of the slots are used, tombstones included */
+#define MAX_LOAD(cap)	((cap) - (cap) / 8)
 
 #define WARN(fmt, arg...) \
 do { \
 	warning("%s: " fmt, __FUNCTION__, ##arg); \
 } while (0);
 
+struct hash_slot {
+	unsigned long	hash;
+	void		*key;
+	void		*data;
+};
+
+struct hash_array {
+	unsigned char	*ctrl;
+	struct hash_slot *slots;
+	size_t		mask;		/* number of groups - 1 */
+};
+
 struct hash_table {
-	struct hash_bucket *arr;
-	size_t		size;
+	struct hash_array arr;
+	size_t		count;		/* entries in arr */
+	size_t		deleted;	/* tombstones in arr */
+	/* array being migrated into arr, ctrl is NULL when there is none */
+	struct hash_array old;
+	size_t		old_count;
+	size_t		old_next;	/* first group not migrated yet */
 	hash_callback_t	hash_cb;
 	hash_compare_t	cmp_cb;
-	size_t		count;
-	size_t		collision;
-};
-
-struct hash_bucket {
-	struct hash_bucket *next;
-	void		*key;
-	void		*data;
 };
 
 struct hash_table_iter {
 	struct hash_table *table;
-	struct hash_bucket *bucket;
-	unsigned int	idx;
+	size_t		idx;
 };
 
 static unsigned long
@@ -46,11 +80,6 @@ default_hash_cb(const void *ptr)
 static int
 default_key_cmp_cb(const void *a, const void *b)
 {
-	unsigned long ap, bp;
-
-	ap = (unsigned long) a;
-	bp = (unsigned long) b;
-
 	if (a > b)
 		return 1;
 	else if (a < b)
@@ -58,10 +87,296 @@ default_key_cmp_cb(const void *a, const void *b)
 	return 0;
 }
 
+/* spread the callback's hash, pointers have their low bits clear */
+static inline unsigned long
+hash_mix(unsigned long hash)
+{
+	hash ^= hash >> 33;
+	hash *= 0xff51afd7ed558ccdUL;
+	hash ^= hash >> 33;
+
+	return hash;
+}
+
+/* bit i of the result is set when ctrl[i] matches */
+#ifdef __SSE2__
+static inline unsigned int
+group_match(const unsigned char *ctrl, unsigned char h2)
+{
+	__m128i group;
+
+	group = _mm_load_si128((const __m128i *)ctrl);
+
+	return _mm_movemask_epi8(_mm_cmpeq_epi8(group, _mm_set1_epi8(h2)));
+}
+
+/* empty or deleted: the only control values with the high bit set */
+static inline unsigned int
+group_match_free(const unsigned char *ctrl)
+{
+	return _mm_movemask_epi8(_mm_load_si128((const __m128i *)ctrl));
+}
+#else
+static inline unsigned int
+group_match(const unsigned char *ctrl, unsigned char h2)
+{
+	unsigned int mask = 0;
+	int i;
+
+	for (i = 0; i < GROUP_SIZE; i++)
+		if (ctrl[i] == h2)
+			mask |= 1U << i;
+
+	return mask;
+}
+
+static inline unsigned int
+group_match_free(const unsigned char *ctrl)
+{
+	unsigned int mask = 0;
+	int i;
+
+	for (i = 0; i < GROUP_SIZE; i++)
+		if (ctrl[i] & 0x80)
+			mask |= 1U << i;
+
+	return mask;
+}
+#endif
+
+static inline size_t
+array_capacity(struct hash_array *arr)
+{
+	return (arr->mask + 1) * GROUP_SIZE;
+}
+
+/*
+ * by_address is a constant at every call site below, so tables with the
+ * default pointer keys get a probe loop without any indirect calls.
+ */
+static inline ssize_t
+_find_slot(struct hash_table *table, struct hash_array *arr,
+		unsigned long hash, void *key, int by_address)
+{
+	struct hash_slot *slot;
+	unsigned char *ctrl;
+	unsigned int mask;
+	size_t g, i, idx;
+
+	g = H1(hash) & arr->mask;
+
+	for (i = 0; i <= arr->mask; i++) {
+		ctrl = arr->ctrl + g * GROUP_SIZE;
+
+		for (mask = group_match(ctrl, H2(hash)); mask; mask &= mask - 1) {
+			idx  = g * GROUP_SIZE + __builtin_ctz(mask);
+			slot = &arr->slots[idx];
+
+			if (slot->hash != hash)
+				continue;
+
+			if (by_address ? slot->key == key :
+					 table->cmp_cb(slot->key, key) == 0)
+				return idx;
+		}
+
+		/* the key would have been placed in this group */
+		if (group_match(ctrl, CTRL_EMPTY))
+			return -1;
+
+		g = (g + 1) & arr->mask;
+	}
+
+	return -1;
+}
+
+static inline int
+by_address(struct hash_table *table)
+{
+	return table->cmp_cb == default_key_cmp_cb &&
+	       table->hash_cb == default_hash_cb;
+}
+
+static inline unsigned long
+key_hash(struct hash_table *table, void *key)
+{
+	if (by_address(table))
+		return hash_mix((unsigned long)key);
+
+	return hash_mix(table->hash_cb(key));
+}
+
+static inline ssize_t
+find_slot(struct hash_table *table, struct hash_array *arr,
+					unsigned long hash, void *key)
+{
+	if (by_address(table))
+		return _find_slot(table, arr, hash, key, TRUE);
+
+	return _find_slot(table, arr, hash, key, FALSE);
+}
+
+/* the slot holding key in either array, or NULL */
+static struct hash_slot*
+find_entry(struct hash_table *table, unsigned long hash, void *key,
+					struct hash_array **where)
+{
+	ssize_t idx;
+
+	idx = find_slot(table, &table->arr, hash, key);
+
+	if (idx >= 0) {
+		*where = &table->arr;
+		return &table->arr.slots[idx];
+	}
+
+	if (table->old.ctrl == NULL)
+		return NULL;
+
+	idx = find_slot(table, &table->old, hash, key);
+
+	if (idx < 0)
+		return NULL;
+
+	*where = &table->old;
+	return &table->old.slots[idx];
+}
+
+static size_t
+find_free(struct hash_array *arr, unsigned long hash)
+{
+	unsigned char *ctrl;
+	unsigned int mask;
+	size_t g;
+
+	g = H1(hash) & arr->mask;
+
+	for (;;) {
+		ctrl = arr->ctrl + g * GROUP_SIZE;
+		mask = group_match_free(ctrl);
+
+		if (mask)
+			return g * GROUP_SIZE + __builtin_ctz(mask);
+
+		g = (g + 1) & arr->mask;
+	}
+}
+
+static ret_t
+array_alloc(struct hash_array *arr, size_t ngroups)
+{
+	size_t cap;
+	void *mem;
+
+	cap = ngroups * GROUP_SIZE;
+
+	/* control bytes and slots share one block, groups are 16-aligned */
+	if (posix_memalign(&mem, GROUP_SIZE, cap + cap * sizeof(*arr->slots)) != 0)
+		return ret_out_of_memory;
+
+	arr->ctrl  = mem;
+	arr->slots = (struct hash_slot *)(arr->ctrl + cap);
+	arr->mask  = ngroups - 1;
+
+	memset(arr->ctrl, CTRL_EMPTY, cap);
+
+	return ret_ok;
+}
+
+/* clear slot idx of arr, returns TRUE if a tombstone was left */
+static int
+array_erase(struct hash_array *arr, size_t idx)
+{
+	/*
+	 * A probe stops at the first group with an empty slot, so a slot in
+	 * such a group can become empty again; elsewhere leave a tombstone.
+	 */
+	if (group_match(arr->ctrl + idx / GROUP_SIZE * GROUP_SIZE, CTRL_EMPTY)) {
+		arr->ctrl[idx] = CTRL_EMPTY;
+		return FALSE;
+	}
+
+	arr->ctrl[idx] = CTRL_DELETED;
+	return TRUE;
+}
+
+static void
+array_put(struct hash_table *table, struct hash_slot *slot)
+{
+	size_t idx;
+
+	idx = find_free(&table->arr, slot->hash);
+
+	if (table->arr.ctrl[idx] == CTRL_DELETED)
+		table->deleted--;
+
+	table->arr.ctrl[idx]  = H2(slot->hash);
+	table->arr.slots[idx] = *slot;
+	table->count++;
+}
+
+/* move up to ngroups groups of the old array into the current one */
+static void
+migrate(struct hash_table *table, size_t ngroups)
+{
+	struct hash_array *old;
+	size_t idx, end;
+
+	old = &table->old;
+
+	if (old->ctrl == NULL)
+		return;
+
+	for (; ngroups && table->old_next <= old->mask; ngroups--) {
+		idx = table->old_next++ * GROUP_SIZE;
+
+		for (end = idx + GROUP_SIZE; idx < end; idx++) {
+			if (old->ctrl[idx] & 0x80)
+				continue;
+
+			array_put(table, &old->slots[idx]);
+			table->old_count--;
+			/* keeps probes through this group going */
+			old->ctrl[idx] = CTRL_DELETED;
+		}
+	}
+
+	if (table->old_next > old->mask || table->old_count == 0) {
+		free(old->ctrl);
+		old->ctrl = NULL;
+	}
+}
+
+/* start moving everything into a fresh array of ngroups groups */
+static ret_t
+start_resize(struct hash_table *table, size_t ngroups)
+{
+	struct hash_array arr;
+
+	/* a previous resize that has not finished is completed first */
+	migrate(table, (size_t)-1);
+
+	if (array_alloc(&arr, ngroups) != ret_ok) {
+		WARN("can't allocate array");
+		return ret_out_of_memory;
+	}
+
+	table->old       = table->arr;
+	table->old_count = table->count;
+	table->old_next  = 0;
+
+	table->arr     = arr;
+	table->count   = 0;
+	table->deleted = 0;
+
+	return ret_ok;
+}
+
 struct hash_table *
 hash_table_new(size_t hint_size, hash_callback_t hash, hash_compare_t key_cmp)
 {
 	struct hash_table *table;
+	size_t ngroups;
 
 	table = malloc(sizeof(struct hash_table));
 
@@ -72,126 +387,67 @@ hash_table_new(size_t hint_size, hash_callback_t hash, hash_compare_t key_cmp)
 
 	memset(table, 0, sizeof(struct hash_table));
 
-	table->size = (hint_size == 0) ? HASH_SIZE : prime_nearest(hint_size);
+	for (ngroups = HASH_GROUPS; MAX_LOAD(ngroups * GROUP_SIZE) < hint_size; )
+		ngroups *= 2;
+
 	table->hash_cb = (hash == NULL) ? default_hash_cb : hash;
 	table->cmp_cb = (key_cmp == NULL) ? default_key_cmp_cb : key_cmp;
-	table->collision = 0;
-	table->count = 0;
 
-	table->arr = malloc(table->size * sizeof(struct hash_bucket));
-
-	if (table->arr == NULL) {
+	if (array_alloc(&table->arr, ngroups) != ret_ok) {
 		WARN("can't allocate array");
 		free(table);
 		return NULL;
 	}
 
-	memset(table->arr, 0, table->size * sizeof(struct hash_bucket));
-
 	return table;
 }
 
 void
 hash_table_destroy(struct hash_table **table)
 {
-	struct hash_bucket *bp, *next;
-	unsigned int idx;
-
 	return_if_fail(table != NULL);
 	return_if_fail(*table != NULL);
 
-	for (idx = 0; idx < (*table)->size; idx++) {
-
-		if ((*table)->arr[idx].next == NULL)
-			continue;
-
-		for (bp = (*table)->arr[idx].next; bp != NULL; bp = next) {
-			next = bp->next;
-			free(bp);
-		}
-	}
+	if ((*table)->old.ctrl != NULL)
+		free((*table)->old.ctrl);
 
-	free((*table)->arr);
+	free((*table)->arr.ctrl);
 	free(*table);
 	(*table) = NULL;
 }
 
 static ret_t
-_hash_table_insert(struct hash_table *table, void *key, void *data)
+_hash_table_insert(struct hash_table *table, unsigned long hash,
+						void *key, void *data)
 {
-	struct hash_bucket *bp;
-	struct hash_bucket *arr;
-	unsigned int idx, new_idx;
-	unsigned int new_size;
-	unsigned int collision = 0;
-
-	if (COLLISION_RATE(table) <= 2.0) {
+	struct hash_slot slot;
+	size_t cap, ngroups;
+	ret_t ret;
 
-		new_size = prime_nearest(table->size+1);
-		arr = malloc(new_size * sizeof(struct hash_bucket));
+	migrate(table, MIGRATE_GROUPS);
 
-		if (arr == NULL) {
-			WARN("can't allocate array");
-			return ret_out_of_memory;
-		}
+	cap = array_capacity(&table->arr);
 
-		memset(arr, 0, new_size * sizeof(struct hash_bucket));
+	if (table->count + table->deleted + 1 > MAX_LOAD(cap)) {
+		/* mostly tombstones: clean up at the same size, otherwise grow */
+		ngroups = cap / GROUP_SIZE;
 
-		/* Repopulate the new hash with data from the old one. */
-		for (idx = 0; idx < table->size; idx++) {
-			struct hash_bucket *next;
+		if (table->deleted <= table->count)
+			ngroups *= 2;
 
-			if (table->arr[idx].key == NULL)
-				continue;
+		ret = start_resize(table, ngroups);
 
-			for (bp = &table->arr[idx]; bp != NULL; bp = next) {
-
-				next = bp->next;
-				new_idx = table->hash_cb(bp->key) % new_size;
-
-				if (arr[new_idx].key == NULL) {
-					arr[new_idx].key = bp->key;
-					arr[new_idx].data = bp->data;
-					arr[new_idx].next = NULL;
-					if (bp != &table->arr[idx])
-						free(bp);
-				} else {
-					bp->next = arr[new_idx].next;
-					arr[new_idx].next = bp;
-					collision++;
-				}
-			}
-		}
+		if (ret != ret_ok)
+			return ret;
 
-		/* Say goodbye to the old hash table. */
-		free(table->arr);
-		table->arr = arr;
-		table->size = new_size;
-		table->collision = collision;
+		migrate(table, MIGRATE_GROUPS);
 	}
 
-	idx = table->hash_cb(key) % table->size;
+	slot.hash = hash;
+	slot.key  = key;
+	slot.data = data;
 
-	if (table->arr[idx].key == NULL) {
-		table->arr[idx].key = key;
-		table->arr[idx].data = data;
-		table->count++;
-	} else {
-		bp = malloc(sizeof(struct hash_bucket));
-		if (bp == NULL){
-			WARN("can't allocate bucket");
-			return ret_out_of_memory;
-		}
-		memset(bp, 0, sizeof(struct hash_bucket));
-
-		bp->key = key;
-		bp->data = data;
-
-		bp->next = table->arr[idx].next;
-		table->arr[idx].next = bp;
-		table->collision++;
-		table->count++;
-	}
+	array_put(table, &slot);
 
 	return ret_ok;
 }
@@ -202,159 +458,148 @@ hash_table_insert(struct hash_table *table, void *key, void *data)
 	return_val_if_fail(table != NULL, -1);
 	return_val_if_fail(key != NULL, -1);
 
-	return _hash_table_insert(table, key, data);
+	return _hash_table_insert(table, key_hash(table, key), key, data);
 }
 
 ret_t
 hash_table_insert_unique(struct hash_table *table, void *key, void *data)
 {
-	struct hash_bucket *nb;
-	unsigned int idx;
+	struct hash_array *where;
+	unsigned long hash;
 
 	return_val_if_fail(table != NULL, FALSE);
 	return_val_if_fail(key != NULL, FALSE);
 
-	idx = table->hash_cb(key) % table->size;
+	hash = key_hash(table, key);
 
-	if (table->arr[idx].key != NULL) {
-		for (nb = &table->arr[idx]; nb != NULL; nb = nb->next) {
-			if (table->cmp_cb(nb->key, key) == 0)
-				return ret_entry_exists;
-		}
-	}
+	if (find_entry(table, hash, key, &where) != NULL)
+		return ret_entry_exists;
 
-	return _hash_table_insert(table, key, data);
+	return _hash_table_insert(table, hash, key, data);
 }
 
 boolean_t
 hash_table_remove(struct hash_table *table, void *key)
 {
-	struct hash_bucket *nb;
-	unsigned int idx;
+	struct hash_array *where;
+	struct hash_slot *slot;
 	
 	return_val_if_fail(table != NULL, FALSE);
 	return_val_if_fail(key != NULL, FALSE);
 	
-	idx = table->hash_cb(key) % table->size;
+	slot = find_entry(table, key_hash(table, key), key, &where);
 
-	if (table->arr[idx].key == NULL)
+	if (slot == NULL)
 		return FALSE;
 
-	if (table->cmp_cb(table->arr[idx].key, key) == 0) {
-
-		if (table->arr[idx].next != NULL) {
-			nb = table->arr[idx].next;
-			table->arr[idx].key = nb->key;
-			table->arr[idx].data = nb->data;
-			table->arr[idx].next = nb->next;
-			free(nb);
-			table->collision--;
-		} else {
-			table->arr[idx].key = NULL;
-			table->arr[idx].data = NULL;
-		}
-
+	if (where == &table->arr) {
+		if (array_erase(where, slot - where->slots))
+			table->deleted++;
 		table->count--;
-		return TRUE;
-
-	} else if (table->arr[idx].next != NULL){
-
-		struct hash_bucket *prev = NULL;
-
-		for (nb = table->arr[idx].next; nb != NULL; nb = nb->next) {
-			if (table->cmp_cb(nb->key, key) == 0) {
-
-				if (prev != NULL)
-					prev->next = nb->next;
-				else
-					table->arr[idx].next = nb->next;
-
-				table->collision--;
-				table->count--;
-				free(nb);
-				return TRUE;
-			}
-			prev = nb;
-		}
+	} else {
+		array_erase(where, slot - where->slots);
+		table->old_count--;
 	}
 
-	return FALSE;
+	migrate(table, MIGRATE_GROUPS);
+
+	return TRUE;
 }
 
 void
 hash_table_clean(struct hash_table *table)
 {
-	unsigned int idx;
-	struct hash_bucket *nb, *next;
-
 	return_if_fail(table != NULL);
 
-	for (idx = 0; idx < table->size; idx++) {
-
-		if (table->arr[idx].key == NULL)
-			continue;
-		
-		if (table->arr[idx].next != NULL) {
-			for (nb = table->arr[idx].next; nb != NULL; nb = next) {
-				next = nb->next;
-				free(nb);
-			}
-		}
-
-		memset(&table->arr[idx], 0, sizeof(struct hash_bucket));
+	if (table->old.ctrl != NULL) {
+		free(table->old.ctrl);
+		table->old.ctrl = NULL;
 	}
 
+	memset(table->arr.ctrl, CTRL_EMPTY, array_capacity(&table->arr));
+
 	table->count = 0;
-	table->collision = 0;
+	table->deleted = 0;
+	table->old_count = 0;
 }
 
 boolean_t
 hash_table_replace(struct hash_table *table, void *key, void *data)
 {
-	struct hash_bucket *nb;
-	unsigned int idx;
+	struct hash_array *where;
+	struct hash_slot *slot;
 	
 	return_val_if_fail(table != NULL, FALSE);
 	return_val_if_fail(key != NULL, FALSE);
 
-	idx = table->hash_cb(key) % table->size;
+	slot = find_entry(table, key_hash(table, key), key, &where);
 
-	if (table->arr[idx].key == NULL)
+	if (slot == NULL)
 		return FALSE;
 
-	for (nb = &table->arr[idx]; nb != NULL; nb = nb->next) {
-		if (table->cmp_cb(nb->key, key) == 0) {
-			nb->data = data;
-			return TRUE;
-		}
+	slot->data = data;
+
+	return TRUE;
+}
+
+/*
+ * Most lookups are settled by the home group: a hit by its first
+ * candidate, a miss by an empty slot and no candidate at all.  Checking
+ * that apart from the probe loop keeps the path short enough for the
+ * compiler to leave everything in registers.  Sets *done when the answer,
+ * the slot or NULL, is final.
+ */
+static inline struct hash_slot*
+home_match(struct hash_table *table, unsigned long hash, void *key,
+								int *done)
+{
+	struct hash_slot *slot;
+	unsigned char *ctrl;
+	unsigned int mask;
+
+	ctrl  = table->arr.ctrl + (H1(hash) & table->arr.mask) * GROUP_SIZE;
+	mask  = group_match(ctrl, H2(hash));
+	*done = FALSE;
+
+	if (mask == 0) {
+		*done = table->old.ctrl == NULL && group_match(ctrl, CTRL_EMPTY);
+		return NULL;
 	}
 
-	return FALSE;
+	slot = &table->arr.slots[(ctrl - table->arr.ctrl) + __builtin_ctz(mask)];
+
+	if (by_address(table) ? slot->key != key : (slot->hash != hash ||
+				table->cmp_cb(slot->key, key) != 0))
+		return NULL;
+
+	*done = TRUE;
+	return slot;
 }
 
 ret_t
 hash_table_lookup(struct hash_table *table, void *key, void **res_data)
 {
-	struct hash_bucket *nb;
-	unsigned int idx = 0;
+	struct hash_array *where;
+	struct hash_slot *slot;
+	unsigned long hash;
+	int done;
 
 	return_val_if_fail(table != NULL, -1);
 	return_val_if_fail(key != NULL, -1);
 
-	idx = table->hash_cb(key) % table->size;
+	hash = key_hash(table, key);
+	slot = home_match(table, hash, key, &done);
+
+	if (!done)
+		slot = find_entry(table, hash, key, &where);
 
-	if (table->arr[idx].key == NULL)
+	if (slot == NULL)
 		return ret_not_found;
 
-	for (nb = &table->arr[idx]; nb != NULL; nb = nb->next) {
-		if (table->cmp_cb(nb->key, key) == 0) {
-			if (res_data != NULL)
-				*res_data = nb->data;
-			return ret_ok;
-		}
-	}
+	if (res_data != NULL)
+		*res_data = slot->data;
 
-	return ret_err;
+	return ret_ok;
 }
 
 struct hash_table_iter *
@@ -371,9 +616,11 @@ hash_table_iterate_init(struct hash_table *table)
 		return NULL;
 	}
 
+	/* a walk over all entries pays for finishing the migration */
+	migrate(table, (size_t)-1);
+
 	iter->table = table;
 	iter->idx = 0;
-	iter->bucket = NULL;
 
 	return iter;
 }
@@ -391,36 +638,23 @@ boolean_t
 hash_table_iterate(struct hash_table_iter *iter, void **res_key, void **res_data)
 {
 	struct hash_table *table;	
+	struct hash_slot *slot;
 	
 	return_val_if_fail(iter != NULL, FALSE);
 	return_val_if_fail(iter->table != NULL, FALSE);
 
 	table = iter->table;
 
-	if (iter->bucket == NULL) {
-		/* Skip to next bucket. */
-		while (iter->idx < table->size) {
-			if (table->arr[iter->idx].key != NULL) {
-				iter->bucket = &(table->arr[iter->idx]);
-				break;
-			}
-			iter->idx++;
-		}
-	}
+	for (; iter->idx < array_capacity(&table->arr); iter->idx++) {
+		if (table->arr.ctrl[iter->idx] & 0x80)
+			continue;
 
-	if (iter->bucket != NULL) {
+		slot = &table->arr.slots[iter->idx++];
 
 		if (res_key != NULL)
-			*res_key = iter->bucket->key;
+			*res_key = slot->key;
 		if (res_data != NULL)
-			*res_data = iter->bucket->data;
-
-		if (iter->bucket->next != NULL) {
-			iter->bucket = iter->bucket->next;
-		} else {
-			iter->bucket = NULL;
-			iter->idx++;
-		}
+			*res_data = slot->data;
 
 		return TRUE;
 	}
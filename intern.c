@@ -0,0 +1,161 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+
+#include "intern.h"
+#include "hash.h"
+#include "macros.h"
+#include "umalloc.h"
+
+static struct hash_table *strings;
+static pthread_mutex_t strings_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static unsigned long
+intern_hash(const unsigned char *str)
+{
+	unsigned long hash = 5381;
+	int c;
+
+	while ((c = *str++) != 0)
+		hash = ((hash << 5) + hash) + c;
+
+	return hash;
+}
+
+static int
+intern_strcmp(const void *a, const void *b)
+{
+	return strcmp((char *)a, (char *)b);
+}
+
+static struct hash_table*
+table_new(void)
+{
+	struct hash_table *table;
+
+	table = hash_table_new(0, (hash_callback_t)intern_hash, intern_strcmp);
+
+	if (table == NULL)
+		error(1, "can't create string table");
+
+	return table;
+}
+
+/* the copy of str in table, NULL if it has none */
+static char*
+table_lookup(struct hash_table *table, const char *str)
+{
+	char *res;
+	ret_t ret;
+
+	if (table == NULL)
+		return NULL;
+
+	ret = hash_table_lookup(table, (void *)str, (void **)&res);
+
+	return ret == ret_ok ? res : NULL;
+}
+
+/* a copy of str that is not in table yet */
+static char*
+table_insert(struct hash_table *table, const char *str)
+{
+	umem_handler_t oom;
+	char *res;
+
+	/* never unwind between the copy and the insert */
+	oom = umem_set_handler(NULL);
+
+	res = ustrdup(str);
+	hash_table_insert(table, res, res);
+
+	umem_set_handler(oom);
+
+	return res;
+}
+
+char*
+intern(const char *str)
+{
+	char *res;
+
+	return_val_if_fail(str != NULL, NULL);
+
+	pthread_mutex_lock(&strings_lock);
+
+	if (strings == NULL)
+		strings = table_new();
+
+	res = table_lookup(strings, str);
+
+	if (res == NULL)
+		res = table_insert(strings, str);
+
+	pthread_mutex_unlock(&strings_lock);
+
+	return res;
+}
+
+char*
+intern_lookup(struct hash_table *local, const char *str)
+{
+	char *res;
+
+	return_val_if_fail(str != NULL, NULL);
+
+	/* local first: the global table may get the string later */
+	res = table_lookup(local, str);
+
+	if (res != NULL)
+		return res;
+
+	pthread_mutex_lock(&strings_lock);
+	res = table_lookup(strings, str);
+	pthread_mutex_unlock(&strings_lock);
+
+	return res;
+}
+
+char*
+intern_local(struct hash_table *local, const char *str)
+{
+	char *res;
+
+	if (local == NULL)
+		return intern(str);
+
+	res = intern_lookup(local, str);
+
+	if (res == NULL)
+		res = table_insert(local, str);
+
+	return res;
+}
+
+struct hash_table*
+intern_local_new(void)
+{
+	return table_new();
+}
+
+void
+intern_local_destroy(struct hash_table **local)
+{
+	struct hash_table_iter *iter;
+	char *str, *data;
+
+	return_if_fail(local != NULL && *local != NULL);
+
+	iter = hash_table_iterate_init(*local);
+
+	if (!iter)
+		error(1, "hash iterator");
+
+	while (hash_table_iterate(iter, (void **)&str, (void **)&data))
+		ufree(str);
+
+	hash_table_iterate_deinit(&iter);
+
+	hash_table_destroy(local);
+}
@@ -0,0 +1,33 @@
+#ifndef INTERN_H_
+#define INTERN_H_
+
+struct hash_table;
+
+/*
+ * Global string table.  intern() returns the canonical copy of str, so two
+ * interned names are equal if and only if the pointers are equal.
+ * Interned strings live until exit and must not be modified or freed.
+ */
+char*
+intern(const char *str);
+
+/*
+ * A table of its own for a short-lived context: a string the global table
+ * lacks goes into local and is freed with it.  Strings of one context
+ * stay canonical, those of different contexts must not be mixed.  A NULL
+ * local is the global table.
+ */
+char*
+intern_local(struct hash_table *local, const char *str);
+
+/* the canonical copy of str, NULL rather than a new one if there is none */
+char*
+intern_lookup(struct hash_table *local, const char *str);
+
+struct hash_table*
+intern_local_new(void);
+
+void
+intern_local_destroy(struct hash_table **local);
+
+#endif /*INTERN_H_*/
@@ -3,11 +3,20 @@
 #include <string.h>
 
 #include "keyword.h"
-#include "hash.h"
 #include "macros.h"
 #include "common.h"
 
-static struct hash_table *keyword_table;
+/*
+ * Perfect hash over the fixed keyword set: length plus last character,
+ * modulo KEYWORD_SLOTS, puts every keyword in its own slot.  A lookup is
+ * one slot read and one compare; keyword_table_create() checks the hash
+ * is still collision-free after a keyword has been added.  With 16 slots
+ * `if' and `parfor' collide.
+ */
+#define KEYWORD_SLOTS	32
+
+#define KEYWORD_HASH(name, len) \
+	(((len) + (unsigned char)(name)[(len) - 1]) & (KEYWORD_SLOTS - 1))
 
 struct keyword keywords[] = {
 	{ "function",	TOKEN_FUNCTION },
@@ -20,68 +29,52 @@ struct keyword keywords[] = {
 	{ "continue",	TOKEN_CONTINUE },
 	{ "local",	TOKEN_LOCAL },
 	{ "include",	TOKEN_INCLUDE },
+	{ "parfor",	TOKEN_PARFOR },
 	{ NULL,		TOKEN_UNKNOWN }
 };
 
-static int
-keyword_hash(unsigned char *str)
-{
-	unsigned long hash = 5381;
-	int c;
-
-	while ((c = *str++) != 0)
-		hash = ((hash << 5) + hash) + c;
-
-	return hash;
-}
+static struct keyword *keyword_slots[KEYWORD_SLOTS];
 
-static int
-keyword_strcmp(void *a, void *b)
+void
+keyword_table_create(void)
 {
-	int ret;
-	
-	return_val_if_fail(a, ret_invalid);
-	return_val_if_fail(b, ret_invalid);
+	struct keyword *kw;
+	size_t len;
+	int i, h;
 
-	ret = strcmp((char *)a, (char *)b);
+	for (i = 0; keywords[i].token != TOKEN_UNKNOWN; i++) {
+		kw  = &keywords[i];
+		len = strlen(kw->name);
+		h   = KEYWORD_HASH(kw->name, len);
 
-	return ret;
-}
+		if (keyword_slots[h] != NULL)
+			error(1, "keyword hash: `%s' collides with `%s'",
+					kw->name, keyword_slots[h]->name);
 
-void
-keyword_table_create(void)
-{
-	int i;
-	keyword_table = hash_table_new(0, (hash_callback_t)keyword_hash,
-					(hash_compare_t)keyword_strcmp);
-	if (keyword_table == NULL)
-		error(1, "no memory for keyword table");
-	
-	for (i = 0; keywords[i].token != TOKEN_UNKNOWN; i++)
-		hash_table_insert_unique(keyword_table, keywords[i].name,
-							&keywords[i]);
-	
+		kw->len = len;
+		keyword_slots[h] = kw;
+	}
 }
 
 void
 keyword_table_destroy(void)
 {
-	return_if_fail(keyword_table != NULL);
-	
-	hash_table_clean(keyword_table);
-	hash_table_destroy(&keyword_table);
+	memset(keyword_slots, 0, sizeof(keyword_slots));
 }
 
 struct keyword*
-keyword_table_lookup(char *name)
+keyword_table_lookup(const char *name, size_t len)
 {
 	struct keyword *kw;
-	ret_t ret;
-	
-	return_val_if_fail(keyword_table != NULL, NULL);
-	
-	ret = hash_table_lookup(keyword_table, name, (void**)&kw);
-	if (ret != ret_ok)
+
+	return_val_if_fail(name != NULL, NULL);
+
+	if (len == 0)
+		return NULL;
+
+	kw = keyword_slots[KEYWORD_HASH(name, len)];
+
+	if (kw == NULL || kw->len != len || memcmp(kw->name, name, len) != 0)
 		return NULL;
 
 	return kw;
@@ -3,9 +3,12 @@
 
 #include "lex.h"
 
+#include <stddef.h>
+
 struct keyword {
 	char	*name;
 	token_t	token;
+	size_t	len;
 };
 
 void
@@ -14,7 +17,8 @@ keyword_table_create(void);
 void
 keyword_table_destroy(void);
 	
+/* name need not be terminated, NULL if it is not a keyword */
 struct keyword*
-keyword_table_lookup(char *name);
+keyword_table_lookup(const char *name, size_t len);
 
 #endif /*KEYWORD_H_*/ 
@@ -9,52 +9,51 @@
 #include "symbol.h"
 #include "umalloc.h"
 #include "keyword.h"
+#include "intern.h"
+#include "context.h"
 
-struct lex lex;
-static int peek; 
-static FILE *input_file;
 
 void
-set_file(FILE *file)
+set_file(struct bclite_ctx *ctx, FILE *file)
 {
 	return_if_fail(file != NULL);
 	
-	input_file = file;
+	ctx->input = file;
+	ctx->peek  = 0;
 }
 
 void
-skip_comment(void)
+skip_comment(struct bclite_ctx *ctx)
 {
 	while(TRUE) {
-		peek = fgetc(input_file);
-		if (peek == '\n')
+		ctx->peek = fgetc(ctx->input);
+		if (ctx->peek == '\n' || ctx->peek == EOF)
 			break;
 	}
 }
 
 token_t
-get_next_token(void)
+get_next_token(struct bclite_ctx *ctx)
 {
 	int used, len, neg;
 	double number, mult;
 	int power_temp, power;
-	char *id, *string;
+	char *string;
 	struct symbol *symbol;
 	struct keyword *keyword;
 	int tmp;
 
 	neg = 0;
-	id  = NULL;
 
 	while (TRUE) {
-		switch(peek) {
+		switch(ctx->peek) {
 		case 0: 
 		case ' ':
 		case '\t':
-			peek = fgetc(input_file);
+			ctx->peek = fgetc(ctx->input);
 			continue;
 		case '#':
-			skip_comment();
+			skip_comment(ctx);
 			break;
 		default:
 			break;
@@ -63,53 +62,38 @@ get_next_token(void)
 		break;
 	}
 
-	switch (lex.token) {
-	case TOKEN_ID:
-		if (lex.id != NULL) 
-			ufree(lex.id);
-		break;
-	case TOKEN_STRING:	
-		if (lex.string != NULL)
-			ufree(lex.string);
-		break;
-	default:
-		break;
-	}
-	
-	memset(&lex, 0, sizeof(lex));
+	memset(&ctx->lex, 0, sizeof(ctx->lex));
 	
-	if (isalpha(peek) || peek == '_') {
-		used = len = 0;
+	if (isalpha(ctx->peek) || ctx->peek == '_') {
+		used = 0;
 		do {
-			if ((used + 1) >= len) {
-				len += 64;
-				id   = urealloc(id, len);
+			if ((used + 1) >= ctx->id_size) {
+				ctx->id_size += 64;
+				ctx->id_buf   = urealloc(ctx->id_buf, ctx->id_size);
 			}
 
-			id[used++] = peek;
-			peek = fgetc(input_file);
+			ctx->id_buf[used++] = ctx->peek;
+			ctx->peek = fgetc(ctx->input);
 
-		} while (isalnum(peek) || peek == '_');
+		} while (isalnum(ctx->peek) || ctx->peek == '_');
 
-		id[used++] = 0;
-			
-		keyword = keyword_table_lookup(id);
+		ctx->id_buf[used] = 0;
+
+		/* keywords are never interned */
+		keyword = keyword_table_lookup(ctx->id_buf, used);
 
 		if (keyword != NULL) {
-			lex.token = keyword->token;
-			ufree(id);
-			return lex.token;
+			ctx->lex.token = keyword->token;
+			return ctx->lex.token;
 		}
 		
-		lex.id = ustrdup(id);
-		lex.token = TOKEN_ID;
-		
-		ufree(id);	
+		ctx->lex.id = intern_local(ctx->strings, ctx->id_buf);
+		ctx->lex.token = TOKEN_ID;
 		return TOKEN_ID;	
 	}
 	
 
-	switch (peek) {
+	switch (ctx->peek) {
 	case '0':
 	case '1':
 	case '2':
@@ -121,51 +105,51 @@ get_next_token(void)
 	case '8':
 	case '9':
 do_number:	
-		switch(peek) {
+		switch(ctx->peek) {
 		case '-':
 			neg = 1;
 		case '+':
-			peek = fgetc(input_file);
+			ctx->peek = fgetc(ctx->input);
 			break;
 		}
 
 		number  = 0.0;
 		power_temp = power = 0;
 
-		while (isdigit(peek)) {
+		while (isdigit(ctx->peek)) {
 			number *= 10;
-			number += peek - '0';
-			peek = fgetc(input_file); 
+			number += ctx->peek - '0';
+			ctx->peek = fgetc(ctx->input); 
 		}
 		
-		if (peek == '.') {
-			peek = fgetc(input_file);
-			while(isdigit(peek)) {
+		if (ctx->peek == '.') {
+			ctx->peek = fgetc(ctx->input);
+			while(isdigit(ctx->peek)) {
 				number *= 10;
-				number += peek - '0';
-				peek = fgetc(input_file);
+				number += ctx->peek - '0';
+				ctx->peek = fgetc(ctx->input);
 				power_temp--;
 			}
 		} 
 	
-		if (peek == 'e' || peek == 'E') {
+		if (ctx->peek == 'e' || ctx->peek == 'E') {
 			int exp_neg = 0;
 			
-			peek = fgetc(input_file);
-			switch(peek) {
+			ctx->peek = fgetc(ctx->input);
+			switch(ctx->peek) {
 			case '-':
-				peek = fgetc(input_file);
+				ctx->peek = fgetc(ctx->input);
 				exp_neg++;
 				break;
 			case '+':
-				peek = fgetc(input_file);
+				ctx->peek = fgetc(ctx->input);
 				break;
 			}
 			
-			while(isdigit(peek)) {
+			while(isdigit(ctx->peek)) {
 				power *= 10;
-				power += peek - '0';
-				peek   = fgetc(input_file);
+				power += ctx->peek - '0';
+				ctx->peek   = fgetc(ctx->input);
 			}
 			
 			power = (exp_neg) ? -power : power;	
@@ -187,128 +171,128 @@ do_number:
 			power_temp >>= 1;
 		}
 		
-		lex.real  = (neg) ? -number : number;
-		lex.token = TOKEN_DOUBLE;
+		ctx->lex.real  = (neg) ? -number : number;
+		ctx->lex.token = TOKEN_DOUBLE;
 
 		return TOKEN_DOUBLE;
 	case '+':
-		peek = 0;
-		lex.token = TOKEN_PLUS;
+		ctx->peek = 0;
+		ctx->lex.token = TOKEN_PLUS;
 		return TOKEN_PLUS;
 	case '-':
-		tmp = fgetc(input_file);
+		tmp = fgetc(ctx->input);
 		if (isdigit(tmp)) {
-			ungetc(tmp, input_file);
+			ungetc(tmp, ctx->input);
 			goto do_number;
 		}
-		peek = 0;
-		lex.token = TOKEN_MINUS;
+		ctx->peek = 0;
+		ctx->lex.token = TOKEN_MINUS;
 		return TOKEN_MINUS;
 	case '*':
-		peek = 0;
-		lex.token = TOKEN_ASTERIK;
+		ctx->peek = 0;
+		ctx->lex.token = TOKEN_ASTERIK;
 		return TOKEN_ASTERIK;
 	case '/':
-		peek = 0;
-		lex.token = TOKEN_SLASH;
+		ctx->peek = 0;
+		ctx->lex.token = TOKEN_SLASH;
 		return TOKEN_SLASH;
 	case '(':
-		peek = 0;
-		lex.token = TOKEN_LPARENTH;
+		ctx->peek = 0;
+		ctx->lex.token = TOKEN_LPARENTH;
 		return TOKEN_LPARENTH;
 	case ')':
-		peek = 0;
-		lex.token = TOKEN_RPARENTH;
+		ctx->peek = 0;
+		ctx->lex.token = TOKEN_RPARENTH;
 		return TOKEN_RPARENTH;
 	case ',':
-		peek = 0;
-		lex.token = TOKEN_COMMA;
+		ctx->peek = 0;
+		ctx->lex.token = TOKEN_COMMA;
 		return TOKEN_COMMA;
 	case '!':
-		peek = fgetc(input_file);
-		if (peek == '=') {
-			peek = 0;
-			lex.token = TOKEN_NE;
+		ctx->peek = fgetc(ctx->input);
+		if (ctx->peek == '=') {
+			ctx->peek = 0;
+			ctx->lex.token = TOKEN_NE;
 			return TOKEN_NE;
 		}
-		lex.token = TOKEN_NOT;
+		ctx->lex.token = TOKEN_NOT;
 		return TOKEN_NOT;
 	case '&':
-		peek = fgetc(input_file);
-		if (peek == '&') {
-			peek = 0;
-			lex.token = TOKEN_AND;
+		ctx->peek = fgetc(ctx->input);
+		if (ctx->peek == '&') {
+			ctx->peek = 0;
+			ctx->lex.token = TOKEN_AND;
 			return TOKEN_AND;
 		}
-		lex.token = TOKEN_UNKNOWN;
+		ctx->lex.token = TOKEN_UNKNOWN;
 		return TOKEN_UNKNOWN;
 	case '|':
-		peek = fgetc(input_file);
-		if (peek == '|') {
-			peek = 0;
-			lex.token = TOKEN_OR;
+		ctx->peek = fgetc(ctx->input);
+		if (ctx->peek == '|') {
+			ctx->peek = 0;
+			ctx->lex.token = TOKEN_OR;
 			return TOKEN_OR;
 		}
-		lex.token = TOKEN_UNKNOWN;
+		ctx->lex.token = TOKEN_UNKNOWN;
 		return TOKEN_UNKNOWN;
 	case '=':
-		peek = fgetc(input_file);
-		if (peek == '=') {
-			peek = 0;
-			lex.token = TOKEN_EQ;
+		ctx->peek = fgetc(ctx->input);
+		if (ctx->peek == '=') {
+			ctx->peek = 0;
+			ctx->lex.token = TOKEN_EQ;
 			return TOKEN_EQ;
 		}
-		lex.token = TOKEN_EQUALITY;
+		ctx->lex.token = TOKEN_EQUALITY;
 		return TOKEN_EQUALITY;
 	case '>':
-		peek = fgetc(input_file);
-		if (peek == '=') {
-			peek = 0;
-			lex.token = TOKEN_GE;
+		ctx->peek = fgetc(ctx->input);
+		if (ctx->peek == '=') {
+			ctx->peek = 0;
+			ctx->lex.token = TOKEN_GE;
 			return TOKEN_GE;
 		}
-		lex.token = TOKEN_GT;
+		ctx->lex.token = TOKEN_GT;
 		return TOKEN_GT;
 	case '<':
-		peek = fgetc(input_file);
-		if (peek == '=') {
-			peek = 0;
-			lex.token = TOKEN_LE;
+		ctx->peek = fgetc(ctx->input);
+		if (ctx->peek == '=') {
+			ctx->peek = 0;
+			ctx->lex.token = TOKEN_LE;
 			return TOKEN_LE;	
 		}
-		lex.token = TOKEN_LT;
+		ctx->lex.token = TOKEN_LT;
 		return TOKEN_LT;
 	case '{':
-		peek = 0;
-		lex.token = TOKEN_LBRACE;
+		ctx->peek = 0;
+		ctx->lex.token = TOKEN_LBRACE;
 		return TOKEN_LBRACE;
 	case '}':
-		peek = 0;
-		lex.token = TOKEN_RBRACE;
+		ctx->peek = 0;
+		ctx->lex.token = TOKEN_RBRACE;
 		return TOKEN_RBRACE;
 	case '[':
-		peek = 0;
-		lex.token = TOKEN_LBRACKET;
+		ctx->peek = 0;
+		ctx->lex.token = TOKEN_LBRACKET;
 		return TOKEN_LBRACKET;
 	case ']':
-		peek = 0;
-		lex.token = TOKEN_RBRACKET;
+		ctx->peek = 0;
+		ctx->lex.token = TOKEN_RBRACKET;
 		return TOKEN_RBRACKET;
 	case ';':
-		peek = 0;
-		lex.token = TOKEN_SEMICOLON;
+		ctx->peek = 0;
+		ctx->lex.token = TOKEN_SEMICOLON;
 		return TOKEN_SEMICOLON;	
 	case '"':
 		string = NULL;
 		used = len = 0;
-		peek = fgetc(input_file);
+		ctx->peek = fgetc(ctx->input);
 
 		do {
-			if (peek == '\n') {
+			if (ctx->peek == '\n') {
 				if (string != NULL)
 					ufree(string);
 
-				lex.token = TOKEN_UNKNOWN;
+				ctx->lex.token = TOKEN_UNKNOWN;
 				return TOKEN_UNKNOWN;	
 			}
 			
@@ -317,35 +301,35 @@ do_number:
 				string = urealloc(string, len);
 			}
 			
-			string[used++] = peek;
+			string[used++] = ctx->peek;
 
-			peek = fgetc(input_file);
+			ctx->peek = fgetc(ctx->input);
 				
-		} while(peek != '"');	
+		} while(ctx->peek != '"');	
 		
 		string[used] = '\0';
 
-		peek = 0;
-		lex.string = ustrdup(string); 
-		lex.token  = TOKEN_STRING;
+		ctx->peek = 0;
+		ctx->lex.string = intern_local(ctx->strings, string);
+		ctx->lex.token  = TOKEN_STRING;
 		ufree(string);
 		return TOKEN_STRING;
 	case '^':
-		peek = 0;
-		lex.token = TOKEN_CARET;
+		ctx->peek = 0;
+		ctx->lex.token = TOKEN_CARET;
 		return TOKEN_CARET;	
 	case '\n':
-		peek = 0;
-		lex.token = TOKEN_EOL;
+		ctx->peek = 0;
+		ctx->lex.token = TOKEN_EOL;
 		return TOKEN_EOL;
 	case EOF:
-		peek = 0;
-		lex.token = TOKEN_EOF;
+		ctx->peek = 0;
+		ctx->lex.token = TOKEN_EOF;
 		return TOKEN_EOF;
 	}
 
-	peek = 0;
-	lex.token = TOKEN_UNKNOWN;
+	ctx->peek = 0;
+	ctx->lex.token = TOKEN_UNKNOWN;
 	return TOKEN_UNKNOWN;	
 }
 
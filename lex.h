@@ -42,10 +42,12 @@ typedef enum {
 	TOKEN_DIGIT,
 	TOKEN_CARET,
 	TOKEN_INCLUDE,
+	TOKEN_PARFOR,
 	TOKEN_EOL,
 	TOKEN_EOF
 } token_t;
 
+/* id and string are interned, see intern.h */
 struct lex {
 	token_t		token;
 	union {
@@ -55,12 +57,12 @@ struct lex {
 	};
 };
 
-extern struct lex lex;
+struct bclite_ctx;
 
 void
-set_file(FILE *file);
+set_file(struct bclite_ctx *ctx, FILE *file);
 
 token_t
-get_next_token(void);
+get_next_token(struct bclite_ctx *ctx);
 
 #endif /*LEX_H_*/
@@ -5,119 +5,103 @@
 
 #include "libcall.h"
 #include "umalloc.h"
+#include "pool.h"
 #include "macros.h"
 #include "misc.h"
+#include "reduce.h"
+#include "vmath.h"
+#include "libm.h"
+#include "spmatrix.h"
 
 #define err_msg(fmt, arg...) \
 do { \
 	message(fmt, ##arg); \
 } while(0)
-	
-int
-libcall_sin(struct function *func, value_t *v_type, void **result)
+
+/* a digit result goes where the caller points result, see function.h */
+#define DIGIT(result)	(*(double *)*(result))
+
+/* f of a digit, or of every element of a vector or a matrix */
+static int
+map(struct symbol *arg, vmath_fn_t f, value_t *v_type, void **result)
 {
-	double *dg;
+	gsl_vector *vc;
+	gsl_matrix *mx;
+	size_t i;
 
-	return_val_if_fail(func != NULL, FALSE);
-	
-	if (func->args[0]->v_type != VALUE_TYPE_DIGIT) {	
+	switch(arg->v_type) {
+	case VALUE_TYPE_DIGIT:
+		f(&DIGIT(result), &arg->digit, 1);
+		break;
+	case VALUE_TYPE_VECTOR:
+		vc = pool_vector_alloc(arg->vector->size);
+
+		if (arg->vector->stride == 1) {
+			f(vc->data, arg->vector->data, vc->size);
+		} else {
+			gsl_vector_memcpy(vc, arg->vector);
+			f(vc->data, vc->data, vc->size);
+		}
+
+		*result = vc;
+		break;
+	case VALUE_TYPE_MATRIX:
+		mx = pool_matrix_alloc(arg->matrix->size1, arg->matrix->size2);
+
+		for (i = 0; i < mx->size1; i++)
+			f(mx->data + i * mx->tda,
+				arg->matrix->data + i * arg->matrix->tda, mx->size2);
+
+		*result = mx;
+		break;
+	default:
 		err_msg("error: incompatible argument type");
 		return FALSE;
 	}
-	
-	dg  = umalloc(sizeof(double));
-	*dg = sin(func->args[0]->digit);
 
-	*v_type = VALUE_TYPE_DIGIT;	
-	*result = dg;
-	
+	*v_type = arg->v_type;
+
 	return TRUE;
 }
 
+int
+libcall_sin(struct function *func, value_t *v_type, void **result)
+{
+	return_val_if_fail(func != NULL, FALSE);
+
+	return map(func->args[0], vmath_sin, v_type, result);
+}
+
 int
 libcall_cos(struct function *func, value_t *v_type, void **result)
 {
-	double *dg;
-		
 	return_val_if_fail(func != NULL, FALSE);
-	
-	if (func->args[0]->v_type != VALUE_TYPE_DIGIT) {
-		err_msg("error: incompatible argument type");
-		return FALSE;
-	}
-	
-	dg  = umalloc(sizeof(double));
-	*dg = cos(func->args[0]->digit);
 
-	*v_type = VALUE_TYPE_DIGIT;	
-	*result = dg;
-	
-	return TRUE;
+	return map(func->args[0], vmath_cos, v_type, result);
 }
 
-int 
+int
 libcall_ln(struct function *func, value_t *v_type, void **result)
 {
-	double *dg;
-	
 	return_val_if_fail(func != NULL, FALSE);
-	
-	if (func->args[0]->v_type != VALUE_TYPE_DIGIT) {
-		err_msg("error: incompatible argument type");
-		return FALSE;
-	}
-	
-	dg  = umalloc(sizeof(double));
-	*dg = log(func->args[0]->digit);
-
-	*v_type = VALUE_TYPE_DIGIT;	
-	*result = dg;
-	
-	return TRUE;
 
+	return map(func->args[0], vmath_ln, v_type, result);
 }
 
-int 
+int
 libcall_exp(struct function *func, value_t *v_type, void **result)
 {
-	double *dg;
-	
 	return_val_if_fail(func != NULL, FALSE);
-	
-	if (func->args[0]->v_type != VALUE_TYPE_DIGIT) {
-		err_msg("error: incompatible argument type");
-		return FALSE;
-	}
-	
-	dg  = umalloc(sizeof(double));
-	*dg = exp(func->args[0]->digit);
 
-	*v_type = VALUE_TYPE_DIGIT;	
-	*result = dg;
-	
-	return TRUE;
+	return map(func->args[0], vmath_exp, v_type, result);
 }
 
 int
 libcall_tan(struct function *func, value_t *v_type, void **result)
 {
-	double *dg;
-	
 	return_val_if_fail(func != NULL, FALSE);
-	
-	if (func->args[0]->v_type != VALUE_TYPE_DIGIT) {
-		err_msg("error: incompatible argument type");
-		return FALSE;
-	}
-	
-	dg  = umalloc(sizeof(double));
-	*dg = tan(func->args[0]->digit);
-
-	*v_type = VALUE_TYPE_DIGIT;	
-	*result = dg;
-	
-	return TRUE;
 
+	return map(func->args[0], vmath_tan, v_type, result);
 }
 
 int
@@ -141,7 +125,7 @@ libcall_matrix(struct function *func, value_t *v_type, void **result)
 	row = func->args[0]->digit;
 	col = func->args[1]->digit;
 
-	mx = gsl_matrix_calloc(row, col);
+	mx = pool_matrix_calloc(row, col);
 	
 	*v_type = VALUE_TYPE_MATRIX;
 	*result = mx;
@@ -163,7 +147,7 @@ libcall_vector(struct function *func, value_t *v_type, void **result)
 	}
 	
 	len = func->args[0]->digit;
-	vc  = gsl_vector_calloc(len);
+	vc  = pool_vector_calloc(len);
 	
 	*v_type = VALUE_TYPE_VECTOR;
 	*result = vc;
@@ -174,20 +158,287 @@ libcall_vector(struct function *func, value_t *v_type, void **result)
 int
 libcall_sqrt(struct function *func, value_t *v_type, void **result)
 {
-	double *dg;
-	
 	return_val_if_fail(func != NULL, FALSE);
-	
-	if (func->args[0]->v_type != VALUE_TYPE_DIGIT) {
-		err_msg("error: arguments in the `vector()' must be the digits");
+
+	return map(func->args[0], vmath_sqrt, v_type, result);
+}
+
+/*
+ * Matrix functions, see libm.h; a digit is taken as a 1 x 1 matrix.
+ * The result is NULL when libm has already reported why.
+ */
+static int
+matrix_fn(struct symbol *arg, gsl_matrix *(*fn)(gsl_matrix *, double),
+			double p, value_t *v_type, void **result)
+{
+	gsl_matrix_view one;
+	gsl_matrix *mx;
+
+	switch(arg->v_type) {
+	case VALUE_TYPE_DIGIT:
+		one = gsl_matrix_view_array(&arg->digit, 1, 1);
+		mx  = fn(&one.matrix, p);
+
+		if (mx == NULL)
+			return FALSE;
+
+		DIGIT(result) = gsl_matrix_get(mx, 0, 0);
+		pool_matrix_free(mx);
+
+		*v_type = VALUE_TYPE_DIGIT;
+		return TRUE;
+	case VALUE_TYPE_MATRIX:
+		mx = fn(arg->matrix, p);
+
+		if (mx == NULL)
+			return FALSE;
+
+		*v_type = VALUE_TYPE_MATRIX;
+		*result = mx;
+		return TRUE;
+	default:
+		err_msg("error: incompatible argument type");
 		return FALSE;
 	}
+}
 
-	dg  = umalloc(sizeof(double));
-	*dg = sqrt(func->args[0]->digit);
+static gsl_matrix*
+expm(gsl_matrix *mx, double unused)
+{
+	return libm_matrix_expm(mx);
+}
+
+static gsl_matrix*
+logm(gsl_matrix *mx, double unused)
+{
+	return libm_matrix_logm(mx);
+}
+
+int
+libcall_expm(struct function *func, value_t *v_type, void **result)
+{
+	return_val_if_fail(func != NULL, FALSE);
+
+	return matrix_fn(func->args[0], expm, 0.0, v_type, result);
+}
+
+int
+libcall_logm(struct function *func, value_t *v_type, void **result)
+{
+	return_val_if_fail(func != NULL, FALSE);
+
+	return matrix_fn(func->args[0], logm, 0.0, v_type, result);
+}
+
+int
+libcall_powm(struct function *func, value_t *v_type, void **result)
+{
+	return_val_if_fail(func != NULL, FALSE);
+
+	if (func->args[1]->v_type != VALUE_TYPE_DIGIT) {
+		err_msg("error: power must be a digit");
+		return FALSE;
+	}
+
+	return matrix_fn(func->args[0], libm_matrix_powm, func->args[1]->digit,
+							v_type, result);
+}
+
+/* digits of a vector or a matrix as rows x cols, see reduce.h */
+static int
+reduce_arg(struct symbol *arg, const double **data, size_t *rows,
+					size_t *cols, size_t *ld)
+{
+	switch(arg->v_type) {
+	case VALUE_TYPE_DIGIT:
+		*data = &arg->digit;
+		*rows = *cols = *ld = 1;
+		return TRUE;
+	case VALUE_TYPE_VECTOR:
+		*data = arg->vector->data;
+		*rows = arg->vector->size;
+		*cols = 1;
+		*ld   = arg->vector->stride;
+		return TRUE;
+	case VALUE_TYPE_MATRIX:
+		*data = arg->matrix->data;
+		*rows = arg->matrix->size1;
+		*cols = arg->matrix->size2;
+		*ld   = arg->matrix->tda;
+		return TRUE;
+	case VALUE_TYPE_SPMATRIX:
+		/* the zeros add nothing to a sum nor to a norm */
+		*data = arg->spmatrix->val;
+		*rows = arg->spmatrix->nnz;
+		*cols = *ld = 1;
+		return TRUE;
+	default:
+		return FALSE;
+	}
+}
+
+int
+libcall_sum(struct function *func, value_t *v_type, void **result)
+{
+	const double *data;
+	size_t rows, cols, ld;
+
+	return_val_if_fail(func != NULL, FALSE);
+
+	if (!reduce_arg(func->args[0], &data, &rows, &cols, &ld)) {
+		err_msg("error: incompatible argument type");
+		return FALSE;
+	}
+
+	DIGIT(result) = reduce_sum(data, rows, cols, ld);
+
+	*v_type = VALUE_TYPE_DIGIT;
+
+	return TRUE;
+}
+
+int
+libcall_norm(struct function *func, value_t *v_type, void **result)
+{
+	const double *data;
+	size_t rows, cols, ld;
+
+	return_val_if_fail(func != NULL, FALSE);
+
+	if (!reduce_arg(func->args[0], &data, &rows, &cols, &ld)) {
+		err_msg("error: incompatible argument type");
+		return FALSE;
+	}
+
+	DIGIT(result) = reduce_norm(data, rows, cols, ld);
+
+	*v_type = VALUE_TYPE_DIGIT;
+
+	return TRUE;
+}
+
+/* a digit as a vector of one */
+static gsl_vector*
+vector_arg(struct symbol *arg, gsl_vector_view *one)
+{
+	switch(arg->v_type) {
+	case VALUE_TYPE_DIGIT:
+		*one = gsl_vector_view_array(&arg->digit, 1);
+		return &one->vector;
+	case VALUE_TYPE_VECTOR:
+		return arg->vector;
+	default:
+		return NULL;
+	}
+}
+
+int
+libcall_sparse(struct function *func, value_t *v_type, void **result)
+{
+	gsl_vector_view one[3];
+	gsl_vector *ijv[3];
+	struct spmatrix *sp;
+	int i;
+
+	return_val_if_fail(func != NULL, FALSE);
+
+	for (i = 0; i < 3; i++) {
+		ijv[i] = vector_arg(func->args[i], &one[i]);
+
+		if (ijv[i] == NULL) {
+			err_msg("error: i, j and v of `sparse()' must be vectors");
+			return FALSE;
+		}
+	}
+
+	if (func->args[3]->v_type != VALUE_TYPE_DIGIT ||
+	    func->args[4]->v_type != VALUE_TYPE_DIGIT ||
+	    func->args[3]->digit < 0 || func->args[4]->digit < 0) {
+		err_msg("error: sizes in the `sparse()' must be the digits");
+		return FALSE;
+	}
+
+	sp = spmatrix_from_triplets(func->args[3]->digit, func->args[4]->digit,
+						ijv[0], ijv[1], ijv[2]);
+
+	if (sp == NULL)
+		return FALSE;
+
+	*v_type = VALUE_TYPE_SPMATRIX;
+	*result = sp;
+
+	return TRUE;
+}
+
+int
+libcall_full(struct function *func, value_t *v_type, void **result)
+{
+	struct symbol *arg;
+	gsl_matrix *mx;
+
+	return_val_if_fail(func != NULL, FALSE);
+
+	arg = func->args[0];
+
+	switch(arg->v_type) {
+	case VALUE_TYPE_SPMATRIX:
+		mx = spmatrix_to_dense(arg->spmatrix);
+		break;
+	case VALUE_TYPE_MATRIX:
+		mx = pool_matrix_alloc(arg->matrix->size1, arg->matrix->size2);
+		gsl_matrix_memcpy(mx, arg->matrix);
+		break;
+	default:
+		err_msg("error: incompatible argument type");
+		return FALSE;
+	}
+
+	*v_type = VALUE_TYPE_MATRIX;
+	*result = mx;
+
+	return TRUE;
+}
+
+int
+libcall_nnz(struct function *func, value_t *v_type, void **result)
+{
+	struct symbol *arg;
+	size_t i, j, n;
+
+	return_val_if_fail(func != NULL, FALSE);
+
+	arg = func->args[0];
+
+	switch(arg->v_type) {
+	case VALUE_TYPE_SPMATRIX:
+		n = arg->spmatrix->nnz;
+		break;
+	case VALUE_TYPE_MATRIX:
+		for (n = 0, i = 0; i < arg->matrix->size1; i++)
+			for (j = 0; j < arg->matrix->size2; j++)
+				n += (gsl_matrix_get(arg->matrix, i, j) != 0.0);
+		break;
+	default:
+		err_msg("error: incompatible argument type");
+		return FALSE;
+	}
+
+	DIGIT(result) = n;
+
+	*v_type = VALUE_TYPE_DIGIT;
+
+	return TRUE;
+}
+
+int
+libcall_memstat(struct function *func, value_t *v_type, void **result)
+{
+	return_val_if_fail(func != NULL, FALSE);
+
+	umalloc_report();
+	DIGIT(result) = umem_used();
+
+	*v_type = VALUE_TYPE_DIGIT;
 
-	*v_type = VALUE_TYPE_DIGIT;	
-	*result = dg;
-	
 	return TRUE;
 }
@@ -27,4 +27,33 @@ libcall_vector(struct function *func, value_t *v_type, void **result);
 int
 libcall_sqrt(struct function *func, value_t *v_type, void **result);
 
+int
+libcall_sum(struct function *func, value_t *v_type, void **result);
+
+int
+libcall_norm(struct function *func, value_t *v_type, void **result);
+
+/* expm(a), logm(a), powm(a, p) of square matrices, see libm.h */
+int
+libcall_expm(struct function *func, value_t *v_type, void **result);
+
+int
+libcall_logm(struct function *func, value_t *v_type, void **result);
+
+int
+libcall_powm(struct function *func, value_t *v_type, void **result);
+
+/* sparse(i, j, v, rows, cols), full(s), nnz(s), see spmatrix.h */
+int
+libcall_sparse(struct function *func, value_t *v_type, void **result);
+
+int
+libcall_full(struct function *func, value_t *v_type, void **result);
+
+int
+libcall_nnz(struct function *func, value_t *v_type, void **result);
+
+int
+libcall_memstat(struct function *func, value_t *v_type, void **result);
+
 #endif /* LIBCALL_H_ */ 
@@ -1,12 +1,22 @@
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <float.h>
+#include <limits.h>
+#include <pthread.h>
 
 #include <gsl/gsl_linalg.h>
+#include <gsl/gsl_eigen.h>
 
 #include "libm.h"
+#include "blas.h"
 #include "misc.h"
 #include "macros.h"
 #include "umalloc.h"
+#include "pool.h"
+#include "tpool.h"
+#include "spmatrix.h"
 
 #define err_msg_ret(ret, fmt, arg...) \
 do { \
@@ -86,7 +96,7 @@ matrix_and(gsl_matrix *a, gsl_matrix *b)
 			y  = gsl_matrix_get(b, i, j);
 			dg = x && y;
 			if (dg == 0.0)
-				break; 
+				return dg;
 		}
 	}
 
@@ -105,7 +115,7 @@ matrix_or(gsl_matrix *a, gsl_matrix *b)
 			y  = gsl_matrix_get(b, i, j);
 			dg = x || y;
 			if (dg == 1.0)
-				break;
+				return dg;
 		}
 	}
 	return dg;
@@ -127,7 +137,7 @@ vector_init(gsl_vector **dest, gsl_vector *src)
 {
 	gsl_vector *vc;
 
-	vc = gsl_vector_alloc(src->size);
+	vc = pool_vector_alloc(src->size);
 
 	gsl_vector_memcpy(vc, src);
 	
@@ -139,16 +149,534 @@ matrix_init(gsl_matrix **dest, gsl_matrix *src)
 {
 	gsl_matrix *mx;
 
-	mx = gsl_matrix_alloc(src->size1, src->size2);
+	mx = pool_matrix_alloc(src->size1, src->size2);
 
 	gsl_matrix_memcpy(mx, src);
 	
 	*dest = mx;
 }
 
+/*
+ * Unrolled kernels for values with inline storage (see pool.h): at these
+ * sizes a BLAS call costs more than the arithmetic.  Larger operands go
+ * to GSL as before.
+ */
+#define VECTOR_SMALL(vc)	((vc)->size <= POOL_SMALL_VECTOR)
+#define MATRIX_SMALL(mx)	((mx)->size1 <= POOL_SMALL_MATRIX && \
+				 (mx)->size2 <= POOL_SMALL_MATRIX)
+
+/* y += alpha * x, n <= 16: a 4x4 matrix is done in two halves */
+static void
+small_axpy(double *y, const double *x, double alpha, size_t n)
+{
+	if (n > 8) {
+		small_axpy(y + 8, x + 8, alpha, n - 8);
+		n = 8;
+	}
+
+	switch(n) {
+	case 8: y[7] += alpha * x[7];
+	case 7: y[6] += alpha * x[6];
+	case 6: y[5] += alpha * x[5];
+	case 5: y[4] += alpha * x[4];
+	case 4: y[3] += alpha * x[3];
+	case 3: y[2] += alpha * x[2];
+	case 2: y[1] += alpha * x[1];
+	case 1: y[0] += alpha * x[0];
+	}
+}
+
+static void
+small_scale(double *y, double alpha, size_t n)
+{
+	if (n > 8) {
+		small_scale(y + 8, alpha, n - 8);
+		n = 8;
+	}
+
+	switch(n) {
+	case 8: y[7] *= alpha;
+	case 7: y[6] *= alpha;
+	case 6: y[5] *= alpha;
+	case 5: y[4] *= alpha;
+	case 4: y[3] *= alpha;
+	case 3: y[2] *= alpha;
+	case 2: y[1] *= alpha;
+	case 1: y[0] *= alpha;
+	}
+}
+
+static double
+small_dot(const double *x, const double *y, size_t n)
+{
+	double s = 0.0;
+
+	switch(n) {
+	case 8: s += x[7] * y[7];
+	case 7: s += x[6] * y[6];
+	case 6: s += x[5] * y[5];
+	case 5: s += x[4] * y[4];
+	case 4: s += x[3] * y[3];
+	case 3: s += x[2] * y[2];
+	case 2: s += x[1] * y[1];
+	case 1: s += x[0] * y[0];
+	}
+
+	return s;
+}
+
+/* c = a * b, all row-major with tda == size2 */
+static void
+small_gemm(const gsl_matrix *a, const gsl_matrix *b, gsl_matrix *c)
+{
+	double s;
+	size_t i, j, k;
+
+#pragma GCC unroll 4
+	for (i = 0; i < a->size1; i++) {
+#pragma GCC unroll 4
+		for (j = 0; j < b->size2; j++) {
+			s = 0.0;
+#pragma GCC unroll 4
+			for (k = 0; k < a->size2; k++)
+				s += a->data[i * a->tda + k] * b->data[k * b->tda + j];
+			c->data[i * c->tda + j] = s;
+		}
+	}
+}
+
+static void
+vector_axpy(gsl_vector *y, gsl_vector *x, double alpha)
+{
+	if (VECTOR_SMALL(y)) {
+		small_axpy(y->data, x->data, alpha, y->size);
+		return;
+	}
+
+	if (alpha > 0)
+		gsl_vector_add(y, x);
+	else
+		gsl_vector_sub(y, x);
+}
+
+static void
+vector_scale(gsl_vector *vc, double alpha)
+{
+	if (VECTOR_SMALL(vc))
+		small_scale(vc->data, alpha, vc->size);
+	else
+		gsl_vector_scale(vc, alpha);
+}
+
+static double
+vector_dot(gsl_vector *a, gsl_vector *b)
+{
+	if (VECTOR_SMALL(a))
+		return small_dot(a->data, b->data, a->size);
+
+	return blas_ddot(a, b);
+}
+
+static void
+matrix_axpy(gsl_matrix *y, gsl_matrix *x, double alpha)
+{
+	if (MATRIX_SMALL(y)) {
+		small_axpy(y->data, x->data, alpha, y->size1 * y->size2);
+		return;
+	}
+
+	if (alpha > 0)
+		gsl_matrix_add(y, x);
+	else
+		gsl_matrix_sub(y, x);
+}
+
+static void
+matrix_scale(gsl_matrix *mx, double alpha)
+{
+	if (MATRIX_SMALL(mx)) {
+		small_scale(mx->data, alpha, mx->size1 * mx->size2);
+		return;
+	}
+
+	gsl_matrix_scale(mx, alpha);
+}
+
+static int
+matrix_mult(gsl_matrix *a, gsl_matrix *b, gsl_matrix *c)
+{
+	if (MATRIX_SMALL(a) && MATRIX_SMALL(b) && a->size2 == b->size1 &&
+	    c->size1 == a->size1 && c->size2 == b->size2) {
+		small_gemm(a, b, c);
+		return 0;
+	}
+
+	return blas_dgemm(a, b, c);
+}
+
+/*
+ * Division solves rather than inverts: a copy of b is factorized into
+ * P b = L U, then the right-hand sides are permuted and go through the
+ * two triangular solves all together.  The copy comes from the pool,
+ * which recycles it.
+ *
+ * A divisor held by a variable keeps its factors in a struct libm_lu for
+ * the next division, until the version of the variable changes.  Threads
+ * of a parfor may divide by the same variable at once: the factors are
+ * only read once published, a stale entry is replaced by a fresh one in
+ * a single exchange.  Another worker may still be reading the entry it
+ * displaced, so that one is kept on the retired list of the new entry
+ * until a division or a change of the variable outside a loop frees it.
+ */
+struct libm_lu {
+	unsigned int		version;
+	gsl_matrix		*lu;
+	gsl_permutation		*perm;
+	struct libm_lu		*retired;
+};
+
+static void
+lu_free_retired(struct libm_lu *f)
+{
+	struct libm_lu *next;
+
+	for (; f != NULL; f = next) {
+		next = f->retired;
+
+		pool_matrix_free(f->lu);
+		gsl_permutation_free(f->perm);
+		ufree(f);
+	}
+}
+
+void
+libm_lu_free(struct libm_lu **lu)
+{
+	return_if_fail(lu != NULL);
+
+	lu_free_retired(*lu);
+
+	(*lu) = NULL;
+}
+
+/* NULL if b is singular */
+static struct libm_lu*
+lu_factor(gsl_matrix *b, unsigned int version)
+{
+	struct libm_lu *f;
+	size_t i;
+	int signum;
+
+	f = umalloc0(sizeof(*f));
+
+	f->version = version;
+	f->perm    = gsl_permutation_alloc(b->size1);
+
+	matrix_init(&f->lu, b);
+
+	gsl_linalg_LU_decomp(f->lu, f->perm, &signum);
+
+	for (i = 0; i < f->lu->size1; i++)
+		if (gsl_matrix_get(f->lu, i, i) == 0.0) {
+			libm_lu_free(&f);
+			return NULL;
+		}
+
+	return f;
+}
+
+/* x = b \ a for the n rows of a, lda apart, with the factors of b */
+static void
+lu_apply(struct libm_lu *f, const double *a, size_t lda, gsl_matrix *x)
+{
+	size_t i, j;
+
+	/* row i of P a is row p[i] of a */
+	for (i = 0; i < x->size1; i++)
+		for (j = 0; j < x->size2; j++)
+			x->data[i * x->tda + j] = a[f->perm->data[i] * lda + j];
+
+	blas_dtrsm(CblasLower, CblasUnit, f->lu, x);
+	blas_dtrsm(CblasUpper, CblasNonUnit, f->lu, x);
+}
+
+/*
+ * As lu_apply(), factorizing b unless cache holds its factors for
+ * version; FALSE if b is singular.  Without a cache the factors are
+ * dropped afterwards.
+ */
+static int
+lu_solve(gsl_matrix *b, struct libm_lu **cache, unsigned int version,
+			const double *a, size_t lda, gsl_matrix *x)
+{
+	struct libm_lu *f, *old;
+
+	if (cache != NULL) {
+		f = __atomic_load_n(cache, __ATOMIC_ACQUIRE);
+
+		if (f != NULL && f->version == version) {
+			if (f->retired != NULL && !tpool_in_loop()) {
+				lu_free_retired(f->retired);
+				f->retired = NULL;
+			}
+
+			lu_apply(f, a, lda, x);
+			return TRUE;
+		}
+	}
+
+	f = lu_factor(b, version);
+
+	if (f == NULL)
+		err_msg_ret(FALSE, "error: matrix is singular");
+
+	lu_apply(f, a, lda, x);
+
+	if (cache == NULL) {
+		libm_lu_free(&f);
+		return TRUE;
+	}
+
+	old = __atomic_load_n(cache, __ATOMIC_ACQUIRE);
+
+	/* another thread got there first */
+	if (old != NULL && old->version == version) {
+		libm_lu_free(&f);
+		return TRUE;
+	}
+
+	/* the factors outlive the statement */
+	pool_keep_matrix(f->lu);
+
+	f->retired = old;
+
+	if (!__atomic_compare_exchange_n(cache, &old, f, FALSE,
+				__ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE)) {
+		f->retired = NULL;
+		libm_lu_free(&f);
+	} else if (!tpool_in_loop()) {
+		lu_free_retired(f->retired);
+		f->retired = NULL;
+	}
+
+	return TRUE;
+}
+
+/*
+ * Element-wise operations on large operands, split over the thread pool.
+ * A worker writes the result straight from the operands, no copy first,
+ * and [0, n) is split into one contiguous share per worker, so the pages
+ * of a new result are first touched - and placed - by the worker that
+ * goes on using them.  Every element is computed as on one thread.
+ */
+#define PAR_GRAIN	(16 * 1024)
+
+struct par_op {
+	opcode_type_t	op;
+	double		*y;
+	const double	*a;		/* NULL: da for every element */
+	const double	*b;
+	double		da;
+	double		db;
+	int		decided;	/* AND, OR: some element settled it */
+};
+
+#define PAR_LOOP(expr) \
+do { \
+	if (p->a != NULL && p->b != NULL) \
+		for (i = lo; i < hi; i++) { x = a[i]; z = b[i]; y[i] = (expr); } \
+	else if (p->a != NULL) \
+		for (i = lo; i < hi; i++) { x = a[i]; z = db; y[i] = (expr); } \
+	else \
+		for (i = lo; i < hi; i++) { x = da; z = b[i]; y[i] = (expr); } \
+} while (0)
+
+static void
+par_logic(struct par_op *p, long lo, long hi)
+{
+	double x, z;
+	long i;
+
+	for (i = lo; i < hi; i++) {
+		x = p->a ? p->a[i] : p->da;
+		z = p->b ? p->b[i] : p->db;
+
+		if ((p->op == OPCODE_AND) ? !(x && z) : (x || z)) {
+			__atomic_store_n(&p->decided, TRUE, __ATOMIC_RELAXED);
+			break;
+		}
+	}
+}
+
+static void
+par_chunk(void *arg, int worker, long lo, long hi)
+{
+	struct par_op *p = arg;
+	const double *a, *b;
+	double *y, da, db, x, z;
+	long i;
+
+	a  = p->a;
+	b  = p->b;
+	y  = p->y;
+	da = p->da;
+	db = p->db;
+
+	switch(p->op) {
+	case OPCODE_ADD:
+		PAR_LOOP(x + z);
+		break;
+	case OPCODE_SUB:
+		PAR_LOOP(x - z);
+		break;
+	case OPCODE_MULT:
+		PAR_LOOP(x * z);
+		break;
+	case OPCODE_LT:
+		PAR_LOOP(x < z);
+		break;
+	case OPCODE_LE:
+		PAR_LOOP(x <= z);
+		break;
+	case OPCODE_GT:
+		PAR_LOOP(x > z);
+		break;
+	case OPCODE_GE:
+		PAR_LOOP(x >= z);
+		break;
+	case OPCODE_EQ:
+		PAR_LOOP(x == z);
+		break;
+	case OPCODE_NE:
+		PAR_LOOP(x != z);
+		break;
+	case OPCODE_AND:
+	case OPCODE_OR:
+		if (!__atomic_load_n(&p->decided, __ATOMIC_RELAXED))
+			par_logic(p, lo, hi);
+		break;
+	default:
+		SHOULDNT_REACH();
+	}
+}
+
+static void
+par_run(struct par_op *p, size_t n)
+{
+	tpool_run(n, PAR_GRAIN, par_chunk, p);
+}
+
+/* large, and one run of doubles: even on one thread it saves the copy */
+static int
+par_vector(gsl_vector *vc)
+{
+	return vc->size >= tpool_min_size() && vc->stride == 1;
+}
+
+static int
+par_matrix(gsl_matrix *mx)
+{
+	return mx->size1 * mx->size2 >= tpool_min_size() &&
+						mx->tda == mx->size2;
+}
+
+/* *dest = a op b, a NULL vector stands for the digit next to it */
+static int
+par_vector_op(gsl_vector **dest, gsl_vector *a, double da, gsl_vector *b,
+					double db, opcode_type_t op)
+{
+	struct par_op p = { op, NULL, NULL, NULL, da, db, FALSE };
+	gsl_vector *vc;
+
+	vc = a ? a : b;
+
+	if (!par_vector(vc) || (a && b && !par_vector(b)))
+		return FALSE;
+
+	*dest = pool_vector_alloc(vc->size);
+
+	p.y = (*dest)->data;
+	p.a = a ? a->data : NULL;
+	p.b = b ? b->data : NULL;
+
+	par_run(&p, vc->size);
+
+	return TRUE;
+}
+
+static int
+par_matrix_op(gsl_matrix **dest, gsl_matrix *a, double da, gsl_matrix *b,
+					double db, opcode_type_t op)
+{
+	struct par_op p = { op, NULL, NULL, NULL, da, db, FALSE };
+	gsl_matrix *mx;
+
+	mx = a ? a : b;
+
+	if (!par_matrix(mx) || (a && b && !par_matrix(b)))
+		return FALSE;
+
+	*dest = pool_matrix_alloc(mx->size1, mx->size2);
+
+	p.y = (*dest)->data;
+	p.a = a ? a->data : NULL;
+	p.b = b ? b->data : NULL;
+
+	par_run(&p, mx->size1 * mx->size2);
+
+	return TRUE;
+}
+
+/* AND: 0.0 if some element pair is false, OR: 1.0 if some is true */
+static double
+par_logic_result(struct par_op *p, size_t n)
+{
+	par_run(p, n);
+
+	if (p->op == OPCODE_AND)
+		return p->decided ? 0.0 : 1.0;
+
+	return p->decided ? 1.0 : 0.0;
+}
+
+static int
+par_vector_logic(double *dg, gsl_vector *a, double da, gsl_vector *b,
+							opcode_type_t op)
+{
+	struct par_op p = { op, NULL, NULL, NULL, da, 0.0, FALSE };
+
+	if (!par_vector(b) || (a && !par_vector(a)))
+		return FALSE;
+
+	p.a = a ? a->data : NULL;
+	p.b = b->data;
+
+	*dg = par_logic_result(&p, b->size);
+
+	return TRUE;
+}
+
+static int
+par_matrix_logic(double *dg, gsl_matrix *a, double da, gsl_matrix *b,
+							opcode_type_t op)
+{
+	struct par_op p = { op, NULL, NULL, NULL, da, 0.0, FALSE };
+
+	if (!par_matrix(b) || (a && !par_matrix(a)))
+		return FALSE;
+
+	p.a = a ? a->data : NULL;
+	p.b = b->data;
+
+	*dg = par_logic_result(&p, b->size1 * b->size2);
+
+	return TRUE;
+}
+
 double
 libm_digit_op(double a, double b, opcode_type_t op)
 {
+	unsigned int p;
 	int pow;
 	double dg;
 
@@ -163,9 +691,10 @@ libm_digit_op(double a, double b, opcode_type_t op)
 		dg = a * b;
 		break;
 	case OPCODE_DIV:
-		if (b == 0.0)
-			err_msg("division by zero");	
-		else 
+		if (b == 0.0) {
+			err_msg("division by zero");
+			dg = 0.0;
+		} else 
 			dg = a / b;
 		break;
 	case OPCODE_AND:
@@ -194,15 +723,19 @@ libm_digit_op(double a, double b, opcode_type_t op)
 		break;
 	case OPCODE_EXP:
 		pow = (int)b;
-		dg  = (pow & 0x1) ? a : 1.0;
-		pow >>= 1;
+		p   = (pow < 0) ? -(unsigned int)pow : (unsigned int)pow;
+		dg  = (p & 0x1) ? a : 1.0;
+		p >>= 1;
 	
-		while(pow) {
+		while(p) {
 			a *= a;
-			if (pow & 0x1) 
+			if (p & 0x1) 
 				dg = (dg == 1) ? a : a*dg;
-			pow >>= 1;
+			p >>= 1;
 		}		
+
+		if (pow < 0)
+			dg = 1.0 / dg;
 		break;
 	default:
 		error(1, "unknown operation");
@@ -218,6 +751,9 @@ libm_digit_vector_add_op(double a, gsl_vector *b, opcode_type_t op)
 	gsl_vector *vc;
 
 	return_val_if_fail(b != NULL, NULL);
+
+	if (par_vector_op(&vc, NULL, a, b, 0.0, op))
+		return vc;
 	
 	vector_init(&vc, b);
 
@@ -226,7 +762,7 @@ libm_digit_vector_add_op(double a, gsl_vector *b, opcode_type_t op)
 		gsl_vector_add_constant(vc, a);
 		break;
 	case OPCODE_SUB:
-		gsl_vector_scale(vc, -1.0);
+		vector_scale(vc, -1.0);
 		gsl_vector_add_constant(vc, a);
 		break;
 	default:
@@ -245,8 +781,10 @@ libm_digit_vector_mult_op(double a, gsl_vector *b, opcode_type_t op)
 	
 	switch(op) {
 	case OPCODE_MULT:
+		if (par_vector_op(&vc, NULL, a, b, 0.0, op))
+			break;
 		vector_init(&vc, b);		
-		gsl_vector_scale(vc, a);
+		vector_scale(vc, a);
 		break;
 	case OPCODE_DIV:
 		err_msg_ret(NULL, "nonconformant argument");
@@ -264,6 +802,9 @@ libm_digit_vector_logic_op(double a, gsl_vector *b, opcode_type_t op)
 	int i;
 
 	return_val_if_fail(b != NULL, -1.0);
+
+	if (par_vector_logic(&dg, NULL, a, b, op))
+		return dg;
 	
 	switch(op) {
 	case OPCODE_AND:
@@ -297,8 +838,11 @@ libm_digit_vector_rel_op(double a, gsl_vector *b, opcode_type_t op)
 	int i;
 
 	return_val_if_fail(b != NULL, NULL);
+
+	if (par_vector_op(&vc, NULL, a, b, 0.0, op))
+		return vc;
 	
-	vc = gsl_vector_alloc(b->size);
+	vc = pool_vector_alloc(b->size);
 	
 	switch(op) {
 	case OPCODE_LT:
@@ -308,7 +852,7 @@ libm_digit_vector_rel_op(double a, gsl_vector *b, opcode_type_t op)
 	case OPCODE_EQ:
 	case OPCODE_NE:
 		for (i = 0; i < vc->size; i++) {
-			x = gsl_vector_get(vc, i);
+			x = gsl_vector_get(b, i);
 			x = libm_digit_op(a, x, op);
 			gsl_vector_set(vc, i, x);
 		}
@@ -327,19 +871,25 @@ libm_vector_digit_mult_op(gsl_vector *a, double b, opcode_type_t op)
 	gsl_vector *vc;
 
 	return_val_if_fail(a != NULL, NULL);
+
+	/* divided through the reciprocal, as by vector_scale() */
+	if ((op == OPCODE_MULT || (op == OPCODE_DIV && b != 0.0)) &&
+	    par_vector_op(&vc, a, 0.0, NULL, (op == OPCODE_MULT) ? b : 1 / b,
+								OPCODE_MULT))
+		return vc;
 		
 	vector_init(&vc, a);
 	
 	switch(op) {
 	case OPCODE_MULT:
-		gsl_vector_scale(vc, b);
+		vector_scale(vc, b);
 		break;
 	case OPCODE_DIV:
 		if (b == 0.0) {	
-			gsl_vector_free(vc);
+			pool_vector_free(vc);
 			err_msg_ret(NULL, "division by zero");
 		} else {
-			gsl_vector_scale(vc, 1 / b);
+			vector_scale(vc, 1 / b);
 		}
 		break;
 	default:
@@ -356,6 +906,9 @@ libm_digit_matrix_add_op(double a, gsl_matrix *b, opcode_type_t op)
 	gsl_matrix *mx;
 
 	return_val_if_fail(b != NULL, NULL);
+
+	if (par_matrix_op(&mx, NULL, a, b, 0.0, op))
+		return mx;
 	
 	matrix_init(&mx, b);
 
@@ -364,7 +917,7 @@ libm_digit_matrix_add_op(double a, gsl_matrix *b, opcode_type_t op)
 		gsl_matrix_add_constant(mx, a);
 		break;
 	case OPCODE_SUB:
-		gsl_matrix_scale(mx, -1.0);
+		matrix_scale(mx, -1.0);
 		gsl_matrix_add_constant(mx, a);
 		break;
 	default:
@@ -383,8 +936,10 @@ libm_digit_matrix_mult_op(double a, gsl_matrix *b, opcode_type_t op)
 			
 	switch(op) {
 	case OPCODE_MULT:	
+		if (par_matrix_op(&mx, NULL, a, b, 0.0, op))
+			break;
 		matrix_init(&mx, b);
-		gsl_matrix_scale(mx, a);
+		matrix_scale(mx, a);
 		break;
 	case OPCODE_DIV:
 		err_msg_ret(NULL, "non conformant arguments");
@@ -402,6 +957,9 @@ libm_digit_matrix_logic_op(double a, gsl_matrix *b, opcode_type_t op)
 	int i, j;
 
 	return_val_if_fail(b != NULL, -1.0);
+
+	if (par_matrix_logic(&dg, NULL, a, b, op))
+		return dg;
 	
 	switch(op) {
 	case OPCODE_AND:
@@ -410,7 +968,7 @@ libm_digit_matrix_logic_op(double a, gsl_matrix *b, opcode_type_t op)
 				x  = gsl_matrix_get(b, i, j);
 				dg = libm_digit_op(a, x, op);
 				if (dg == 0.0)
-					break;
+					return dg;
 			}
 		}
 		break;		
@@ -420,7 +978,7 @@ libm_digit_matrix_logic_op(double a, gsl_matrix *b, opcode_type_t op)
 				x  = gsl_matrix_get(b, i, j);
 				dg = libm_digit_op(a, x, op);
 				if (dg == 1.0)
-					break;
+					return dg;
 			}
 		}
 		break;
@@ -439,6 +997,9 @@ libm_digit_matrix_rel_op(double a, gsl_matrix *b, opcode_type_t op)
 	int i, j;
 
 	return_val_if_fail(b != NULL, NULL);
+
+	if (par_matrix_op(&mx, NULL, a, b, 0.0, op))
+		return mx;
 	
 	matrix_init(&mx, b);
 	
@@ -471,19 +1032,24 @@ libm_matrix_digit_mult_op(gsl_matrix *a, double b, opcode_type_t op)
 	gsl_matrix *mx;
 
 	return_val_if_fail(a != NULL, NULL);
+
+	if ((op == OPCODE_MULT || (op == OPCODE_DIV && b != 0.0)) &&
+	    par_matrix_op(&mx, a, 0.0, NULL, (op == OPCODE_MULT) ? b : 1 / b,
+								OPCODE_MULT))
+		return mx;
 	
 	matrix_init(&mx, a);
 
 	switch(op) {
 	case OPCODE_MULT:
-		gsl_matrix_scale(mx, b);
+		matrix_scale(mx, b);
 		break;
 	case OPCODE_DIV:
 		if (b == 0.0) {
-			gsl_matrix_free(mx);
+			pool_matrix_free(mx);
 			err_msg_ret(NULL, "division by zero");
 		} else {
-			gsl_matrix_scale(mx, 1 / b);
+			matrix_scale(mx, 1 / b);
 		}
 		break;
 	default:
@@ -508,14 +1074,17 @@ libm_vector_add_op(gsl_vector *a, gsl_vector *b, opcode_type_t op)
 	if (!ok)
 		err_msg_ret(NULL, "error: nonconformant arguments");
 
+	if (par_vector_op(&vc, a, 0.0, b, 0.0, op))
+		return vc;
+
 	vector_init(&vc, a);
 
 	switch(op) {
 	case OPCODE_ADD:
-		gsl_vector_add(vc, b);
+		vector_axpy(vc, b, 1.0);
 		break;	
 	case OPCODE_SUB:
-		gsl_vector_sub(vc, b);
+		vector_axpy(vc, b, -1.0);
 		break;
 	default:
 		error(1, "nonconformant operation");
@@ -540,7 +1109,7 @@ libm_vector_mult_op(gsl_vector *a, gsl_vector *b, opcode_type_t op)
 
 	switch(op) {
 	case OPCODE_MULT:
-		gsl_blas_ddot(a, b, &dg);
+		dg = vector_dot(a, b);
 		break;
 	case OPCODE_DIV:
 		ok = gsl_vector_isnull(b);
@@ -552,8 +1121,8 @@ libm_vector_mult_op(gsl_vector *a, gsl_vector *b, opcode_type_t op)
 		 * x = a * b
 		 * y = b * b
 		 */
-		gsl_blas_ddot(a, b, &x);
-		gsl_blas_ddot(b, b, &y);
+		x  = vector_dot(a, b);
+		y  = vector_dot(b, b);
 		dg = x / y;
 		break;
 	default:
@@ -577,6 +1146,9 @@ libm_vector_logic_op(gsl_vector *a, gsl_vector *b, opcode_type_t op)
 	if (!ok)
 		err_msg_ret(-1.0, "nonconformant size");
 
+	if (par_vector_logic(&dg, a, 0.0, b, op))
+		return dg;
+
 	switch(op) {
 	case OPCODE_AND:
 		dg = vector_and(a, b);
@@ -606,7 +1178,10 @@ libm_vector_rel_op(gsl_vector *a, gsl_vector *b, opcode_type_t op)
 	if (!ok)
 		err_msg_ret(NULL, "nonconformant arguments");
 
-	vc = gsl_vector_alloc(a->size);
+	if (par_vector_op(&vc, a, 0.0, b, 0.0, op))
+		return vc;
+
+	vc = pool_vector_alloc(a->size);
 	
 	switch(op) {
 	case OPCODE_LT:
@@ -630,44 +1205,53 @@ libm_vector_rel_op(gsl_vector *a, gsl_vector *b, opcode_type_t op)
 }
 
 /* Vector op Matrix */
+gsl_vector*
+libm_vector_matrix_div(gsl_vector *a, gsl_matrix *b, struct libm_lu **lu,
+						unsigned int version)
+{
+	gsl_matrix_view x;
+	gsl_vector *vc;
+
+	return_val_if_fail(a != NULL, NULL);
+	return_val_if_fail(b != NULL, NULL);
+
+	if (!matrix_is_square(b))
+		err_msg_ret(NULL, "error: matrix is not square");
+
+	if (a->size != b->size1)
+		err_msg_ret(NULL, "error: nonconformant arguments");
+
+	vc = pool_vector_alloc(b->size1);
+	x  = gsl_matrix_view_vector(vc, vc->size, 1);
+
+	if (!lu_solve(b, lu, version, a->data, a->stride, &x.matrix)) {
+		pool_vector_free(vc);
+		return NULL;
+	}
+
+	return vc;
+}
+
 gsl_vector*
 libm_vector_matrix_mult_op(gsl_vector *a, gsl_matrix *b, opcode_type_t op)
 {
-	gsl_permutation *pm;
-	gsl_matrix *mx;
 	gsl_vector *vc;
-	int err, ok, signum;
+	int err;
 
 	return_val_if_fail(a != NULL, NULL);
 	return_val_if_fail(b != NULL, NULL);	
 	
 	switch(op) {	
 	case OPCODE_MULT:
-		vc  = gsl_vector_alloc(b->size1);
-		err = gsl_blas_dgemv(CblasTrans, 1.0, b, a, 0.0, vc);
+		vc  = pool_vector_alloc(b->size1);
+		err = blas_dgemv(CblasTrans, b, a, vc);
 		if (err) {
-			gsl_vector_free(vc);
+			pool_vector_free(vc);
 			return NULL;
 		}
 		break;
 	case OPCODE_DIV:
-		ok = matrix_is_square(b);
-		if (!ok) {
-			fprintf(stderr, "error: matrix is not square\n");
-			return NULL;	
-		}
-		
-		pm = gsl_permutation_alloc(b->size1);
-		vc = gsl_vector_alloc(b->size1);
-		
-		matrix_init(&mx, b);
-
-		gsl_linalg_LU_decomp(mx, pm, &signum);
-		gsl_linalg_LU_solve(mx, pm, a, vc);
-			
-		gsl_permutation_free(pm);
-		gsl_matrix_free(mx);		
-		 
+		vc = libm_vector_matrix_div(a, b, NULL, 0);
 		break;
 	default:
 		error(1, "nonconformant operation");
@@ -688,10 +1272,10 @@ libm_matrix_vector_mult_op(gsl_matrix *a, gsl_vector *b, opcode_type_t op)
 	
 	switch(op) {
 	case OPCODE_MULT:
-		vc  = gsl_vector_alloc(b->size);
-		err = gsl_blas_dgemv(CblasNoTrans, 1.0, a, b, 0.0, vc);
+		vc  = pool_vector_alloc(b->size);
+		err = blas_dgemv(CblasNoTrans, a, b, vc);
 		if (err) {
-			gsl_vector_free(vc);
+			pool_vector_free(vc);
 			return NULL;
 		}
 		break;
@@ -720,14 +1304,17 @@ libm_matrix_add_op(gsl_matrix *a, gsl_matrix *b, opcode_type_t op)
 	if (!ok)
 		err_msg_ret(NULL, "nonconformant matrix size");
 
+	if (par_matrix_op(&mx, a, 0.0, b, 0.0, op))
+		return mx;
+
 	matrix_init(&mx, a);
 
 	switch(op) {
 	case OPCODE_ADD:
-		gsl_matrix_add(mx, b);
+		matrix_axpy(mx, b, 1.0);
 		break;
-	case OPCODE_OR:
-		gsl_matrix_sub(mx, b);
+	case OPCODE_SUB:
+		matrix_axpy(mx, b, -1.0);
 		break;
 	default:
 		error(1, "nonconformant operation");
@@ -736,61 +1323,243 @@ libm_matrix_add_op(gsl_matrix *a, gsl_matrix *b, opcode_type_t op)
 	return mx;
 }
 
+/* b \ a, b is left as it was */
+gsl_matrix*
+libm_matrix_div(gsl_matrix *a, gsl_matrix *b, struct libm_lu **lu,
+						unsigned int version)
+{
+	gsl_matrix *mx;
+
+	return_val_if_fail(a != NULL, NULL);
+	return_val_if_fail(b != NULL, NULL);
+
+	if (!matrix_is_square(b))
+		err_msg_ret(NULL, "error: matrix is not square");
+
+	if (a->size1 != b->size1)
+		err_msg_ret(NULL, "error: nonconformant arguments");
+
+	mx = pool_matrix_alloc(b->size1, a->size2);
+
+	if (!lu_solve(b, lu, version, a->data, a->tda, mx)) {
+		pool_matrix_free(mx);
+		return NULL;
+	}
+
+	return mx;
+}
+
 gsl_matrix*
 libm_matrix_mult_op(gsl_matrix *a, gsl_matrix *b, opcode_type_t op)
 {
-	gsl_permutation *pm;
-	gsl_matrix *inv, *mx = NULL;
-	int ok, err, signum;
+	gsl_matrix *mx = NULL;
+	int err;
 
 	return_val_if_fail(a != NULL, NULL);
 	return_val_if_fail(b != NULL, NULL);
-	
-	mx = gsl_matrix_alloc(a->size1, b->size2);
 
 	switch(op) {
 	case OPCODE_MULT:	
-		err = gsl_blas_dgemm(CblasNoTrans, CblasNoTrans, 1.0,
-					 a, b, 0.0, mx);
+		mx  = pool_matrix_alloc(a->size1, b->size2);
+		err = matrix_mult(a, b, mx);
 		if (err) {
-			gsl_matrix_free(mx);
+			pool_matrix_free(mx);
 			return NULL;
 		}
 		break;
 	case OPCODE_DIV:
-		ok = matrix_is_square(b);
+		mx = libm_matrix_div(a, b, NULL, 0);
+		break;
+	default:
+		error(1, "nonconformant operation");
+	}	
+	
+	return mx;	
+}
 
-		if (!ok) {
-			fprintf(stderr, "error: matrix is not square\n");
-			return NULL;	
-		}
-			
-		pm = gsl_permutation_alloc(b->size1);
-			
-		inv = gsl_matrix_alloc(b->size1, b->size2);
+/*
+ * Sparse matrix ops, see spmatrix.h.  Only scaling keeps a matrix sparse,
+ * products and quotients with dense operands come out dense.
+ */
+struct spmatrix*
+libm_spmatrix_digit_mult_op(struct spmatrix *a, double b, opcode_type_t op)
+{
+	return_val_if_fail(a != NULL, NULL);
 
-		gsl_linalg_LU_decomp(b, pm, &signum);	
-		gsl_linalg_LU_invert(b, pm, inv);
-	
-		mx = gsl_matrix_alloc(b->size1, a->size2);
-		
-		err = gsl_blas_dgemm(CblasNoTrans, CblasNoTrans, 1.0,
-						inv, a, 0.0, mx);
-			
-		gsl_permutation_free(pm);
-		gsl_matrix_free(inv);
-			
-		if (err) {
-			gsl_matrix_free(mx);
+	switch(op) {
+	case OPCODE_MULT:
+		return spmatrix_scale(a, b);
+	case OPCODE_DIV:
+		return spmatrix_scale(a, 1.0 / b);
+	default:
+		error(1, "nonconformant operation");
+	}
+
+	return NULL;
+}
+
+struct spmatrix*
+libm_digit_spmatrix_mult_op(double a, struct spmatrix *b, opcode_type_t op)
+{
+	return_val_if_fail(b != NULL, NULL);
+
+	switch(op) {
+	case OPCODE_MULT:
+		return spmatrix_scale(b, a);
+	case OPCODE_DIV:
+		err_msg_ret(NULL, "non conformant arguments");
+	default:
+		error(1, "nonconformant operation");
+	}
+
+	return NULL;
+}
+
+gsl_vector*
+libm_spmatrix_vector_mult_op(struct spmatrix *a, gsl_vector *b,
+							opcode_type_t op)
+{
+	gsl_vector *vc;
+
+	return_val_if_fail(a != NULL, NULL);
+	return_val_if_fail(b != NULL, NULL);
+
+	switch(op) {
+	case OPCODE_MULT:
+		vc = pool_vector_alloc(a->size1);
+		if (!spmatrix_mult_vector(a, FALSE, b, vc)) {
+			pool_vector_free(vc);
 			return NULL;
 		}
-	
 		break;
+	case OPCODE_DIV:
+		err_msg_ret(NULL, "non conformant arguments");
 	default:
 		error(1, "nonconformant operation");
-	}	
-	
-	return mx;	
+	}
+
+	return vc;
+}
+
+/* a * b is b^T a as for dense b, a / b solves with the factors kept by b */
+gsl_vector*
+libm_vector_spmatrix_mult_op(gsl_vector *a, struct spmatrix *b,
+							opcode_type_t op)
+{
+	gsl_vector *vc;
+	int ok;
+
+	return_val_if_fail(a != NULL, NULL);
+	return_val_if_fail(b != NULL, NULL);
+
+	switch(op) {
+	case OPCODE_MULT:
+		vc = pool_vector_alloc(b->size2);
+		ok = spmatrix_mult_vector(b, TRUE, a, vc);
+		break;
+	case OPCODE_DIV:
+		vc = pool_vector_alloc(b->size2);
+		ok = spmatrix_solve_vector(b, a, vc);
+		break;
+	default:
+		error(1, "nonconformant operation");
+	}
+
+	if (!ok) {
+		pool_vector_free(vc);
+		return NULL;
+	}
+
+	return vc;
+}
+
+gsl_matrix*
+libm_spmatrix_matrix_mult_op(struct spmatrix *a, gsl_matrix *b,
+							opcode_type_t op)
+{
+	gsl_matrix *mx, *da;
+
+	return_val_if_fail(a != NULL, NULL);
+	return_val_if_fail(b != NULL, NULL);
+
+	switch(op) {
+	case OPCODE_MULT:
+		mx = pool_matrix_alloc(a->size1, b->size2);
+		if (!spmatrix_mult_dense(a, b, mx)) {
+			pool_matrix_free(mx);
+			return NULL;
+		}
+		break;
+	case OPCODE_DIV:
+		da = spmatrix_to_dense(a);
+		mx = libm_matrix_div(da, b, NULL, 0);
+		pool_matrix_free(da);
+		break;
+	default:
+		err_msg_ret(NULL, "error: nonconformant operation");
+	}
+
+	return mx;
+}
+
+gsl_matrix*
+libm_matrix_spmatrix_mult_op(gsl_matrix *a, struct spmatrix *b,
+							opcode_type_t op)
+{
+	gsl_matrix *mx;
+	int ok;
+
+	return_val_if_fail(a != NULL, NULL);
+	return_val_if_fail(b != NULL, NULL);
+
+	switch(op) {
+	case OPCODE_MULT:
+		mx = pool_matrix_alloc(a->size1, b->size2);
+		ok = spmatrix_dense_mult(a, b, mx);
+		break;
+	case OPCODE_DIV:
+		mx = pool_matrix_alloc(b->size2, a->size2);
+		ok = spmatrix_solve_dense(b, a, mx);
+		break;
+	default:
+		err_msg_ret(NULL, "error: nonconformant operation");
+	}
+
+	if (!ok) {
+		pool_matrix_free(mx);
+		return NULL;
+	}
+
+	return mx;
+}
+
+struct spmatrix*
+libm_spmatrix_mult_op(struct spmatrix *a, struct spmatrix *b, opcode_type_t op)
+{
+	return_val_if_fail(a != NULL, NULL);
+	return_val_if_fail(b != NULL, NULL);
+
+	if (op != OPCODE_MULT)
+		err_msg_ret(NULL, "error: nonconformant operation");
+
+	return spmatrix_mult(a, b);
+}
+
+/* the quotient is dense anyway, the left operand goes dense for it */
+gsl_matrix*
+libm_spmatrix_div(struct spmatrix *a, struct spmatrix *b)
+{
+	gsl_matrix *mx, *dx;
+
+	return_val_if_fail(a != NULL, NULL);
+	return_val_if_fail(b != NULL, NULL);
+
+	dx = spmatrix_to_dense(a);
+	mx = libm_matrix_spmatrix_mult_op(dx, b, OPCODE_DIV);
+
+	pool_matrix_free(dx);
+
+	return mx;
 }
 
 double
@@ -807,6 +1576,9 @@ libm_matrix_logic_op(gsl_matrix *a, gsl_matrix *b, opcode_type_t op)
 	if (!ok)
 		err_msg_ret(-1.0, "nonconformant size");
 
+	if (par_matrix_logic(&dg, a, 0.0, b, op))
+		return dg;
+
 	switch(op) {
 	case OPCODE_AND:
 		dg = matrix_and(a, b);
@@ -835,8 +1607,11 @@ libm_matrix_rel_op(gsl_matrix *a, gsl_matrix *b, opcode_type_t op)
 	
 	if (!ok)
 		return NULL;	
+
+	if (par_matrix_op(&mx, a, 0.0, b, 0.0, op))
+		return mx;
 	
-	mx = gsl_matrix_alloc(a->size1, a->size2);
+	mx = pool_matrix_alloc(a->size1, a->size2);
 
 	switch(op) {
 	case OPCODE_LT:
@@ -861,45 +1636,709 @@ libm_matrix_rel_op(gsl_matrix *a, gsl_matrix *b, opcode_type_t op)
 	return mx;
 }
 
-gsl_matrix*    
+/*
+ * Very large powers of a symmetric matrix are taken through its
+ * eigenvectors, a = V D V^T, in one decomposition and one product
+ * rather than a product per bit of the exponent.  BCLITE_POW_DIAG sets
+ * the smallest exponent that goes that way, 0 turns it off.
+ */
+#define POW_DIAG	(1L << 16)
+
+static long pow_diag;
+static pthread_once_t pow_diag_once = PTHREAD_ONCE_INIT;
+
+static void
+pow_diag_init(void)
+{
+	char *env;
+
+	env = getenv("BCLITE_POW_DIAG");
+
+	pow_diag = env ? atol(env) : POW_DIAG;
+}
+
+static int
+matrix_is_symmetric(gsl_matrix *mx)
+{
+	size_t i, j;
+
+	for (i = 0; i < mx->size1; i++)
+		for (j = 0; j < i; j++)
+			if (gsl_matrix_get(mx, i, j) != gsl_matrix_get(mx, j, i))
+				return FALSE;
+
+	return TRUE;
+}
+
+/* a^p = V D^p V^T for a symmetric a, NULL if p < 0 and a is singular */
+static gsl_matrix*
+matrix_pow_diag(gsl_matrix *a, int p)
+{
+	gsl_eigen_symmv_workspace *ws;
+	gsl_matrix *vd, *v, *mx;
+	gsl_vector *ev;
+	double d;
+	size_t i, j, n;
+
+	n = a->size1;
+
+	matrix_init(&vd, a);
+	v  = pool_matrix_alloc(n, n);
+	ev = pool_vector_alloc(n);
+	ws = gsl_eigen_symmv_alloc(n);
+
+	gsl_eigen_symmv(vd, ev, v, ws);
+	gsl_eigen_symmv_free(ws);
+
+	mx = NULL;
+
+	for (i = 0; i < n; i++)
+		if (p < 0 && gsl_vector_get(ev, i) == 0.0) {
+			message("error: matrix is singular");
+			goto out;
+		}
+
+	/* V D^p, then V^T in place of V */
+	for (j = 0; j < n; j++) {
+		d = pow(gsl_vector_get(ev, j), p);
+
+		for (i = 0; i < n; i++)
+			gsl_matrix_set(vd, i, j, gsl_matrix_get(v, i, j) * d);
+	}
+
+	gsl_matrix_transpose(v);
+
+	mx = pool_matrix_alloc(n, n);
+
+	if (matrix_mult(vd, v, mx)) {
+		pool_matrix_free(mx);
+		mx = NULL;
+	}
+out:
+	pool_matrix_free(vd);
+	pool_matrix_free(v);
+	pool_vector_free(ev);
+
+	return mx;
+}
+
+/* one of the three buffers that is neither x nor y, allocated on first use */
+static gsl_matrix*
+pow_spare(gsl_matrix **buf, size_t n, gsl_matrix *x, gsl_matrix *y)
+{
+	int i;
+
+	for (i = 0; i < 3; i++) {
+		if (buf[i] == NULL)
+			buf[i] = pool_matrix_alloc(n, n);
+
+		if (buf[i] != x && buf[i] != y)
+			return buf[i];
+	}
+
+	error(1, "no spare buffer");
+	return NULL;
+}
+
+/*
+ * Square and multiply over the bits of p.  The running square and the
+ * result are swapped by pointer between three buffers, each product goes
+ * to the one that holds neither.  The result starts out as the first
+ * square it needs, so the identity is never built nor multiplied.
+ */
+static gsl_matrix*
+matrix_pow(gsl_matrix *a, unsigned int p)
+{
+	gsl_matrix *buf[3] = { NULL, NULL, NULL };
+	gsl_matrix *sq, *res, *dst;
+	size_t n;
+	int i;
+
+	n   = a->size1;
+	sq  = a;
+	res = NULL;
+
+	for (;;) {
+		if (p & 0x1) {
+			if (res == NULL) {
+				res = sq;
+			} else {
+				dst = pow_spare(buf, n, res, sq);
+				if (matrix_mult(res, sq, dst))
+					goto fail;
+				res = dst;
+			}
+		}
+
+		p >>= 1;
+
+		if (p == 0)
+			break;
+
+		dst = pow_spare(buf, n, res, sq);
+		if (matrix_mult(sq, sq, dst))
+			goto fail;
+		sq = dst;
+	}
+
+	if (res == a)
+		matrix_init(&res, a);
+
+	for (i = 0; i < 3; i++)
+		if (buf[i] && buf[i] != res)
+			pool_matrix_free(buf[i]);
+
+	return res;
+fail:
+	for (i = 0; i < 3; i++)
+		if (buf[i])
+			pool_matrix_free(buf[i]);
+
+	return NULL;
+}
+
+/* a^-1 from the LU factors of a, NULL if a is singular */
+static gsl_matrix*
+matrix_inverse(gsl_matrix *a)
+{
+	struct libm_lu *f;
+	gsl_matrix *id, *mx;
+
+	f = lu_factor(a, 0);
+
+	if (f == NULL)
+		err_msg_ret(NULL, "error: matrix is singular");
+
+	id = pool_matrix_alloc(a->size1, a->size2);
+	mx = pool_matrix_alloc(a->size1, a->size2);
+
+	gsl_matrix_set_identity(id);
+
+	lu_apply(f, id->data, id->tda, mx);
+
+	pool_matrix_free(id);
+	libm_lu_free(&f);
+
+	return mx;
+}
+
+gsl_matrix*
 libm_matrix_exp(gsl_matrix *a, int pow)
 {
-	gsl_matrix *mx, *amx, *buf;
+	gsl_matrix *mx, *inv;
+	unsigned int p;
 	int ok;
 
 	return_val_if_fail(a != NULL, NULL);
-		
+
 	ok = matrix_is_square(a);
 
 	if (!ok)
 		err_msg_ret(NULL, "in this operation matrix"
 				  " must be square");
-	
-	matrix_init(&mx, a);
-	matrix_init(&amx, a);
-	
-	buf = gsl_matrix_alloc(a->size1, a->size2);
-	
-	(pow & 0x1) ? : gsl_matrix_set_identity(mx);
-		
-	pow >>= 1;
-	
-	while (pow) {
-		gsl_blas_dgemm(CblasNoTrans, CblasNoTrans, 1.0,
-					amx, amx, 0.0, buf);
-		matrix_init(&amx, buf);
 
-		if (pow & 0x1) {
-			gsl_blas_dgemm(CblasNoTrans, CblasNoTrans, 1.0,
-						amx, mx, 0.0, buf);
-			matrix_init(&mx, buf);
+	if (pow == 0) {
+		mx = pool_matrix_alloc(a->size1, a->size2);
+		gsl_matrix_set_identity(mx);
+		return mx;
+	}
+
+	pthread_once(&pow_diag_once, pow_diag_init);
+
+	/* -INT_MIN is no int */
+	p = (pow < 0) ? -(unsigned int)pow : (unsigned int)pow;
+
+	if (pow_diag > 0 && p >= pow_diag && matrix_is_symmetric(a))
+		return matrix_pow_diag(a, pow);
+
+	if (pow > 0)
+		return matrix_pow(a, p);
+
+	/* a^-p = (a^-1)^p */
+	inv = matrix_inverse(a);
+
+	if (inv == NULL || p == 1)
+		return inv;
+
+	mx = matrix_pow(inv, p);
+
+	pool_matrix_free(inv);
+
+	return mx;
+}
+
+/*
+ * Matrix functions: expm by scaling and squaring over Pade approximants
+ * (Higham 2005), logm by inverse scaling and squaring, taking square
+ * roots with the product form of the Denman-Beavers iteration until a
+ * Pade approximant of log(I + E) is accurate, and real powers through
+ * both.  The n x n intermediates live in a workspace kept by each thread
+ * for the next call of the same size; one larger than MFUN_KEEP elements
+ * a buffer goes back to the pool afterwards.
+ */
+#define MFUN_BUFS	8
+#define MFUN_KEEP	(256 * 256)
+
+/* workspace buffers, by their use */
+enum {
+	WS_A,		/* expm: a scaled	logm: the square roots */
+	WS_A2,		/* expm: powers of a	logm: M of the iteration */
+	WS_A4,		/*			logm: M^-1 */
+	WS_A6,		/*			logm: Y of the iteration */
+	WS_A8,
+	WS_U,
+	WS_V,
+	WS_T		/* products and partial sums */
+};
+
+static __thread struct {
+	size_t		n;
+	gsl_matrix	*mx[MFUN_BUFS];
+} mfun_ws;
+
+static void
+mfun_ws_release(void)
+{
+	int i;
+
+	for (i = 0; i < MFUN_BUFS; i++)
+		if (mfun_ws.mx[i]) {
+			pool_matrix_free(mfun_ws.mx[i]);
+			mfun_ws.mx[i] = NULL;
 		}
 
-		pow >>= 1;
+	mfun_ws.n = 0;
+}
+
+static gsl_matrix*
+mfun_ws_get(int i, size_t n)
+{
+	if (mfun_ws.n != n) {
+		mfun_ws_release();
+		mfun_ws.n = n;
 	}
-	
-	gsl_matrix_free(amx);
-	gsl_matrix_free(buf);
-	
+
+	if (mfun_ws.mx[i] == NULL) {
+		mfun_ws.mx[i] = pool_matrix_alloc(n, n);
+		pool_keep_matrix(mfun_ws.mx[i]);
+	}
+
+	return mfun_ws.mx[i];
+}
+
+/* trade a buffer of the workspace for mx, which must be n x n */
+static void
+mfun_ws_swap(int i, gsl_matrix **mx)
+{
+	gsl_matrix *tmp;
+
+	tmp = mfun_ws.mx[i];
+	mfun_ws.mx[i] = *mx;
+	*mx = tmp;
+
+	pool_keep_matrix(mfun_ws.mx[i]);
+	pool_temp_matrix(*mx);
+}
+
+void
+libm_workspace_release(void)
+{
+	mfun_ws_release();
+}
+
+static void
+mfun_ws_done(void)
+{
+	if (mfun_ws.n * mfun_ws.n > MFUN_KEEP)
+		mfun_ws_release();
+}
+
+static double
+matrix_norm1(gsl_matrix *mx)
+{
+	double s, max;
+	size_t i, j;
+
+	max = 0.0;
+
+	for (j = 0; j < mx->size2; j++) {
+		for (s = 0.0, i = 0; i < mx->size1; i++)
+			s += fabs(gsl_matrix_get(mx, i, j));
+
+		if (s > max)
+			max = s;
+	}
+
+	return max;
+}
+
+/* y = c0 I + sum of c[k] x[k] for k < nx; y may be one of x */
+static void
+matrix_lincomb(gsl_matrix *y, double c0, const double *c, gsl_matrix **x,
+								int nx)
+{
+	double s;
+	size_t i, j;
+	int k;
+
+	for (i = 0; i < y->size1; i++)
+		for (j = 0; j < y->size2; j++) {
+			s = (i == j) ? c0 : 0.0;
+
+			for (k = 0; k < nx; k++)
+				s += c[k] * gsl_matrix_get(x[k], i, j);
+
+			gsl_matrix_set(y, i, j, s);
+		}
+}
+
+/* x = b \ a through the LU factors of b, FALSE if b is singular */
+static int
+matrix_solve(gsl_matrix *b, gsl_matrix *a, gsl_matrix *x)
+{
+	struct libm_lu *f;
+
+	f = lu_factor(b, 0);
+
+	if (f == NULL)
+		return FALSE;
+
+	lu_apply(f, a->data, a->tda, x);
+
+	libm_lu_free(&f);
+
+	return TRUE;
+}
+
+/* Pade degrees with the largest 1-norm each is accurate for */
+static const struct {
+	int		m;
+	double		theta;
+	double		b[14];
+} pade[] = {
+	{ 3,  1.495585217958292e-2,
+	  { 120, 60, 12, 1 } },
+	{ 5,  2.539398330063230e-1,
+	  { 30240, 15120, 3360, 420, 30, 1 } },
+	{ 7,  9.504178996162932e-1,
+	  { 17297280, 8648640, 1995840, 277200, 25200, 1512, 56, 1 } },
+	{ 9,  2.097847961257068e0,
+	  { 17643225600., 8821612800., 2075673600, 302702400, 30270240,
+	    2162160, 110880, 3960, 90, 1 } },
+	{ 13, 5.371920351148152e0,
+	  { 64764752532480000., 32382376266240000., 7771770303897600.,
+	    1187353796428800., 129060195264000., 10559470521600.,
+	    670442572800., 33522128640., 1323241920, 40840800, 960960,
+	    16380, 182, 1 } },
+};
+
+#define PADE_N		(sizeof(pade) / sizeof(pade[0]))
+
+gsl_matrix*
+libm_matrix_expm(gsl_matrix *a)
+{
+	gsl_matrix *as, *p[4], *u, *v, *t, *mx;
+	const double *b;
+	double nrm, c[4] = { 0.0 };
+	size_t n;
+	int i, s, d;
+
+	return_val_if_fail(a != NULL, NULL);
+
+	if (!matrix_is_square(a))
+		err_msg_ret(NULL, "error: matrix is not square");
+
+	n   = a->size1;
+	nrm = matrix_norm1(a);
+
+	for (d = 0; d < PADE_N - 1; d++)
+		if (nrm <= pade[d].theta)
+			break;
+
+	/* a / 2^s within reach of the degree */
+	s = 0;
+
+	if (nrm > pade[d].theta)
+		s = (int)ceil(log2(nrm / pade[d].theta));
+
+	b  = pade[d].b;
+	as = mfun_ws_get(WS_A, n);
+	u  = mfun_ws_get(WS_U, n);
+	v  = mfun_ws_get(WS_V, n);
+	t  = mfun_ws_get(WS_T, n);
+
+	gsl_matrix_memcpy(as, a);
+
+	if (s > 0)
+		matrix_scale(as, ldexp(1.0, -s));
+
+	/* p[k] = as^(2k + 2) */
+	p[0] = mfun_ws_get(WS_A2, n);
+	matrix_mult(as, as, p[0]);
+
+	for (i = 1; i < 4 && 2 * i + 1 < pade[d].m && pade[d].m != 13; i++) {
+		p[i] = mfun_ws_get(WS_A2 + i, n);
+		matrix_mult(p[i - 1], p[0], p[i]);
+	}
+
+	if (pade[d].m == 13) {
+		p[1] = mfun_ws_get(WS_A4, n);
+		p[2] = mfun_ws_get(WS_A6, n);
+		matrix_mult(p[0], p[0], p[1]);
+		matrix_mult(p[1], p[0], p[2]);
+
+		/* u = as (a6 (b13 a6 + b11 a4 + b9 a2) + b7 a6 + ... + b1 I) */
+		c[0] = b[13], c[1] = b[11], c[2] = b[9];
+		matrix_lincomb(t, 0.0, c, (gsl_matrix *[]){ p[2], p[1], p[0] }, 3);
+		matrix_mult(p[2], t, v);
+		c[0] = 1.0, c[1] = b[7], c[2] = b[5], c[3] = b[3];
+		matrix_lincomb(t, b[1], c,
+			(gsl_matrix *[]){ v, p[2], p[1], p[0] }, 4);
+		matrix_mult(as, t, u);
+
+		/* v = a6 (b12 a6 + b10 a4 + b8 a2) + b6 a6 + ... + b0 I */
+		c[0] = b[12], c[1] = b[10], c[2] = b[8];
+		matrix_lincomb(t, 0.0, c, (gsl_matrix *[]){ p[2], p[1], p[0] }, 3);
+		matrix_mult(p[2], t, v);
+		c[0] = 1.0, c[1] = b[6], c[2] = b[4], c[3] = b[2];
+		matrix_lincomb(v, b[0], c,
+			(gsl_matrix *[]){ v, p[2], p[1], p[0] }, 4);
+	} else {
+		/* u = as (b1 I + b3 a2 + ...), v = b0 I + b2 a2 + ... */
+		for (i = 0; 2 * i + 3 <= pade[d].m; i++)
+			c[i] = b[2 * i + 3];
+		matrix_lincomb(t, b[1], c, p, i);
+		matrix_mult(as, t, u);
+
+		for (i = 0; 2 * i + 2 <= pade[d].m; i++)
+			c[i] = b[2 * i + 2];
+		matrix_lincomb(v, b[0], c, p, i);
+	}
+
+	/* (v - u) r = v + u */
+	gsl_matrix_memcpy(t, v);
+	gsl_matrix_sub(t, u);
+	gsl_matrix_add(v, u);
+
+	mx = pool_matrix_alloc(n, n);
+
+	if (!matrix_solve(t, v, mx)) {
+		pool_matrix_free(mx);
+		mfun_ws_done();
+		err_msg_ret(NULL, "error: matrix exponential failed");
+	}
+
+	/* undo the scaling, the result and t change places */
+	for (i = 0; i < s; i++) {
+		matrix_mult(mx, mx, t);
+		mfun_ws_swap(WS_T, &mx);
+		t = mfun_ws.mx[WS_T];
+	}
+
+	mfun_ws_done();
+
 	return mx;
-} 
+}
+
+#define SQRTM_MAX	64
+#define LOGM_MAX	64
+#define LOGM_THETA	0.25
+
+/* Gauss-Legendre nodes and weights on [0, 1] */
+static const double logm_node[] = {
+	0.0198550717512319, 0.1016667612931866, 0.2372337950418355,
+	0.4082826787521751, 0.5917173212478249, 0.7627662049581645,
+	0.8983332387068134, 0.9801449282487681
+};
+
+static const double logm_weight[] = {
+	0.0506142681451881, 0.1111905172266872, 0.1568533229389436,
+	0.1813418916891810, 0.1813418916891810, 0.1568533229389436,
+	0.1111905172266872, 0.0506142681451881
+};
+
+static double
+matrix_dist_identity(gsl_matrix *mx)
+{
+	double s, max;
+	size_t i, j;
+
+	max = 0.0;
+
+	for (j = 0; j < mx->size2; j++) {
+		for (s = 0.0, i = 0; i < mx->size1; i++)
+			s += fabs(gsl_matrix_get(mx, i, j) - (i == j));
+
+		if (s > max)
+			max = s;
+	}
+
+	return max;
+}
+
+/*
+ * x = x^1/2 by M = Y = x, Y = g Y (I + M^-1 / g^2) / 2 and
+ * M = (I + (g^2 M + M^-1 / g^2) / 2) / 2, where g = |det M|^(-1/2n)
+ * while M is far from I; FALSE if x is singular or the iteration does
+ * not settle, e.g. for eigenvalues on the negative real axis.
+ */
+static int
+matrix_sqrt(gsl_matrix *x)
+{
+	struct libm_lu *f;
+	gsl_matrix *m, *mi, *y, *t;
+	double d, prev, g, ldet;
+	size_t i, n;
+	int k;
+
+	n  = x->size1;
+	m  = mfun_ws_get(WS_A2, n);
+	mi = mfun_ws_get(WS_A4, n);
+	y  = mfun_ws_get(WS_A6, n);
+	t  = mfun_ws_get(WS_T, n);
+
+	gsl_matrix_memcpy(m, x);
+	gsl_matrix_memcpy(y, x);
+
+	prev = HUGE_VAL;
+
+	for (k = 0; k < SQRTM_MAX; k++) {
+		d = matrix_dist_identity(m);
+
+		/* converged, or down to rounding */
+		if (d <= n * DBL_EPSILON || (d < 1e-8 && d >= prev / 2)) {
+			gsl_matrix_memcpy(x, y);
+			return TRUE;
+		}
+
+		prev = d;
+
+		f = lu_factor(m, 0);
+
+		if (f == NULL)
+			return FALSE;
+
+		for (ldet = 0.0, i = 0; i < n; i++)
+			ldet += log(fabs(gsl_matrix_get(f->lu, i, i)));
+
+		gsl_matrix_set_identity(t);
+		lu_apply(f, t->data, t->tda, mi);
+		libm_lu_free(&f);
+
+		g = (d > 1e-2) ? exp(-ldet / (2.0 * n)) : 1.0;
+
+		/* x is free until the end, it takes the product */
+		matrix_lincomb(t, 0.5, (double []){ 0.5 / (g * g) }, &mi, 1);
+		matrix_mult(y, t, x);
+		matrix_scale(x, g);
+		gsl_matrix_memcpy(y, x);
+
+		matrix_lincomb(m, 0.5, (double []){ 0.25 * g * g, 0.25 / (g * g) },
+					(gsl_matrix *[]){ m, mi }, 2);
+	}
+
+	return FALSE;
+}
+
+gsl_matrix*
+libm_matrix_logm(gsl_matrix *a)
+{
+	gsl_matrix *x, *t, *e, *mx;
+	size_t n;
+	int j, k;
+
+	return_val_if_fail(a != NULL, NULL);
+
+	if (!matrix_is_square(a))
+		err_msg_ret(NULL, "error: matrix is not square");
+
+	n = a->size1;
+	x = mfun_ws_get(WS_A, n);
+
+	gsl_matrix_memcpy(x, a);
+
+	/* a^(1/2^k) close enough to I */
+	for (k = 0; matrix_dist_identity(x) > LOGM_THETA; k++)
+		if (k == LOGM_MAX || !matrix_sqrt(x)) {
+			mfun_ws_done();
+			err_msg_ret(NULL, "error: matrix has no real logarithm");
+		}
+
+	/* log(I + e) = sum of w e (I + t e)^-1 over the nodes t */
+	e = x;
+	for (j = 0; j < n; j++)
+		gsl_matrix_set(e, j, j, gsl_matrix_get(e, j, j) - 1.0);
+
+	t  = mfun_ws_get(WS_T, n);
+	mx = pool_matrix_calloc(n, n);
+
+	for (j = 0; j < sizeof(logm_node) / sizeof(logm_node[0]); j++) {
+		matrix_lincomb(t, 1.0, &logm_node[j], &e, 1);
+
+		if (!matrix_solve(t, e, mfun_ws_get(WS_U, n))) {
+			pool_matrix_free(mx);
+			mfun_ws_done();
+			err_msg_ret(NULL, "error: matrix has no real logarithm");
+		}
+
+		matrix_lincomb(mx, 0.0, (double []){ 1.0, logm_weight[j] },
+				(gsl_matrix *[]){ mx, mfun_ws.mx[WS_U] }, 2);
+	}
+
+	matrix_scale(mx, ldexp(1.0, k));
+
+	mfun_ws_done();
+
+	return mx;
+}
+
+/* a^p = a^q expm(f logm(a)) for p = q + f, q whole and 0 < f < 1 */
+gsl_matrix*
+libm_matrix_powm(gsl_matrix *a, double p)
+{
+	gsl_matrix *l, *e, *aq, *mx;
+	double q;
+
+	return_val_if_fail(a != NULL, NULL);
+
+	q = floor(p);
+
+	if (p == q && fabs(q) <= INT_MAX)
+		return libm_matrix_exp(a, (int)q);
+
+	if (fabs(q) > INT_MAX)
+		err_msg_ret(NULL, "error: power is out of range");
+
+	l = libm_matrix_logm(a);
+
+	if (l == NULL)
+		return NULL;
+
+	matrix_scale(l, p - q);
+
+	e = libm_matrix_expm(l);
+
+	pool_matrix_free(l);
+
+	if (e == NULL || q == 0)
+		return e;
+
+	aq = libm_matrix_exp(a, (int)q);
+
+	if (aq == NULL) {
+		pool_matrix_free(e);
+		return NULL;
+	}
+
+	mx = pool_matrix_alloc(a->size1, a->size2);
+
+	if (matrix_mult(aq, e, mx)) {
+		pool_matrix_free(mx);
+		mx = NULL;
+	}
+
+	pool_matrix_free(aq);
+	pool_matrix_free(e);
+
+	return mx;
+}
@@ -55,10 +55,24 @@ libm_vector_logic_op(gsl_vector *a, gsl_vector *b, opcode_type_t op);
 gsl_vector*
 libm_vector_rel_op(gsl_vector *a, gsl_vector *b, opcode_type_t op);
 
+/*
+ * LU factors of a divisor kept by a variable, see symbol.h; reused by
+ * the next division by the same matrix while version is unchanged.
+ */
+struct libm_lu;
+
+void
+libm_lu_free(struct libm_lu **lu);
+
 /* Vector op Matrix */
 gsl_vector*
 libm_vector_matrix_mult_op(gsl_vector *a, gsl_matrix *b, opcode_type_t op);
 
+/* a / b, i.e. b \ a; lu may be NULL, nothing is kept then */
+gsl_vector*
+libm_vector_matrix_div(gsl_vector *a, gsl_matrix *b, struct libm_lu **lu,
+						unsigned int version);
+
 /* Matrix op Vector */
 gsl_vector*
 libm_matrix_vector_mult_op(gsl_matrix *a, gsl_vector *b, opcode_type_t op);
@@ -70,6 +84,41 @@ libm_matrix_add_op(gsl_matrix *a, gsl_matrix *b, opcode_type_t op);
 gsl_matrix*
 libm_matrix_mult_op(gsl_matrix *a, gsl_matrix *b, opcode_type_t op);
 
+gsl_matrix*
+libm_matrix_div(gsl_matrix *a, gsl_matrix *b, struct libm_lu **lu,
+						unsigned int version);
+
+/* Sparse matrix op digit, Vector, Matrix or Sparse matrix */
+struct spmatrix;
+
+struct spmatrix*
+libm_spmatrix_digit_mult_op(struct spmatrix *a, double b, opcode_type_t op);
+
+struct spmatrix*
+libm_digit_spmatrix_mult_op(double a, struct spmatrix *b, opcode_type_t op);
+
+gsl_vector*
+libm_spmatrix_vector_mult_op(struct spmatrix *a, gsl_vector *b,
+							opcode_type_t op);
+
+gsl_vector*
+libm_vector_spmatrix_mult_op(gsl_vector *a, struct spmatrix *b,
+							opcode_type_t op);
+
+gsl_matrix*
+libm_spmatrix_matrix_mult_op(struct spmatrix *a, gsl_matrix *b,
+							opcode_type_t op);
+
+gsl_matrix*
+libm_matrix_spmatrix_mult_op(gsl_matrix *a, struct spmatrix *b,
+							opcode_type_t op);
+
+struct spmatrix*
+libm_spmatrix_mult_op(struct spmatrix *a, struct spmatrix *b, opcode_type_t op);
+
+gsl_matrix*
+libm_spmatrix_div(struct spmatrix *a, struct spmatrix *b);
+
 double
 libm_matrix_logic_op(gsl_matrix *a, gsl_matrix *b, opcode_type_t op);
 
@@ -79,4 +128,18 @@ libm_matrix_rel_op(gsl_matrix *a, gsl_matrix *b, opcode_type_t op);
 gsl_matrix*
 libm_matrix_exp(gsl_matrix *a, int dg);
 
+/* matrix exponential, principal logarithm and real power a^p */
+gsl_matrix*
+libm_matrix_expm(gsl_matrix *a);
+
+gsl_matrix*
+libm_matrix_logm(gsl_matrix *a);
+
+gsl_matrix*
+libm_matrix_powm(gsl_matrix *a, double p);
+
+/* free the buffers the matrix functions keep for the calling thread */
+void
+libm_workspace_release(void);
+
 #endif /* LIBM_H_ */
@@ -4,45 +4,58 @@
 #include "list.h"
 #include "macros.h"
 #include "umalloc.h"
-
-struct list_of_val *list;
+#include "context.h"
 
 void
-push(void *arg)
+push(struct bclite_ctx *ctx, void *arg)
 {
 	struct list_of_val *tmp;
 		
-	tmp = umalloc0(sizeof(*tmp));
+	tmp = uslab_alloc0(sizeof(*tmp));
 
 	tmp->val  = arg;
-	tmp->prev = list;
-	list      = tmp;	
+	tmp->prev = ctx->list;
+	ctx->list      = tmp;	
 }
 
 void*
-pop(void)
+pop(struct bclite_ctx *ctx)
 {
 	void *ret;
 	struct list_of_val *tmp;
 
-	return_val_if_fail(list != NULL, NULL);
+	return_val_if_fail(ctx->list != NULL, NULL);
 	
-	ret   = list->val;
-	tmp   = list;
-	list  = list->prev;
+	ret   = ctx->list->val;
+	tmp   = ctx->list;
+	ctx->list  = ctx->list->prev;
 	
-	ufree(tmp);
+	uslab_free(tmp, sizeof(*tmp));
 
 	return ret;	
 }
 
+/* n-th value from the top without removing it */
+void*
+peek(struct bclite_ctx *ctx, int n)
+{
+	struct list_of_val *tmp;
+
+	for (tmp = ctx->list; tmp != NULL && n > 0; n--)
+		tmp = tmp->prev;
+
+	return_val_if_fail(tmp != NULL, NULL);
+
+	return tmp->val;
+}
+
 void
-purge(void)
+purge(struct bclite_ctx *ctx)
 {
 	struct list_of_val *prev;
 	
-	for  (;list != NULL; list = prev) {
-		prev = list->prev;
-		ufree(list);
+	for  (;ctx->list != NULL; ctx->list = prev) {
+		prev = ctx->list->prev;
+		uslab_free(ctx->list, sizeof(*ctx->list));
 	}
 }
@@ -6,15 +6,18 @@ struct list_of_val {
 	void	*val;
 };
 
-extern struct list_of_val *list;
+struct bclite_ctx;
 
 void
-push(void *arg);
+push(struct bclite_ctx *ctx, void *arg);
 
 void*
-pop(void);
+pop(struct bclite_ctx *ctx);
+
+void*
+peek(struct bclite_ctx *ctx, int n);
 
 void
-purge(void);
+purge(struct bclite_ctx *ctx);
 
 #endif /*LIST_H_*/
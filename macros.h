@@ -13,6 +13,14 @@
 
 #define STREQ(s1, s2)	(strcmp(s1, s2) == 0)
 
+#ifndef MIN
+#define MIN(a, b)	((a) < (b) ? (a) : (b))
+#endif
+
+#ifndef MAX
+#define MAX(a, b)	((a) > (b) ? (a) : (b))
+#endif
+
 #define SHOULDNT_REACH() \
 do { \
 	fprintf(stderr, "file %s line %d %s(): should not reach this" CRLF, \
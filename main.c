@@ -1,13 +1,17 @@
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 
 #include "syntax.h"
 #include "traverse.h"
 #include "as_tree.h"
 #include "symbol.h"
-#include "keyword.h"
+#include "context.h"
 #include "function.h"
 #include "macros.h"
+#include "umalloc.h"
+#include "pool.h"
+#include "server.h"
 
 static char *prompt; /* `> ' or nothing */
 static FILE *input;  /* if no file is specified we read from stdin */
@@ -24,11 +28,11 @@ print_info(void)
 }
 
 static void
-parse_args(int argc, char **argv)
+parse_args(struct bclite_ctx *ctx, int argc, char **argv)
 {
 	if (argc < 2) {
 		input = stdin;
-		set_file(input);
+		set_file(ctx, input);
 		print_info();
 		prompt = "> ";
 	} else {
@@ -37,19 +41,19 @@ parse_args(int argc, char **argv)
 			fprintf(stderr, "error: cannot open the file %s\n", argv[1]);
 			return;
 		}
-		set_file(input);
+		set_file(ctx, input);
 		prompt = "";
 	}	
 }
 
 static void
-get_result(struct ast_node *tree, int errors)
+get_result(struct bclite_ctx *ctx, struct ast_node *tree, int errors)
 {
 	return_if_fail(tree != NULL);
 
 	if (!errors) {
-		traversal(tree);
-		traversal_print_result();
+		traversal_statement(ctx, tree);
+		traversal_print_result(ctx);
 	}
 	
 	ast_node_unref(tree);
@@ -64,46 +68,83 @@ close_stream(FILE *input)
 		fclose(input);
 }
 
+/* BCLITE_MEM_BUDGET=<bytes>[kKmMgG] */
 static void
-gsl_handler(const char *reason, const char *file, int line, int gsl_errno)
+set_mem_budget(void)
 {
-	switch(gsl_errno) {
-	case GSL_ENOMEM:
-		fprintf(stderr, "Reason: %s File: %s line: %d",
-			reason, file, line);		
-		exit(1);
+	unsigned long long bytes;
+	char *env, *end;
+
+	env = getenv("BCLITE_MEM_BUDGET");
+
+	if (env == NULL)
+		return;
+
+	bytes = strtoull(env, &end, 10);
+
+	switch(*end) {
+	case 'g': case 'G':
+		bytes <<= 10;
+	case 'm': case 'M':
+		bytes <<= 10;
+	case 'k': case 'K':
+		bytes <<= 10;
+		end++;
+	case '\0':
 		break;
 	default:
-		fprintf(stderr, "Reason: %s File: %s line: %d",
-			reason, file, line);
-		break;
+		fprintf(stderr, "error: bad BCLITE_MEM_BUDGET `%s'\n", env);
+		return;
+	}
+
+	if (*end != '\0') {
+		fprintf(stderr, "error: bad BCLITE_MEM_BUDGET `%s'\n", env);
+		return;
 	}
+
+	umem_set_budget(bytes);
+	/* free blocks kept by the pool are the first thing to give back */
+	umem_set_reclaim(pool_trim);
 }
 
 int
 main(int argc, char **argv)
 {
+	struct bclite_ctx *ctx;
 	struct ast_node *tree;
 	int eof, errors;
 							
-	symbol_table_create_global();
-	keyword_table_create();
-	function_table_create();
-	
-	/* set our handler*/
-	gsl_set_error_handler(gsl_handler);
-	parse_args(argc, argv);
+	set_mem_budget();
+
+	/* bclite -s <socket> [file.bc ...], see server.h */
+	if (argc > 2 && STREQ(argv[1], "-s"))
+		return server_run(argv[2], argv + 3, argc - 3) ? 1 : 0;
+
+	ctx = bclite_ctx_new();
+
+	parse_args(ctx, argc, argv);
 
 	do {	
 		fputs(prompt, stdout);
 
-		errors = programme(&tree, &eof);
+		errors = programme(ctx, &tree, &eof);
 		
-		get_result(tree, errors);
+		get_result(ctx, tree, errors);
 				
 	} while (!eof);
 	
 	close_stream(input);
+
+	bclite_ctx_destroy(&ctx);
+
+	if (getenv("BCLITE_SLAB_STATS") != NULL)
+		uslab_stats();
+
+	if (getenv("BCLITE_POOL_STATS") != NULL)
+		pool_stats();
+#ifdef UMALLOC_PROFILE
+	umalloc_report();
+#endif
 	
 	return 0;
 }
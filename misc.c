@@ -4,6 +4,27 @@
 #include <unistd.h>
 
 #include "macros.h"
+#include "misc.h"
+
+/* where messages go on this thread, stderr if not set */
+static __thread FILE *message_out;
+
+FILE*
+message_set_stream(FILE *stream)
+{
+	FILE *prev;
+
+	prev = message_out;
+	message_out = stream;
+
+	return prev;
+}
+
+FILE*
+message_stream(void)
+{
+	return message_out ? message_out : stderr;
+}
 
 void
 message(const char *fmt, ...)
@@ -21,7 +42,9 @@ message(const char *fmt, ...)
 	
 	n = vsnprintf(buf, sizeof(buf), fmtbuf, ap);
 	
-	if (n > 0)
+	if (n > 0 && message_out != NULL)
+		fwrite(buf, 1, n, message_out);
+	else if (n > 0)
 		write(STDERR_FILENO, buf, n);		
 	else {
 		SHOULDNT_REACH();
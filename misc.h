@@ -1,7 +1,16 @@
 #ifndef MISC_H_
 #define MISC_H_
 
+#include <stdio.h>
+
 void
-message(char *fmt, ...);
+message(const char *fmt, ...);
+
+/* redirect messages of the calling thread, NULL restores stderr */
+FILE*
+message_set_stream(FILE *stream);
+
+FILE*
+message_stream(void);
 
 #endif /*MISC_H_*/
@@ -0,0 +1,503 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+
+#include "pool.h"
+#include "macros.h"
+#include "umalloc.h"
+
+#define POOL_ALIGN	64
+#define POOL_MIN	8			/* doubles in the smallest class */
+#define POOL_CLASSES	(4 * 64)
+#define POOL_RETAIN	(64UL * 1024 * 1024)	/* bytes kept on free lists */
+
+/* a value on a list of temporaries, see pool_track() */
+struct pool_link {
+	struct pool_link	*prev;
+	struct pool_link	*next;
+	struct pool_temps	*temps;
+	void			*value;
+	int			matrix;
+};
+
+/*
+ * Size classes: everything up to POOL_MIN doubles shares class 0, above
+ * that every power of two is split into four linear steps, so a block
+ * wastes at most a quarter of its size.
+ */
+struct pool_block {
+	gsl_block		block;
+	struct pool_block	*next;
+	int			cls;
+	struct pool_link	link;
+#ifdef UMALLOC_PROFILE
+	struct umalloc_site	*site;
+	size_t			bytes;
+#endif
+};
+
+/* header, block and data of a small value in one slab object */
+struct pool_small_vector {
+	gsl_vector	vc;
+	gsl_block	block;
+	double		data[POOL_SMALL_VECTOR];
+	struct pool_link link;
+};
+
+struct pool_small_matrix {
+	gsl_matrix	mx;
+	gsl_block	block;
+	double		data[POOL_SMALL_MATRIX * POOL_SMALL_MATRIX];
+	struct pool_link link;
+};
+
+#define VECTOR_IS_SMALL(vc) \
+	((vc)->block == &((struct pool_small_vector *)(vc))->block)
+#define MATRIX_IS_SMALL(mx) \
+	((mx)->block == &((struct pool_small_matrix *)(mx))->block)
+
+#ifdef UMALLOC_PROFILE
+#define pool_small_alloc(size, file, line)	umalloc0_at(size, file, line)
+#else
+#define pool_small_alloc(size, file, line)	uslab_alloc0(size)
+#endif
+
+static struct {
+	pthread_mutex_t		lock;
+	struct pool_block	*free[POOL_CLASSES];
+	size_t			retained;
+	unsigned long		hits;
+	unsigned long		misses;
+	unsigned long		released;
+	unsigned long		small;
+} pool = {
+	.lock = PTHREAD_MUTEX_INITIALIZER
+};
+
+static __thread struct pool_temps *pool_temps;
+
+static struct pool_link*
+vector_link(gsl_vector *vc)
+{
+	if (VECTOR_IS_SMALL(vc))
+		return &((struct pool_small_vector *)vc)->link;
+
+	return &((struct pool_block *)vc->block)->link;
+}
+
+static struct pool_link*
+matrix_link(gsl_matrix *mx)
+{
+	if (MATRIX_IS_SMALL(mx))
+		return &((struct pool_small_matrix *)mx)->link;
+
+	return &((struct pool_block *)mx->block)->link;
+}
+
+static void
+link_add(struct pool_link *link, void *value, int matrix)
+{
+	link->value  = value;
+	link->matrix = matrix;
+	link->temps  = pool_temps;
+	link->prev   = NULL;
+
+	if (pool_temps == NULL)
+		return;
+
+	link->next = pool_temps->head;
+
+	if (link->next)
+		link->next->prev = link;
+
+	pool_temps->head = link;
+}
+
+static void
+link_del(struct pool_link *link)
+{
+	if (link->temps == NULL)
+		return;
+
+	if (link->prev)
+		link->prev->next = link->next;
+	else
+		link->temps->head = link->next;
+
+	if (link->next)
+		link->next->prev = link->prev;
+
+	link->temps = NULL;
+}
+
+static int
+pool_class(size_t n, size_t *cap)
+{
+	size_t p, quarter, sub;
+	int bit;
+
+	if (n <= POOL_MIN) {
+		*cap = POOL_MIN;
+		return 0;
+	}
+
+	bit = 63 - __builtin_clzl(n - 1);
+	p   = 1UL << bit;
+	quarter = p / 4;
+	sub = (n - p + quarter - 1) / quarter;
+
+	*cap = p + sub * quarter;
+
+	return (bit - 3) * 4 + sub;
+}
+
+static void
+pool_block_release(struct pool_block *pb)
+{
+	umem_uncharge(pb->block.size * sizeof(double));
+	free(pb->block.data);
+	uslab_free(pb, sizeof(*pb));
+}
+
+static gsl_block*
+pool_block_get(size_t n, const char *file, int line)
+{
+	struct pool_block *pb;
+	size_t cap;
+	void *data;
+	int cls;
+
+	cls = pool_class(n, &cap);
+
+	pthread_mutex_lock(&pool.lock);
+
+	pb = pool.free[cls];
+	
+	if (pb != NULL) {
+		pool.free[cls] = pb->next;
+		pool.retained -= cap * sizeof(double);
+		pool.hits++;
+		pthread_mutex_unlock(&pool.lock);
+		goto out;
+	}
+
+	pool.misses++;
+	pthread_mutex_unlock(&pool.lock);
+
+	umem_charge(cap * sizeof(double));
+
+	if (posix_memalign(&data, POOL_ALIGN, cap * sizeof(double)) != 0) {
+		umem_uncharge(cap * sizeof(double));
+		umem_fail(cap * sizeof(double));
+	}
+
+	pb = uslab_alloc0(sizeof(*pb));
+	
+	pb->block.size = cap;
+	pb->block.data = data;
+	pb->cls = cls;
+out:
+#ifdef UMALLOC_PROFILE
+	pb->site  = umalloc_site(file, line);
+	pb->bytes = n * sizeof(double);
+	umalloc_site_alloc(pb->site, pb->bytes);
+#endif
+	return &pb->block;
+}
+
+static void
+pool_block_put(gsl_block *block)
+{
+	struct pool_block *pb;
+	size_t bytes;
+
+	pb = (struct pool_block *)block;
+	bytes = pb->block.size * sizeof(double);
+
+#ifdef UMALLOC_PROFILE
+	umalloc_site_free(pb->site, pb->bytes);
+#endif
+
+	pthread_mutex_lock(&pool.lock);
+
+	if (pool.retained + bytes > POOL_RETAIN) {
+		pool.released++;
+		pthread_mutex_unlock(&pool.lock);
+		pool_block_release(pb);
+		return;
+	}
+
+	pb->next = pool.free[pb->cls];
+	pool.free[pb->cls] = pb;
+	pool.retained += bytes;
+
+	pthread_mutex_unlock(&pool.lock);
+}
+
+static gsl_vector*
+pool_small_vector(size_t n, const char *file, int line)
+{
+	struct pool_small_vector *sv;
+
+	sv = pool_small_alloc(sizeof(*sv), file, line);
+
+	sv->block.size = n;
+	sv->block.data = sv->data;
+
+	sv->vc.block  = &sv->block;
+	sv->vc.data   = sv->data;
+	sv->vc.size   = n;
+	sv->vc.stride = 1;
+
+	__atomic_add_fetch(&pool.small, 1, __ATOMIC_RELAXED);
+
+	return &sv->vc;
+}
+
+static gsl_matrix*
+pool_small_matrix(size_t n1, size_t n2, const char *file, int line)
+{
+	struct pool_small_matrix *sm;
+
+	sm = pool_small_alloc(sizeof(*sm), file, line);
+
+	sm->block.size = n1 * n2;
+	sm->block.data = sm->data;
+
+	sm->mx.block = &sm->block;
+	sm->mx.data  = sm->data;
+	sm->mx.size1 = n1;
+	sm->mx.size2 = n2;
+	sm->mx.tda   = n2;
+
+	__atomic_add_fetch(&pool.small, 1, __ATOMIC_RELAXED);
+
+	return &sm->mx;
+}
+
+gsl_vector*
+pool_vector_alloc_at(size_t n, const char *file, int line)
+{
+	gsl_vector *vc;
+
+	if (n != 0 && n <= POOL_SMALL_VECTOR) {
+		vc = pool_small_vector(n, file, line);
+		goto out;
+	}
+
+	vc = uslab_alloc0(sizeof(*vc));
+
+	vc->block  = pool_block_get(n, file, line);
+	vc->data   = vc->block->data;
+	vc->size   = n;
+	vc->stride = 1;
+	vc->owner  = 0;
+out:
+	link_add(vector_link(vc), vc, FALSE);
+
+	return vc;
+}
+
+gsl_vector*
+pool_vector_calloc_at(size_t n, const char *file, int line)
+{
+	gsl_vector *vc;
+
+	vc = pool_vector_alloc_at(n, file, line);
+
+	memset(vc->data, 0, n * sizeof(double));
+
+	return vc;
+}
+
+void
+pool_vector_free(gsl_vector *vc)
+{
+	return_if_fail(vc != NULL);
+
+	link_del(vector_link(vc));
+
+	if (VECTOR_IS_SMALL(vc)) {
+		uslab_free(vc, sizeof(struct pool_small_vector));
+		return;
+	}
+
+	pool_block_put(vc->block);
+	uslab_free(vc, sizeof(*vc));
+}
+
+gsl_matrix*
+pool_matrix_alloc_at(size_t n1, size_t n2, const char *file, int line)
+{
+	gsl_matrix *mx;
+
+	if (n1 != 0 && n2 != 0 && n1 <= POOL_SMALL_MATRIX && n2 <= POOL_SMALL_MATRIX) {
+		mx = pool_small_matrix(n1, n2, file, line);
+		goto out;
+	}
+
+	mx = uslab_alloc0(sizeof(*mx));
+
+	mx->block = pool_block_get(n1 * n2, file, line);
+	mx->data  = mx->block->data;
+	mx->size1 = n1;
+	mx->size2 = n2;
+	mx->tda   = n2;
+	mx->owner = 0;
+out:
+	link_add(matrix_link(mx), mx, TRUE);
+
+	return mx;
+}
+
+gsl_matrix*
+pool_matrix_calloc_at(size_t n1, size_t n2, const char *file, int line)
+{
+	gsl_matrix *mx;
+
+	mx = pool_matrix_alloc_at(n1, n2, file, line);
+
+	memset(mx->data, 0, n1 * n2 * sizeof(double));
+
+	return mx;
+}
+
+void
+pool_matrix_free(gsl_matrix *mx)
+{
+	return_if_fail(mx != NULL);
+
+	link_del(matrix_link(mx));
+
+	if (MATRIX_IS_SMALL(mx)) {
+		uslab_free(mx, sizeof(struct pool_small_matrix));
+		return;
+	}
+
+	pool_block_put(mx->block);
+	uslab_free(mx, sizeof(*mx));
+}
+
+#ifndef UMALLOC_PROFILE
+gsl_vector*
+pool_vector_alloc(size_t n)
+{
+	return pool_vector_alloc_at(n, NULL, 0);
+}
+
+gsl_vector*
+pool_vector_calloc(size_t n)
+{
+	return pool_vector_calloc_at(n, NULL, 0);
+}
+
+gsl_matrix*
+pool_matrix_alloc(size_t n1, size_t n2)
+{
+	return pool_matrix_alloc_at(n1, n2, NULL, 0);
+}
+
+gsl_matrix*
+pool_matrix_calloc(size_t n1, size_t n2)
+{
+	return pool_matrix_calloc_at(n1, n2, NULL, 0);
+}
+#endif
+
+struct pool_temps*
+pool_track(struct pool_temps *temps)
+{
+	struct pool_temps *prev;
+
+	prev = pool_temps;
+	pool_temps = temps;
+
+	return prev;
+}
+
+void
+pool_keep_vector(gsl_vector *vc)
+{
+	return_if_fail(vc != NULL);
+
+	link_del(vector_link(vc));
+}
+
+void
+pool_keep_matrix(gsl_matrix *mx)
+{
+	return_if_fail(mx != NULL);
+
+	link_del(matrix_link(mx));
+}
+
+void
+pool_temp_matrix(gsl_matrix *mx)
+{
+	return_if_fail(mx != NULL);
+
+	link_del(matrix_link(mx));
+	link_add(matrix_link(mx), mx, TRUE);
+}
+
+void
+pool_forget(struct pool_temps *temps)
+{
+	struct pool_link *link;
+
+	return_if_fail(temps != NULL);
+
+	while ((link = temps->head) != NULL)
+		link_del(link);
+}
+
+void
+pool_release(struct pool_temps *temps)
+{
+	struct pool_link *link;
+
+	return_if_fail(temps != NULL);
+
+	/* freeing takes each off the list */
+	while ((link = temps->head) != NULL) {
+		if (link->matrix)
+			pool_matrix_free(link->value);
+		else
+			pool_vector_free(link->value);
+	}
+}
+
+void
+pool_trim(void)
+{
+	struct pool_block *pb, *next;
+	int i;
+
+	pthread_mutex_lock(&pool.lock);
+
+	for (i = 0; i < POOL_CLASSES; i++) {
+		for (pb = pool.free[i]; pb != NULL; pb = next) {
+			next = pb->next;
+			pool_block_release(pb);
+		}
+		pool.free[i] = NULL;
+	}
+
+	pool.retained = 0;
+
+	pthread_mutex_unlock(&pool.lock);
+}
+
+void
+pool_stats(void)
+{
+	unsigned long total;
+
+	total = pool.hits + pool.misses;
+
+	fprintf(stderr, "pool: %lu allocs, %lu hits (%.2f%%), %lu released,"
+		" %lu bytes retained, %lu small inline" CRLF,
+		total, pool.hits, total ? 100.0 * pool.hits / total : 0.0,
+		pool.released, (unsigned long)pool.retained, pool.small);
+}
@@ -0,0 +1,101 @@
+#ifndef POOL_H_
+#define POOL_H_
+
+#include <gsl/gsl_vector.h>
+#include <gsl/gsl_matrix.h>
+
+/*
+ * Every vector and matrix value of the interpreter is allocated here.
+ * Data blocks are 64-byte aligned and recycled by size class; at most
+ * POOL_RETAIN bytes of free blocks are kept for reuse.
+ * Values from this pool must be released with pool_*_free(), never with
+ * gsl_vector_free()/gsl_matrix_free().
+ *
+ * Vectors of up to POOL_SMALL_VECTOR elements and matrices of up to
+ * POOL_SMALL_MATRIX x POOL_SMALL_MATRIX keep their data inline, right
+ * after the header in a single slab object.
+ */
+#define POOL_SMALL_VECTOR	8
+#define POOL_SMALL_MATRIX	4
+
+gsl_vector*
+pool_vector_alloc(size_t n);
+
+gsl_vector*
+pool_vector_calloc(size_t n);
+
+void
+pool_vector_free(gsl_vector *vc);
+
+gsl_matrix*
+pool_matrix_alloc(size_t n1, size_t n2);
+
+gsl_matrix*
+pool_matrix_calloc(size_t n1, size_t n2);
+
+void
+pool_matrix_free(gsl_matrix *mx);
+
+/*
+ * Temporaries of a statement that may be aborted, see traverse.c.  While
+ * a list is set for the thread with pool_track(), the vectors and
+ * matrices it allocates go on the list until they are freed, or kept by
+ * something that outlives the statement with pool_keep_*().  What an
+ * aborted statement leaves there is freed by pool_release(), what a
+ * finished one leaves is forgotten by pool_forget().  A value is freed or
+ * kept by the thread that allocated it.
+ */
+struct pool_link;
+
+struct pool_temps {
+	struct pool_link	*head;
+};
+
+/* returns the list set before */
+struct pool_temps*
+pool_track(struct pool_temps *temps);
+
+void
+pool_keep_vector(gsl_vector *vc);
+
+void
+pool_keep_matrix(gsl_matrix *mx);
+
+/* a kept matrix back on the list of the thread */
+void
+pool_temp_matrix(gsl_matrix *mx);
+
+void
+pool_forget(struct pool_temps *temps);
+
+void
+pool_release(struct pool_temps *temps);
+
+/* release all retained blocks */
+void
+pool_trim(void);
+
+void
+pool_stats(void);
+
+/* the same with the caller's site, used by the heap profiler (umalloc.h) */
+gsl_vector*
+pool_vector_alloc_at(size_t n, const char *file, int line);
+
+gsl_vector*
+pool_vector_calloc_at(size_t n, const char *file, int line);
+
+gsl_matrix*
+pool_matrix_alloc_at(size_t n1, size_t n2, const char *file, int line);
+
+gsl_matrix*
+pool_matrix_calloc_at(size_t n1, size_t n2, const char *file, int line);
+
+#ifdef UMALLOC_PROFILE
+#define pool_vector_alloc(n)		pool_vector_alloc_at(n, __FILE__, __LINE__)
+#define pool_vector_calloc(n)		pool_vector_calloc_at(n, __FILE__, __LINE__)
+#define pool_matrix_alloc(n1, n2)	pool_matrix_alloc_at(n1, n2, __FILE__, __LINE__)
+#define pool_matrix_calloc(n1, n2)	pool_matrix_calloc_at(n1, n2, __FILE__, __LINE__)
+#endif /* UMALLOC_PROFILE */
+
+#endif /*POOL_H_*/
@@ -0,0 +1,202 @@
+#include <stdio.h>
+#include <math.h>
+
+#include "reduce.h"
+#include "tpool.h"
+#include "umalloc.h"
+#include "macros.h"
+
+/* elements in a block, and the length from which blocks run in parallel */
+#define REDUCE_BLOCK		1024
+#define REDUCE_PARALLEL		(32 * REDUCE_BLOCK)
+
+typedef enum {
+	REDUCE_SUM,
+	REDUCE_SQUARES,		/* of the elements over scale */
+	REDUCE_MAXABS
+} reduce_t;
+
+struct reduce_job {
+	reduce_t	type;
+	const double	*data;
+	size_t		cols;
+	size_t		ld;
+	size_t		n;
+	double		scale;
+	double		*part;		/* result of every block */
+};
+
+static double
+block_maxabs(struct reduce_job *job, size_t lo, size_t hi)
+{
+	size_t k, r, c;
+	double m, a;
+
+	r = lo / job->cols;
+	c = lo % job->cols;
+	m = 0.0;
+
+	for (k = lo; k < hi; k++) {
+		a = fabs(job->data[r * job->ld + c]);
+
+		/* a NaN sticks */
+		if (a > m || isnan(a))
+			m = isnan(m) ? m : a;
+
+		if (++c == job->cols) {
+			c = 0;
+			r++;
+		}
+	}
+
+	return m;
+}
+
+static double
+block_sum(struct reduce_job *job, size_t lo, size_t hi)
+{
+	size_t k, r, c;
+	double s, e, t, x;
+
+	r = lo / job->cols;
+	c = lo % job->cols;
+	s = e = 0.0;
+
+	for (k = lo; k < hi; k++) {
+		x = job->data[r * job->ld + c];
+
+		if (job->type == REDUCE_SQUARES) {
+			x /= job->scale;
+			x *= x;
+		}
+
+		t = s + x;
+
+		if (fabs(s) >= fabs(x))
+			e += (s - t) + x;
+		else
+			e += (x - t) + s;
+
+		s = t;
+
+		if (++c == job->cols) {
+			c = 0;
+			r++;
+		}
+	}
+
+	/* the error term of an infinite sum is a NaN */
+	return isfinite(s) ? s + e : s;
+}
+
+static void
+blocks(void *arg, int worker, long lo, long hi)
+{
+	struct reduce_job *job;
+	size_t first, last;
+	long b;
+
+	job = arg;
+
+	for (b = lo; b < hi; b++) {
+		first = b * REDUCE_BLOCK;
+		last  = MIN(first + REDUCE_BLOCK, job->n);
+
+		if (job->type == REDUCE_MAXABS)
+			job->part[b] = block_maxabs(job, first, last);
+		else
+			job->part[b] = block_sum(job, first, last);
+	}
+}
+
+static double
+pairwise(reduce_t type, const double *part, size_t n)
+{
+	double a, b;
+	size_t h;
+
+	if (n == 1)
+		return part[0];
+
+	h = n / 2;
+	a = pairwise(type, part, h);
+	b = pairwise(type, part + h, n - h);
+
+	if (type != REDUCE_MAXABS)
+		return a + b;
+
+	return (a > b || isnan(a)) ? a : b;
+}
+
+static double
+reduce(struct reduce_job *job)
+{
+	size_t nblocks;
+	double res, one;
+
+	if (job->n == 0)
+		return 0.0;
+
+	nblocks = (job->n + REDUCE_BLOCK - 1) / REDUCE_BLOCK;
+
+	if (nblocks == 1) {
+		job->part = &one;
+		blocks(job, 0, 0, 1);
+		return one;
+	}
+
+	job->part = umalloc(nblocks * sizeof(double));
+
+	if (job->n >= REDUCE_PARALLEL)
+		tpool_run(nblocks, MAX(1, nblocks / (tpool_size() * 4)),
+								blocks, job);
+	else
+		blocks(job, 0, 0, nblocks);
+
+	res = pairwise(job->type, job->part, nblocks);
+
+	ufree(job->part);
+
+	return res;
+}
+
+double
+reduce_sum(const double *data, size_t rows, size_t cols, size_t ld)
+{
+	struct reduce_job job;
+
+	return_val_if_fail(data != NULL || rows * cols == 0, 0.0);
+
+	job.type = REDUCE_SUM;
+	job.data = data;
+	job.cols = cols;
+	job.ld   = ld;
+	job.n    = rows * cols;
+
+	return reduce(&job);
+}
+
+double
+reduce_norm(const double *data, size_t rows, size_t cols, size_t ld)
+{
+	struct reduce_job job;
+	double scale;
+
+	return_val_if_fail(data != NULL || rows * cols == 0, 0.0);
+
+	job.type = REDUCE_MAXABS;
+	job.data = data;
+	job.cols = cols;
+	job.ld   = ld;
+	job.n    = rows * cols;
+
+	scale = reduce(&job);
+
+	if (scale == 0.0 || !isfinite(scale))
+		return scale;
+
+	job.type  = REDUCE_SQUARES;
+	job.scale = scale;
+
+	return scale * sqrt(reduce(&job));
+}
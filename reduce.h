@@ -0,0 +1,23 @@
+#ifndef REDUCE_H_
+#define REDUCE_H_
+
+#include <stddef.h>
+
+/*
+ * Reductions over rows x cols doubles, row r starting at data + r * ld:
+ * a vector with a stride is rows = size, cols = 1, ld = stride.
+ *
+ * The elements are taken in fixed blocks, summed with Neumaier's
+ * compensation, and the block results are combined pairwise.  Blocks
+ * run on the thread pool for long arrays but the result depends on the
+ * data alone, never on the number of threads.
+ */
+
+double
+reduce_sum(const double *data, size_t rows, size_t cols, size_t ld);
+
+/* Euclidean norm, scaled by the largest element so it does not overflow */
+double
+reduce_norm(const double *data, size_t rows, size_t cols, size_t ld);
+
+#endif /* REDUCE_H_ */
@@ -0,0 +1,1009 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <signal.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <ctype.h>
+#include <arpa/inet.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+#include "server.h"
+#include "bclite.h"
+#include "context.h"
+#include "syntax.h"
+#include "traverse.h"
+#include "eval.h"
+#include "intern.h"
+#include "macros.h"
+#include "misc.h"
+#include "umalloc.h"
+
+/* larger requests are refused and the connection is closed */
+#define SERVER_MAX_REQUEST	(16 << 20)
+
+#define SERVER_MAX_WORKERS	256
+
+/* requests read ahead on a connection before its responses are written */
+#define SERVER_MAX_INFLIGHT	64
+
+/* requests for one script run together at most */
+#define SERVER_MAX_BATCH	256
+
+/* compiled scripts kept by a worker */
+#define SERVER_CACHE		16
+
+struct input {
+	char	*name;
+	double	value;
+};
+
+struct conn;
+struct server;
+
+struct job {
+	struct conn	*conn;
+	unsigned long	seq;		/* position on the connection */
+	char		*req;		/* script, then the inputs after a NUL */
+	char		*inputs;
+	struct input	*in;
+	int		nin;
+	char		*bad;		/* the input line that does not parse */
+	int		ok;
+	char		*out;
+	size_t		size;
+	struct job	*next;		/* in a batch, then on the conn */
+};
+
+struct conn {
+	int			fd;
+	struct server		*srv;
+	pthread_mutex_t		lock;
+	pthread_cond_t		cond;		/* a slot in flight is free */
+	unsigned long		seq;		/* of the next request read */
+	unsigned long		sent;		/* of the next response due */
+	struct job		*done;		/* finished ahead of their turn */
+	struct job		*due;		/* in order, to be written */
+	struct job		**due_tail;
+	int			writing;	/* a thread is writing them */
+	int			inflight;
+	int			refs;		/* the reader and the jobs */
+	int			broken;
+};
+
+/* queued requests for the same script */
+struct batch {
+	char			*script;
+	struct job		*first;
+	struct job		*last;
+	int			count;
+	struct batch		*next;
+};
+
+struct server {
+	int			fd;
+	struct bclite_ctx	*base;	/* preloaded, read-only once serving */
+
+	pthread_mutex_t		lock;
+	pthread_cond_t		cond;	/* a batch is queued */
+	struct batch		*head;
+	struct batch		*tail;
+	struct hash_table	*open;	/* script -> queued batch */
+};
+
+struct cached {
+	char			*script;
+	struct bclite_ctx	*ctx;
+	struct bclite_program	*prog;
+	unsigned long		used;
+};
+
+struct worker {
+	struct server		*srv;
+	struct cached		cache[SERVER_CACHE];
+	unsigned long		clock;
+};
+
+/* run every statement from in, as the interactive loop does */
+static int
+evaluate(struct bclite_ctx *ctx, FILE *in)
+{
+	struct ast_node *tree;
+	struct eval *res;
+	int eof, errors, ok;
+
+	ok = TRUE;
+
+	set_file(ctx, in);
+
+	do {
+		errors = programme(ctx, &tree, &eof);
+
+		if (errors) {
+			ok = FALSE;
+		} else {
+			traversal_statement(ctx, tree);
+
+			if (!traversal_result(ctx, &res)) {
+				ok = FALSE;
+			} else if (res != NULL) {
+				eval_print(ctx->out, res);
+				eval_free(res);
+			}
+		}
+
+		ast_node_unref(tree);
+
+	} while (!eof);
+
+	return ok;
+}
+
+static int
+preload(struct bclite_ctx *base, const char *file)
+{
+	FILE *in;
+
+	in = fopen(file, "r");
+
+	if (in == NULL) {
+		fprintf(stderr, "error: cannot open the file %s\n", file);
+		return FALSE;
+	}
+
+	if (!evaluate(base, in))
+		fprintf(stderr, "warning: errors in %s\n", file);
+
+	fclose(in);
+
+	return TRUE;
+}
+
+static int
+read_full(int fd, void *buf, size_t len)
+{
+	ssize_t n;
+
+	while (len > 0) {
+		n = read(fd, buf, len);
+
+		if (n < 0 && errno == EINTR)
+			continue;
+
+		if (n <= 0)
+			return FALSE;
+
+		buf  = (char *)buf + n;
+		len -= n;
+	}
+
+	return TRUE;
+}
+
+static int
+write_full(int fd, const void *buf, size_t len)
+{
+	ssize_t n;
+
+	while (len > 0) {
+		n = write(fd, buf, len);
+
+		if (n < 0 && errno == EINTR)
+			continue;
+
+		if (n <= 0)
+			return FALSE;
+
+		buf  = (const char *)buf + n;
+		len -= n;
+	}
+
+	return TRUE;
+}
+
+static unsigned long
+script_hash(const void *key)
+{
+	const unsigned char *p;
+	unsigned long hash;
+
+	hash = 14695981039346656037UL;
+
+	for (p = key; *p; p++)
+		hash = (hash ^ *p) * 1099511628211UL;
+
+	return hash;
+}
+
+static int
+script_cmp(const void *a, const void *b)
+{
+	return strcmp(a, b);
+}
+
+/* name=value lines, a digit for each name */
+static void
+parse_inputs(struct job *job)
+{
+	char *line, *next, *eq, *end;
+	int n;
+
+	if (job->inputs == NULL || *job->inputs == '\0')
+		return;
+
+	n = 1;
+
+	for (line = job->inputs; *line; line++)
+		if (*line == '\n')
+			n++;
+
+	job->in = umalloc(n * sizeof(*job->in));
+
+	for (line = job->inputs; line != NULL; line = next) {
+		next = strchr(line, '\n');
+
+		if (next != NULL)
+			*next++ = '\0';
+
+		if (*line == '\0')
+			continue;
+
+		eq = strchr(line, '=');
+
+		if (eq == NULL || (!isalpha(*line) && *line != '_')) {
+			job->bad = line;
+			return;
+		}
+
+		for (end = line; end != eq; end++)
+			if (!isalnum(*end) && *end != '_') {
+				job->bad = line;
+				return;
+			}
+
+		job->in[job->nin].value = strtod(eq + 1, &end);
+
+		if (end == eq + 1 || *end != '\0') {
+			job->bad = line;
+			return;
+		}
+
+		*eq = '\0';
+
+		job->in[job->nin++].name = line;
+	}
+}
+
+/*
+ * A compiled script sees only the names it interned, the others are not
+ * bound: a cached context must not grow with what its requests send.
+ */
+static int
+bind_inputs(struct bclite_ctx *ctx, struct job *job, int compiled)
+{
+	int i;
+
+	if (job->bad) {
+		fprintf(message_stream(), "error: bad input `%s'\n", job->bad);
+		return FALSE;
+	}
+
+	for (i = 0; i < job->nin; i++) {
+		if (compiled &&
+		    intern_lookup(ctx->strings, job->in[i].name) == NULL)
+			continue;
+
+		bclite_set_digit(ctx, job->in[i].name, job->in[i].value);
+	}
+
+	return TRUE;
+}
+
+static void
+job_free(struct job *job)
+{
+	if (job->in)
+		ufree(job->in);
+
+	free(job->out);
+	free(job->req);
+	free(job);
+}
+
+static void
+conn_unref(struct conn *conn)
+{
+	int refs;
+
+	pthread_mutex_lock(&conn->lock);
+	refs = --conn->refs;
+	pthread_mutex_unlock(&conn->lock);
+
+	if (refs > 0)
+		return;
+
+	close(conn->fd);
+
+	pthread_mutex_destroy(&conn->lock);
+	pthread_cond_destroy(&conn->cond);
+	free(conn);
+}
+
+/* append a response frame */
+static void
+frame(FILE *out, struct job *job)
+{
+	uint32_t size;
+	char status;
+
+	size   = htonl(job->size + 1);
+	status = job->ok ? 0 : 1;
+
+	fwrite(&size, sizeof(size), 1, out);
+	fwrite(&status, 1, 1, out);
+	fwrite(job->out, 1, job->size, out);
+}
+
+/*
+ * Write the responses of the jobs in one write, or drop them on a broken
+ * connection, and free the jobs; FALSE if the write failed.
+ */
+static int
+write_due(struct conn *conn, struct job *due, int broken, int *n)
+{
+	struct job *next;
+	FILE *out;
+	char *buf;
+	size_t size;
+	int ok;
+
+	out = open_memstream(&buf, &size);
+
+	if (out == NULL)
+		error(1, "can't open a response stream");
+
+	for (*n = 0; due != NULL; due = next, (*n)++) {
+		next = due->next;
+
+		frame(out, due);
+		job_free(due);
+	}
+
+	fclose(out);
+
+	ok = broken || write_full(conn->fd, buf, size);
+
+	free(buf);
+
+	return ok;
+}
+
+/*
+ * Responses go out in request order: a finished job waits in conn->done
+ * until those before it are due, then moves to conn->due.  One thread at
+ * a time writes what is due, outside the lock, so a slow client holds up
+ * that thread alone; the others leave their jobs to it.
+ */
+static void
+conn_finish(struct job *job)
+{
+	struct conn *conn;
+	struct job **p, *due;
+	int n, written, broken, ok;
+
+	conn = job->conn;
+
+	pthread_mutex_lock(&conn->lock);
+
+	job->next  = conn->done;
+	conn->done = job;
+
+	for (p = &conn->done; *p != NULL; ) {
+		if ((*p)->seq != conn->sent) {
+			p = &(*p)->next;
+			continue;
+		}
+
+		due = *p;
+		*p  = due->next;
+
+		due->next       = NULL;
+		*conn->due_tail = due;
+		conn->due_tail  = &due->next;
+
+		conn->sent++;
+
+		/* an earlier job may be due now, look again */
+		p = &conn->done;
+	}
+
+	if (conn->writing) {
+		pthread_mutex_unlock(&conn->lock);
+		return;
+	}
+
+	conn->writing = TRUE;
+	written = 0;
+
+	while ((due = conn->due) != NULL) {
+		conn->due      = NULL;
+		conn->due_tail = &conn->due;
+
+		broken = conn->broken;
+
+		pthread_mutex_unlock(&conn->lock);
+
+		ok = write_due(conn, due, broken, &n);
+
+		pthread_mutex_lock(&conn->lock);
+
+		if (!ok && !conn->broken) {
+			/* let the reader see the end of the connection */
+			conn->broken = TRUE;
+			shutdown(conn->fd, SHUT_RDWR);
+		}
+
+		conn->inflight -= n;
+		written += n;
+
+		pthread_cond_signal(&conn->cond);
+	}
+
+	conn->writing = FALSE;
+
+	pthread_mutex_unlock(&conn->lock);
+
+	while (written-- > 0)
+		conn_unref(conn);
+}
+
+/* run the script of job on its own, as the interactive loop would */
+static void
+run_alone(struct server *srv, struct job *job)
+{
+	struct bclite_ctx *ctx;
+	FILE *in, *out, *prev;
+
+	out = open_memstream(&job->out, &job->size);
+
+	if (out == NULL)
+		error(1, "can't open request streams");
+
+	ctx = bclite_ctx_new_from(srv->base);
+	ctx->out = out;
+
+	prev = message_set_stream(out);
+
+	job->ok = bind_inputs(ctx, job, FALSE);
+
+	if (job->ok && *job->req) {
+		in = fmemopen(job->req, strlen(job->req), "r");
+
+		if (in == NULL)
+			error(1, "can't open request streams");
+
+		job->ok = evaluate(ctx, in);
+
+		fclose(in);
+	}
+
+	message_set_stream(prev);
+
+	bclite_ctx_destroy(&ctx);
+
+	fclose(out);
+}
+
+static void
+cache_drop(struct cached *c)
+{
+	bclite_program_destroy(&c->prog);
+	bclite_ctx_destroy(&c->ctx);
+	free(c->script);
+
+	c->script = NULL;
+}
+
+/* the script compiled in a context of its own, NULL on a syntax error */
+static struct cached*
+cache_get(struct worker *w, const char *script)
+{
+	struct cached *c, *victim;
+	FILE *sink, *prev;
+	char *buf;
+	size_t size;
+	int i;
+
+	victim = &w->cache[0];
+
+	for (i = 0; i < SERVER_CACHE; i++) {
+		c = &w->cache[i];
+
+		if (c->script != NULL && STREQ(c->script, script)) {
+			c->used = ++w->clock;
+			return c;
+		}
+
+		if (c->script == NULL ||
+		    (victim->script != NULL && c->used < victim->used))
+			victim = c;
+	}
+
+	if (victim->script != NULL)
+		cache_drop(victim);
+
+	c = victim;
+
+	c->ctx = bclite_ctx_new_from(w->srv->base);
+
+	/* the errors are reported when the script runs on its own */
+	sink = open_memstream(&buf, &size);
+
+	if (sink == NULL)
+		error(1, "can't open request streams");
+
+	prev = message_set_stream(sink);
+
+	c->prog = bclite_compile(c->ctx, script, strlen(script));
+
+	message_set_stream(prev);
+
+	fclose(sink);
+	free(buf);
+
+	if (c->prog == NULL) {
+		bclite_ctx_destroy(&c->ctx);
+		return NULL;
+	}
+
+	c->script = strdup(script);
+	c->used   = ++w->clock;
+
+	if (c->script == NULL)
+		error(1, "can't cache a script");
+
+	return c;
+}
+
+static void
+print_digit(struct job *job, double value)
+{
+	struct eval *res;
+	FILE *out;
+
+	out = open_memstream(&job->out, &job->size);
+
+	if (out == NULL)
+		error(1, "can't open request streams");
+
+	res = eval_new(TAG_CONST, VALUE_TYPE_DIGIT, &value);
+	eval_print(out, res);
+	eval_free(res);
+
+	fclose(out);
+
+	job->ok = TRUE;
+}
+
+static int
+same_names(struct job *a, struct job *b)
+{
+	int i;
+
+	if (a->nin != b->nin)
+		return FALSE;
+
+	for (i = 0; i < a->nin; i++)
+		if (!STREQ(a->in[i].name, b->in[i].name))
+			return FALSE;
+
+	return TRUE;
+}
+
+/*
+ * One pass for the whole batch: each input becomes a vector of the
+ * values the requests give it.  FALSE leaves the jobs untouched.
+ */
+static int
+run_vector(struct cached *c, struct batch *batch)
+{
+	const char **names;
+	const double *res;
+	double **data, value;
+	struct job *job;
+	FILE *sink, *prev;
+	char *buf;
+	size_t size, len;
+	int i, k, n, ok;
+
+	n = batch->first->nin;
+
+	for (job = batch->first; job != NULL; job = job->next)
+		if (job->bad || !same_names(batch->first, job))
+			return FALSE;
+
+	names = umalloc((n + 1) * sizeof(*names));
+
+	for (i = 0; i < n; i++)
+		names[i] = batch->first->in[i].name;
+
+	if (!bclite_program_elementwise(c->prog, names, n)) {
+		ufree(names);
+		return FALSE;
+	}
+
+	data = umalloc((n + 1) * sizeof(*data));
+
+	for (i = 0; i < n; i++) {
+		data[i] = umalloc(batch->count * sizeof(**data));
+
+		for (job = batch->first, k = 0; job != NULL; job = job->next)
+			data[i][k++] = job->in[i].value;
+
+		/* as in bind_inputs() */
+		if (intern_lookup(c->ctx->strings, names[i]) != NULL)
+			bclite_bind_vector(c->ctx, names[i], data[i],
+								batch->count);
+	}
+
+	sink = open_memstream(&buf, &size);
+
+	if (sink == NULL)
+		error(1, "can't open request streams");
+
+	prev = message_set_stream(sink);
+
+	ok = bclite_run(c->prog);
+
+	message_set_stream(prev);
+
+	fclose(sink);
+	free(buf);
+
+	if (ok && bclite_result_vector(c->prog, &res, &len) &&
+						len == batch->count) {
+		for (job = batch->first, k = 0; job != NULL; job = job->next)
+			print_digit(job, res[k++]);
+	} else if (ok && bclite_result_digit(c->prog, &value)) {
+		for (job = batch->first; job != NULL; job = job->next)
+			print_digit(job, value);
+	} else {
+		ok = FALSE;
+	}
+
+	bclite_reset(c->ctx);
+
+	for (i = 0; i < n; i++)
+		ufree(data[i]);
+
+	ufree(data);
+	ufree(names);
+
+	return ok;
+}
+
+static void
+run_one(struct cached *c, struct job *job)
+{
+	FILE *out, *prev;
+
+	out = open_memstream(&job->out, &job->size);
+
+	if (out == NULL)
+		error(1, "can't open request streams");
+
+	c->ctx->out = out;
+
+	prev = message_set_stream(out);
+
+	job->ok = bind_inputs(c->ctx, job, TRUE) && bclite_run_print(c->prog, out);
+
+	message_set_stream(prev);
+
+	c->ctx->out = stdout;
+
+	bclite_reset(c->ctx);
+
+	fclose(out);
+}
+
+static void
+run_batch(struct worker *w, struct batch *batch)
+{
+	struct cached *c;
+	struct job *job, *next;
+
+	c = (*batch->script) ? cache_get(w, batch->script) : NULL;
+
+	if (c == NULL) {
+		for (job = batch->first; job != NULL; job = job->next)
+			run_alone(w->srv, job);
+	} else if (batch->count == 1 || !run_vector(c, batch)) {
+		for (job = batch->first; job != NULL; job = job->next)
+			run_one(c, job);
+	}
+
+	for (job = batch->first; job != NULL; job = next) {
+		next = job->next;
+		conn_finish(job);
+	}
+
+	free(batch);
+}
+
+/*
+ * A request joins the queued batch for its script if there is one; the
+ * batch grows while the workers are busy, so no request waits for more
+ * to arrive.
+ */
+static void
+dispatch(struct server *srv, struct job *job)
+{
+	struct batch *batch;
+
+	pthread_mutex_lock(&srv->lock);
+
+	if (hash_table_lookup(srv->open, job->req, (void **)&batch) == ret_ok) {
+		batch->last->next = job;
+		batch->last = job;
+
+		if (++batch->count == SERVER_MAX_BATCH)
+			hash_table_remove(srv->open, batch->script);
+	} else {
+		batch = calloc(1, sizeof(*batch));
+
+		if (batch == NULL)
+			error(1, "can't queue a request");
+
+		batch->script = job->req;
+		batch->first  = batch->last = job;
+		batch->count  = 1;
+
+		if (srv->tail)
+			srv->tail->next = batch;
+		else
+			srv->head = batch;
+
+		srv->tail = batch;
+
+		if (hash_table_insert(srv->open, batch->script, batch) != ret_ok)
+			error(1, "can't queue a request");
+
+		pthread_cond_signal(&srv->cond);
+	}
+
+	pthread_mutex_unlock(&srv->lock);
+}
+
+static struct batch*
+next_batch(struct server *srv)
+{
+	struct batch *batch, *queued;
+
+	pthread_mutex_lock(&srv->lock);
+
+	while (srv->head == NULL)
+		pthread_cond_wait(&srv->cond, &srv->lock);
+
+	batch = srv->head;
+	srv->head = batch->next;
+
+	if (srv->head == NULL)
+		srv->tail = NULL;
+
+	/* closed: later requests start a new batch */
+	if (hash_table_lookup(srv->open, batch->script,
+				(void **)&queued) == ret_ok && queued == batch)
+		hash_table_remove(srv->open, batch->script);
+
+	pthread_mutex_unlock(&srv->lock);
+
+	batch->next = NULL;
+
+	return batch;
+}
+
+static void*
+worker(void *arg)
+{
+	struct worker w;
+
+	memset(&w, 0, sizeof(w));
+	w.srv = arg;
+
+	while (TRUE)
+		run_batch(&w, next_batch(w.srv));
+
+	return NULL;
+}
+
+/* reads requests as they come, the workers answer them */
+static void*
+reader(void *arg)
+{
+	struct conn *conn;
+	struct job *job;
+	uint32_t len;
+	char *req;
+
+	conn = arg;
+
+	while (read_full(conn->fd, &len, sizeof(len))) {
+		len = ntohl(len);
+
+		if (len > SERVER_MAX_REQUEST) {
+			fprintf(stderr, "error: request of %u bytes refused\n",
+									len);
+			break;
+		}
+
+		/*
+		 * plain malloc: the size comes from the client and must not
+		 * count against the interpreter's memory budget
+		 */
+		req = malloc(len + 1);
+		job = calloc(1, sizeof(*job));
+
+		if (req == NULL || job == NULL || !read_full(conn->fd, req, len)) {
+			free(req);
+			free(job);
+			break;
+		}
+
+		req[len] = '\0';
+
+		job->conn   = conn;
+		job->req    = req;
+		job->inputs = (strlen(req) < len) ? req + strlen(req) + 1 : NULL;
+
+		parse_inputs(job);
+
+		pthread_mutex_lock(&conn->lock);
+
+		while (conn->inflight == SERVER_MAX_INFLIGHT)
+			pthread_cond_wait(&conn->cond, &conn->lock);
+
+		job->seq = conn->seq++;
+		conn->inflight++;
+		conn->refs++;
+
+		pthread_mutex_unlock(&conn->lock);
+
+		dispatch(conn->srv, job);
+	}
+
+	conn_unref(conn);
+
+	return NULL;
+}
+
+static int
+server_workers(void)
+{
+	char *env;
+	long n;
+
+	env = getenv("BCLITE_WORKERS");
+
+	n = env ? atol(env) : sysconf(_SC_NPROCESSORS_ONLN);
+
+	if (n < 1)
+		n = 1;
+
+	if (n > SERVER_MAX_WORKERS)
+		n = SERVER_MAX_WORKERS;
+
+	return n;
+}
+
+static void
+serve(struct server *srv)
+{
+	struct conn *conn;
+	pthread_attr_t attr;
+	pthread_t thread;
+	int fd;
+
+	pthread_attr_init(&attr);
+	pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+
+	while (TRUE) {
+		fd = accept(srv->fd, NULL, NULL);
+
+		if (fd < 0) {
+			if (errno == EINTR || errno == ECONNABORTED)
+				continue;
+
+			error(1, "accept: %s", strerror(errno));
+		}
+
+		conn = calloc(1, sizeof(*conn));
+
+		if (conn == NULL) {
+			close(fd);
+			continue;
+		}
+
+		conn->fd   = fd;
+		conn->srv  = srv;
+		conn->refs = 1;
+
+		conn->due_tail = &conn->due;
+
+		pthread_mutex_init(&conn->lock, NULL);
+		pthread_cond_init(&conn->cond, NULL);
+
+		if (pthread_create(&thread, &attr, reader, conn) != 0) {
+			fprintf(stderr, "error: can't start a connection reader\n");
+			conn_unref(conn);
+		}
+	}
+}
+
+int
+server_run(const char *path, char **files, int nfiles)
+{
+	pthread_t thread;
+	struct sockaddr_un addr;
+	struct server srv;
+	int i, nworkers;
+
+	return_val_if_fail(path != NULL, -1);
+
+	if (strlen(path) >= sizeof(addr.sun_path)) {
+		fprintf(stderr, "error: socket path %s is too long\n", path);
+		return -1;
+	}
+
+	/* a client going away must not kill the server */
+	signal(SIGPIPE, SIG_IGN);
+
+	memset(&srv, 0, sizeof(srv));
+
+	srv.base = bclite_ctx_new();
+
+	for (i = 0; i < nfiles; i++)
+		if (!preload(srv.base, files[i]))
+			return -1;
+
+	srv.open = hash_table_new(0, script_hash, script_cmp);
+
+	if (srv.open == NULL)
+		error(1, "can't create the request queue");
+
+	pthread_mutex_init(&srv.lock, NULL);
+	pthread_cond_init(&srv.cond, NULL);
+
+	srv.fd = socket(AF_UNIX, SOCK_STREAM, 0);
+
+	if (srv.fd < 0) {
+		fprintf(stderr, "error: socket: %s\n", strerror(errno));
+		return -1;
+	}
+
+	memset(&addr, 0, sizeof(addr));
+	addr.sun_family = AF_UNIX;
+	strcpy(addr.sun_path, path);
+
+	unlink(path);
+
+	if (bind(srv.fd, (struct sockaddr *)&addr, sizeof(addr)) < 0 ||
+					listen(srv.fd, SOMAXCONN) < 0) {
+		fprintf(stderr, "error: %s: %s\n", path, strerror(errno));
+		close(srv.fd);
+		return -1;
+	}
+
+	nworkers = server_workers();
+
+	for (i = 0; i < nworkers; i++)
+		if (pthread_create(&thread, NULL, worker, &srv) != 0)
+			error(1, "can't start a worker");
+
+	serve(&srv);
+
+	return 0;
+}
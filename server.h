@@ -0,0 +1,39 @@
+#ifndef SERVER_H_
+#define SERVER_H_
+
+/*
+ * bclite -s <socket> [file.bc ...]
+ *
+ * Serve evaluation requests on a Unix domain socket.  The files are
+ * evaluated once at start-up; the functions and globals they define are
+ * then visible, read-only, to every request.  Each request runs as in a
+ * fresh context: whatever it defines or assigns is gone when it ends.
+ *
+ * Both directions use frames of a 4-byte length in network byte order
+ * and that many bytes:
+ *
+ *	request		script text, optionally followed by a NUL and
+ *			name=value lines binding digit inputs
+ *	response	status byte (0 ok, 1 some statement failed) followed
+ *			by the output, values and error messages as the
+ *			interactive interpreter prints them
+ *
+ * A connection carries any number of requests and may send them without
+ * waiting for the answers; responses come back in request order.
+ *
+ * Requests for the same script are queued together while the workers
+ * are busy and run as a batch on one compiled copy of the script, kept
+ * by the worker for the next batch.  When the script is one element-wise
+ * expression of its inputs (a*x + b*y, see bclite_program_elementwise())
+ * the whole batch is a single evaluation over vectors of the inputs;
+ * otherwise the requests run back to back.
+ *
+ * BCLITE_WORKERS sets the number of worker threads, it defaults to the
+ * number of processors.  Each connection has a thread reading requests.
+ */
+
+/* only returns on a start-up error */
+int
+server_run(const char *path, char **files, int nfiles);
+
+#endif /* SERVER_H_ */
@@ -0,0 +1,920 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#include "spmatrix.h"
+#include "pool.h"
+#include "tpool.h"
+#include "umalloc.h"
+#include "macros.h"
+#include "misc.h"
+
+#define err_msg_ret(ret, fmt, arg...) \
+do { \
+	message(fmt, ##arg); \
+	return (ret); \
+} while(0)
+
+/* rows of a product handed to a worker at a time */
+#define SPMV_GRAIN	256
+
+/* diagonal pivot as long as it is this close to the largest candidate */
+#define SPLU_TOL	0.1
+
+/*
+ * LU factors with partial pivoting, P A = L U, of the columns of A, found
+ * left-looking one column at a time (Gilbert and Peierls): only the
+ * nonzeros that a column reaches through L are touched, so the work goes
+ * with the nonzeros of the factors.  Both factors are kept by columns;
+ * the unit diagonal of L comes first in its columns, that of U last.
+ * Rows are not reordered to reduce fill.
+ */
+struct splu {
+	size_t		n;
+	size_t		*lp, *li, *up, *ui;
+	double		*lx, *ux;
+	long		*pinv;		/* row of A -> pivot row */
+};
+
+static struct spmatrix*
+spmatrix_alloc(size_t size1, size_t size2, size_t nnz)
+{
+	struct spmatrix *sp;
+
+	sp = umalloc0(sizeof(*sp));
+
+	sp->size1  = size1;
+	sp->size2  = size2;
+	sp->nnz    = nnz;
+	sp->refs   = 1;
+	sp->rowptr = umalloc0((size1 + 1) * sizeof(size_t));
+	sp->col    = umalloc((nnz ? nnz : 1) * sizeof(size_t));
+	sp->val    = umalloc((nnz ? nnz : 1) * sizeof(double));
+
+	return sp;
+}
+
+static void
+splu_free(struct splu *lu)
+{
+	ufree(lu->lp);
+	ufree(lu->li);
+	ufree(lu->lx);
+	ufree(lu->up);
+	ufree(lu->ui);
+	ufree(lu->ux);
+	ufree(lu->pinv);
+	ufree(lu);
+}
+
+struct spmatrix*
+spmatrix_ref(struct spmatrix *sp)
+{
+	return_val_if_fail(sp != NULL, NULL);
+
+	__atomic_add_fetch(&sp->refs, 1, __ATOMIC_RELAXED);
+
+	return sp;
+}
+
+void
+spmatrix_unref(struct spmatrix *sp)
+{
+	return_if_fail(sp != NULL);
+
+	if (__atomic_sub_fetch(&sp->refs, 1, __ATOMIC_ACQ_REL) != 0)
+		return;
+
+	if (sp->lu)
+		splu_free(sp->lu);
+
+	ufree(sp->rowptr);
+	ufree(sp->col);
+	ufree(sp->val);
+	ufree(sp);
+}
+
+static int
+index_ok(double x, size_t size)
+{
+	return x >= 0 && x < size && x == floor(x);
+}
+
+struct spmatrix*
+spmatrix_from_triplets(size_t size1, size_t size2, const gsl_vector *i,
+				const gsl_vector *j, const gsl_vector *v)
+{
+	struct spmatrix *sp;
+	size_t *cnt, *tr, *tc;
+	double *tv;
+	size_t k, n, p, q, r, start, end;
+
+	return_val_if_fail(i != NULL && j != NULL && v != NULL, NULL);
+
+	n = v->size;
+
+	if (i->size != n || j->size != n)
+		err_msg_ret(NULL, "error: nonconformant arguments");
+
+	for (k = 0; k < n; k++)
+		if (!index_ok(gsl_vector_get(i, k), size1) ||
+		    !index_ok(gsl_vector_get(j, k), size2))
+			err_msg_ret(NULL, "error: index out of range");
+
+	sp = spmatrix_alloc(size1, size2, n);
+
+	/*
+	 * Stable counting sorts, by column and then by row, leave every row
+	 * in column order with the duplicates side by side.
+	 */
+	cnt = umalloc0((size2 + 1) * sizeof(size_t));
+	tr  = umalloc((n ? n : 1) * sizeof(size_t));
+	tc  = umalloc((n ? n : 1) * sizeof(size_t));
+	tv  = umalloc((n ? n : 1) * sizeof(double));
+
+	for (k = 0; k < n; k++)
+		cnt[(size_t)gsl_vector_get(j, k) + 1]++;
+
+	for (k = 0; k < size2; k++)
+		cnt[k + 1] += cnt[k];
+
+	for (k = 0; k < n; k++) {
+		p = cnt[(size_t)gsl_vector_get(j, k)]++;
+		tr[p] = gsl_vector_get(i, k);
+		tc[p] = gsl_vector_get(j, k);
+		tv[p] = gsl_vector_get(v, k);
+	}
+
+	ufree(cnt);
+
+	for (k = 0; k < n; k++)
+		sp->rowptr[tr[k] + 1]++;
+
+	for (r = 0; r < size1; r++)
+		sp->rowptr[r + 1] += sp->rowptr[r];
+
+	cnt = umalloc((size1 ? size1 : 1) * sizeof(size_t));
+	memcpy(cnt, sp->rowptr, size1 * sizeof(size_t));
+
+	for (k = 0; k < n; k++) {
+		p = cnt[tr[k]]++;
+		sp->col[p] = tc[k];
+		sp->val[p] = tv[k];
+	}
+
+	ufree(cnt);
+	ufree(tr);
+	ufree(tc);
+	ufree(tv);
+
+	/* sum duplicates, drop zeros, in place */
+	for (q = 0, start = 0, r = 0; r < size1; r++) {
+		k = q;
+
+		for (p = start; p < sp->rowptr[r + 1]; p++) {
+			if (q > k && sp->col[q - 1] == sp->col[p]) {
+				sp->val[q - 1] += sp->val[p];
+				continue;
+			}
+
+			sp->col[q] = sp->col[p];
+			sp->val[q] = sp->val[p];
+			q++;
+		}
+
+		/* zeros, also of duplicates that cancel */
+		end = q;
+
+		for (q = p = k; p < end; p++)
+			if (sp->val[p] != 0.0) {
+				sp->col[q] = sp->col[p];
+				sp->val[q] = sp->val[p];
+				q++;
+			}
+
+		start = sp->rowptr[r + 1];
+		sp->rowptr[r + 1] = q;
+	}
+
+	sp->nnz = q;
+
+	return sp;
+}
+
+struct spmatrix*
+spmatrix_from_dense(const gsl_matrix *mx)
+{
+	struct spmatrix *sp;
+	size_t i, j, n;
+	double x;
+
+	return_val_if_fail(mx != NULL, NULL);
+
+	for (n = 0, i = 0; i < mx->size1; i++)
+		for (j = 0; j < mx->size2; j++)
+			n += (gsl_matrix_get(mx, i, j) != 0.0);
+
+	sp = spmatrix_alloc(mx->size1, mx->size2, n);
+
+	for (n = 0, i = 0; i < mx->size1; i++) {
+		for (j = 0; j < mx->size2; j++) {
+			x = gsl_matrix_get(mx, i, j);
+
+			if (x == 0.0)
+				continue;
+
+			sp->col[n] = j;
+			sp->val[n] = x;
+			n++;
+		}
+
+		sp->rowptr[i + 1] = n;
+	}
+
+	return sp;
+}
+
+gsl_matrix*
+spmatrix_to_dense(const struct spmatrix *sp)
+{
+	gsl_matrix *mx;
+	size_t i, p;
+
+	return_val_if_fail(sp != NULL, NULL);
+
+	mx = pool_matrix_calloc(sp->size1, sp->size2);
+
+	for (i = 0; i < sp->size1; i++)
+		for (p = sp->rowptr[i]; p < sp->rowptr[i + 1]; p++)
+			gsl_matrix_set(mx, i, sp->col[p], sp->val[p]);
+
+	return mx;
+}
+
+double
+spmatrix_get(const struct spmatrix *sp, size_t i, size_t j)
+{
+	size_t lo, hi, mid;
+
+	return_val_if_fail(sp != NULL, 0.0);
+
+	if (i >= sp->size1 || j >= sp->size2)
+		err_msg_ret(0.0, "error: index out of range");
+
+	lo = sp->rowptr[i];
+	hi = sp->rowptr[i + 1];
+
+	while (lo < hi) {
+		mid = lo + (hi - lo) / 2;
+
+		if (sp->col[mid] == j)
+			return sp->val[mid];
+
+		if (sp->col[mid] < j)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+
+	return 0.0;
+}
+
+struct spmatrix*
+spmatrix_scale(const struct spmatrix *sp, double alpha)
+{
+	struct spmatrix *res;
+	size_t p;
+
+	return_val_if_fail(sp != NULL, NULL);
+
+	/* no explicit zeros */
+	res = spmatrix_alloc(sp->size1, sp->size2, (alpha != 0.0) ? sp->nnz : 0);
+
+	if (alpha == 0.0)
+		return res;
+
+	memcpy(res->rowptr, sp->rowptr, (sp->size1 + 1) * sizeof(size_t));
+	memcpy(res->col, sp->col, sp->nnz * sizeof(size_t));
+
+	for (p = 0; p < sp->nnz; p++)
+		res->val[p] = alpha * sp->val[p];
+
+	return res;
+}
+
+static int
+index_cmp(const void *a, const void *b)
+{
+	size_t x, y;
+
+	x = *(const size_t *)a;
+	y = *(const size_t *)b;
+
+	return (x > y) - (x < y);
+}
+
+/*
+ * Gustavson's product, a row at a time: row i of a b sums the rows of b
+ * that the nonzeros of row i of a pick, in a dense accumulator where a
+ * column is marked with the last row that reached it.  A first pass
+ * counts the entries, so the work goes with the products of nonzeros and
+ * the result is never dense.
+ */
+struct spmatrix*
+spmatrix_mult(const struct spmatrix *a, const struct spmatrix *b)
+{
+	struct spmatrix *c;
+	size_t *mark, i, j, k, n, p, q, start;
+	double *w, x;
+
+	return_val_if_fail(a != NULL && b != NULL, NULL);
+
+	if (a->size2 != b->size1)
+		err_msg_ret(NULL, "error: nonconformant arguments");
+
+	mark = umalloc((b->size2 ? b->size2 : 1) * sizeof(size_t));
+
+	/* no row has this index */
+	for (j = 0; j < b->size2; j++)
+		mark[j] = a->size1;
+
+	for (n = 0, i = 0; i < a->size1; i++)
+		for (p = a->rowptr[i]; p < a->rowptr[i + 1]; p++) {
+			k = a->col[p];
+
+			for (q = b->rowptr[k]; q < b->rowptr[k + 1]; q++)
+				if (mark[b->col[q]] != i) {
+					mark[b->col[q]] = i;
+					n++;
+				}
+		}
+
+	c = spmatrix_alloc(a->size1, b->size2, n);
+	w = umalloc((b->size2 ? b->size2 : 1) * sizeof(double));
+
+	for (j = 0; j < b->size2; j++)
+		mark[j] = a->size1;
+
+	for (n = 0, i = 0; i < a->size1; i++) {
+		start = n;
+
+		for (p = a->rowptr[i]; p < a->rowptr[i + 1]; p++) {
+			k = a->col[p];
+			x = a->val[p];
+
+			for (q = b->rowptr[k]; q < b->rowptr[k + 1]; q++) {
+				j = b->col[q];
+
+				if (mark[j] != i) {
+					mark[j]     = i;
+					w[j]        = x * b->val[q];
+					c->col[n++] = j;
+				} else {
+					w[j] += x * b->val[q];
+				}
+			}
+		}
+
+		qsort(c->col + start, n - start, sizeof(size_t), index_cmp);
+
+		/* sums that cancel are dropped, as in spmatrix_from_triplets() */
+		for (q = p = start; p < n; p++) {
+			j = c->col[p];
+
+			if (w[j] != 0.0) {
+				c->col[q] = j;
+				c->val[q] = w[j];
+				q++;
+			}
+		}
+
+		n = q;
+		c->rowptr[i + 1] = n;
+	}
+
+	c->nnz = n;
+
+	ufree(mark);
+	ufree(w);
+
+	return c;
+}
+
+/*
+ * Products by rows of the result, split over the thread pool when the
+ * sparse operand has enough nonzeros; rows are independent, so the
+ * result does not depend on the number of threads.
+ */
+struct spmv_job {
+	const struct spmatrix	*sp;
+	const gsl_matrix	*a;	/* dense operand, a vector is n x 1 */
+	gsl_matrix		*c;
+	int			left;	/* c = a sp, else c = sp a */
+};
+
+static void
+spmv_rows(void *arg, int worker, long lo, long hi)
+{
+	struct spmv_job *job = arg;
+	const struct spmatrix *sp;
+	const gsl_matrix *a;
+	gsl_matrix *c;
+	double *ci, aik;
+	size_t i, j, k, p;
+
+	sp = job->sp;
+	a  = job->a;
+	c  = job->c;
+
+	for (i = lo; i < hi; i++) {
+		ci = c->data + i * c->tda;
+
+		for (j = 0; j < c->size2; j++)
+			ci[j] = 0.0;
+
+		if (!job->left) {
+			/* row i of sp times a */
+			for (p = sp->rowptr[i]; p < sp->rowptr[i + 1]; p++)
+				for (j = 0; j < c->size2; j++)
+					ci[j] += sp->val[p] *
+					    a->data[sp->col[p] * a->tda + j];
+			continue;
+		}
+
+		/* row i of a times sp */
+		for (k = 0; k < sp->size1; k++) {
+			aik = a->data[i * a->tda + k];
+
+			if (aik == 0.0)
+				continue;
+
+			for (p = sp->rowptr[k]; p < sp->rowptr[k + 1]; p++)
+				ci[sp->col[p]] += aik * sp->val[p];
+		}
+	}
+}
+
+static void
+spmv_run(struct spmv_job *job)
+{
+	size_t work;
+
+	work = job->sp->nnz * job->c->size2;
+
+	if (work >= tpool_min_size())
+		tpool_run(job->c->size1, SPMV_GRAIN, spmv_rows, job);
+	else
+		spmv_rows(job, 0, 0, job->c->size1);
+}
+
+int
+spmatrix_mult_vector(const struct spmatrix *sp, int trans, const gsl_vector *x,
+							gsl_vector *y)
+{
+	struct spmv_job job;
+	gsl_matrix_view xv, yv;
+	size_t i, p;
+	double xi;
+
+	return_val_if_fail(sp != NULL && x != NULL && y != NULL, FALSE);
+
+	if (x->size != (trans ? sp->size1 : sp->size2) ||
+	    y->size != (trans ? sp->size2 : sp->size1))
+		err_msg_ret(FALSE, "error: nonconformant arguments");
+
+	if (trans) {
+		/* a scatter into y, rows would collide on one thread */
+		gsl_vector_set_zero(y);
+
+		for (i = 0; i < sp->size1; i++) {
+			xi = gsl_vector_get(x, i);
+
+			for (p = sp->rowptr[i]; p < sp->rowptr[i + 1]; p++)
+				y->data[sp->col[p] * y->stride] += sp->val[p] * xi;
+		}
+
+		return TRUE;
+	}
+
+	if (x->stride != 1 || y->stride != 1) {
+		for (i = 0; i < sp->size1; i++) {
+			for (xi = 0.0, p = sp->rowptr[i]; p < sp->rowptr[i + 1]; p++)
+				xi += sp->val[p] * gsl_vector_get(x, sp->col[p]);
+
+			gsl_vector_set(y, i, xi);
+		}
+
+		return TRUE;
+	}
+
+	xv = gsl_matrix_view_array(x->data, x->size, 1);
+	yv = gsl_matrix_view_array(y->data, y->size, 1);
+
+	job.sp   = sp;
+	job.a    = &xv.matrix;
+	job.c    = &yv.matrix;
+	job.left = FALSE;
+
+	spmv_run(&job);
+
+	return TRUE;
+}
+
+int
+spmatrix_mult_dense(const struct spmatrix *sp, const gsl_matrix *b,
+							gsl_matrix *c)
+{
+	struct spmv_job job;
+
+	return_val_if_fail(sp != NULL && b != NULL && c != NULL, FALSE);
+
+	if (sp->size2 != b->size1 || c->size1 != sp->size1 ||
+	    c->size2 != b->size2)
+		err_msg_ret(FALSE, "error: nonconformant arguments");
+
+	job.sp   = sp;
+	job.a    = b;
+	job.c    = c;
+	job.left = FALSE;
+
+	spmv_run(&job);
+
+	return TRUE;
+}
+
+int
+spmatrix_dense_mult(const gsl_matrix *a, const struct spmatrix *sp,
+							gsl_matrix *c)
+{
+	struct spmv_job job;
+
+	return_val_if_fail(sp != NULL && a != NULL && c != NULL, FALSE);
+
+	if (a->size2 != sp->size1 || c->size1 != a->size1 ||
+	    c->size2 != sp->size2)
+		err_msg_ret(FALSE, "error: nonconformant arguments");
+
+	job.sp   = sp;
+	job.a    = a;
+	job.c    = c;
+	job.left = TRUE;
+
+	spmv_run(&job);
+
+	return TRUE;
+}
+
+/* room for n more entries in each factor */
+static void
+splu_grow(struct splu *lu, size_t *lmax, size_t *umax, size_t lnz, size_t unz)
+{
+	if (lnz + lu->n > *lmax) {
+		*lmax = 2 * (*lmax) + lu->n;
+		lu->li = urealloc(lu->li, *lmax * sizeof(size_t));
+		lu->lx = urealloc(lu->lx, *lmax * sizeof(double));
+	}
+
+	if (unz + lu->n > *umax) {
+		*umax = 2 * (*umax) + lu->n;
+		lu->ui = urealloc(lu->ui, *umax * sizeof(size_t));
+		lu->ux = urealloc(lu->ux, *umax * sizeof(double));
+	}
+}
+
+/*
+ * Rows of L that column k of A reaches, into xi[top..n) in topological
+ * order: a depth-first search from every nonzero of the column through
+ * the columns of L found so far.
+ */
+static size_t
+splu_reach(struct splu *lu, const size_t *ap, const size_t *ai, size_t k,
+		size_t *xi, size_t *stack, size_t *pstack, size_t *mark)
+{
+	size_t p, q, j, i, top, end;
+	long head, jnew;
+	int done;
+
+	top = lu->n;
+
+	for (q = ap[k]; q < ap[k + 1]; q++) {
+		if (mark[ai[q]] == k + 1)
+			continue;
+
+		head = 0;
+		stack[0] = ai[q];
+
+		while (head >= 0) {
+			j = stack[head];
+			jnew = lu->pinv[j];
+
+			if (mark[j] != k + 1) {
+				mark[j] = k + 1;
+				pstack[head] = (jnew < 0) ? 0 : lu->lp[jnew];
+			}
+
+			done = TRUE;
+			end  = (jnew < 0) ? 0 : lu->lp[jnew + 1];
+
+			for (p = pstack[head]; p < end; p++) {
+				i = lu->li[p];
+
+				if (mark[i] == k + 1)
+					continue;
+
+				pstack[head] = p + 1;
+				stack[++head] = i;
+				done = FALSE;
+				break;
+			}
+
+			if (done) {
+				head--;
+				xi[--top] = j;
+			}
+		}
+	}
+
+	return top;
+}
+
+static struct splu*
+splu_factor(const struct spmatrix *sp)
+{
+	struct splu *lu;
+	size_t *ap, *ai, *xi, *stack, *pstack, *mark;
+	double *ax, *x, a, t, pivot;
+	size_t n, i, j, k, p, q, top, lnz, unz, lmax, umax;
+	long ipiv, jnew;
+
+	n = sp->size1;
+
+	/* the columns of sp */
+	ap = umalloc0((n + 1) * sizeof(size_t));
+	ai = umalloc((sp->nnz ? sp->nnz : 1) * sizeof(size_t));
+	ax = umalloc((sp->nnz ? sp->nnz : 1) * sizeof(double));
+
+	for (p = 0; p < sp->nnz; p++)
+		ap[sp->col[p] + 1]++;
+
+	for (j = 0; j < n; j++)
+		ap[j + 1] += ap[j];
+
+	xi = umalloc((n ? n : 1) * sizeof(size_t));
+	memcpy(xi, ap, n * sizeof(size_t));
+
+	for (i = 0; i < n; i++)
+		for (p = sp->rowptr[i]; p < sp->rowptr[i + 1]; p++) {
+			q = xi[sp->col[p]]++;
+			ai[q] = i;
+			ax[q] = sp->val[p];
+		}
+
+	lu = umalloc0(sizeof(*lu));
+
+	lu->n    = n;
+	lu->lp   = umalloc((n + 1) * sizeof(size_t));
+	lu->up   = umalloc((n + 1) * sizeof(size_t));
+	lu->pinv = umalloc((n ? n : 1) * sizeof(long));
+
+	lmax = umax = 0;
+	lnz  = unz  = 0;
+
+	stack  = umalloc((n ? n : 1) * sizeof(size_t));
+	pstack = umalloc((n ? n : 1) * sizeof(size_t));
+	mark   = umalloc0((n ? n : 1) * sizeof(size_t));
+	x      = umalloc0((n ? n : 1) * sizeof(double));
+
+	for (i = 0; i < n; i++)
+		lu->pinv[i] = -1;
+
+	for (k = 0; k < n; k++) {
+		lu->lp[k] = lnz;
+		lu->up[k] = unz;
+
+		splu_grow(lu, &lmax, &umax, lnz, unz);
+
+		/* x = L \ A(:, k) over the rows it reaches */
+		top = splu_reach(lu, ap, ai, k, xi, stack, pstack, mark);
+
+		for (q = ap[k]; q < ap[k + 1]; q++)
+			x[ai[q]] = ax[q];
+
+		for (q = top; q < n; q++) {
+			j = xi[q];
+			jnew = lu->pinv[j];
+
+			if (jnew < 0)
+				continue;
+
+			for (p = lu->lp[jnew] + 1; p < lu->lp[jnew + 1]; p++)
+				x[lu->li[p]] -= lu->lx[p] * x[j];
+		}
+
+		/* the largest candidate, the diagonal if it is close */
+		ipiv = -1;
+		a    = -1.0;
+
+		for (q = top; q < n; q++) {
+			i = xi[q];
+
+			if (lu->pinv[i] < 0) {
+				t = fabs(x[i]);
+				if (t > a) {
+					a = t;
+					ipiv = i;
+				}
+			} else {
+				lu->ui[unz] = lu->pinv[i];
+				lu->ux[unz++] = x[i];
+			}
+		}
+
+		if (ipiv == -1 || a <= 0.0)
+			goto singular;
+
+		if (lu->pinv[k] < 0 && fabs(x[k]) >= a * SPLU_TOL)
+			ipiv = k;
+
+		pivot = x[ipiv];
+
+		lu->ui[unz]   = k;
+		lu->ux[unz++] = pivot;
+		lu->pinv[ipiv] = k;
+		lu->li[lnz]   = ipiv;
+		lu->lx[lnz++] = 1.0;
+
+		for (q = top; q < n; q++) {
+			i = xi[q];
+
+			if (lu->pinv[i] < 0) {
+				lu->li[lnz]   = i;
+				lu->lx[lnz++] = x[i] / pivot;
+			}
+
+			x[i] = 0.0;
+		}
+	}
+
+	lu->lp[n] = lnz;
+	lu->up[n] = unz;
+
+	/* rows of L in pivot order */
+	for (p = 0; p < lnz; p++)
+		lu->li[p] = lu->pinv[lu->li[p]];
+
+	goto out;
+singular:
+	splu_free(lu);
+	lu = NULL;
+out:
+	ufree(ap);
+	ufree(ai);
+	ufree(ax);
+	ufree(xi);
+	ufree(stack);
+	ufree(pstack);
+	ufree(mark);
+	ufree(x);
+
+	return lu;
+}
+
+/* the factors of sp, found by the first solve; see lu_solve() in libm.c */
+static struct splu*
+splu_get(struct spmatrix *sp)
+{
+	struct splu *lu, *old;
+
+	lu = __atomic_load_n(&sp->lu, __ATOMIC_ACQUIRE);
+
+	if (lu != NULL)
+		return lu;
+
+	lu = splu_factor(sp);
+
+	if (lu == NULL)
+		err_msg_ret(NULL, "error: matrix is singular");
+
+	old = NULL;
+
+	if (!__atomic_compare_exchange_n(&sp->lu, &old, lu, FALSE,
+					__ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE)) {
+		splu_free(lu);
+		lu = old;
+	}
+
+	return lu;
+}
+
+/* y = A \ y with the factors of A, w is n doubles */
+static void
+splu_solve(struct splu *lu, double *y, double *w)
+{
+	size_t i, j, p;
+
+	for (i = 0; i < lu->n; i++)
+		w[lu->pinv[i]] = y[i];
+
+	for (j = 0; j < lu->n; j++)
+		for (p = lu->lp[j] + 1; p < lu->lp[j + 1]; p++)
+			w[lu->li[p]] -= lu->lx[p] * w[j];
+
+	for (j = lu->n; j-- > 0; ) {
+		w[j] /= lu->ux[lu->up[j + 1] - 1];
+
+		for (p = lu->up[j]; p < lu->up[j + 1] - 1; p++)
+			w[lu->ui[p]] -= lu->ux[p] * w[j];
+	}
+
+	memcpy(y, w, lu->n * sizeof(double));
+}
+
+static struct splu*
+splu_check(struct spmatrix *sp, size_t rows)
+{
+	if (sp->size1 != sp->size2)
+		err_msg_ret(NULL, "error: matrix is not square");
+
+	if (rows != sp->size1)
+		err_msg_ret(NULL, "error: nonconformant arguments");
+
+	return splu_get(sp);
+}
+
+int
+spmatrix_solve_vector(struct spmatrix *sp, const gsl_vector *b, gsl_vector *x)
+{
+	struct splu *lu;
+	double *y, *w;
+	size_t i, n;
+
+	return_val_if_fail(sp != NULL && b != NULL && x != NULL, FALSE);
+
+	lu = splu_check(sp, b->size);
+
+	if (lu == NULL)
+		return FALSE;
+
+	n = sp->size1;
+	y = umalloc((n ? 2 * n : 1) * sizeof(double));
+	w = y + n;
+
+	for (i = 0; i < n; i++)
+		y[i] = gsl_vector_get(b, i);
+
+	splu_solve(lu, y, w);
+
+	for (i = 0; i < n; i++)
+		gsl_vector_set(x, i, y[i]);
+
+	ufree(y);
+
+	return TRUE;
+}
+
+int
+spmatrix_solve_dense(struct spmatrix *sp, const gsl_matrix *b, gsl_matrix *x)
+{
+	struct splu *lu;
+	double *y, *w;
+	size_t i, j, n;
+
+	return_val_if_fail(sp != NULL && b != NULL && x != NULL, FALSE);
+
+	lu = splu_check(sp, b->size1);
+
+	if (lu == NULL)
+		return FALSE;
+
+	n = sp->size1;
+	y = umalloc((n ? 2 * n : 1) * sizeof(double));
+	w = y + n;
+
+	for (j = 0; j < b->size2; j++) {
+		for (i = 0; i < n; i++)
+			y[i] = gsl_matrix_get(b, i, j);
+
+		splu_solve(lu, y, w);
+
+		for (i = 0; i < n; i++)
+			gsl_matrix_set(x, i, j, y[i]);
+	}
+
+	ufree(y);
+
+	return TRUE;
+}
+
+void
+spmatrix_fprintf(FILE *stream, const struct spmatrix *sp)
+{
+	size_t i, p;
+
+	return_if_fail(stream != NULL);
+	return_if_fail(sp != NULL);
+
+	for (i = 0; i < sp->size1; i++)
+		for (p = sp->rowptr[i]; p < sp->rowptr[i + 1]; p++)
+			fprintf(stream, "%zu %zu %f\n", i, sp->col[p], sp->val[p]);
+}
@@ -0,0 +1,88 @@
+#ifndef SPMATRIX_H_
+#define SPMATRIX_H_
+
+#include <stdio.h>
+
+#include <gsl/gsl_vector.h>
+#include <gsl/gsl_matrix.h>
+
+struct splu;
+
+/*
+ * Sparse matrices in compressed sparse row form: the nonzeros of row i
+ * are val[rowptr[i]] to val[rowptr[i + 1] - 1], in column order.  Memory
+ * and the cost of every operation go with the nonzeros.
+ *
+ * A sparse matrix never changes once built, so values share it by
+ * reference.  The LU factors of its first solve are kept with it for the
+ * next ones.
+ *
+ * Bad sizes and indexes, and singular matrices, are reported here; the
+ * functions return NULL or FALSE then.
+ */
+struct spmatrix {
+	size_t		size1;
+	size_t		size2;
+	size_t		nnz;
+	size_t		*rowptr;
+	size_t		*col;
+	double		*val;
+	unsigned int	refs;
+	struct splu	*lu;
+};
+
+/* from (i[k], j[k], v[k]) triplets, duplicates are summed */
+struct spmatrix*
+spmatrix_from_triplets(size_t size1, size_t size2, const gsl_vector *i,
+				const gsl_vector *j, const gsl_vector *v);
+
+struct spmatrix*
+spmatrix_from_dense(const gsl_matrix *mx);
+
+gsl_matrix*
+spmatrix_to_dense(const struct spmatrix *sp);
+
+struct spmatrix*
+spmatrix_ref(struct spmatrix *sp);
+
+void
+spmatrix_unref(struct spmatrix *sp);
+
+double
+spmatrix_get(const struct spmatrix *sp, size_t i, size_t j);
+
+/* alpha sp */
+struct spmatrix*
+spmatrix_scale(const struct spmatrix *sp, double alpha);
+
+/* a b, sparse as well */
+struct spmatrix*
+spmatrix_mult(const struct spmatrix *a, const struct spmatrix *b);
+
+/* y = sp x, or sp^T x with trans */
+int
+spmatrix_mult_vector(const struct spmatrix *sp, int trans, const gsl_vector *x,
+							gsl_vector *y);
+
+/* c = sp b */
+int
+spmatrix_mult_dense(const struct spmatrix *sp, const gsl_matrix *b,
+							gsl_matrix *c);
+
+/* c = a sp */
+int
+spmatrix_dense_mult(const gsl_matrix *a, const struct spmatrix *sp,
+							gsl_matrix *c);
+
+/* x = sp \ b for a square sp */
+int
+spmatrix_solve_vector(struct spmatrix *sp, const gsl_vector *b, gsl_vector *x);
+
+int
+spmatrix_solve_dense(struct spmatrix *sp, const gsl_matrix *b, gsl_matrix *x);
+
+/* one "row col value" line for every nonzero */
+void
+spmatrix_fprintf(FILE *stream, const struct spmatrix *sp);
+
+#endif /* SPMATRIX_H_ */
@@ -5,40 +5,18 @@
 #include "symbol.h"
 #include "macros.h"
 #include "umalloc.h"
+#include "intern.h"
+#include "pool.h"
+#include "context.h"
+#include "libm.h"
+#include "spmatrix.h"
+#include "tpool.h"
 
 #define DIR_LEN 1024
 
-static struct symbol_table *global;
-static struct symbol_table *top;
-
-static struct symbol *ans;
-
-static void symbol_init_ans(void);
-
-static int
-symbol_strcmp(void *a, void *b)
-{
-	int ret;
-
-	return_val_if_fail(a != NULL, ret_invalid);
-	return_val_if_fail(b != NULL, ret_invalid);
-
-	ret = strcmp((char *)a, (char *)b);
-
-	return ret;
-}
-
-static int
-symbol_strhash(unsigned char *str)
-{
-	unsigned long hash = 5381;
-	int c;
-
-	while ((c = *str++) != 0)
-		hash = ((hash << 5) + hash) + c; /* hash * 33 + c */
-
-	return hash;
-}
+static void symbol_init_ans(struct bclite_ctx *ctx);
+static void symbol_init_ans_val(struct bclite_ctx *ctx);
+static void symbol_clean_val(struct symbol *symbol);
 
 static struct symbol_table*
 create_table(void)
@@ -47,7 +25,8 @@ create_table(void)
 	
 	table = umalloc0(sizeof(*table));
 	
-	table->scope =  hash_table_new(0, (hash_callback_t)symbol_strhash, (hash_compare_t)symbol_strcmp);
+	/* names are interned, so they are hashed and compared by address */
+	table->scope =  hash_table_new(0, NULL, NULL);
 
 	if (table->scope == NULL)
 		error(1, "can't create a scope");
@@ -55,131 +34,430 @@ create_table(void)
 	return table;
 }
 
+static struct symbol*
+table_lookup(struct symbol_table *table, char *name)
+{
+	struct symbol *symbol;
+	ret_t ret;
+	int i;
+
+	/* backwards: private slots of a parfor shadow the shared ones */
+	if (table->scope == NULL) {
+		for (i = table->count - 1; i >= 0; i--)
+			if (table->slots[i]->name == name)
+				return table->slots[i];
+
+		return NULL;
+	}
+
+	ret = hash_table_lookup(table->scope, (void *)name, (void **)&symbol);
+	
+	if (ret != ret_ok)
+		return NULL;
+	
+	return symbol;
+}
+
 void
-symbol_table_create_global(void)
+symbol_table_create_global(struct bclite_ctx *ctx)
 {
 	struct symbol_table *table;
 	
 	table = create_table();
 	
-	global = top = table;
+	ctx->global = ctx->top = table;
 	/* init special variable */
-	symbol_init_ans();
+	symbol_init_ans(ctx);
 }
 
 void
-symbol_table_global_put_symbol(struct symbol *symbol)
+symbol_table_global_put_symbol(struct bclite_ctx *ctx, struct symbol *symbol)
 {
 	ret_t ret;
 	
 	return_if_fail(symbol != NULL);
 
-	ret = hash_table_insert_unique(global->scope, symbol->name, symbol);
+	ret = hash_table_insert_unique(ctx->global->scope, symbol->name, symbol);
 	
 	if (ret != ret_ok)
 		error(1, "symbol insert fail");
 }
 
 struct symbol*
-symbol_table_lookup_top(char *name)
+symbol_table_lookup_top(struct bclite_ctx *ctx, char *name)
 {
-	struct symbol *symbol;
-	ret_t ret;
-
 	return_val_if_fail(name != NULL, NULL);
 	
-	if (!global)
+	if (!ctx->global)
 		return NULL;
 	
-	ret = hash_table_lookup(top->scope, (void *)name, (void **)&symbol);
-	
-	if (ret != ret_ok)
+	return table_lookup(ctx->top, name);
+}
+
+static void
+copy_val(struct symbol *dst, struct symbol *src)
+{
+	switch(src->v_type) {
+	case VALUE_TYPE_DIGIT:
+		symbol_set_val(dst, src->v_type, &src->digit);
+		break;
+	case VALUE_TYPE_STRING:
+		symbol_set_val(dst, src->v_type, src->string);
+		break;
+	case VALUE_TYPE_VECTOR:
+		symbol_set_val(dst, src->v_type, src->vector);
+		break;
+	case VALUE_TYPE_MATRIX:
+		symbol_set_val(dst, src->v_type, src->matrix);
+		break;
+	case VALUE_TYPE_SPMATRIX:
+		symbol_set_val(dst, src->v_type, src->spmatrix);
+		break;
+	default:
+		break;
+	}
+}
+
+/*
+ * Copy a global of the shared base context on first reference.  A frame
+ * uses those of its parent, up to the first context that is not a frame,
+ * in place.
+ */
+static struct symbol*
+import_global(struct bclite_ctx *ctx, char *name)
+{
+	struct bclite_ctx *base;
+	struct symbol *symbol, *copy;
+	int shared;
+
+	symbol = NULL;
+	shared = ctx->frame;
+
+	for (base = ctx->base; base != NULL; base = base->base) {
+		symbol = table_lookup(base->global, name);
+
+		if (symbol != NULL)
+			break;
+
+		if (!base->frame)
+			shared = FALSE;
+	}
+
+	if (symbol == NULL)
 		return NULL;
-	
-	return symbol;
+
+	if (shared)
+		return symbol;
+
+	copy = symbol_new(name, VALUE_TYPE_UNKNOWN);
+
+	copy_val(copy, symbol);
+
+	symbol_table_global_put_symbol(ctx, copy);
+
+	return copy;
 }
 
 struct symbol*
-symbol_table_lookup_all(char *name)
+symbol_table_lookup_all(struct bclite_ctx *ctx, char *name)
 {
 	struct symbol *symbol;
 	struct symbol_table *table;
-	ret_t ret;
 	
 	return_val_if_fail(name != NULL, NULL);
 	
-	if (!global)
+	if (!ctx->global)
 		return NULL;
 		
-	for (table = top; table != NULL; table = table->prev) {
-		ret = hash_table_lookup(table->scope, (void *)name, (void **)&symbol);
+	for (table = ctx->top; table != NULL; table = table->prev) {
+		symbol = table_lookup(table, name);
 	
-		if (ret == ret_ok)
+		if (symbol != NULL)
 			return symbol;
 	}
 	
-	return NULL;
+	return import_global(ctx, name);
+}
+
+struct symbol*
+symbol_table_lookup_global(struct bclite_ctx *ctx, char *name)
+{
+	struct symbol *symbol;
+
+	return_val_if_fail(name != NULL, NULL);
+	
+	if (!ctx->global)
+		return NULL;
+
+	symbol = table_lookup(ctx->global, name);
+
+	if (symbol == NULL)
+		symbol = import_global(ctx, name);
+
+	return symbol;
+}
+
+int
+symbol_table_lookup_slot(struct bclite_ctx *ctx, char *name)
+{
+	int i;
+
+	return_val_if_fail(name != NULL, -1);
+
+	if (!ctx->global || ctx->top == ctx->global)
+		return -1;
+
+	for (i = ctx->top->count - 1; i >= 0; i--)
+		if (ctx->top->slots[i]->name == name)
+			return i;
+
+	return -1;
+}
+
+struct symbol*
+symbol_table_slot(struct bclite_ctx *ctx, int slot)
+{
+	return_val_if_fail(ctx->top != NULL && ctx->top != ctx->global, NULL);
+	return_val_if_fail(slot >= 0 && slot < ctx->top->count, NULL);
+
+	return ctx->top->slots[slot];
 }
 
 struct symbol_table*
-symbol_table_get_current_table(void)
+symbol_table_get_current_table(struct bclite_ctx *ctx)
 {
-	return_val_if_fail(top != NULL, NULL);
-	return_val_if_fail(global != NULL, NULL);
+	return_val_if_fail(ctx->top != NULL, NULL);
+	return_val_if_fail(ctx->global != NULL, NULL);
 	
-	return top;
+	return ctx->top;
 }
 
 void
-symbol_table_push(void)
+symbol_table_push(struct bclite_ctx *ctx)
 {
 	struct symbol_table *table;
 	
-	return_if_fail(global != NULL);
+	return_if_fail(ctx->global != NULL);
 
-	table = create_table();	
+	/* function scopes are flat, see symbol.h */
+	table = umalloc0(sizeof(*table));
 	
-	table->prev = top;
+	table->prev = ctx->top;
 	
-	top = table;
+	ctx->top = table;
+}
+
+void
+symbol_table_push_frame(struct bclite_ctx *ctx)
+{
+	struct symbol_table *table, *top;
+
+	return_if_fail(ctx->global != NULL);
+
+	top = ctx->top;
+
+	symbol_table_push(ctx);
+
+	if (top == ctx->global || top->count == 0)
+		return;
+
+	table = ctx->top;
+
+	table->slots = umalloc(top->count * sizeof(*table->slots));
+	memcpy(table->slots, top->slots, top->count * sizeof(*table->slots));
+
+	table->count = table->shared = top->count;
 }
 
 void
-symbol_table_pop(void)
+symbol_table_pop(struct bclite_ctx *ctx)
 {
-	return_if_fail(global != NULL);
+	return_if_fail(ctx->global != NULL);
 	
-	if (!top->prev)
+	if (!ctx->top->prev)
 		error(1, "pop global table");
 	
-	top = top->prev;
+	ctx->top = ctx->top->prev;
 }
 
 void
-symbol_table_put_symbol(struct symbol *symbol)
+symbol_table_put_symbol(struct bclite_ctx *ctx, struct symbol *symbol)
 {
-	ret_t ret;
+	int i;
 	
 	return_if_fail(symbol != NULL);
 
-	ret = hash_table_insert_unique(top->scope, symbol->name, symbol);
-	
-	if (ret != ret_ok)
-		error(1, "symbol insert fail");
+	if (ctx->top == ctx->global) {
+		symbol_table_global_put_symbol(ctx, symbol);
+		return;
+	}
+
+	for (i = ctx->top->shared; i < ctx->top->count; i++)
+		if (ctx->top->slots[i]->name == symbol->name)
+			error(1, "symbol insert fail");
+
+	i = ctx->top->count++;
+
+	ctx->top->slots = urealloc(ctx->top->slots,
+		ctx->top->count * sizeof(*ctx->top->slots));
+
+	ctx->top->slots[i] = symbol;
 }
 
-void
-symbol_table_set_scope(struct symbol_table *scope)
+struct symbol_table*
+symbol_table_set_scope(struct bclite_ctx *ctx, struct symbol_table *scope)
 {
 	struct symbol_table *prev;
 
-	return_if_fail(scope != NULL);
-	
-	prev = top;
+	return_val_if_fail(scope != NULL, NULL);
 	
-	top  = scope;
+	/* 
+	 * no link to the caller: names that are not in the slots were
+	 * resolved to globals by the parser
+	 */
+	prev = ctx->top;
 	
-	top->prev = prev;
+	ctx->top  = scope;
+
+	return prev;
+}
+
+void
+symbol_table_reset(struct bclite_ctx *ctx)
+{
+	return_if_fail(ctx->global != NULL);
+
+	ctx->top = ctx->global;
+}
+
+void
+symbol_table_restore_globals(struct bclite_ctx *ctx)
+{
+	struct symbol *symbol, *orig;
+	struct hash_table_iter *iter;
+	char *name;
+
+	return_if_fail(ctx->global != NULL);
+
+	iter = hash_table_iterate_init(ctx->global->scope);
+
+	if (!iter)
+		error(1, "hash iterator");
+
+	while (hash_table_iterate(iter, (void **)&name, (void **)&symbol)) {
+		if (symbol == ctx->ans)
+			continue;
+
+		orig = ctx->base ? table_lookup(ctx->base->global, name) : NULL;
+
+		if (orig != NULL && orig->v_type != VALUE_TYPE_UNKNOWN) {
+			copy_val(symbol, orig);
+		} else {
+			symbol_clean_val(symbol);
+			symbol->v_type = VALUE_TYPE_UNKNOWN;
+		}
+	}
+
+	hash_table_iterate_deinit(&iter);
+
+	symbol_init_ans_val(ctx);
+}
+
+struct symbol_table*
+symbol_table_clone_scope(struct symbol_table *scope)
+{
+	struct symbol_table *table;
+	int i;
+
+	return_val_if_fail(scope != NULL, NULL);
+	return_val_if_fail(scope->scope == NULL, NULL);
+
+	table = umalloc0(sizeof(*table));
+
+	table->count = scope->count;
+
+	if (scope->count)
+		table->slots = umalloc(scope->count * sizeof(*table->slots));
+
+	for (i = 0; i < scope->count; i++)
+		table->slots[i] = symbol_new(scope->slots[i]->name,
+						VALUE_TYPE_UNKNOWN);
+
+	return table;
+}
+
+struct symbol_frame*
+symbol_frame_save(struct symbol_table *scope)
+{
+	struct symbol_frame *frame;
+	struct symbol *sym;
+	int i;
+
+	return_val_if_fail(scope != NULL, NULL);
+
+	frame = umalloc0(sizeof(*frame) + scope->count * sizeof(*sym));
+
+	frame->scope = scope;
+	frame->saved = (struct symbol *)(frame + 1);
+
+	for (i = 0; i < scope->count; i++) {
+		sym = scope->slots[i];
+
+		frame->saved[i] = *sym;
+
+		sym->v_type   = VALUE_TYPE_UNKNOWN;
+		sym->borrowed = FALSE;
+		sym->lu       = NULL;
+	}
+
+	return frame;
+}
+
+void
+symbol_frame_restore(struct symbol_frame *frame)
+{
+	struct symbol *sym;
+	unsigned int version;
+	int i;
+
+	return_if_fail(frame != NULL);
+
+	for (i = 0; i < frame->scope->count; i++) {
+		sym = frame->scope->slots[i];
+
+		symbol_clean_val(sym);
+
+		/* versions only go up, the kept factors turn stale */
+		version      = sym->version;
+		*sym         = frame->saved[i];
+		sym->version = version + 1;
+	}
+
+	ufree(frame);
+}
+
+struct symbol_table*
+symbol_table_new_frame(struct symbol_table *scope, struct symbol_table *parent)
+{
+	struct symbol_table *table;
+	int i;
+
+	return_val_if_fail(scope != NULL, NULL);
+	return_val_if_fail(scope->scope == NULL, NULL);
+
+	table = umalloc0(sizeof(*table));
+
+	table->count  = scope->count;
+	table->shared = scope->shared;
+
+	if (scope->count)
+		table->slots = umalloc(scope->count * sizeof(*table->slots));
+
+	for (i = 0; i < scope->count; i++)
+		table->slots[i] = (i < scope->shared) ? parent->slots[i] :
+			symbol_new(scope->slots[i]->name, VALUE_TYPE_UNKNOWN);
+
+	return table;
 }
 
 void
@@ -188,46 +466,83 @@ symbol_table_destroy(struct symbol_table **table)
 	struct symbol *symbol;
 	struct hash_table_iter *iter;
 	char *name;
+	int i;
 
 	return_if_fail(table != NULL);
-	
-	iter = hash_table_iterate_init((*table)->scope);
 
-	if (!iter)
-		error(1, "hash iterator");
+	if ((*table)->scope == NULL) {
+		for (i = (*table)->shared; i < (*table)->count; i++)
+			symbol_destroy((*table)->slots[i]);
+
+		if ((*table)->slots)
+			ufree((*table)->slots);
+	} else {
+		iter = hash_table_iterate_init((*table)->scope);
+
+		if (!iter)
+			error(1, "hash iterator");
 	
-	while (hash_table_iterate(iter, (void **)&name, (void **)&symbol))
-		symbol_destroy(symbol);
+		while (hash_table_iterate(iter, (void **)&name, (void **)&symbol))
+			symbol_destroy(symbol);
 	
-	hash_table_iterate_deinit(&iter);
-	hash_table_destroy(&(*table)->scope);
+		hash_table_iterate_deinit(&iter);
+		hash_table_destroy(&(*table)->scope);
+	}
 
 	ufree(*table);
 	(*table) = NULL;		
 }
 
 static void
-symbol_free(struct symbol *symbol)
+symbol_clean_val(struct symbol *symbol)
 {
 	return_if_fail(symbol != NULL);
 
-	ufree(symbol->name);
-
+	symbol_touch(symbol);
+
+	if (symbol->lu)
+		libm_lu_free(&symbol->lu);
+
+	if (symbol->borrowed) {
+		/* only the view is ours */
+		switch(symbol->v_type) {
+		case VALUE_TYPE_VECTOR:
+			uslab_free(symbol->vector, sizeof(*symbol->vector));
+			break;
+		case VALUE_TYPE_MATRIX:
+			uslab_free(symbol->matrix, sizeof(*symbol->matrix));
+			break;
+		default:
+			break;
+		}
+
+		symbol->borrowed = FALSE;
+		return;
+	}
+	
 	switch(symbol->v_type) {
-	case VALUE_TYPE_STRING:
-		ufree(symbol->string);
-		break;
 	case VALUE_TYPE_VECTOR:
-		gsl_vector_free(symbol->vector);
+		pool_vector_free(symbol->vector);
 		break;
 	case VALUE_TYPE_MATRIX:
-		gsl_matrix_free(symbol->matrix);
+		pool_matrix_free(symbol->matrix);
+		break;
+	case VALUE_TYPE_SPMATRIX:
+		spmatrix_unref(symbol->spmatrix);
 		break;
 	default:
 		break;
 	}
+}
+
+static void
+symbol_free(struct symbol *symbol)
+{
+	return_if_fail(symbol != NULL);
+
+	symbol_clean_val(symbol);
 	
-	ufree(symbol);
+	uslab_free(symbol, sizeof(*symbol));
 }
 
 struct symbol*
@@ -237,7 +552,7 @@ symbol_new(char *name, value_t v_type)
 
 	return_val_if_fail(name != NULL, NULL);
 	
-	sym = umalloc0(sizeof(*sym));
+	sym = uslab_alloc0(sizeof(*sym));
 	
 	switch(v_type) {
 	case VALUE_TYPE_UNKNOWN:
@@ -245,7 +560,8 @@ symbol_new(char *name, value_t v_type)
 	case VALUE_TYPE_STRING:
 	case VALUE_TYPE_VECTOR:
 	case VALUE_TYPE_MATRIX:
-		sym->name       = ustrdup(name);
+	case VALUE_TYPE_SPMATRIX:
+		sym->name       = name;
 		sym->v_type     = v_type;
 		sym->destructor = symbol_free;
 		break;
@@ -256,34 +572,55 @@ symbol_new(char *name, value_t v_type)
 	return sym;
 }
 
-static void
-symbol_clean_val(struct symbol *symbol)
+void
+symbol_touch(struct symbol *symbol)
+{
+	return_if_fail(symbol != NULL);
+
+	symbol->version++;
+
+	/* in a parfor the factors are left to be replaced, see libm.c */
+	if (!tpool_in_loop())
+		libm_lu_free(&symbol->lu);
+}
+
+void
+symbol_set_val(struct symbol *symbol, value_t v_type, void *val)
 {
+	gsl_vector *vc;
+	gsl_matrix *mx;
+	struct spmatrix *sp;
+	char *str;
+
 	return_if_fail(symbol != NULL);
+	return_if_fail(val != NULL);
 	
-	switch(symbol->v_type) {
+	/* 
+	 * copy before the previous value is cleaned: the copy may fail
+	 * over the memory budget and the symbol must stay intact then
+	 */
+	switch(v_type) {
 	case VALUE_TYPE_STRING:
-		ufree(symbol->string);
+		str = (char *)val;
 		break;
 	case VALUE_TYPE_VECTOR:
-		gsl_vector_free(symbol->vector);
+		vc = pool_vector_alloc(((gsl_vector *)val)->size);
+		gsl_vector_memcpy(vc, (gsl_vector *)val);
+		pool_keep_vector(vc);
 		break;
 	case VALUE_TYPE_MATRIX:
-		gsl_matrix_free(symbol->matrix);
+		mx = (gsl_matrix *)val;
+		mx = pool_matrix_alloc(mx->size1, mx->size2);
+		gsl_matrix_memcpy(mx, (gsl_matrix *)val);
+		pool_keep_matrix(mx);
+		break;
+	case VALUE_TYPE_SPMATRIX:
+		sp = spmatrix_ref((struct spmatrix *)val);
 		break;
 	default:
 		break;
 	}
-}
-
-void
-symbol_set_val(struct symbol *symbol, value_t v_type, void *val)
-{
-	gsl_vector *vc;
-	gsl_matrix *mx;
 
-	return_if_fail(symbol != NULL);
-	return_if_fail(val != NULL);
 	/* clean previous value*/
 	symbol_clean_val(symbol);
 	
@@ -294,43 +631,93 @@ symbol_set_val(struct symbol *symbol, value_t v_type, void *val)
 		break;
 	case VALUE_TYPE_STRING:
 		symbol->v_type = v_type;
-		symbol->string = ustrdup((char *)val);
+		symbol->string = str;
 		break;
 	case VALUE_TYPE_VECTOR:
 		symbol->v_type = v_type;
-		vc = (gsl_vector *)val;
-		symbol->vector = gsl_vector_alloc(vc->size);
-		gsl_vector_memcpy(symbol->vector, vc);
+		symbol->vector = vc;
 		break;
 	case VALUE_TYPE_MATRIX:
 		symbol->v_type = v_type;
-		mx = (gsl_matrix *)val;
-		symbol->matrix = gsl_matrix_alloc(mx->size1, mx->size2);
-		gsl_matrix_memcpy(symbol->matrix, mx);
+		symbol->matrix = mx;
+		break;
+	case VALUE_TYPE_SPMATRIX:
+		symbol->v_type = v_type;
+		symbol->spmatrix = sp;
 		break;
 	default:
 		error(1, "wrong value type");
 	}
 }
 
+void
+symbol_bind_vector(struct symbol *symbol, double *data, size_t size)
+{
+	gsl_vector *vc;
+
+	return_if_fail(symbol != NULL);
+	return_if_fail(data != NULL);
+
+	vc = uslab_alloc0(sizeof(*vc));
+
+	vc->size   = size;
+	vc->stride = 1;
+	vc->data   = data;
+
+	symbol_clean_val(symbol);
+
+	symbol->v_type   = VALUE_TYPE_VECTOR;
+	symbol->vector   = vc;
+	symbol->borrowed = TRUE;
+}
+
+void
+symbol_bind_matrix(struct symbol *symbol, double *data, size_t rows,
+						size_t cols)
+{
+	gsl_matrix *mx;
+
+	return_if_fail(symbol != NULL);
+	return_if_fail(data != NULL);
+
+	mx = uslab_alloc0(sizeof(*mx));
+
+	mx->size1 = rows;
+	mx->size2 = cols;
+	mx->tda   = cols;
+	mx->data  = data;
+
+	symbol_clean_val(symbol);
+
+	symbol->v_type   = VALUE_TYPE_MATRIX;
+	symbol->matrix   = mx;
+	symbol->borrowed = TRUE;
+}
+
 static void
-symbol_init_ans(void)
+symbol_init_ans_val(struct bclite_ctx *ctx)
 {
 	char dname[DIR_LEN];
 
-	ans = symbol_new("ans", VALUE_TYPE_UNKNOWN);
-	
 	getcwd(dname, DIR_LEN);
 	
-	symbol_set_val(ans, VALUE_TYPE_STRING, dname);
+	symbol_set_val(ctx->ans, VALUE_TYPE_STRING, intern(dname));
+}
+
+static void
+symbol_init_ans(struct bclite_ctx *ctx)
+{
+	ctx->ans = symbol_new(intern("ans"), VALUE_TYPE_UNKNOWN);
+	
+	symbol_init_ans_val(ctx);
 	
-	symbol_table_global_put_symbol(ans);
+	symbol_table_global_put_symbol(ctx, ctx->ans);
 }
 
 struct symbol*
-symbol_get_ans(void)
+symbol_get_ans(struct bclite_ctx *ctx)
 {
-	return ans;
+	return ctx->ans;
 }
 
 void
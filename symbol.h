@@ -8,15 +8,29 @@
 #include "common.h"
 
 struct symbol;
-
+struct bclite_ctx;
+struct libm_lu;
+struct spmatrix;
+
+/*
+ * Only the global scope is a hash table.  A function scope is a dense
+ * array of slots, arguments first and then locals in declaration order;
+ * the parser resolves local names to slot indexes, so calls never hash.
+ *
+ * A parfor frame starts with the slots of the function it is in, shared
+ * (not owned), followed by its private ones.
+ */
 struct symbol_table {
 	struct symbol_table *prev;
 	struct hash_table *scope;
+	struct symbol **slots;
 	int count;	
+	int shared;
 };
 
 typedef void (*release_t)(struct symbol* );
 
+/* name and string values are interned, see intern.h */
 struct symbol {
 	value_t			v_type;
 	char			*name;
@@ -25,50 +39,122 @@ struct symbol {
 		char		*string;
 		gsl_vector	*vector;
 		gsl_matrix	*matrix;		
+		struct spmatrix	*spmatrix;	/* shared, see spmatrix.h */
 	};
+	/* vector or matrix is a view of caller memory, see bclite.h */
+	unsigned int		borrowed;
+	/* bumped by every change of the value, in place or not */
+	unsigned int		version;
+	/* factors of the matrix from its last use as a divisor, see libm.h */
+	struct libm_lu		*lu;
 
 	release_t		destructor;
 };
 
 void
-symbol_table_create_global(void);
+symbol_table_create_global(struct bclite_ctx *ctx);
 
 void
-symbol_table_global_put_symbol(struct symbol *symbol);
+symbol_table_global_put_symbol(struct bclite_ctx *ctx, struct symbol *symbol);
+
+/* lookups take interned names */
+struct symbol*
+symbol_table_lookup_top(struct bclite_ctx *ctx, char *name);
 
 struct symbol*
-symbol_table_lookup_top(char *name);
+symbol_table_lookup_all(struct bclite_ctx *ctx, char *name);
 
 struct symbol*
-symbol_table_lookup_all(char *name);
+symbol_table_lookup_global(struct bclite_ctx *ctx, char *name);
+
+/* slot of a name in the current function scope, -1 if it is not local */
+int
+symbol_table_lookup_slot(struct bclite_ctx *ctx, char *name);
+
+/* symbol in a slot of the current function scope */
+struct symbol*
+symbol_table_slot(struct bclite_ctx *ctx, int slot);
 
 struct symbol_table*
-symbol_table_get_current_table(void);
+symbol_table_get_current_table(struct bclite_ctx *ctx);
+
+void
+symbol_table_push(struct bclite_ctx *ctx);
 
+/* a parfor frame over the current scope, see above */
 void
-symbol_table_push(void);
+symbol_table_push_frame(struct bclite_ctx *ctx);
 
 void
-symbol_table_pop(void);
+symbol_table_pop(struct bclite_ctx *ctx);
 
 void
-symbol_table_put_symbol(struct symbol *symbol);
+symbol_table_put_symbol(struct bclite_ctx *ctx, struct symbol *symbol);
+
+/* make a function scope current, returns the previous one */
+struct symbol_table*
+symbol_table_set_scope(struct bclite_ctx *ctx, struct symbol_table *scope);
 
+/* drop all function scopes, used when a statement is aborted */
 void
-symbol_table_set_scope(struct symbol_table *scope);
+symbol_table_reset(struct bclite_ctx *ctx);
 
+/*
+ * set every global back to its value in the base context, or unset it,
+ * so the context can run another script as if it were new
+ */
 void
-symbol_table_destroy(struct symbol_table **table);
+symbol_table_restore_globals(struct bclite_ctx *ctx);
+
+/*
+ * The values of the slots of a function scope, moved out while the
+ * function is called again from within itself; the slots are left unset
+ * for the inner call, restoring frees what it left in them.
+ */
+struct symbol_frame {
+	struct symbol_frame	*prev;
+	struct symbol_table	*scope;
+	struct symbol		*saved;
+};
+
+struct symbol_frame*
+symbol_frame_save(struct symbol_table *scope);
 
+void
+symbol_frame_restore(struct symbol_frame *frame);
 
+/* the same slots with fresh, unset symbols */
+struct symbol_table*
+symbol_table_clone_scope(struct symbol_table *scope);
+
+/* a frame like scope for one thread, sharing the slots of parent */
+struct symbol_table*
+symbol_table_new_frame(struct symbol_table *scope, struct symbol_table *parent);
+
+void
+symbol_table_destroy(struct symbol_table **table);
+
+/* name, and the string given as a value below, must be interned */
 struct symbol*
 symbol_new(char *name, value_t v_type);
 
+/* the value was changed in place */
+void
+symbol_touch(struct symbol *symbol);
+
 void
 symbol_set_val(struct symbol *symbol, value_t v_type, void *val);
 
+/* make the symbol a view of data owned by the caller, nothing is copied */
+void
+symbol_bind_vector(struct symbol *symbol, double *data, size_t size);
+
+void
+symbol_bind_matrix(struct symbol *symbol, double *data, size_t rows,
+						size_t cols);
+
 struct symbol*
-symbol_get_ans(void);
+symbol_get_ans(struct bclite_ctx *ctx);
 
 void
 symbol_destroy(struct symbol *symbol);
@@ -8,102 +8,83 @@
 #include "symbol.h"
 #include "umalloc.h"
 #include "function.h"
-
-extern struct lex lex;
-
-static int errors;
+#include "context.h"
+#include "misc.h"
 
 #define error_msg(message) \
 do { \
-	errors++; \
-	fprintf(stderr, "%s\n", (message)); \
+	ctx->parse_errors++; \
+	fprintf(message_stream(), "%s\n", (message)); \
 } while(0)
 
 struct scope_ctx {
 	int is_func;
 	int is_cycle;
 	int is_cond;
+	int is_par;		/* in a parfor body */
+	int is_par_loop;	/* the innermost loop is a parfor */
 };
 
-static struct lex lex_prev;
-static token_t current_token;
-
-static struct ast_node *or_expr(void);
-static struct ast_node *and_expr(void);
-static struct ast_node *rest_or(struct ast_node *node);
-static struct ast_node *rest_and(struct ast_node *node);
-static struct ast_node *rel_expr(void);
-static struct ast_node *sum_expr(void);
-static struct ast_node *mult_expr(void);
-static struct ast_node *rest_mult(struct ast_node *node);
-static struct ast_node *rest_sum(struct ast_node *node);
-static struct ast_node *exp_expr(void);
-static struct ast_node *rest_exp(struct ast_node *node);
-static struct ast_node *token_id(char *name);
-static struct ast_node *function_call(char *name);
-static struct ast_node *stmt(void *opaque);
-static struct ast_node *stmts(void *opaque);
-static struct ast_node *process_matrix(void);
+static struct ast_node *or_expr(struct bclite_ctx *ctx);
+static struct ast_node *and_expr(struct bclite_ctx *ctx);
+static struct ast_node *rest_or(struct bclite_ctx *ctx, struct ast_node *node);
+static struct ast_node *rest_and(struct bclite_ctx *ctx, struct ast_node *node);
+static struct ast_node *rel_expr(struct bclite_ctx *ctx);
+static struct ast_node *sum_expr(struct bclite_ctx *ctx);
+static struct ast_node *mult_expr(struct bclite_ctx *ctx);
+static struct ast_node *rest_mult(struct bclite_ctx *ctx, struct ast_node *node);
+static struct ast_node *rest_sum(struct bclite_ctx *ctx, struct ast_node *node);
+static struct ast_node *exp_expr(struct bclite_ctx *ctx);
+static struct ast_node *rest_exp(struct bclite_ctx *ctx, struct ast_node *node);
+static struct ast_node *token_id(struct bclite_ctx *ctx, char *name);
+static struct ast_node *function_call(struct bclite_ctx *ctx, char *name);
+static struct ast_node *stmt(struct bclite_ctx *ctx, void *opaque);
+static struct ast_node *stmts(struct bclite_ctx *ctx, void *opaque);
+static struct ast_node *parfor_expr(struct bclite_ctx *ctx, void *opaque);
+static struct ast_node *process_matrix(struct bclite_ctx *ctx);
 
 
 static void
-sync_stream(void)
+sync_stream(struct bclite_ctx *ctx)
 {
-	while (current_token != TOKEN_EOL)
-		current_token = get_next_token();
+	while (ctx->current_token != TOKEN_EOL)
+		ctx->current_token = get_next_token(ctx);
 }
 
 static void
-lex_dup(void)
+lex_dup(struct bclite_ctx *ctx)
 {
-	switch (lex.token) {
+	switch (ctx->lex.token) {
 	case TOKEN_DOUBLE:
-		lex_prev.real = lex.real;
+		ctx->lex_prev.real = ctx->lex.real;
 		break;
 	case TOKEN_ID:
-		lex_prev.id = ustrdup(lex.id);
+		ctx->lex_prev.id = ctx->lex.id;
 		break;
 	case TOKEN_STRING:
-		lex_prev.string = ustrdup(lex.string);
+		ctx->lex_prev.string = ctx->lex.string;
 		break;
 	default:
 		break;
 	
 	}
 
-	lex_prev.token = current_token;
-}
-
-static void
-lex_prev_free(void)
-{
-	switch(lex_prev.token) {
-	case TOKEN_ID:
-		ufree(lex_prev.id);
-		break;
-	case TOKEN_STRING:
-		ufree(lex_prev.string);
-		break;
-	default:
-		break;	
-	}
+	ctx->lex_prev.token = ctx->current_token;
 }
 
 static void
-consume_token(void)
+consume_token(struct bclite_ctx *ctx)
 {
-	lex_prev_free();
-	lex_dup();
-	current_token = get_next_token();
+	lex_dup(ctx);
+	ctx->current_token = get_next_token(ctx);
 }
 
 static int
-match(token_t token)
+match(struct bclite_ctx *ctx, token_t token)
 {
-	if (current_token == token) {
-		lex_prev_free();
-		lex_dup();
-		current_token = get_next_token();
+	if (ctx->current_token == token) {
+		lex_dup(ctx);
+		ctx->current_token = get_next_token(ctx);
 		return 1;	
 	}
 
@@ -111,22 +92,22 @@ match(token_t token)
 }
 
 static struct ast_node*
-term(void)
+term(struct bclite_ctx *ctx)
 {
 	struct ast_node_const *_const;
 	struct ast_node *node;
 
-	if (match(TOKEN_ID)) {
-		node = token_id(lex_prev.id);
+	if (match(ctx, TOKEN_ID)) {
+		node = token_id(ctx, ctx->lex_prev.id);
 		return node;
-	} else if (match(TOKEN_DOUBLE)) {
-		_const = ast_node_const(VALUE_TYPE_DIGIT, &lex_prev.real);
+	} else if (match(ctx, TOKEN_DOUBLE)) {
+		_const = ast_node_const(VALUE_TYPE_DIGIT, &ctx->lex_prev.real);
 		return AST_NODE(_const);
-	} else if (match(TOKEN_STRING)) {
-		_const = ast_node_const(VALUE_TYPE_STRING, lex_prev.string);
+	} else if (match(ctx, TOKEN_STRING)) {
+		_const = ast_node_const(VALUE_TYPE_STRING, ctx->lex_prev.string);
 		return AST_NODE(_const);
-	} else if (match(TOKEN_LBRACKET)) {
-		node = process_matrix();
+	} else if (match(ctx, TOKEN_LBRACKET)) {
+		node = process_matrix(ctx);
 		return node;
 	}
 
@@ -134,7 +115,7 @@ term(void)
 }
 
 static struct ast_node*
-process_matrix(void)
+process_matrix(struct bclite_ctx *ctx)
 {	
 	struct ast_node_stub *stub_node;
 	struct ast_node **elem;
@@ -150,40 +131,40 @@ process_matrix(void)
 	len = prev_col = 0;
 
 	while (TRUE) {
-		node = or_expr();
+		node = or_expr(ctx);
 
 		if (node == NULL) {
 			error_msg("expr expected");
-			sync_stream();
+			sync_stream(ctx);
 			goto err;
 		}		
 		
 		elem = urealloc(elem, ++len*sizeof(struct ast_node *));
 		elem[len - 1] = node;
 
-		switch(current_token) {
+		switch(ctx->current_token) {
 		case TOKEN_COMMA:
-			consume_token();
+			consume_token(ctx);
 			col++;
 			continue;
 		case TOKEN_SEMICOLON:
-			consume_token();
+			consume_token(ctx);
 			if (prev_col == 0)
 				prev_col = col;
 			else if (prev_col != col) {
 				error_msg("incompatible column count");
-				sync_stream();
+				sync_stream(ctx);
 				goto err;
 			}
 			col = 1;
 			row++;
 			continue;
 		case TOKEN_RBRACKET:
-			consume_token();
+			consume_token(ctx);
 			break;
 		default:
 			error_msg("syntax error");
-			sync_stream();
+			sync_stream(ctx);
 			goto err;
 		} 
 		break;							
@@ -210,7 +191,7 @@ err:
 }
 
 static struct ast_node*
-function_call(char *name)
+function_call(struct bclite_ctx *ctx, char *name)
 {
 	struct function *func_ctx;
 	struct ast_node_func_call *func_call;
@@ -218,32 +199,32 @@ function_call(char *name)
 	struct ast_node *arg;
 	int nargs = 0;
 
-	func_ctx = function_table_lookup(name);
+	func_ctx = function_table_lookup(ctx, name);
 
-	consume_token();
+	consume_token(ctx);
 	
 	if (func_ctx == NULL) {
 		error_msg("unknown function");
-		sync_stream();
+		sync_stream(ctx);
 		stub_node = ast_node_stub();
 		return AST_NODE(stub_node);	
 	}
 
 	func_call = ast_node_func_call(func_ctx->name);
 
-	while (!match(TOKEN_RPARENTH)) {
-		if (match(TOKEN_EOL)) {
+	while (!match(ctx, TOKEN_RPARENTH)) {
+		if (match(ctx, TOKEN_EOL)) {
 			error_msg("EOL in function call");
-			sync_stream();
+			sync_stream(ctx);
 			goto free;
 			
 		}
 		
-		arg = or_expr();
+		arg = or_expr(ctx);
 
 		if (arg == NULL) {
 			error_msg("error: function argument expected");
-			sync_stream();
+			sync_stream(ctx);
 			goto free;
 		}
 			
@@ -251,16 +232,16 @@ function_call(char *name)
 
 		ast_node_func_call_add_arg(func_call, arg);
 		
-		if (current_token != TOKEN_RPARENTH && !match(TOKEN_COMMA)) {
+		if (ctx->current_token != TOKEN_RPARENTH && !match(ctx, TOKEN_COMMA)) {
 			error_msg("error: missed comma");
-			sync_stream();
+			sync_stream(ctx);
 			goto free;
 		}				
 	}
 	
 	if (func_ctx->nargs != nargs) {
 		error_msg("error: unmatched arguments count");
-		sync_stream();
+		sync_stream(ctx);
 		goto free;
 	}
 
@@ -272,7 +253,7 @@ free:
 }
 
 /*static int
-verify_index_type(struct ast_node *node)
+verify_index_type(struct bclite_ctx *ctx, struct ast_node *node)
 {
 	struct ast_node_const *_const;
 	struct ast_node_id *id;
@@ -286,7 +267,7 @@ verify_index_type(struct ast_node *node)
 		break; 
 	case NODE_TYPE_ID:
 		id  = (struct ast_node_id *)node;
-		sym = symbol_table_lookup_all(id->name);
+		sym = symbol_table_lookup_all(ctx, id->name);
 		if (sym->v_type != VALUE_TYPE_DIGIT)
 			return FALSE;
 		break;
@@ -300,46 +281,46 @@ verify_index_type(struct ast_node *node)
 */
 
 static struct ast_node*
-access_node(char *name)
+access_node(struct bclite_ctx *ctx, char *name)
 {
 	struct ast_node_stub *stub_node;
 	struct ast_node_access *ac_node;
 	struct ast_node *idx;
 	struct symbol *sym;
 
-	sym = symbol_table_lookup_all(name);
+	sym = symbol_table_lookup_all(ctx, name);
 	
+	/* may be bound later, the type is checked when it is evaluated */
 	if (sym == NULL) {
-		error_msg("error: no such symbol");
-		sync_stream();
-		stub_node = ast_node_stub();
-		return AST_NODE(stub_node);
+		sym = symbol_new(name, VALUE_TYPE_UNKNOWN);
+		symbol_table_global_put_symbol(ctx, sym);
 	}
 	/* `[' */
-	consume_token();
+	consume_token(ctx);
 	
-	ac_node = ast_node_access(sym->v_type, sym->name);
+	ac_node = ast_node_access(sym->v_type, sym->name,
+		symbol_table_lookup_slot(ctx, sym->name));
 
 	do {
-		idx = or_expr();
+		idx = or_expr(ctx);
 			
 		if (idx == NULL) {	
 			error_msg("error: empty index");
-			sync_stream();
+			sync_stream(ctx);
 			goto ac_error;
 		}
 		
 		ast_node_access_add(ac_node, idx);
 
-		if (current_token != TOKEN_RBRACKET) {
+		if (ctx->current_token != TOKEN_RBRACKET) {
 			error_msg("error: missed `]'");	
-			sync_stream();
+			sync_stream(ctx);
 			goto ac_error;
 		}
 		/* `]' */
-		consume_token();
+		consume_token(ctx);
 
-	} while (match(TOKEN_LBRACKET));
+	} while (match(ctx, TOKEN_LBRACKET));
 
 	return AST_NODE(ac_node);
 
@@ -351,27 +332,28 @@ ac_error:
 }
 
 struct ast_node*
-token_id(char *name)
+token_id(struct bclite_ctx *ctx, char *name)
 {
 	struct ast_node *node;
 	struct symbol *sym;
 
-	switch (current_token) {
+	switch (ctx->current_token) {
 	case TOKEN_LPARENTH :
-		node = function_call(name);
+		node = function_call(ctx, name);
 		break;
 	case TOKEN_LBRACKET:
-		node = access_node(name);
+		node = access_node(ctx, name);
 		break;
 	default:		
-		sym = symbol_table_lookup_all(name);
+		sym = symbol_table_lookup_all(ctx, name);
 		
 		if (sym == NULL) {
 			sym = symbol_new(name, VALUE_TYPE_UNKNOWN);
-			symbol_table_global_put_symbol(sym);
+			symbol_table_global_put_symbol(ctx, sym);
 		}
 
-		node = (struct ast_node *)ast_node_id(name);
+		node = (struct ast_node *)ast_node_id(name,
+			symbol_table_lookup_slot(ctx, name));
 		break;
 	}
 
@@ -379,39 +361,39 @@ token_id(char *name)
 }
 
 static struct ast_node*
-term_expr(void)
+term_expr(struct bclite_ctx *ctx)
 {
 	struct ast_node *node;
 
-	if (!match(TOKEN_LPARENTH))
-		return term();
+	if (!match(ctx, TOKEN_LPARENTH))
+		return term(ctx);
 
-	node = or_expr();
+	node = or_expr(ctx);
 	
-	if (!match(TOKEN_RPARENTH)) 
+	if (!match(ctx, TOKEN_RPARENTH)) 
 		error_msg("error: missed `)'");	
 
 	return node;	
 }
 
 static struct ast_node*
-exp_expr(void)
+exp_expr(struct bclite_ctx *ctx)
 {
 	struct ast_node *node;
 	struct ast_node *rest_node;
 	
-	node = term_expr();
+	node = term_expr(ctx);
 		
 	if (node == NULL)
 		return NULL;
 	
-	rest_node = rest_exp(node);
+	rest_node = rest_exp(ctx, node);
 	
 	return rest_node;
 }
 
 static struct ast_node*
-rest_exp(struct ast_node *node)
+rest_exp(struct bclite_ctx *ctx, struct ast_node *node)
 {
 	struct ast_node *expr_node;
 	struct ast_node *prev_node;
@@ -421,7 +403,7 @@ rest_exp(struct ast_node *node)
 	prev_node = node;
 
 	while(TRUE) {
-		switch(current_token) {
+		switch(ctx->current_token) {
 		case TOKEN_CARET:
 			op = '^';
 			break;
@@ -429,13 +411,13 @@ rest_exp(struct ast_node *node)
 			goto exit_exp;			
 		}
 
-		consume_token();
-		expr_node = term_expr();
+		consume_token(ctx);
+		expr_node = term_expr(ctx);
 	
 		if (expr_node == NULL) {
 			error_msg("error: syntax error");
 			expr_node = (struct ast_node *)ast_node_stub();
-			sync_stream();
+			sync_stream(ctx);
 			goto exit_exp;
 		}
 	
@@ -448,23 +430,23 @@ exit_exp:
 }
 
 static struct ast_node*
-mult_expr(void)
+mult_expr(struct bclite_ctx *ctx)
 {
 	struct ast_node *node;
 	struct ast_node *rest_node;
 	
-	node = exp_expr();
+	node = exp_expr(ctx);
 
 	if (node == NULL)
 		return NULL;
 
-	rest_node = rest_mult(node);
+	rest_node = rest_mult(ctx, node);
 	
 	return rest_node;	
 }
 
 static struct ast_node*
-rest_mult(struct ast_node *node)
+rest_mult(struct bclite_ctx *ctx, struct ast_node *node)
 {
 	struct ast_node *expr_node;
 	struct ast_node *prev_node;
@@ -474,7 +456,7 @@ rest_mult(struct ast_node *node)
 	prev_node = node;
 	
 	while (TRUE) {
-		switch(current_token) {	
+		switch(ctx->current_token) {	
 		case TOKEN_ASTERIK:
 			op = '*';
 			break;
@@ -485,8 +467,8 @@ rest_mult(struct ast_node *node)
 			goto exit_mult;
 		}
 
-		consume_token();
-		expr_node = exp_expr();
+		consume_token(ctx);
+		expr_node = exp_expr(ctx);
 
 		if (expr_node == NULL) {
 			error_msg("error: syntax error");
@@ -503,23 +485,23 @@ exit_mult:
 }
 
 static struct ast_node*
-sum_expr(void) 
+sum_expr(struct bclite_ctx *ctx) 
 {
 	struct ast_node *node;
 	struct ast_node *rest_node;
 
-	node = mult_expr();
+	node = mult_expr(ctx);
 
 	if (node == NULL)
 		return NULL;
 
-	rest_node = rest_sum(node);
+	rest_node = rest_sum(ctx, node);
 
 	return rest_node;
 }
 
 static struct ast_node*
-rest_sum(struct ast_node *node)
+rest_sum(struct bclite_ctx *ctx, struct ast_node *node)
 {
 	struct ast_node *prev_node;
 	struct ast_node *ret_node;
@@ -529,7 +511,7 @@ rest_sum(struct ast_node *node)
 	prev_node = node;
 	
 	while (TRUE) {
-		switch(current_token) {
+		switch(ctx->current_token) {
 		case TOKEN_PLUS:
 			op = '+';
 			break;
@@ -540,8 +522,8 @@ rest_sum(struct ast_node *node)
 			goto exit_sum;
 		}
 
-		consume_token();
-		mult_node = mult_expr();
+		consume_token(ctx);
+		mult_node = mult_expr(ctx);
 		
 		if (mult_node == NULL) {
 			error_msg("error: syntax error");
@@ -557,23 +539,23 @@ exit_sum:
 }
 
 static struct ast_node*
-or_expr(void)
+or_expr(struct bclite_ctx *ctx)
 {
 	struct ast_node *node;
 	struct ast_node *rest_node;
 	
-	node = and_expr();
+	node = and_expr(ctx);
 	
 	if (node == NULL)
 		return NULL;
 		
-	rest_node = rest_or(node);
+	rest_node = rest_or(ctx, node);
 	
 	return rest_node;	
 }
 
 static struct ast_node*
-rest_or(struct ast_node *node)
+rest_or(struct bclite_ctx *ctx, struct ast_node *node)
 {
 	struct ast_node *ret_node;	
 	struct ast_node *left;
@@ -582,17 +564,17 @@ rest_or(struct ast_node *node)
 	ret_node = node;
 	
 	while (TRUE) {
-		switch(current_token) {
+		switch(ctx->current_token) {
 		case TOKEN_OR :
-			consume_token();
+			consume_token(ctx);
 
 			left  = ret_node;
-			right = and_expr();
+			right = and_expr(ctx);
 			
 			if (right == NULL) {
 				error_msg("error: expression expected after ||");	
 				right = (struct ast_node *)ast_node_stub();
-				sync_stream();
+				sync_stream(ctx);
 			}
 			ret_node = (struct ast_node *)ast_node_logic_op(OPCODE_OR, left, right);
 			continue;
@@ -606,23 +588,23 @@ exit_or:
 }
 
 static struct ast_node*
-and_expr(void)
+and_expr(struct bclite_ctx *ctx)
 {
 	struct ast_node *node;
 	struct ast_node *rest_node;
 
-	node = rel_expr();
+	node = rel_expr(ctx);
 	
 	if (node == NULL)
 		return NULL;
 	
-	rest_node = rest_and(node);
+	rest_node = rest_and(ctx, node);
 	
 	return	rest_node;
 }
 
 static struct ast_node*
-rest_and(struct ast_node *node)
+rest_and(struct bclite_ctx *ctx, struct ast_node *node)
 {
 	struct ast_node *ret_node;
 	struct ast_node *left;
@@ -631,17 +613,17 @@ rest_and(struct ast_node *node)
 	ret_node = node;
 	
 	while (TRUE) {
-		switch (current_token) {
+		switch (ctx->current_token) {
 		case TOKEN_AND:
-			consume_token();
+			consume_token(ctx);
 
 			left  = ret_node;
-			right = rel_expr();
+			right = rel_expr(ctx);
 
 			if (right == NULL) {
 				error_msg("error: missed expression");
 				right = (struct ast_node *)ast_node_stub();
-				sync_stream();
+				sync_stream(ctx);
 			}	
 			ret_node = (struct ast_node *)ast_node_logic_op(OPCODE_AND, left, right);
 			continue;
@@ -655,53 +637,53 @@ exit_and:
 }
 
 static struct ast_node*
-rel_expr(void)
+rel_expr(struct bclite_ctx *ctx)
 {
 	struct ast_node *left;
 	struct ast_node *right;
 	struct ast_node_op *op_node;
 	opcode_type_t opcode;
 
-	left = sum_expr();
+	left = sum_expr(ctx);
 
 	if (left == NULL)
 		return NULL;
 
-	switch(current_token) {
+	switch(ctx->current_token) {
 	case TOKEN_EQ:
-		consume_token();
+		consume_token(ctx);
 		opcode = OPCODE_EQ;
 		break;	
 	case TOKEN_LT:
-		consume_token();
+		consume_token(ctx);
 		opcode = OPCODE_LT;
 		break; 
 	case TOKEN_GT:
-		consume_token();
+		consume_token(ctx);
 		opcode = OPCODE_GT;
 		break;
 	case TOKEN_LE:
-		consume_token();
+		consume_token(ctx);
 		opcode = OPCODE_LE;
 		break;
 	case TOKEN_GE:
-		consume_token();
+		consume_token(ctx);
 		opcode = OPCODE_GE;
 		break;
 	case TOKEN_NE:
-		consume_token();
+		consume_token(ctx);
 		opcode = OPCODE_NE;
 		break;
 	default:
 		return left;
 	}
 	
-	right = sum_expr();
+	right = sum_expr(ctx);
 
 	if (right == NULL) {
 		error_msg("error: expression expected");
 		right = (struct ast_node *)ast_node_stub();
-		sync_stream();
+		sync_stream(ctx);
 	}
 		
 	op_node = ast_node_rel_op(opcode, left, right);
@@ -711,18 +693,18 @@ rel_expr(void)
 
 
 static struct ast_node*
-expr(void)
+expr(struct bclite_ctx *ctx)
 {
 	struct ast_node *lvalue;
 	struct ast_node *rvalue;
 	struct ast_node_assign *assign;
 
-	lvalue = or_expr();
+	lvalue = or_expr(ctx);
 	
-	if (current_token != TOKEN_EQUALITY)
+	if (ctx->current_token != TOKEN_EQUALITY)
 		return lvalue;	
 	/* `=' */
-	consume_token();
+	consume_token(ctx);
 	
 	switch(lvalue->type) {
 	case NODE_TYPE_ID:
@@ -730,15 +712,24 @@ expr(void)
 		break;
 	default:	
 		error_msg("error: rvalue assignmet");
-		sync_stream();
+		sync_stream(ctx);
+		return lvalue;
+	}
+
+	/* other iterations may read it meanwhile */
+	if (ctx->par_scope != NULL && lvalue->type == NODE_TYPE_ID &&
+	    ((struct ast_node_id *)lvalue)->slot < ctx->par_scope->shared) {
+		error_msg("error: assignment to a shared variable in parfor,"
+						" declare it local");
+		sync_stream(ctx);
 		return lvalue;
 	}
 	
-	rvalue = or_expr();
+	rvalue = or_expr(ctx);
 
 	if (!rvalue) {
 		error_msg("error: expression expected `='");
-		sync_stream();
+		sync_stream(ctx);
 		rvalue = (struct ast_node *)ast_node_stub();
 	}
 	
@@ -748,19 +739,26 @@ expr(void)
 }
 
 struct ast_node*
-process_return_node(void *opaque)
+process_return_node(struct bclite_ctx *ctx, void *opaque)
 {
 	struct ast_node *ret_val;
 	struct ast_node_return *_return;
 	
 	if (!opaque) {
 		error_msg("error: return outside function");
-		sync_stream();
+		sync_stream(ctx);
+		ret_val = (struct ast_node *)ast_node_stub();
+		return AST_NODE(ret_val);
+	}
+
+	if (((struct scope_ctx *)opaque)->is_par) {
+		error_msg("error: `return' in parfor");
+		sync_stream(ctx);
 		ret_val = (struct ast_node *)ast_node_stub();
 		return AST_NODE(ret_val);
 	}
 	
-	ret_val = sum_expr();
+	ret_val = sum_expr(ctx);
 	
 	_return = ast_node_return(ret_val);
 
@@ -768,117 +766,122 @@ process_return_node(void *opaque)
 }
 
 static void
-process_function_body(char *name)
+process_function_body(struct bclite_ctx *ctx, char *name)
 {
 	struct scope_ctx helper;
 	struct ast_node *body;
 	struct function *func_ctx;
-	struct symbol_table *scope;
+	struct symbol_table *scope, *par_scope;
 	int i;
 
-	consume_token();
+	consume_token(ctx);
 	
-	func_ctx = function_table_lookup(name);
+	func_ctx = function_table_lookup(ctx, name);
 
-	symbol_table_push();
+	symbol_table_push(ctx);
 	/* insert arguments in function scope */	
 	for (i = 0; i < func_ctx->nargs; i++)
-		symbol_table_put_symbol(func_ctx->args[i]);
+		symbol_table_put_symbol(ctx, func_ctx->args[i]);
 	
 	
 	memset(&helper, 0, sizeof(helper));
 	
 	helper.is_func = 1;
 	
-	body  = stmts(&helper);
+	par_scope = ctx->par_scope;
+	ctx->par_scope = NULL;
+
+	body  = stmts(ctx, &helper);
+
+	ctx->par_scope = par_scope;
 	
-	scope = symbol_table_get_current_table();
+	scope = symbol_table_get_current_table(ctx);
 	
 	func_ctx->body  = body;		
 	func_ctx->scope = scope;
 	
-	symbol_table_pop();	
+	symbol_table_pop(ctx);	
 
-	if(errors) {
+	if(ctx->parse_errors) {
 		error_msg("->redefine your function");
-		function_table_delete_function(name);
+		function_table_delete_function(ctx, name);
 	}	
 }
 
 static void
-process_args(char *name)
+process_args(struct bclite_ctx *ctx, char *name)
 {
 	struct function *func;
 	struct symbol *arg;
 
 	/*(*/
-	consume_token();
+	consume_token(ctx);
 
-	func = function_table_lookup(name);
+	func = function_table_lookup(ctx, name);
 
 	/* Delete an old function and make a new one */
 	if (func != NULL) 
-		function_table_delete_function(name);	
+		function_table_delete_function(ctx, name);	
 
 	func = function_new(name);
 	
-	while (!match(TOKEN_RPARENTH)) {
-		if (match(TOKEN_EOL)) {
+	while (!match(ctx, TOKEN_RPARENTH)) {
+		if (match(ctx, TOKEN_EOL)) {
 			error_msg("error: new line in function definition");
 			return;	
 		}
 		
-		if (!match(TOKEN_ID)) {
+		if (!match(ctx, TOKEN_ID)) {
 			error_msg("error: unexpected symbol in definition");
-			sync_stream();
+			sync_stream(ctx);
 			ufree(func);
 			return;
 		}
 	
-		arg = symbol_new(lex_prev.id, VALUE_TYPE_UNKNOWN);
+		arg = symbol_new(ctx->lex_prev.id, VALUE_TYPE_UNKNOWN);
 		
 		function_add_arg(func, arg);
 		
-		if (current_token != TOKEN_RPARENTH && !match(TOKEN_COMMA)) {
+		if (ctx->current_token != TOKEN_RPARENTH && !match(ctx, TOKEN_COMMA)) {
 			error_msg("error: comma expected");
-			sync_stream();
+			sync_stream(ctx);
 			return;
 		}			
 	}
 
-	switch(current_token) {
+	switch(ctx->current_token) {
 	case TOKEN_LBRACE:
-		function_table_insert(func);
-		process_function_body(name);
+		function_table_insert(ctx, func);
+		process_function_body(ctx, name);
 		break;
 	default:
 		error_msg("error: `{' expected");
-		sync_stream();
+		sync_stream(ctx);
 		break;
 	}	
 }
 
 struct ast_node*
-process_function(void *opaque)
+process_function(struct bclite_ctx *ctx, void *opaque)
 {
 	char *name;
 	struct ast_node_stub *stub_node;
 
-	if (!match(TOKEN_ID)) {
+	if (!match(ctx, TOKEN_ID)) {
 		error_msg("error: function name expected after `function'");	
-		sync_stream();
+		sync_stream(ctx);
 		goto exit;	
 	}
 	
-	name = ustrdup(lex_prev.id);
+	name = ctx->lex_prev.id;
 
-	if (current_token != TOKEN_LPARENTH) {
+	if (ctx->current_token != TOKEN_LPARENTH) {
 		error_msg("error: `(' expected");
-		sync_stream();
+		sync_stream(ctx);
 		goto exit;
 	}
 	
-	process_args(name);
+	process_args(ctx, name);
 exit:	
 	stub_node = ast_node_stub();
 
@@ -886,7 +889,7 @@ exit:
 }
 
 static struct ast_node*
-if_expr(void *opaque)
+if_expr(struct bclite_ctx *ctx, void *opaque)
 {
 	struct ast_node_if *if_node;
 	struct ast_node_stub *stub_node;
@@ -895,25 +898,25 @@ if_expr(void *opaque)
 	struct ast_node *_else;
 	struct scope_ctx helper;
 
-	if (!match(TOKEN_LPARENTH)) {
+	if (!match(ctx, TOKEN_LPARENTH)) {
 		error_msg("error: `(' expected after if");
-		sync_stream();
+		sync_stream(ctx);
 		stub_node = ast_node_stub();
 		return AST_NODE(stub_node);
 	}
 	
-	expr = or_expr();
+	expr = or_expr(ctx);
 	
 	if (expr == NULL) {
 		error_msg("error: expression expected after `('");
-		sync_stream(); 
+		sync_stream(ctx); 
 		stub_node = ast_node_stub();
 		return AST_NODE(stub_node);
 	}
 	
-	if (!match(TOKEN_RPARENTH)) {	
+	if (!match(ctx, TOKEN_RPARENTH)) {	
 		error_msg("error: `)' expected after exprssion");
-		sync_stream();
+		sync_stream(ctx);
 		stub_node = ast_node_stub();
 		return AST_NODE(stub_node);
 	}
@@ -926,7 +929,7 @@ if_expr(void *opaque)
 		helper.is_cond++;
 	}	
 		
-	stmt_node = stmt(&helper);
+	stmt_node = stmt(ctx, &helper);
 		
 	if (stmt_node == NULL) {
 		error_msg("error: statment expected after `)'");
@@ -936,8 +939,8 @@ if_expr(void *opaque)
 
 	_else = NULL;
 
-	if (match(TOKEN_ELSE))
-		_else = stmt(&helper);
+	if (match(ctx, TOKEN_ELSE))
+		_else = stmt(ctx, &helper);
 	
 	if_node = ast_node_if(expr, stmt_node, _else);
 		
@@ -947,7 +950,7 @@ if_expr(void *opaque)
 }
 
 static struct ast_node*
-process_scope(void *opaque)
+process_scope(struct bclite_ctx *ctx, void *opaque)
 {
 	struct ast_node *stmt;
 	struct ast_node_stub *stub_node;
@@ -955,7 +958,7 @@ process_scope(void *opaque)
 
 	if (opaque == NULL) {
 		error_msg("error: unexpected symbol");
-		sync_stream();
+		sync_stream(ctx);
 		stub_node = ast_node_stub();
 		return AST_NODE(stub_node);
 	}	
@@ -968,19 +971,19 @@ process_scope(void *opaque)
 		return AST_NODE(stub_node);
 	}
 		
-	stmt = stmts(opaque);	
+	stmt = stmts(ctx, opaque);	
 		
 	return stmt;
 }
 
 static struct ast_node*
-unknown_expr(void *opaque)
+unknown_expr(struct bclite_ctx *ctx, void *opaque)
 {
 	struct ast_node_stub *node;
 
 	error_msg("error: unknown expression");
 
-	sync_stream();	
+	sync_stream(ctx);	
 
 	node = ast_node_stub();
 
@@ -988,17 +991,17 @@ unknown_expr(void *opaque)
 }
 
 static struct ast_node*
-other_expr(void *opaque)
+other_expr(struct bclite_ctx *ctx, void *opaque)
 {
 	struct ast_node *node;
 	struct ast_node_stub *stub_node;
 
-	node = expr();	
+	node = expr(ctx);	
 		
 	if (node == NULL) {
-		if (current_token != TOKEN_EOL) {
+		if (ctx->current_token != TOKEN_EOL) {
 			error_msg("error: unexpected symbol");
-			sync_stream();
+			sync_stream(ctx);
 			stub_node = ast_node_stub();
 			return AST_NODE(stub_node);
 		}
@@ -1008,7 +1011,7 @@ other_expr(void *opaque)
 }
 
 static struct ast_node*
-for_expr(void *opaque)
+for_expr(struct bclite_ctx *ctx, void *opaque)
 {
 	struct ast_node_for *for_node;
 	struct ast_node_stub *stub_node;
@@ -1018,36 +1021,36 @@ for_expr(void *opaque)
 	struct ast_node *_stmt;
 	struct scope_ctx helper;
 
-	if (!match(TOKEN_LPARENTH)) {
+	if (!match(ctx, TOKEN_LPARENTH)) {
 		error_msg("error: `(' expected after for");
-		sync_stream();
+		sync_stream(ctx);
 		stub_node = ast_node_stub();
 		return AST_NODE(stub_node);
 	}
 	
-	expr1 = expr();
+	expr1 = expr(ctx);
 	
-	if (!match(TOKEN_SEMICOLON)) {
+	if (!match(ctx, TOKEN_SEMICOLON)) {
 		error_msg("error: `;' expected after for(");
-		sync_stream();
+		sync_stream(ctx);
 		stub_node = ast_node_stub();
 		return AST_NODE(stub_node);
 	}
 	
-	expr2 = or_expr();
+	expr2 = or_expr(ctx);
 
-	if (!match(TOKEN_SEMICOLON)) {
+	if (!match(ctx, TOKEN_SEMICOLON)) {
 		error_msg("error: `;' expected after for(;");
-		sync_stream();
+		sync_stream(ctx);
 		stub_node = ast_node_stub();
 		return AST_NODE(stub_node);
 	}	
 	
-	expr3 = expr();
+	expr3 = expr(ctx);
 		
-	if (!match(TOKEN_RPARENTH)) {
+	if (!match(ctx, TOKEN_RPARENTH)) {
 		error_msg("error: `)' expected after for(;;");
-		sync_stream();
+		sync_stream(ctx);
 		stub_node = ast_node_stub();
 		return AST_NODE(stub_node);
 	}
@@ -1060,11 +1063,13 @@ for_expr(void *opaque)
 		helper.is_cycle++;
 	}
 
-	_stmt = stmt(&helper);
+	helper.is_par_loop = 0;
+
+	_stmt = stmt(ctx, &helper);
 	
 	if (_stmt == NULL) {
 		error_msg("error: stmt expected after for(;;)");
-		sync_stream();
+		sync_stream(ctx);
 		stub_node = ast_node_stub();
 		return AST_NODE(stub_node);
 	}
@@ -1076,8 +1081,223 @@ for_expr(void *opaque)
 	return AST_NODE(for_node);
 }
 
+/* the private slot for name in the parfor frame being parsed */
+static int
+parfor_private(struct bclite_ctx *ctx, char *name)
+{
+	struct symbol_table *scope;
+
+	scope = symbol_table_get_current_table(ctx);
+
+	if (symbol_table_lookup_slot(ctx, name) >= scope->shared)
+		return -1;
+
+	symbol_table_put_symbol(ctx, symbol_new(name, VALUE_TYPE_UNKNOWN));
+
+	return scope->count - 1;
+}
+
+static int
+parfor_var(struct bclite_ctx *ctx, char *var)
+{
+	return match(ctx, TOKEN_ID) && ctx->lex_prev.id == var;
+}
+
+static int
+parfor_reductions(struct bclite_ctx *ctx, struct ast_node_parfor *parfor)
+{
+	struct symbol_table *scope;
+	opcode_type_t opcode;
+	char *op, *name;
+	int slot, outer;
+
+	scope = symbol_table_get_current_table(ctx);
+
+	do {
+		if (!match(ctx, TOKEN_ID))
+			return FALSE;
+
+		op = ctx->lex_prev.id;
+
+		if (STREQ(op, "sum"))
+			opcode = OPCODE_ADD;
+		else if (STREQ(op, "product"))
+			opcode = OPCODE_MULT;
+		else if (STREQ(op, "min"))
+			opcode = OPCODE_LT;
+		else if (STREQ(op, "max"))
+			opcode = OPCODE_GT;
+		else
+			return FALSE;
+
+		if (!match(ctx, TOKEN_ID))
+			return FALSE;
+
+		name  = ctx->lex_prev.id;
+		outer = symbol_table_lookup_slot(ctx, name);
+
+		if (outer >= scope->shared)
+			return FALSE;
+
+		/* a global, created if it is new */
+		if (outer < 0 && symbol_table_lookup_all(ctx, name) == NULL)
+			symbol_table_global_put_symbol(ctx,
+				symbol_new(name, VALUE_TYPE_UNKNOWN));
+
+		slot = parfor_private(ctx, name);
+
+		ast_node_parfor_add_reduction(parfor, opcode, name, slot, outer);
+
+	} while (match(ctx, TOKEN_COMMA));
+
+	return TRUE;
+}
+
+static struct ast_node*
+parfor_expr(struct bclite_ctx *ctx, void *opaque)
+{
+	struct ast_node_parfor *parfor;
+	struct ast_node *from, *to, *step, *body;
+	struct symbol_table *scope, *par_scope;
+	struct scope_ctx helper;
+	opcode_type_t cmp;
+	double zero;
+	char *var;
+	int slot, neg;
+
+	if (!match(ctx, TOKEN_LPARENTH) || ctx->current_token != TOKEN_ID) {
+		error_msg("error: parfor needs (i = a; i < b; i = i + c)");
+		sync_stream(ctx);
+		return AST_NODE(ast_node_stub());
+	}
+
+	var = ctx->lex.id;
+
+	symbol_table_push_frame(ctx);
+
+	scope  = symbol_table_get_current_table(ctx);
+	slot   = parfor_private(ctx, var);
+	parfor = NULL;
+	from   = to = step = NULL;
+
+	/* var = from; */
+	if (!parfor_var(ctx, var) || !match(ctx, TOKEN_EQUALITY) ||
+	    (from = or_expr(ctx)) == NULL || !match(ctx, TOKEN_SEMICOLON))
+		goto syntax;
+
+	/* var cmp to; */
+	if (!parfor_var(ctx, var))
+		goto syntax;
+
+	switch(ctx->current_token) {
+	case TOKEN_LT:
+		cmp = OPCODE_LT;
+		break;
+	case TOKEN_LE:
+		cmp = OPCODE_LE;
+		break;
+	case TOKEN_GT:
+		cmp = OPCODE_GT;
+		break;
+	case TOKEN_GE:
+		cmp = OPCODE_GE;
+		break;
+	default:
+		goto syntax;
+	}
+
+	consume_token(ctx);
+
+	if ((to = or_expr(ctx)) == NULL || !match(ctx, TOKEN_SEMICOLON))
+		goto syntax;
+
+	/* var = var + step or var = var - step */
+	if (!parfor_var(ctx, var) || !match(ctx, TOKEN_EQUALITY) ||
+	    !parfor_var(ctx, var))
+		goto syntax;
+
+	if (match(ctx, TOKEN_PLUS))
+		neg = FALSE;
+	else if (match(ctx, TOKEN_MINUS))
+		neg = TRUE;
+	else
+		goto syntax;
+
+	if ((step = mult_expr(ctx)) == NULL)
+		goto syntax;
+
+	/* 0 - step */
+	if (neg) {
+		zero = 0.0;
+		step = AST_NODE(ast_node_op('-',
+			AST_NODE(ast_node_const(VALUE_TYPE_DIGIT, &zero)), step));
+	}
+
+	parfor = ast_node_parfor(slot, from, to, step, cmp);
+	from = to = step = NULL;
+
+	/* ; sum s, max m */
+	if (match(ctx, TOKEN_SEMICOLON) && !parfor_reductions(ctx, parfor)) {
+		error_msg("error: parfor reductions are sum, product, min or"
+						" max of a new variable");
+		goto error;
+	}
+
+	if (!match(ctx, TOKEN_RPARENTH))
+		goto syntax;
+
+	if (opaque)
+		helper = *(struct scope_ctx *)opaque;
+	else
+		memset(&helper, 0, sizeof(helper));
+
+	helper.is_cycle++;
+	helper.is_par = 1;
+	helper.is_par_loop = 1;
+
+	par_scope = ctx->par_scope;
+	ctx->par_scope = scope;
+
+	body = stmt(ctx, &helper);
+
+	ctx->par_scope = par_scope;
+
+	if (body == NULL) {
+		error_msg("error: stmt expected after parfor()");
+		goto error;
+	}
+
+	symbol_table_pop(ctx);
+
+	parfor->stmt  = body;
+	parfor->scope = scope;
+
+	body->parent = AST_NODE(parfor);
+
+	return AST_NODE(parfor);
+
+syntax:
+	error_msg("error: parfor needs (i = a; i < b; i = i + c)");
+error:
+	sync_stream(ctx);
+
+	symbol_table_pop(ctx);
+	symbol_table_destroy(&scope);
+
+	if (parfor)
+		ast_node_unref(AST_NODE(parfor));
+	if (from)
+		ast_node_unref(from);
+	if (to)
+		ast_node_unref(to);
+	if (step)
+		ast_node_unref(step);
+
+	return AST_NODE(ast_node_stub());
+}
+
 static struct ast_node*
-while_expr(void *opaque)
+while_expr(struct bclite_ctx *ctx, void *opaque)
 {
 	struct ast_node_stub *stub_node;
 	struct ast_node_while *while_node;
@@ -1085,25 +1305,25 @@ while_expr(void *opaque)
 	struct ast_node *_stmt;
 	struct scope_ctx helper;
 
-	if (!match(TOKEN_LPARENTH)) {		
+	if (!match(ctx, TOKEN_LPARENTH)) {		
 		error_msg("errorr: `(' expected after while");
-		sync_stream();
+		sync_stream(ctx);
 		stub_node = ast_node_stub();
 		return AST_NODE(stub_node);
 	}
 	
-	expr = or_expr();
+	expr = or_expr(ctx);
 	
 	if (expr == NULL) {
 		error_msg("error: NULL expression in while()");
-		sync_stream();
+		sync_stream(ctx);
 		stub_node = ast_node_stub();
 		return AST_NODE(stub_node);
 	}
 	
-	if (!match(TOKEN_RPARENTH)) {
+	if (!match(ctx, TOKEN_RPARENTH)) {
 		error_msg("error: `)' expected after while(");
-		sync_stream();
+		sync_stream(ctx);
 		stub_node = ast_node_stub();
 		return AST_NODE(stub_node);
 	}
@@ -1116,7 +1336,9 @@ while_expr(void *opaque)
 		helper.is_cycle++;
 	}
 		
-	_stmt = stmt(&helper);
+	helper.is_par_loop = 0;
+
+	_stmt = stmt(ctx, &helper);
 	
 	if (_stmt == NULL) {
 		error_msg("error: statmet expected after while()");
@@ -1132,7 +1354,7 @@ while_expr(void *opaque)
 }
 
 static struct ast_node*
-break_expr(void *opaque)
+break_expr(struct bclite_ctx *ctx, void *opaque)
 {
 	struct ast_node_stub *stub_node;
 	struct ast_node_break *break_node;
@@ -1140,7 +1362,7 @@ break_expr(void *opaque)
 
 	if (opaque == NULL) {
 		error_msg("error: `break' outside loop");
-		sync_stream();
+		sync_stream(ctx);
 		stub_node = ast_node_stub();
 		return AST_NODE(stub_node);	
 	}
@@ -1149,7 +1371,14 @@ break_expr(void *opaque)
 	
 	if (!helper->is_cycle) {
 		error_msg("error: `break' outside loop");
-		sync_stream();
+		sync_stream(ctx);
+		stub_node = ast_node_stub();
+		return AST_NODE(stub_node);
+	}
+
+	if (helper->is_par_loop) {
+		error_msg("error: `break' in parfor");
+		sync_stream(ctx);
 		stub_node = ast_node_stub();
 		return AST_NODE(stub_node);
 	}
@@ -1160,7 +1389,7 @@ break_expr(void *opaque)
 }
 
 static struct ast_node*
-continue_expr(void *opaque)
+continue_expr(struct bclite_ctx *ctx, void *opaque)
 {
 	struct ast_node_continue *continue_node;
 	struct ast_node_stub *stub_node;
@@ -1168,7 +1397,7 @@ continue_expr(void *opaque)
 
 	if (opaque == NULL) {
 		error_msg("error: `continue' outside loop");
-		sync_stream();
+		sync_stream(ctx);
 		stub_node = ast_node_stub();
 		return AST_NODE(stub_node);
 	}
@@ -1177,7 +1406,7 @@ continue_expr(void *opaque)
 	
 	if (!helper.is_cycle) {
 		error_msg("error: `continue' outside loop`");
-		sync_stream();
+		sync_stream(ctx);
 		stub_node = ast_node_stub();
 		return AST_NODE(stub_node);
 	}
@@ -1188,7 +1417,7 @@ continue_expr(void *opaque)
 }
 
 static struct ast_node*
-end_scope_expr(void *opaque)
+end_scope_expr(struct bclite_ctx *ctx, void *opaque)
 {
 	struct ast_node_stub *stub_node;
 	struct ast_node_end_scope *scope_node;
@@ -1205,7 +1434,7 @@ end_scope_expr(void *opaque)
 }
 
 struct ast_node*
-process_local_declaration(void *opaque)
+process_local_declaration(struct bclite_ctx *ctx, void *opaque)
 {
 	struct scope_ctx helper;
 	struct ast_node_stub *stub_node;
@@ -1213,29 +1442,30 @@ process_local_declaration(void *opaque)
 
 	if (opaque == NULL) {
 		error_msg("error: `local' outside function");
-		sync_stream();
+		sync_stream(ctx);
 		stub_node = ast_node_stub();
 		return AST_NODE(stub_node);	
 	}
 	
 	helper = *(struct scope_ctx *)opaque;
 	
-	if (!helper.is_func) {
+	/* in a parfor body they are private to each worker */
+	if (!helper.is_func && !helper.is_par) {
 		error_msg("error: `local' outside function");
-		sync_stream();
+		sync_stream(ctx);
 		stub_node = ast_node_stub();
 		return AST_NODE(stub_node);
 	}
 	
-	while (!match(TOKEN_EOL)) {
-		if (match(TOKEN_ID)) {
-			var = symbol_new(lex_prev.id, VALUE_TYPE_UNKNOWN);
-			symbol_table_put_symbol(var);	
+	while (!match(ctx, TOKEN_EOL)) {
+		if (match(ctx, TOKEN_ID)) {
+			var = symbol_new(ctx->lex_prev.id, VALUE_TYPE_UNKNOWN);
+			symbol_table_put_symbol(ctx, var);	
 		}	
 		
-		if (current_token != TOKEN_EOL && !match(TOKEN_COMMA)) {
+		if (ctx->current_token != TOKEN_EOL && !match(ctx, TOKEN_COMMA)) {
 			error_msg("error: `,' expected after variable");
-			sync_stream();
+			sync_stream(ctx);
 			stub_node = ast_node_stub();
 			return AST_NODE(stub_node);
 		}
@@ -1247,65 +1477,69 @@ process_local_declaration(void *opaque)
 }
 
 static struct ast_node*
-stmt(void *opaque)
+stmt(struct bclite_ctx *ctx, void *opaque)
 {
 	struct ast_node *node;
 	token_t	prev_token;
 
-	prev_token = current_token;
+	prev_token = ctx->current_token;
 
-	if (match(TOKEN_FUNCTION))
+	if (match(ctx, TOKEN_FUNCTION))
 
-		node = process_function(opaque);
+		node = process_function(ctx, opaque);
 	
-	else if (match(TOKEN_LOCAL))
+	else if (match(ctx, TOKEN_LOCAL))
 		
-		node = process_local_declaration(opaque);
+		node = process_local_declaration(ctx, opaque);
 
-	else if (match(TOKEN_IF)) 
+	else if (match(ctx, TOKEN_IF)) 
 		
-		node = if_expr(opaque);
+		node = if_expr(ctx, opaque);
+	
+	else if (match(ctx, TOKEN_FOR))
+			
+		node = for_expr(ctx, opaque);
 	
-	else if (match(TOKEN_FOR))
+	else if (match(ctx, TOKEN_PARFOR))
 			
-		node = for_expr(opaque);
+		node = parfor_expr(ctx, opaque);
 	
-	else if (match(TOKEN_WHILE))
+	else if (match(ctx, TOKEN_WHILE))
 		
-		node = while_expr(opaque);
+		node = while_expr(ctx, opaque);
 	
-	else if (match(TOKEN_BREAK))
+	else if (match(ctx, TOKEN_BREAK))
 		
-		node = break_expr(opaque);
+		node = break_expr(ctx, opaque);
 
-	else if (match(TOKEN_CONTINUE))
+	else if (match(ctx, TOKEN_CONTINUE))
 	
-		node = continue_expr(opaque);
+		node = continue_expr(ctx, opaque);
 
-	else if (match(TOKEN_RETURN))
+	else if (match(ctx, TOKEN_RETURN))
 
-		node = process_return_node(opaque);
+		node = process_return_node(ctx, opaque);
 
-	else if (match(TOKEN_LBRACE))
+	else if (match(ctx, TOKEN_LBRACE))
 
-		node = process_scope(opaque);
+		node = process_scope(ctx, opaque);
 
-	else if (match(TOKEN_RBRACE)) 
+	else if (match(ctx, TOKEN_RBRACE)) 
 
-		node = end_scope_expr(opaque);
+		node = end_scope_expr(ctx, opaque);
 	
-	else if (match(TOKEN_UNKNOWN)) 
+	else if (match(ctx, TOKEN_UNKNOWN)) 
 
-		node = unknown_expr(opaque);
+		node = unknown_expr(ctx, opaque);
 
 	else	
-		node = other_expr(opaque);
+		node = other_expr(ctx, opaque);
 
 	return node;	
 }
 
 static struct ast_node*
-stmts(void *opaque)
+stmts(struct bclite_ctx *ctx, void *opaque)
 {
 	struct ast_node *ret_node;
 	struct ast_node *stmt_head;
@@ -1314,16 +1548,16 @@ stmts(void *opaque)
 	stmt_head = NULL;
 	prev_node = NULL;
 
-	while (current_token != TOKEN_EOF) {	
-		if (opaque != NULL && current_token == TOKEN_EOL)
-			consume_token();
+	while (ctx->current_token != TOKEN_EOF) {	
+		if (opaque != NULL && ctx->current_token == TOKEN_EOL)
+			consume_token(ctx);
 
-		if (opaque == NULL && current_token == TOKEN_EOL)
+		if (opaque == NULL && ctx->current_token == TOKEN_EOL)
 			break;
 
-		ret_node = stmt(opaque);
+		ret_node = stmt(ctx, opaque);
 
-		if (errors)
+		if (ctx->parse_errors)
 			break;
 	
 		if (ret_node == NULL)
@@ -1346,9 +1580,9 @@ stmts(void *opaque)
 	return  stmt_head;
 }
 void
-check_eof(int *eof)
+check_eof(struct bclite_ctx *ctx, int *eof)
 {
-	switch(current_token) {
+	switch(ctx->current_token) {
 	case TOKEN_EOF:
 		*eof = TRUE;
 		break;
@@ -1359,19 +1593,19 @@ check_eof(int *eof)
 }
 
 int
-programme(struct ast_node **root, int *eof)
+programme(struct bclite_ctx *ctx, struct ast_node **root, int *eof)
 {
 	struct ast_node *tree;
 	
-	errors = 0;
+	ctx->parse_errors = 0;
 	
-	consume_token();
+	consume_token(ctx);
 
-	tree  = stmts(NULL);
+	tree  = stmts(ctx, NULL);
 	*root = (struct ast_node *)ast_node_root(tree);
 	
-	check_eof(eof);
+	check_eof(ctx, eof);
 
-	return errors;
+	return ctx->parse_errors;
 }
 
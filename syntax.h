@@ -3,6 +3,8 @@
 
 #include "as_tree.h"
 
-int programme(struct ast_node **tree, int *eof);
+struct bclite_ctx;
+
+int programme(struct bclite_ctx *ctx, struct ast_node **tree, int *eof);
 
 #endif /*SYNTAX_H_*/
@@ -0,0 +1,302 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sched.h>
+
+#include "tpool.h"
+#include "macros.h"
+
+#define TPOOL_MAX_WORKERS	256
+
+/* elements below which an element-wise loop is not worth splitting */
+#define TPOOL_MIN_SIZE		(64 * 1024)
+
+/* what is left of a worker's share, padded to a cache line */
+struct range {
+	pthread_mutex_t	lock;
+	long		lo;
+	long		hi;
+} __attribute__((aligned(64)));
+
+static struct {
+	int		size;
+	long		min_size;
+	cpu_set_t	cpus;		/* helper i runs on the i-th of them */
+	int		pin;
+	struct range	ranges[TPOOL_MAX_WORKERS];
+
+	pthread_mutex_t	busy;		/* held by the loop running */
+	pthread_mutex_t	lock;
+	pthread_cond_t	start;
+	pthread_cond_t	done;
+	unsigned long	generation;	/* bumped for every loop */
+	int		active;		/* helpers still in the loop */
+
+	tpool_fn_t	fn;
+	void		*arg;
+	long		grain;
+} tpool;
+
+static pthread_once_t tpool_once = PTHREAD_ONCE_INIT;
+
+/* a loop inside a loop runs on its caller */
+static __thread int tpool_worker;
+
+/* next grain of worker w's own range */
+static int
+take(int w, long *lo, long *hi)
+{
+	struct range *r;
+	int ok;
+
+	r = &tpool.ranges[w];
+
+	pthread_mutex_lock(&r->lock);
+
+	ok = r->lo < r->hi;
+
+	if (ok) {
+		*lo = r->lo;
+		*hi = MIN(r->lo + tpool.grain, r->hi);
+		r->lo = *hi;
+	}
+
+	pthread_mutex_unlock(&r->lock);
+
+	return ok;
+}
+
+/* move half of some other range into w's own */
+static int
+steal(int w)
+{
+	struct range *r;
+	long lo, hi, mid;
+	int i, v;
+
+	for (i = 1; i < tpool.size; i++) {
+		v = (w + i) % tpool.size;
+		r = &tpool.ranges[v];
+
+		pthread_mutex_lock(&r->lock);
+
+		lo = r->lo;
+		hi = r->hi;
+
+		if (hi - lo > tpool.grain) {
+			mid = lo + (hi - lo) / 2;
+			r->hi = mid;
+			lo = mid;
+		} else {
+			r->lo = hi;
+		}
+
+		pthread_mutex_unlock(&r->lock);
+
+		if (lo < hi) {
+			r = &tpool.ranges[w];
+
+			pthread_mutex_lock(&r->lock);
+			r->lo = lo;
+			r->hi = hi;
+			pthread_mutex_unlock(&r->lock);
+
+			return TRUE;
+		}
+	}
+
+	return FALSE;
+}
+
+static void
+work(int w)
+{
+	long lo, hi;
+
+	do {
+		while (take(w, &lo, &hi))
+			tpool.fn(tpool.arg, w, lo, hi);
+	} while (steal(w));
+}
+
+/* the w-th processor we may run on, so that a worker keeps its caches */
+static void
+pin(int w)
+{
+	cpu_set_t set;
+	int cpu, n;
+
+	for (cpu = n = 0; cpu < CPU_SETSIZE; cpu++) {
+		if (!CPU_ISSET(cpu, &tpool.cpus) || n++ != w)
+			continue;
+
+		CPU_ZERO(&set);
+		CPU_SET(cpu, &set);
+
+		pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+		return;
+	}
+}
+
+static void*
+helper(void *arg)
+{
+	unsigned long seen;
+	int w;
+
+	w = (long)arg;
+
+	tpool_worker = TRUE;
+
+	if (tpool.pin)
+		pin(w);
+
+	seen = 0;
+
+	while (TRUE) {
+		pthread_mutex_lock(&tpool.lock);
+
+		while (tpool.generation == seen)
+			pthread_cond_wait(&tpool.start, &tpool.lock);
+
+		seen = tpool.generation;
+
+		pthread_mutex_unlock(&tpool.lock);
+
+		work(w);
+
+		pthread_mutex_lock(&tpool.lock);
+
+		if (--tpool.active == 0)
+			pthread_cond_signal(&tpool.done);
+
+		pthread_mutex_unlock(&tpool.lock);
+	}
+
+	return NULL;
+}
+
+static void
+tpool_init(void)
+{
+	pthread_t thread;
+	char *env;
+	long n;
+	int i;
+
+	env = getenv("BCLITE_THREADS");
+
+	n = env ? atol(env) : sysconf(_SC_NPROCESSORS_ONLN);
+
+	tpool.size = (int)MAX(1, MIN(n, TPOOL_MAX_WORKERS));
+
+	env = getenv("BCLITE_PAR_MIN");
+
+	tpool.min_size = env ? MAX(1, atol(env)) : TPOOL_MIN_SIZE;
+
+	/* only when there is a processor for each, never over other work */
+	env = getenv("BCLITE_PIN");
+
+	if (sched_getaffinity(0, sizeof(tpool.cpus), &tpool.cpus) == 0)
+		tpool.pin = tpool.size > 1 && tpool.size <= CPU_COUNT(&tpool.cpus)
+					&& (env == NULL || atoi(env) != 0);
+
+	pthread_mutex_init(&tpool.busy, NULL);
+	pthread_mutex_init(&tpool.lock, NULL);
+	pthread_cond_init(&tpool.start, NULL);
+	pthread_cond_init(&tpool.done, NULL);
+
+	for (i = 0; i < tpool.size; i++)
+		pthread_mutex_init(&tpool.ranges[i].lock, NULL);
+
+	for (i = 1; i < tpool.size; i++) {
+		if (pthread_create(&thread, NULL, helper, (void *)(long)i) != 0) {
+			tpool.size = i;
+			break;
+		}
+
+		pthread_detach(thread);
+	}
+}
+
+int
+tpool_size(void)
+{
+	pthread_once(&tpool_once, tpool_init);
+
+	return tpool.size;
+}
+
+int
+tpool_in_loop(void)
+{
+	return tpool_worker;
+}
+
+long
+tpool_min_size(void)
+{
+	pthread_once(&tpool_once, tpool_init);
+
+	return tpool.min_size;
+}
+
+void
+tpool_run(long n, long grain, tpool_fn_t fn, void *arg)
+{
+	struct range *r;
+	long share;
+	int i;
+
+	return_if_fail(fn != NULL);
+
+	if (n <= 0)
+		return;
+
+	if (grain < 1)
+		grain = 1;
+
+	if (tpool_size() == 1 || n <= grain || tpool_worker ||
+				pthread_mutex_trylock(&tpool.busy) != 0) {
+		fn(arg, 0, 0, n);
+		return;
+	}
+
+	tpool.fn    = fn;
+	tpool.arg   = arg;
+	tpool.grain = grain;
+
+	share = n / tpool.size;
+
+	for (i = 0; i < tpool.size; i++) {
+		r = &tpool.ranges[i];
+
+		pthread_mutex_lock(&r->lock);
+		r->lo = i * share;
+		r->hi = (i == tpool.size - 1) ? n : r->lo + share;
+		pthread_mutex_unlock(&r->lock);
+	}
+
+	pthread_mutex_lock(&tpool.lock);
+
+	tpool.active = tpool.size - 1;
+	tpool.generation++;
+
+	pthread_cond_broadcast(&tpool.start);
+	pthread_mutex_unlock(&tpool.lock);
+
+	tpool_worker = TRUE;
+	work(0);
+	tpool_worker = FALSE;
+
+	pthread_mutex_lock(&tpool.lock);
+
+	while (tpool.active > 0)
+		pthread_cond_wait(&tpool.done, &tpool.lock);
+
+	pthread_mutex_unlock(&tpool.lock);
+
+	pthread_mutex_unlock(&tpool.busy);
+}
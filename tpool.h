@@ -0,0 +1,42 @@
+#ifndef TPOOL_H_
+#define TPOOL_H_
+
+/*
+ * Work-stealing pool for data-parallel loops.
+ *
+ * tpool_run() splits [0, n) evenly over the workers; each takes grain
+ * indexes at a time from the front of its range and, once it runs dry,
+ * steals the back half of the next range that has work, looking from
+ * its neighbour on.  The calling thread is worker 0, helpers are started
+ * on first use.
+ *
+ * Only one loop runs on the pool at a time.  A loop started while it is
+ * busy, from a worker or from another thread, runs on the caller alone
+ * as fn(arg, 0, 0, n).
+ *
+ * BCLITE_THREADS sets the number of workers, it defaults to the number
+ * of processors.  When there are no more workers than processors the
+ * helpers are pinned, helper i to the i-th processor the process may
+ * use; BCLITE_PIN=0 leaves them to the scheduler.
+ *
+ * Loops over fewer elements than tpool_min_size() are better run on
+ * one thread, BCLITE_PAR_MIN overrides it.
+ */
+
+/* process [lo, hi), worker is below tpool_size() and owned by the call */
+typedef void (*tpool_fn_t)(void *arg, int worker, long lo, long hi);
+
+int
+tpool_size(void);
+
+long
+tpool_min_size(void);
+
+/* TRUE while the calling thread runs a share of a loop on the pool */
+int
+tpool_in_loop(void);
+
+void
+tpool_run(long n, long grain, tpool_fn_t fn, void *arg);
+
+#endif /* TPOOL_H_ */
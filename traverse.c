@@ -2,6 +2,8 @@
 #include <stdlib.h>
 #include <string.h>
 #include <math.h>
+#include <setjmp.h>
+#include <limits.h>
 
 #include <gsl/gsl_matrix.h>
 #include <gsl/gsl_vector.h>
@@ -11,11 +13,17 @@
 #include "list.h"
 #include "symbol.h"
 #include "umalloc.h"
+#include "pool.h"
 #include "function.h"
 #include "misc.h"
 #include "eval.h"
 #include "lex.h"
 #include "syntax.h"
+#include "context.h"
+#include "tpool.h"
+#include "vkernel.h"
+#include "spmatrix.h"
+#include "libm.h"
 
 typedef enum {
 	RES_OK,
@@ -25,50 +33,45 @@ typedef enum {
 	RES_ERROR
 } res_type_t;
 
-struct loop_ctx {
-	int is_break;
-	int is_continue;
-	int is_return;
-};
-
-extern struct list_of_val *list;
-
-static int errors;
-
 #define err_msg_ret(ret, fmt, arg...) \
 do { \
-	errors++; \
+	ctx->errors++; \
 	message(fmt, ##arg); \
 	return (ret); \
 } while(0)
 		
 #define err_msg(fmt, arg...) \
 do { \
-	errors++; \
+	ctx->errors++; \
 	message(fmt, ##arg); \
 	return; \
 } while(0)
 
-static struct loop_ctx helper;
-
-typedef void (* handler_type_t)(struct ast_node *);
-
-static void traverse_op(struct ast_node *node);
-static void traverse_const(struct ast_node *node);
-static void traverse_id(struct ast_node *node);
-static void traverse_assign(struct ast_node *node);
-static void traverse_func_call(struct ast_node *node);
-static void traverse_return(struct ast_node *node);
-static void traverse_if(struct ast_node *node);
-static void traverse_for(struct ast_node *node);
-static void traverse_while(struct ast_node *node);
-static void traverse_break(struct ast_node *node);
-static void traverse_continue(struct ast_node *node);
-static void traverse_empty(struct ast_node *node);
-static void traverse_vector(struct ast_node *node);
-static void traverse_matrix(struct ast_node *node);
-static void traverse_access(struct ast_node *node);
-static void traverse_root(struct ast_node *node);
+/* the context of the statement being evaluated on this thread */
+static __thread struct bclite_ctx *oom_ctx;
+
+static void traverse_oom(size_t size);
+static void oom_cleanup(struct bclite_ctx *ctx);
+
+typedef void (* handler_type_t)(struct bclite_ctx *, struct ast_node *);
+
+static void traverse_op(struct bclite_ctx *ctx, struct ast_node *node);
+static void traverse_const(struct bclite_ctx *ctx, struct ast_node *node);
+static void traverse_id(struct bclite_ctx *ctx, struct ast_node *node);
+static void traverse_assign(struct bclite_ctx *ctx, struct ast_node *node);
+static void traverse_func_call(struct bclite_ctx *ctx, struct ast_node *node);
+static void traverse_return(struct bclite_ctx *ctx, struct ast_node *node);
+static void traverse_if(struct bclite_ctx *ctx, struct ast_node *node);
+static void traverse_for(struct bclite_ctx *ctx, struct ast_node *node);
+static void traverse_parfor(struct bclite_ctx *ctx, struct ast_node *node);
+static void traverse_while(struct bclite_ctx *ctx, struct ast_node *node);
+static void traverse_break(struct bclite_ctx *ctx, struct ast_node *node);
+static void traverse_continue(struct bclite_ctx *ctx, struct ast_node *node);
+static void traverse_empty(struct bclite_ctx *ctx, struct ast_node *node);
+static void traverse_vector(struct bclite_ctx *ctx, struct ast_node *node);
+static void traverse_matrix(struct bclite_ctx *ctx, struct ast_node *node);
+static void traverse_access(struct bclite_ctx *ctx, struct ast_node *node);
+static void traverse_root(struct bclite_ctx *ctx, struct ast_node *node);
 
 struct {
 	node_type_t	type;
@@ -82,6 +85,7 @@ struct {
 	{ NODE_TYPE_EXP_OP,	traverse_op },	
 	{ NODE_TYPE_IF,		traverse_if },
 	{ NODE_TYPE_FOR,	traverse_for },
+	{ NODE_TYPE_PARFOR,	traverse_parfor },
 	{ NODE_TYPE_WHILE,	traverse_while },
 	{ NODE_TYPE_BREAK,	traverse_break },
 	{ NODE_TYPE_CONTINUE,	traverse_continue },
@@ -100,24 +104,24 @@ struct {
 };
 
 static void
-error_checking(void)
+error_checking(struct bclite_ctx *ctx)
 {	
 	struct eval *eval;
 
-	if (!errors)
+	if (!ctx->errors)
 		return;
 	
-	errors = 0;
+	ctx->errors = 0;
 
-	while (list) {
-		eval = pop();
+	while (ctx->list) {
+		eval = pop(ctx);
 		eval_free(eval);
 	}	
 }
 
 /* set new symbol value */
 static void
-set_value(struct symbol *sym, struct eval *eval)
+set_value(struct bclite_ctx *ctx, struct symbol *sym, struct eval *eval)
 {
 	value_t v_type;
 
@@ -142,6 +146,9 @@ set_value(struct symbol *sym, struct eval *eval)
 	case VALUE_TYPE_MATRIX:
 		symbol_set_val(sym, v_type, eval->matrix);
 		break;
+	case VALUE_TYPE_SPMATRIX:
+		symbol_set_val(sym, v_type, eval->spmatrix);
+		break;
 	case VALUE_TYPE_VOID:
 		break;
 	default:
@@ -150,7 +157,7 @@ set_value(struct symbol *sym, struct eval *eval)
 }
 
 static int
-is_true(struct eval *expr)
+is_true(struct bclite_ctx *ctx, struct eval *expr)
 {
 	if (expr->v_type != VALUE_TYPE_DIGIT)                         
 		err_msg_ret(FALSE, "error: `expr' must be a digit"); 
@@ -162,36 +169,36 @@ is_true(struct eval *expr)
 }
 
 static void
-traverse_root(struct ast_node *node)
+traverse_root(struct bclite_ctx *ctx, struct ast_node *node)
 {
 	return_if_fail(node != NULL);
 	
 	if (node->child)
-		traversal(node->child);
+		traversal(ctx, node->child);
 }
 
 static res_type_t
-traverse_body(struct ast_node *node)
+traverse_body(struct bclite_ctx *ctx, struct ast_node *node)
 {
 	res_type_t res;
 
 	return_val_if_fail(node != NULL, -1);
 	
-	traversal(node);
+	traversal(ctx, node);
 
-	if (errors)
+	if (ctx->errors)
 		return RES_ERROR;
 	
-	if (helper.is_continue) {
-		--helper.is_continue;
+	if (ctx->helper.is_continue) {
+		--ctx->helper.is_continue;
 		res = RES_CONTINUE;
 
-	} else if (helper.is_break) {
-		--helper.is_break;
+	} else if (ctx->helper.is_break) {
+		--ctx->helper.is_break;
 		res = RES_BREAK;
 
-	} else if (helper.is_return) {
-		--helper.is_return;
+	} else if (ctx->helper.is_return) {
+		--ctx->helper.is_return;
 		res = RES_RETURN;
 
 	} else 
@@ -201,15 +208,15 @@ traverse_body(struct ast_node *node)
 }
 
 static int
-init_dims(struct ast_node **dims, int *dim, int ndims)
+init_dims(struct bclite_ctx *ctx, struct ast_node **dims, int *dim, int ndims)
 {
 	struct eval *idx;
 	int i;
 
 	for (i = 0; i < ndims; i++) {
-		traversal(dims[i]);
+		traversal(ctx, dims[i]);
 
-		idx = pop();
+		idx = pop(ctx);
 	
 		if (idx->v_type != VALUE_TYPE_DIGIT) 
 			err_msg_ret(FALSE, "error: incompatible type for index");
@@ -222,29 +229,29 @@ init_dims(struct ast_node **dims, int *dim, int ndims)
 }
 
 static void
-traverse_empty(struct ast_node *node)
+traverse_empty(struct bclite_ctx *ctx, struct ast_node *node)
 {
 	return_if_fail(node != NULL);
 }
 
 static void
-traverse_break(struct ast_node *node)
+traverse_break(struct bclite_ctx *ctx, struct ast_node *node)
 {
 	return_if_fail(node != NULL);
 
-	helper.is_break++;
+	ctx->helper.is_break++;
 }
 
 static void
-traverse_continue(struct ast_node *node)
+traverse_continue(struct bclite_ctx *ctx, struct ast_node *node)
 {
 	return_if_fail(node != NULL);
 	
-	helper.is_continue++;
+	ctx->helper.is_continue++;
 }
 
 static void
-traverse_return(struct ast_node *node)
+traverse_return(struct bclite_ctx *ctx, struct ast_node *node)
 {
 	struct ast_node_return *_return;
 
@@ -252,14 +259,15 @@ traverse_return(struct ast_node *node)
 		
 	_return = (struct ast_node_return *)node;
 	
-	helper.is_return++;
-	
+	/* the value may call functions, they must not see this return */
 	if (_return->ret_val)
-		traversal(_return->ret_val);
+		traversal(ctx, _return->ret_val);
+
+	ctx->helper.is_return++;
 }
 
 static void
-traverse_while(struct ast_node *node)
+traverse_while(struct bclite_ctx *ctx, struct ast_node *node)
 {
 	struct ast_node_while *while_node;
 	struct ast_node *stmt, *next;
@@ -273,22 +281,23 @@ traverse_while(struct ast_node *node)
 	stmt = while_node->stmt;
 	
 	while (TRUE) {
-		traversal(while_node->expr);	
+		traversal(ctx, while_node->expr);	
 		
-		expr = pop();	
+		expr = pop(ctx);	
 	
-		if (!is_true(expr))	
+		if (!is_true(ctx, expr))	
 			goto exit_while;
 	
 		/* continue cycle if end is reached */
 		if (stmt == NULL || stmt->type == NODE_TYPE_END_SCOPE) {
 			stmt = while_node->stmt;
+			eval_free(expr);
 			continue;
 		}
 	
 		next = stmt->next;
 	
-		res = traverse_body(stmt);
+		res = traverse_body(ctx, stmt);
 		
 		switch(res) {
 		case RES_ERROR:
@@ -308,7 +317,7 @@ exit_while:
 }
 
 static void
-traverse_for(struct ast_node *node)
+traverse_for(struct bclite_ctx *ctx, struct ast_node *node)
 {
 	struct ast_node_for *for_node;
 	struct ast_node *stmt, *next;
@@ -320,27 +329,28 @@ traverse_for(struct ast_node *node)
 	for_node = (struct ast_node_for *)node;
 	
 	/*init cycle*/
-	traversal(for_node->expr1);
+	traversal(ctx, for_node->expr1);
 	
 	stmt = for_node->stmt; 
 	
 	while (TRUE) {
-		traversal(for_node->expr2);
+		traversal(ctx, for_node->expr2);
 		
-		expr = pop();
+		expr = pop(ctx);
 	
-		if (!is_true(expr))
+		if (!is_true(ctx, expr))
 			goto exit_for;
 
 		if (stmt == NULL || stmt->type == NODE_TYPE_END_SCOPE) {
 			stmt = for_node->stmt;
-			traversal(for_node->expr3);	
+			eval_free(expr);
+			traversal(ctx, for_node->expr3);	
 			continue;	
 		}
 
 		next = stmt->next;
 
-		res = traverse_body(stmt);
+		res = traverse_body(ctx, stmt);
 		
 		switch(res) {
 		case RES_ERROR:
@@ -359,8 +369,403 @@ exit_for:
 	eval_free(expr);	
 }
 
+/* one worker's copy of the loop: its own stack and private symbols */
+struct par_frame {
+	struct bclite_ctx	*ctx;
+	struct symbol_table	*scope;
+};
+
+/*
+ * The iterations are cut in chunks by their number alone; reductions
+ * keep one partial result per chunk, folded in a fixed tree at the end,
+ * so they come out the same whatever worker ran which chunk.
+ */
+#define PARFOR_CHUNKS	1024
+
+struct par_loop {
+	struct bclite_ctx	*ctx;
+	struct ast_node_parfor	*node;
+	struct symbol_table	*parent;	/* scope the loop runs in */
+	FILE			*messages;
+	double			from;
+	double			step;
+	long			n;
+	long			chunk;		/* iterations in a chunk */
+	double			*partial;	/* nred for every chunk */
+	struct par_frame	*frames;
+	int			failed;
+};
+
+static double
+par_identity(opcode_type_t opcode)
+{
+	switch(opcode) {
+	case OPCODE_MULT:
+		return 1.0;
+	case OPCODE_LT:
+		return INFINITY;
+	case OPCODE_GT:
+		return -INFINITY;
+	default:
+		return 0.0;
+	}
+}
+
+static double
+par_combine(opcode_type_t opcode, double a, double b)
+{
+	switch(opcode) {
+	case OPCODE_MULT:
+		return a * b;
+	case OPCODE_LT:
+		return MIN(a, b);
+	case OPCODE_GT:
+		return MAX(a, b);
+	default:
+		return a + b;
+	}
+}
+
+static int
+par_in_range(opcode_type_t cmp, double x, double to)
+{
+	switch(cmp) {
+	case OPCODE_LT:
+		return x < to;
+	case OPCODE_LE:
+		return x <= to;
+	case OPCODE_GT:
+		return x > to;
+	default:
+		return x >= to;
+	}
+}
+
+/* number of iterations, -1 if the loop would never end */
+static long
+par_count(opcode_type_t cmp, double from, double to, double step)
+{
+	double n;
+	int up;
+
+	up = (cmp == OPCODE_LT || cmp == OPCODE_LE);
+
+	if (step == 0.0 || up != (step > 0.0))
+		return par_in_range(cmp, from, to) ? -1 : 0;
+
+	n = floor((to - from) / step) + 1;
+
+	if (!isfinite(n) || n > LONG_MAX / 2)
+		return -1;
+
+	if (n < 0)
+		n = 0;
+
+	while (n > 0 && !par_in_range(cmp, from + (n - 1) * step, to))
+		n--;
+
+	while (par_in_range(cmp, from + n * step, to))
+		n++;
+
+	return (long)n;
+}
+
+static void
+par_frame_init(struct par_loop *loop, struct par_frame *frame)
+{
+	frame->ctx   = bclite_ctx_new_frame(loop->ctx);
+	frame->scope = symbol_table_new_frame(loop->node->scope, loop->parent);
+
+	symbol_table_set_scope(frame->ctx, frame->scope);
+}
+
+static void
+par_fail(struct par_loop *loop)
+{
+	__atomic_store_n(&loop->failed, TRUE, __ATOMIC_RELAXED);
+}
+
+static void
+par_start_chunk(struct par_loop *loop, struct par_frame *frame)
+{
+	struct par_reduction *red;
+	double value;
+	int i;
+
+	for (i = 0; i < loop->node->nred; i++) {
+		red   = &loop->node->red[i];
+		value = par_identity(red->opcode);
+
+		symbol_set_val(frame->scope->slots[red->slot], VALUE_TYPE_DIGIT,
+									&value);
+	}
+}
+
+static int
+par_end_chunk(struct par_loop *loop, struct par_frame *frame, long chunk)
+{
+	struct par_reduction *red;
+	struct symbol *part;
+	int i;
+
+	for (i = 0; i < loop->node->nred; i++) {
+		red  = &loop->node->red[i];
+		part = frame->scope->slots[red->slot];
+
+		if (part->v_type != VALUE_TYPE_DIGIT) {
+			message("error: reduction variable `%s' must be a digit",
+								red->name);
+			return FALSE;
+		}
+
+		loop->partial[chunk * loop->node->nred + i] = part->digit;
+	}
+
+	return TRUE;
+}
+
+static void
+par_range(void *arg, int worker, long lo, long hi)
+{
+	struct par_loop *loop;
+	struct par_frame *frame;
+	struct bclite_ctx *ctx, *prev_ctx;
+	struct ast_node *stmt, *next;
+	struct pool_temps *prev_temps;
+	umem_handler_t prev_handler;
+	struct eval *eval;
+	FILE *prev_stream;
+	double value;
+	long c, k, last;
+
+	loop  = arg;
+	frame = &loop->frames[worker];
+
+	prev_stream  = message_set_stream(loop->messages);
+	prev_handler = umem_set_handler(NULL);
+	prev_ctx     = oom_ctx;
+
+	if (frame->ctx == NULL)
+		par_frame_init(loop, frame);
+
+	ctx = frame->ctx;
+
+	prev_temps = pool_track(&ctx->temps);
+
+	if (setjmp(ctx->oom_env)) {
+		umem_set_handler(NULL);
+		oom_cleanup(ctx);
+		message("error: out of memory, budget is %lu bytes",
+					(unsigned long)umem_get_budget());
+		par_fail(loop);
+		goto out;
+	}
+
+	oom_ctx = ctx;
+	umem_set_handler(traverse_oom);
+
+	for (c = lo; c < hi; c++) {
+		par_start_chunk(loop, frame);
+
+		last = MIN((c + 1) * loop->chunk, loop->n);
+
+		for (k = c * loop->chunk; k < last; k++) {
+			if (__atomic_load_n(&loop->failed, __ATOMIC_RELAXED))
+				goto out;
+
+			value = loop->from + k * loop->step;
+
+			symbol_set_val(frame->scope->slots[loop->node->var],
+						VALUE_TYPE_DIGIT, &value);
+
+			for (stmt = loop->node->stmt; stmt != NULL &&
+				stmt->type != NODE_TYPE_END_SCOPE; stmt = next) {
+
+				next = stmt->next;
+
+				if (traverse_body(ctx, stmt) == RES_CONTINUE)
+					break;
+			}
+
+			if (ctx->errors) {
+				par_fail(loop);
+				goto out;
+			}
+
+			/* values of expression statements */
+			while (ctx->list) {
+				eval = pop(ctx);
+				eval_free(eval);
+			}
+		}
+
+		if (!par_end_chunk(loop, frame, c)) {
+			par_fail(loop);
+			goto out;
+		}
+	}
+
+out:
+	pool_forget(&ctx->temps);
+	pool_track(prev_temps);
+	umem_set_handler(prev_handler);
+	oom_ctx = prev_ctx;
+	message_set_stream(prev_stream);
+}
+
+static int
+par_bound(struct bclite_ctx *ctx, struct ast_node *node, double *value)
+{
+	struct eval *eval;
+
+	traversal(ctx, node);
+
+	if (ctx->errors)
+		return FALSE;
+
+	eval = pop(ctx);
+
+	if (eval->v_type != VALUE_TYPE_DIGIT) {
+		eval_free(eval);
+		err_msg_ret(FALSE, "error: parfor bounds must be digits");
+	}
+
+	*value = eval->digit;
+	eval_free(eval);
+
+	return TRUE;
+}
+
+static double
+par_tree(opcode_type_t opcode, const double *part, int stride, long n)
+{
+	long h;
+
+	if (n == 1)
+		return part[0];
+
+	h = n / 2;
+
+	return par_combine(opcode, par_tree(opcode, part, stride, h),
+			par_tree(opcode, part + h * stride, stride, n - h));
+}
+
+/* fold the partial results of the chunks into the variables outside */
+static void
+par_reduce(struct par_loop *loop, long nchunks)
+{
+	struct bclite_ctx *ctx;
+	struct par_reduction *red;
+	struct symbol *outer;
+	double acc;
+	int i;
+
+	ctx = loop->ctx;
+
+	for (i = 0; i < loop->node->nred; i++) {
+		red = &loop->node->red[i];
+
+		outer = red->outer >= 0 ? loop->parent->slots[red->outer] :
+				symbol_table_lookup_global(ctx, red->name);
+
+		return_if_fail(outer != NULL);
+
+		if (outer->v_type == VALUE_TYPE_DIGIT)
+			acc = outer->digit;
+		else if (outer->v_type == VALUE_TYPE_UNKNOWN)
+			acc = par_identity(red->opcode);
+		else
+			err_msg("error: reduction variable `%s' must be a digit",
+								red->name);
+
+		acc = par_combine(red->opcode, acc, par_tree(red->opcode,
+			loop->partial + i, loop->node->nred, nchunks));
+
+		symbol_set_val(outer, VALUE_TYPE_DIGIT, &acc);
+	}
+}
+
+/*
+ * The body of every iteration runs in a frame of the worker that takes
+ * it: shared variables are written in place, so iterations must write
+ * different elements.  An error in any iteration stops the loop.
+ */
+static void
+traverse_parfor(struct bclite_ctx *ctx, struct ast_node *node)
+{
+	struct ast_node_parfor *parfor;
+	struct symbol_table *bounds, *prev;
+	struct par_loop loop;
+	double to;
+	long n, nchunks;
+	int nframes, ok, w;
+
+	return_if_fail(node != NULL);
+
+	parfor = (struct ast_node_parfor *)node;
+
+	memset(&loop, 0, sizeof(loop));
+
+	loop.ctx      = ctx;
+	loop.node     = parfor;
+	loop.parent   = ctx->top;
+	loop.messages = message_stream();
+
+	/* the bounds may only read shared variables */
+	bounds = symbol_table_new_frame(parfor->scope, loop.parent);
+	prev   = symbol_table_set_scope(ctx, bounds);
+
+	ok = par_bound(ctx, parfor->from, &loop.from) &&
+	     par_bound(ctx, parfor->to, &to) &&
+	     par_bound(ctx, parfor->step, &loop.step);
+
+	symbol_table_set_scope(ctx, prev);
+	symbol_table_destroy(&bounds);
+
+	if (!ok)
+		return;
+
+	n = par_count(parfor->cmp, loop.from, to, loop.step);
+
+	if (n < 0)
+		err_msg("error: parfor never ends");
+
+	if (n == 0)
+		return;
+
+	loop.n     = n;
+	loop.chunk = (n + PARFOR_CHUNKS - 1) / PARFOR_CHUNKS;
+	nchunks    = (n + loop.chunk - 1) / loop.chunk;
+
+	if (parfor->nred)
+		loop.partial = umalloc(nchunks * parfor->nred * sizeof(double));
+
+	nframes     = tpool_size();
+	loop.frames = umalloc0(nframes * sizeof(*loop.frames));
+
+	tpool_run(nchunks, MAX(1, nchunks / (nframes * 8)), par_range, &loop);
+
+	if (loop.failed)
+		ctx->errors++;
+	else
+		par_reduce(&loop, nchunks);
+
+	for (w = 0; w < nframes; w++) {
+		if (loop.frames[w].ctx == NULL)
+			continue;
+
+		bclite_ctx_destroy(&loop.frames[w].ctx);
+		symbol_table_destroy(&loop.frames[w].scope);
+	}
+
+	ufree(loop.frames);
+
+	if (loop.partial)
+		ufree(loop.partial);
+}
+
 static void
-traverse_if(struct ast_node *node)
+traverse_if(struct bclite_ctx *ctx, struct ast_node *node)
 {
 	struct ast_node_if *if_node;
 	struct eval *expr;
@@ -370,9 +775,9 @@ traverse_if(struct ast_node *node)
 	
 	if_node = (struct ast_node_if *)node;
 
-	traversal(if_node->expr);
+	traversal(ctx, if_node->expr);
 	
-	expr = pop();
+	expr = pop(ctx);
 
 	if (expr->v_type != VALUE_TYPE_DIGIT) {
 		err_msg("error: `expr' must be a digit");
@@ -391,40 +796,72 @@ traverse_if(struct ast_node *node)
 
 		next = stmt->next;
 		
-		traversal(stmt);
+		traversal(ctx, stmt);
 
 		stmt = next;	
 	}
 }
 
+/* locals were resolved to slots by the parser, the rest are globals */
+static struct symbol*
+lookup_symbol(struct bclite_ctx *ctx, char *name, int slot)
+{
+	if (slot >= 0)
+		return symbol_table_slot(ctx, slot);
+
+	return symbol_table_lookup_global(ctx, name);
+}
+
 static void
-perform_init_args(struct function *func, struct ast_node **args)
+perform_init_args(struct bclite_ctx *ctx, struct function *func,
+			struct ast_node **args)
 {
+	struct symbol_frame *frame;
 	struct eval *eval;
 	int i;
 
-	for (i = 0; i < func->nargs; i++) {
-		traversal(args[i]);
-	
-		eval = pop();
+	/* 
+	 * all of them first: in a recursive call an argument may read
+	 * the symbols being set
+	 */
+	for (i = 0; i < func->nargs; i++)
+		traversal(ctx, args[i]);
+
+	if (ctx->errors)
+		return;
+
+	/* the values of the calls in progress wait in a frame */
+	if (func->active && func->scope != NULL) {
+		frame = symbol_frame_save(func->scope);
+
+		frame->prev = ctx->frames;
+		ctx->frames = frame;
+	}
+
+	for (i = func->nargs - 1; i >= 0; i--) {
+		eval = pop(ctx);
 	
-		set_value(func->args[i], eval);
+		set_value(ctx, func->args[i], eval);
 
 		eval_free(eval);
 	}
 }
 
 static void
-perform_lib_function(struct function *func, struct ast_node **args)
+perform_lib_function(struct bclite_ctx *ctx, struct function *func,
+			struct ast_node **args)
 {
 	struct eval *eval;
 	struct symbol *sym;
 	value_t v_type;
+	double digit;
 	void *result;
 	int ok;
 
 	/* initialize function args */	
-	perform_init_args(func, args);
+	perform_init_args(ctx, func, args);
+
+	result = &digit;
 	
 	ok = func->handler(func, &v_type, &result);
 
@@ -435,29 +872,28 @@ perform_lib_function(struct function *func, struct ast_node **args)
 
 	eval = eval_new(TAG_CONST, v_type, result);
 
-	push(eval);
+	push(ctx, eval);
 
-	sym = symbol_get_ans();
+	sym = symbol_get_ans(ctx);
 
-	set_value(sym, eval);
+	set_value(ctx, sym, eval);
 }			
 
 static void
-perform_custom_function(struct function *func, struct ast_node **args)
+perform_custom_function(struct bclite_ctx *ctx, struct function *func,
+			struct ast_node **args)
 {
 	struct ast_node *node, *next;
 	res_type_t res;
 
 	return_if_fail(func != NULL);
 	return_if_fail(args != NULL);
-	
-	perform_init_args(func, args);
 		
 	for (node = func->body; node->type != NODE_TYPE_END_SCOPE; node = next) {
 		
 		next = node->next;
 	
-		res = traverse_body(node);
+		res = traverse_body(ctx, node);
 	
 		switch(res) {
 		case RES_ERROR:
@@ -471,55 +907,199 @@ perform_custom_function(struct function *func, struct ast_node **args)
 	}
 }
 
+/*
+ * func of the digits at each element of its array arguments, interpreted
+ * once per element; the arguments are kept on the stack meanwhile.  Only
+ * for what vkernel_call() does not compile, see vkernel.h
+ */
 static void
-traverse_func_call(struct ast_node *node)
+perform_elementwise(struct bclite_ctx *ctx, struct function *func,
+	struct ast_node **args, value_t v_type, size_t rows, size_t cols)
+{
+	struct symbol_table *prev;
+	struct list_of_val *top;
+	struct eval *eval, *arg;
+	struct symbol *sym;
+	gsl_vector *vc;
+	gsl_matrix *mx;
+	double *out, dg;
+	size_t idx;
+	int i;
+
+	if (v_type == VALUE_TYPE_VECTOR) {
+		vc   = pool_vector_alloc(rows);
+		out  = vc->data;
+		eval = eval_new(TAG_CONST, v_type, vc);
+	} else {
+		mx   = pool_matrix_alloc(rows, cols);
+		out  = mx->data;
+		eval = eval_new(TAG_CONST, v_type, mx);
+	}
+
+	push(ctx, eval);
+
+	for (i = 0; i < func->nargs; i++) {
+		sym = func->args[i];
+
+		switch(sym->v_type) {
+		case VALUE_TYPE_VECTOR:
+			vc = pool_vector_alloc(sym->vector->size);
+			gsl_vector_memcpy(vc, sym->vector);
+			eval = eval_new(TAG_CONST, VALUE_TYPE_VECTOR, vc);
+			break;
+		case VALUE_TYPE_MATRIX:
+			mx = pool_matrix_alloc(sym->matrix->size1,
+						sym->matrix->size2);
+			gsl_matrix_memcpy(mx, sym->matrix);
+			eval = eval_new(TAG_CONST, VALUE_TYPE_MATRIX, mx);
+			break;
+		default:
+			eval = eval_new(TAG_CONST, VALUE_TYPE_DIGIT, &sym->digit);
+			break;
+		}
+
+		push(ctx, eval);
+	}
+
+	for (idx = 0; idx < rows * cols; idx++) {
+		for (i = 0; i < func->nargs; i++) {
+			arg = peek(ctx, func->nargs - 1 - i);
+
+			switch(arg->v_type) {
+			case VALUE_TYPE_VECTOR:
+				dg = gsl_vector_get(arg->vector, idx);
+				break;
+			case VALUE_TYPE_MATRIX:
+				dg = gsl_matrix_get(arg->matrix, idx / cols,
+								idx % cols);
+				break;
+			default:
+				dg = arg->digit;
+				break;
+			}
+
+			symbol_set_val(func->args[i], VALUE_TYPE_DIGIT, &dg);
+		}
+
+		top  = ctx->list;
+		prev = symbol_table_set_scope(ctx, func->scope);
+
+		perform_custom_function(ctx, func, args);
+
+		symbol_table_set_scope(ctx, prev);
+
+		if (ctx->errors)
+			return;
+
+		if (ctx->list == top)
+			err_msg("error: `%s' gives no value", func->name);
+
+		eval = pop(ctx);
+
+		if (eval->v_type != VALUE_TYPE_DIGIT) {
+			eval_free(eval);
+			err_msg("error: `%s' must give a digit for each element",
+								func->name);
+		}
+
+		out[idx] = eval->digit;
+		eval_free(eval);
+	}
+
+	for (i = 0; i < func->nargs; i++)
+		eval_free(pop(ctx));
+}
+
+/* back to the values of the outer call */
+static void
+pop_frame(struct bclite_ctx *ctx)
+{
+	struct symbol_frame *frame;
+
+	frame       = ctx->frames;
+	ctx->frames = frame->prev;
+
+	symbol_frame_restore(frame);
+}
+
+static void
+traverse_func_call(struct bclite_ctx *ctx, struct ast_node *node)
 {
 	struct function *function;
 	struct ast_node_func_call *func_node;
+	struct symbol_frame *frames;
+	struct symbol_table *prev;
+	value_t v_type;
+	size_t rows, cols;
 	
 	return_if_fail(node != NULL);
 	
 	func_node = (struct ast_node_func_call *)node;
 	
-	function = function_table_lookup(func_node->name);
+	function = function_table_lookup(ctx, func_node->name);
 	
 	if (function->is_lib) {
 
-		perform_lib_function(function, func_node->args);
+		perform_lib_function(ctx, function, func_node->args);
 
 	} else {
-		symbol_table_set_scope(function->scope);
-		
-		perform_custom_function(function, func_node->args);
-	
-		symbol_table_pop();
+		frames = ctx->frames;
+
+		/* arguments are evaluated in the scope of the caller */
+		perform_init_args(ctx, function, func_node->args);
+
+		function->active++;
+
+		if (ctx->errors) {
+			;
+		} else if (vkernel_call(ctx, function)) {
+			;
+		} else if (vkernel_scalar(ctx, function, &v_type, &rows,
+								&cols)) {
+			perform_elementwise(ctx, function, func_node->args,
+							v_type, rows, cols);
+		} else {
+			prev = symbol_table_set_scope(ctx, function->scope);
+
+			perform_custom_function(ctx, function, func_node->args);
+
+			symbol_table_set_scope(ctx, prev);
+		}
+
+		function->active--;
+
+		if (ctx->frames != frames)
+			pop_frame(ctx);
 	}				
 }
 
 static void
-set_access_value(struct ast_node_access *ac, struct eval *eval)
+set_access_value(struct bclite_ctx *ctx, struct ast_node_access *ac,
+			struct eval *eval)
 {
 	struct symbol *sym;
 	unsigned int row, col, idx;
 	int ndims, ok;
-	int *dims;
+	int dims[2];
 
 	if (eval->v_type != VALUE_TYPE_DIGIT) {
 		err_msg("error: non-numerical value");	
 		return;
 	}
 	
-	sym = symbol_table_lookup_all(ac->name);
+	sym = lookup_symbol(ctx, ac->name, ac->slot);
 	
 	ndims = ac->ndims;
-	dims  = umalloc(sizeof(int) * ndims);
 
-	ok = init_dims(ac->dims, dims, ndims);
+	if (ndims > 2)
+		err_msg("error: invalid dimention");
+
+	ok = init_dims(ctx, ac->dims, dims, ndims);
 	
 	if (!ok)
 		return;
 		
-	switch(ac->v_type) {
+	switch(sym->v_type) {
 	case VALUE_TYPE_MATRIX:
 		if (ndims != 2) {
 			err_msg("error: invalid dimention");
@@ -528,6 +1108,7 @@ set_access_value(struct ast_node_access *ac, struct eval *eval)
 		row = dims[0];
 		col = dims[1];
 		gsl_matrix_set(sym->matrix, row, col, eval->digit);
+		symbol_touch(sym);
 		break;
 	case VALUE_TYPE_VECTOR:
 		if (ndims != 1) {
@@ -536,14 +1117,19 @@ set_access_value(struct ast_node_access *ac, struct eval *eval)
 		}
 		idx = dims[0];
 		gsl_vector_set(sym->vector, idx, eval->digit);
+		symbol_touch(sym);
 		break;
-	default:
+	case VALUE_TYPE_SPMATRIX:
+		/* shared by reference, see spmatrix.h */
+		err_msg("error: a sparse matrix can not be changed in place");
 		break;
+	default:
+		err_msg("error: id is not a vector or a matrix");
 	}		
 }
 
 static void
-traverse_assign(struct ast_node *node)
+traverse_assign(struct bclite_ctx *ctx, struct ast_node *node)
 {
 	struct ast_node_assign *assign;
 	struct ast_node *left;
@@ -560,19 +1146,19 @@ traverse_assign(struct ast_node *node)
 	left  = assign->left;
 	right = assign->right;
 	
-	traversal(right);
+	traversal(ctx, right);
 	
 	switch(left->type) {
 	case NODE_TYPE_ID:
 		id = (struct ast_node_id *)left;
-		eval = pop();	
-		sym = symbol_table_lookup_all(id->name);
-		set_value(sym, eval);	
+		eval = pop(ctx);	
+		sym = lookup_symbol(ctx, id->name, id->slot);
+		set_value(ctx, sym, eval);	
 		break;
 	case NODE_TYPE_ACCESS:
 		ac = (struct ast_node_access *)left;
-		eval = pop();
-		set_access_value(ac, eval);
+		eval = pop(ctx);
+		set_access_value(ctx, ac, eval);
 		break;
 	default:
 		break;
@@ -582,7 +1168,7 @@ traverse_assign(struct ast_node *node)
 }
 
 static void
-traverse_op(struct ast_node *node)
+traverse_op(struct bclite_ctx *ctx, struct ast_node *node)
 {
 	struct ast_node_op *op;
 	struct eval *a,*b, *c;
@@ -592,11 +1178,13 @@ traverse_op(struct ast_node *node)
 	
 	op = (struct ast_node_op *)node;
 
-	traversal(op->left);
-	traversal(op->right);
+	traversal(ctx, op->left);
+	traversal(ctx, op->right);
 		
-	b = pop();
-	a = pop();
+	/* operands stay on the stack until the result exists, an aborted
+	   statement frees them from there */
+	b = peek(ctx, 0);
+	a = peek(ctx, 1);
 	
 	switch(op->opcode) {
 	case OPCODE_ADD:
@@ -626,18 +1214,21 @@ traverse_op(struct ast_node *node)
 		error(1, "error: unknown operation");
 	}
 
+	pop(ctx);
+	pop(ctx);
+
 	if (c != NULL)
-		push(c);
+		push(ctx, c);
 
 	eval_free(a);
 	eval_free(b);
 	
-	sym = symbol_get_ans();
-	set_value(sym, c);
+	sym = symbol_get_ans(ctx);
+	set_value(ctx, sym, c);
 }
 
 static void
-traverse_const(struct ast_node *node)
+traverse_const(struct bclite_ctx *ctx, struct ast_node *node)
 {
 	struct ast_node_const *_const;
 	struct symbol *sym;
@@ -663,14 +1254,14 @@ traverse_const(struct ast_node *node)
 		break;
 	}	
 	
-	push(eval);
+	push(ctx, eval);
 	
-	sym = symbol_get_ans();
-	set_value(sym, eval);
+	sym = symbol_get_ans(ctx);
+	set_value(ctx, sym, eval);
 }	
 
 static void
-traverse_id(struct ast_node *node)
+traverse_id(struct bclite_ctx *ctx, struct ast_node *node)
 {
 	struct ast_node_id *id;
 	struct symbol *symbol;
@@ -682,7 +1273,7 @@ traverse_id(struct ast_node *node)
 	
 	id = (struct ast_node_id *)node;
 	
-	symbol = symbol_table_lookup_all(id->name);
+	symbol = lookup_symbol(ctx, id->name, id->slot);
 	
 	tag    = TAG_SYMBOL;
 	v_type = symbol->v_type;
@@ -700,16 +1291,21 @@ traverse_id(struct ast_node *node)
 	case VALUE_TYPE_MATRIX:
 		eval = eval_new(tag, v_type, symbol->matrix);
 		break;
+	case VALUE_TYPE_SPMATRIX:
+		eval = eval_new(tag, v_type, symbol->spmatrix);
+		break;
 	default:
 		err_msg("error: unknown variable\n");	
 		break;
 	}	
+
+	eval->symbol = symbol;
 	
-	push(eval);	
+	push(ctx, eval);	
 }
 
 static void
-traverse_vector(struct ast_node *node)
+traverse_vector(struct bclite_ctx *ctx, struct ast_node *node)
 {
 	struct ast_node_vector *vc_node;
 	struct eval *eval;
@@ -720,101 +1316,103 @@ traverse_vector(struct ast_node *node)
 	return_if_fail(node != NULL);
 	
 	vc_node = (struct ast_node_vector *)node;
-	
-	vc = gsl_vector_alloc(vc_node->size);
+
+	/* elements wait on the stack, so nothing leaks if the vector
+	   itself cannot be allocated */
+	for (i = 0; i < vc_node->size; i++)
+		traversal(ctx, vc_node->elem[i]);
+
+	if (ctx->errors)
+		return;
 
 	for (i = 0; i < vc_node->size; i++) {
-		traversal(vc_node->elem[i]);
-	
-		eval = pop();	
-	
-		if (eval->v_type != VALUE_TYPE_DIGIT) {
+		eval = peek(ctx, i);
+
+		if (eval == NULL || eval->v_type != VALUE_TYPE_DIGIT)
 			err_msg("error: nonnumberical value");
-			goto err_vc;
-		}
-		
+	}
+	
+	vc = pool_vector_alloc(vc_node->size);
+
+	for (i = vc_node->size - 1; i >= 0; i--) {
+		eval = pop(ctx);	
 		gsl_vector_set(vc, i, eval->digit);
-		
 		eval_free(eval);
 	}
 	
 	eval = eval_new(TAG_CONST, VALUE_TYPE_VECTOR, vc);
-	push(eval);
+	push(ctx, eval);
 
-	sym = symbol_get_ans();
-	set_value(sym, eval);
-	return;
-err_vc:
-	eval_free(eval);
-	gsl_vector_free(vc);
+	sym = symbol_get_ans(ctx);
+	set_value(ctx, sym, eval);
 }
 
 static void 
-traverse_matrix(struct ast_node *node)
+traverse_matrix(struct bclite_ctx *ctx, struct ast_node *node)
 {
 	struct ast_node_matrix *mx_node;
 	struct symbol *sym;
 	struct eval *eval;
 	gsl_matrix *mx;
-	int i, j, idx;
+	int i, n;
 
 	return_if_fail(node != NULL);
 	
 	mx_node = (struct ast_node_matrix *)node;
-	
-	mx = gsl_matrix_alloc(mx_node->size1, mx_node->size2);
-	
-	for (i = 0; i < mx_node->size1; i++) {
-	
-		idx = i * mx_node->size2;
 
-		for (j = 0; j < mx_node->size2; j++) {
-			traversal(mx_node->elem[idx + j]);
+	n = mx_node->size1 * mx_node->size2;
 
-			eval = pop();
-	
-			if (eval->v_type != VALUE_TYPE_DIGIT) {
-				err_msg("error: nonnumerical value");
-				goto err_mx;
-			}
-			
-			gsl_matrix_set(mx, i, j, eval->digit);
+	for (i = 0; i < n; i++)
+		traversal(ctx, mx_node->elem[i]);
+
+	if (ctx->errors)
+		return;
+
+	for (i = 0; i < n; i++) {
+		eval = peek(ctx, i);
+
+		if (eval == NULL || eval->v_type != VALUE_TYPE_DIGIT)
+			err_msg("error: nonnumerical value");
+	}
 	
-			eval_free(eval);
-		}
+	mx = pool_matrix_alloc(mx_node->size1, mx_node->size2);
+
+	/* elements are stored row by row */
+	for (i = n - 1; i >= 0; i--) {
+		eval = pop(ctx);
+		mx->data[i] = eval->digit;
+		eval_free(eval);
 	}
 
 	eval = eval_new(TAG_CONST, VALUE_TYPE_MATRIX, mx);
-	push(eval);
+	push(ctx, eval);
 
-	sym = symbol_get_ans();
-	set_value(sym, eval);
-	return;
-err_mx:
-	eval_free(eval);
-	gsl_matrix_free(mx);		
+	sym = symbol_get_ans(ctx);
+	set_value(ctx, sym, eval);
 }
 
 static void
-traverse_access(struct ast_node *node)
+traverse_access(struct bclite_ctx *ctx, struct ast_node *node)
 {
 	struct ast_node_access *ac_node;
 	struct symbol *sym;
 	struct eval *eval;
 	double dg;
 	int ndims;
-	int *dims;
+	int dims[2];
 
 	return_if_fail(node != NULL);	
 		
 	ac_node = (struct ast_node_access *)node;
 
-	sym = symbol_table_lookup_all(ac_node->name);
+	sym = lookup_symbol(ctx, ac_node->name, ac_node->slot);
 	 
 	ndims = ac_node->ndims;	
-	dims  = umalloc(sizeof(int) * ndims);
 
-	init_dims(ac_node->dims, dims, ndims);
+	if (ndims > 2)
+		err_msg("error: invalid dimention");
+
+	init_dims(ctx, ac_node->dims, dims, ndims);
 
 	switch(sym->v_type) {
 	case VALUE_TYPE_VECTOR:	
@@ -824,7 +1422,7 @@ traverse_access(struct ast_node *node)
 		}
 		dg   = gsl_vector_get(sym->vector, dims[0]);
 		eval = eval_new(TAG_CONST, VALUE_TYPE_DIGIT, &dg);
-		push(eval);
+		push(ctx, eval);
 		break;
 	case VALUE_TYPE_MATRIX:
 		if (ndims != 2) {
@@ -833,8 +1431,17 @@ traverse_access(struct ast_node *node)
 		}
 		dg   = gsl_matrix_get(sym->matrix, dims[0], dims[1]);
 		eval = eval_new(TAG_CONST, VALUE_TYPE_DIGIT, &dg);
-		push(eval);
+		push(ctx, eval);
 		break;		
+	case VALUE_TYPE_SPMATRIX:
+		if (ndims != 2) {
+			err_msg("error: invalid dimention");
+			return;	
+		}
+		dg   = spmatrix_get(sym->spmatrix, dims[0], dims[1]);
+		eval = eval_new(TAG_CONST, VALUE_TYPE_DIGIT, &dg);
+		push(ctx, eval);
+		break;
 	default:
 		err_msg("error: id is not a vector or a matrix");
 		return;
@@ -844,35 +1451,116 @@ traverse_access(struct ast_node *node)
 }
 
 static void
-traverse_tree(struct ast_node *tree)
+traverse_tree(struct bclite_ctx *ctx, struct ast_node *tree)
 {
 	int i;
 
 	for (i = 0; traverse_nodes[i].type != NODE_TYPE_UNKNOWN; i++) {
 		if (tree->type == traverse_nodes[i].type) {
-			traverse_nodes[i].handler(tree);
+			traverse_nodes[i].handler(ctx, tree);
 			return;
 		}
 	}	
 }
 
+int
+traversal_result(struct bclite_ctx *ctx, struct eval **res)
+{
+	*res = NULL;
+
+	if (ctx->errors) {
+		error_checking(ctx);
+		return FALSE;
+	}
+
+	if (ctx->list != NULL)
+		*res = pop(ctx);
+
+	return TRUE;
+}
+
 void
-traversal_print_result(void)
+traversal_print_result(struct bclite_ctx *ctx)
 {
 	struct eval *res;
 	
-	error_checking();
+	traversal_result(ctx, &res);
 
-	if (list != NULL) {
-		res = pop();
-		eval_print(res);
+	if (res != NULL) {
+		eval_print(ctx->out, res);
 		eval_free(res);	
 	}		
 }
 
+static void
+traverse_oom(size_t size)
+{
+	longjmp(oom_ctx->oom_env, 1);
+}
+
+/*
+ * The longjmp skipped whoever held the values of the statement: those on
+ * the stack and the temporaries of the C code it was in.  Only what was
+ * handed to a symbol outlives it.
+ */
+static void
+oom_cleanup(struct bclite_ctx *ctx)
+{
+	struct eval *eval;
+
+	while (ctx->list) {
+		eval = pop(ctx);
+		eval_free(eval);
+	}
+
+	while (ctx->frames)
+		pop_frame(ctx);
+
+	function_table_unwind(ctx);
+
+	libm_workspace_release();
+	pool_release(&ctx->temps);
+}
+
+/*
+ * Evaluate one top-level statement.  If it runs over the memory budget
+ * it is aborted like any other failed statement: its values and
+ * temporaries are freed by oom_cleanup() and the session goes on.
+ */
+void
+traversal_statement(struct bclite_ctx *ctx, struct ast_node *tree)
+{
+	struct pool_temps *prev;
+
+	prev = pool_track(&ctx->temps);
+
+	if (setjmp(ctx->oom_env)) {
+		umem_set_handler(NULL);
+		oom_ctx = NULL;
+		oom_cleanup(ctx);
+		pool_track(prev);
+		symbol_table_reset(ctx);
+		memset(&ctx->helper, 0, sizeof(ctx->helper));
+		ctx->errors++;
+		message("error: out of memory, budget is %lu bytes",
+					(unsigned long)umem_get_budget());
+		return;
+	}
+
+	oom_ctx = ctx;
+	umem_set_handler(traverse_oom);
+
+	traversal(ctx, tree);
+
+	umem_set_handler(NULL);
+	oom_ctx = NULL;
+	pool_forget(&ctx->temps);
+	pool_track(prev);
+}
+
 void
-traversal(struct ast_node *tree)
+traversal(struct bclite_ctx *ctx, struct ast_node *tree)
 {
-	if (!errors)
-		traverse_tree(tree);			
+	if (!ctx->errors)
+		traverse_tree(ctx, tree);			
 }
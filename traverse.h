@@ -3,10 +3,23 @@
 
 #include "as_tree.h"
 
+struct bclite_ctx;
+struct eval;
+
+void
+traversal(struct bclite_ctx *ctx, struct ast_node *tree);
+
 void
-traversal(struct ast_node *tree);
+traversal_statement(struct bclite_ctx *ctx, struct ast_node *tree);
+
+/* 
+ * Take the value of the statement just evaluated, NULL if it has none.
+ * FALSE if the statement failed, its values are freed then.
+ */
+int
+traversal_result(struct bclite_ctx *ctx, struct eval **res);
 
 void
-traversal_print_result(void);
+traversal_print_result(struct bclite_ctx *ctx);
 
 #endif /*TRAVERSE_H_*/
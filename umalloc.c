@@ -3,8 +3,525 @@
 #include <string.h>
 #include <limits.h>
 #include <unistd.h>
+#include <malloc.h>
+
+#include <pthread.h>
+
+#define UMALLOC_C_	/* no call-site wrappers in here */
 
 #include  "macros.h"
+#include  "umalloc.h"
+
+#if defined(USE_SLAB) && !defined(UMALLOC_PROFILE)
+/*
+ * Size-class slab allocator for small fixed-size objects (eval cells,
+ * list cells, hash buckets, symbols, small vectors and matrices).  Every
+ * thread keeps its own free lists, so no locking is needed; a miss
+ * refills the class with SLAB_REFILL objects carved from one chunk.
+ * Chunks are never returned to malloc, freed objects go back to the list
+ * of the freeing thread.
+ */
+#define SLAB_GRAIN	8
+#define SLAB_MAX	192
+#define SLAB_CLASSES	(SLAB_MAX / SLAB_GRAIN)
+#define SLAB_REFILL	128
+
+#define SLAB_CLASS(size)	(((size) + SLAB_GRAIN - 1) / SLAB_GRAIN - 1)
+
+struct slab_obj {
+	struct slab_obj *next;
+};
+
+struct slab_class {
+	struct slab_obj	*free;
+	unsigned long	allocs;
+	unsigned long	hits;
+	unsigned long	refills;
+	unsigned long	frees;
+};
+
+static __thread struct slab_class slab[SLAB_CLASSES];
+#endif
+
+/*
+ * Memory budget.  Every byte handed out by umalloc and by the block pool
+ * is charged to umem.used.  When a budget is set and a charge would
+ * exceed it, the reclaim hook gets one chance to give memory back before
+ * the out-of-memory handler of the calling thread runs.  The handler is
+ * armed only while a statement is evaluated; without it the charge goes
+ * through and just a real malloc failure is fatal.
+ */
+static struct {
+	size_t	budget;		/* 0 means unlimited */
+	size_t	used;
+	size_t	peak;
+	void	(*reclaim)(void);
+} umem;
+
+static __thread umem_handler_t umem_handler;
+
+void
+umem_set_budget(size_t bytes)
+{
+	umem.budget = bytes;
+}
+
+size_t
+umem_get_budget(void)
+{
+	return umem.budget;
+}
+
+size_t
+umem_used(void)
+{
+	return __atomic_load_n(&umem.used, __ATOMIC_RELAXED);
+}
+
+size_t
+umem_peak(void)
+{
+	return __atomic_load_n(&umem.peak, __ATOMIC_RELAXED);
+}
+
+void
+umem_set_reclaim(void (*reclaim)(void))
+{
+	umem.reclaim = reclaim;
+}
+
+umem_handler_t
+umem_set_handler(umem_handler_t handler)
+{
+	umem_handler_t prev;
+
+	prev = umem_handler;
+	umem_handler = handler;
+
+	return prev;
+}
+
+void
+umem_fail(size_t size)
+{
+	if (umem_handler != NULL)
+		umem_handler(size);
+
+	error(1, "out of memory allocating %lu bytes", (unsigned long)size);
+}
+
+void
+umem_charge(size_t size)
+{
+	size_t used, peak;
+	int reclaimed = FALSE;
+
+again:
+	used = __atomic_add_fetch(&umem.used, size, __ATOMIC_RELAXED);
+
+	if (umem.budget != 0 && used > umem.budget && umem_handler != NULL) {
+		__atomic_sub_fetch(&umem.used, size, __ATOMIC_RELAXED);
+
+		if (!reclaimed && umem.reclaim != NULL) {
+			reclaimed = TRUE;
+			umem.reclaim();
+			goto again;
+		}
+
+		umem_fail(size);
+	}
+
+	peak = __atomic_load_n(&umem.peak, __ATOMIC_RELAXED);
+
+	while (used > peak && !__atomic_compare_exchange_n(&umem.peak, &peak,
+			used, TRUE, __ATOMIC_RELAXED, __ATOMIC_RELAXED))
+		;
+}
+
+void
+umem_uncharge(size_t size)
+{
+	__atomic_sub_fetch(&umem.used, size, __ATOMIC_RELAXED);
+}
+
+/* charge is reserved for the requested size, settle it to what malloc gave */
+static void*
+umem_settle(void *ptr, size_t size)
+{
+	size_t real;
+
+	real = malloc_usable_size(ptr);
+
+	if (real > size)
+		__atomic_add_fetch(&umem.used, real - size, __ATOMIC_RELAXED);
+
+	return ptr;
+}
+
+static void*
+umem_malloc(size_t size)
+{
+	void *ptr;
+
+	umem_charge(size);
+
+	ptr = malloc(size);
+
+	if (ptr == NULL) {
+		umem_uncharge(size);
+		umem_fail(size);
+	}
+
+	return umem_settle(ptr, size);
+}
+
+static void*
+umem_realloc(void *mem, size_t size)
+{
+	size_t old;
+	void *ptr;
+
+	if (mem == NULL)
+		return umem_malloc(size);
+
+	old = malloc_usable_size(mem);
+
+	/* only the growth counts against the budget */
+	if (size > old)
+		umem_charge(size - old);
+
+	ptr = realloc(mem, size);
+
+	if (ptr == NULL) {
+		if (size > old)
+			umem_uncharge(size - old);
+		umem_fail(size);
+	}
+
+	if (size < old)
+		umem_uncharge(old - size);
+
+	return umem_settle(ptr, size);
+}
+
+static void
+umem_free(void *mem)
+{
+	umem_uncharge(malloc_usable_size(mem));
+	free(mem);
+}
+
+#ifdef UMALLOC_PROFILE
+/*
+ * Allocation-site heap profiler.  umalloc.h turns every umalloc*() call
+ * into umalloc*_at(__FILE__, __LINE__); each block carries a small header
+ * naming its site, so ufree() and urealloc() can keep live bytes per site.
+ * The pool accounts GSL blocks through umalloc_site_alloc()/_free().
+ */
+#define PROF_SITES	4096
+
+struct umalloc_site {
+	const char	*file;
+	int		line;
+	unsigned long	allocs;
+	unsigned long	frees;
+	unsigned long	bytes;
+	long		live;
+	long		peak;
+};
+
+union prof_hdr {
+	struct {
+		struct umalloc_site *site;
+		size_t size;
+	};
+	long double	align;
+};
+
+static struct {
+	pthread_mutex_t		lock;
+	struct umalloc_site	sites[PROF_SITES];
+	struct umalloc_site	other;
+	long			live;
+	long			peak;
+} prof = {
+	.lock  = PTHREAD_MUTEX_INITIALIZER,
+	.other = { "(other)", 0 }
+};
+
+/* caller must hold prof.lock */
+static struct umalloc_site*
+prof_site(const char *file, int line)
+{
+	struct umalloc_site *site;
+	unsigned long idx;
+	int i;
+
+	if (file == NULL)
+		return &prof.other;
+
+	idx = ((unsigned long)file >> 3) * 31 + line;
+
+	for (i = 0; i < PROF_SITES; i++) {
+		site = &prof.sites[(idx + i) % PROF_SITES];
+
+		if (site->file == file && site->line == line)
+			return site;
+
+		if (site->file == NULL) {
+			site->file = file;
+			site->line = line;
+			return site;
+		}
+	}
+
+	return &prof.other;
+}
+
+static void
+prof_alloc(struct umalloc_site *site, size_t size)
+{
+	site->allocs++;
+	site->bytes += size;
+	site->live  += size;
+
+	if (site->live > site->peak)
+		site->peak = site->live;
+
+	prof.live += size;
+
+	if (prof.live > prof.peak)
+		prof.peak = prof.live;
+}
+
+static void
+prof_free(struct umalloc_site *site, size_t size)
+{
+	site->frees++;
+	site->live -= size;
+	prof.live  -= size;
+}
+
+struct umalloc_site*
+umalloc_site(const char *file, int line)
+{
+	struct umalloc_site *site;
+
+	pthread_mutex_lock(&prof.lock);
+	site = prof_site(file, line);
+	pthread_mutex_unlock(&prof.lock);
+
+	return site;
+}
+
+void
+umalloc_site_alloc(struct umalloc_site *site, size_t size)
+{
+	pthread_mutex_lock(&prof.lock);
+	prof_alloc(site, size);
+	pthread_mutex_unlock(&prof.lock);
+}
+
+void
+umalloc_site_free(struct umalloc_site *site, size_t size)
+{
+	pthread_mutex_lock(&prof.lock);
+	prof_free(site, size);
+	pthread_mutex_unlock(&prof.lock);
+}
+
+void*
+umalloc_at(size_t size, const char *file, int line)
+{
+	union prof_hdr *hdr;
+
+	if (size == 0 || size > SSIZE_MAX - sizeof(*hdr))
+		error(1, "umalloc: requested %lu bytes", (unsigned long)size);
+
+	hdr = umem_malloc(sizeof(*hdr) + size);
+
+	pthread_mutex_lock(&prof.lock);
+	hdr->site = prof_site(file, line);
+	hdr->size = size;
+	prof_alloc(hdr->site, size);
+	pthread_mutex_unlock(&prof.lock);
+
+	return hdr + 1;
+}
+
+void*
+umalloc0_at(size_t size, const char *file, int line)
+{
+	void *ptr;
+
+	ptr = umalloc_at(size, file, line);
+
+	memset(ptr, 0, size);
+
+	return ptr;
+}
+
+void*
+urealloc_at(void *mem, size_t size, const char *file, int line)
+{
+	union prof_hdr *hdr;
+
+	if (mem == NULL)
+		return umalloc_at(size, file, line);
+
+	if (size == 0 || size > SSIZE_MAX - sizeof(*hdr))
+		error(1, "urealloc: requested %lu bytes", (unsigned long)size);
+
+	hdr = (union prof_hdr *)mem - 1;
+
+	pthread_mutex_lock(&prof.lock);
+	prof_free(hdr->site, hdr->size);
+	pthread_mutex_unlock(&prof.lock);
+
+	hdr = umem_realloc(hdr, sizeof(*hdr) + size);
+
+	pthread_mutex_lock(&prof.lock);
+	hdr->site = prof_site(file, line);
+	hdr->size = size;
+	prof_alloc(hdr->site, size);
+	pthread_mutex_unlock(&prof.lock);
+
+	return hdr + 1;
+}
+
+void*
+urealloc0_at(void *mem, size_t old_size, size_t new_size, const char *file, int line)
+{
+	char *ptr;
+
+	if (mem == NULL && old_size)
+		error(1,"urealloc0: old_size != 0 on NULL memory");
+
+	ptr = urealloc_at(mem, new_size, file, line);
+
+	if (new_size > old_size)
+		memset(ptr + old_size, 0, new_size - old_size);
+
+	return ptr;
+}
+
+char*
+ustrdup_at(const char *str, const char *file, int line)
+{
+	char *res;
+	size_t len;
+
+	if (str == NULL)
+		error(1, "ustrdup: str NULL");
+
+	len = strlen(str);
+	res = umalloc_at(len + 1, file, line);
+
+	memcpy(res, str, len + 1);
+
+	return res;
+}
+
+void
+ufree(void *mem)
+{
+	union prof_hdr *hdr;
+
+	if (mem == NULL)
+		error(1,"ufree: NULL pointer");
+
+	hdr = (union prof_hdr *)mem - 1;
+
+	pthread_mutex_lock(&prof.lock);
+	prof_free(hdr->site, hdr->size);
+	pthread_mutex_unlock(&prof.lock);
+
+	umem_free(hdr);
+}
+
+static int
+prof_cmp_peak(const void *a, const void *b)
+{
+	const struct umalloc_site *x = *(struct umalloc_site **)a;
+	const struct umalloc_site *y = *(struct umalloc_site **)b;
+
+	if (x->peak != y->peak)
+		return (x->peak < y->peak) ? 1 : -1;
+
+	return (x->allocs < y->allocs) ? 1 : (x->allocs > y->allocs) ? -1 : 0;
+}
+
+long
+umalloc_report(void)
+{
+	struct umalloc_site *sorted[PROF_SITES + 1];
+	struct umalloc_site *site;
+	char where[64];
+	long live;
+	int i, n;
+
+	pthread_mutex_lock(&prof.lock);
+
+	for (i = n = 0; i < PROF_SITES; i++)
+		if (prof.sites[i].allocs != 0)
+			sorted[n++] = &prof.sites[i];
+
+	if (prof.other.allocs != 0)
+		sorted[n++] = &prof.other;
+
+	qsort(sorted, n, sizeof(*sorted), prof_cmp_peak);
+
+	fprintf(stderr, "heap: %-28s %10s %10s %12s %12s %12s" CRLF,
+		"site", "allocs", "frees", "bytes", "live", "peak");
+
+	for (i = 0; i < n; i++) {
+		site = sorted[i];
+		snprintf(where, sizeof(where), "%s:%d", site->file, site->line);
+		fprintf(stderr, "heap: %-28s %10lu %10lu %12lu %12ld %12ld" CRLF,
+			where, site->allocs, site->frees, site->bytes,
+			site->live, site->peak);
+	}
+
+	fprintf(stderr, "heap: total live %ld bytes, peak %ld bytes" CRLF,
+						prof.live, prof.peak);
+	live = prof.live;
+
+	pthread_mutex_unlock(&prof.lock);
+
+	return live;
+}
+
+/* unwrapped entry points, for code built without umalloc.h */
+void*
+umalloc(size_t size)
+{
+	return umalloc_at(size, NULL, 0);
+}
+
+void*
+umalloc0(size_t size)
+{
+	return umalloc0_at(size, NULL, 0);
+}
+
+void*
+urealloc(void *mem, size_t size)
+{
+	return urealloc_at(mem, size, NULL, 0);
+}
+
+void*
+urealloc0(void *mem, size_t old_size, size_t new_size)
+{
+	return urealloc0_at(mem, old_size, new_size, NULL, 0);
+}
+
+char*
+ustrdup(const char *str)
+{
+	return ustrdup_at(str, NULL, 0);
+}
+#else
 
 void*
 umalloc(size_t size)
@@ -14,10 +531,7 @@ umalloc(size_t size)
 	if (size == 0 || size > SSIZE_MAX)
 		error(1, "umalloc: requested %lu bytes", (unsigned long) size);
 	
-	ptr = malloc(size);
-	
-	if (ptr == NULL)
-		error(1, "umalloc: out of memory allocating %lu bytes", (unsigned long)size);
+	ptr = umem_malloc(size);
 	
 	return ptr;	
 }
@@ -30,10 +544,7 @@ umalloc0(size_t size)
 	if (size == 0 || size > SSIZE_MAX)
 		error(1, "umalloc0: requested %lu bytes", (unsigned long)size);
 	
-	ptr = malloc(size);
-	
-	if (ptr == NULL)
-		error(1, "umallo0: requested %lu bytes", (unsigned long)size);
+	ptr = umem_malloc(size);
 		
 	memset(ptr, 0, size);
 	
@@ -48,14 +559,8 @@ urealloc(void *mem, size_t size)
 	if (size == 0 || size > SSIZE_MAX)
 		error(1, "urealloc: requested %lu bytes", (unsigned long)size);
 	
-	if (mem == NULL)
-		ptr = malloc(size);
-	else 
-		ptr = realloc(mem, size);
-		
-	if (ptr == NULL)
-		error(1, "urealloc: out of memory allocating %lu bytes",
-							(unsigned long)size);
+	ptr = umem_realloc(mem, size);
+
 	return ptr;
 }
 
@@ -70,15 +575,12 @@ urealloc0(void *mem, size_t old_size, size_t new_size)
 	if (new_size == 0 || new_size > SSIZE_MAX)
 		error(1, "urealloc0: requested %lu byte",(unsigned long)new_size);
 	
-	if (mem == NULL)
-		ptr = malloc(new_size);
-	else
-		ptr = realloc(mem, new_size);
+	ptr = umem_realloc(mem, new_size);
 	
 	if (new_size > old_size)
 		memset(ptr + old_size, 0, new_size - old_size);
 	
-	return mem;
+	return ptr;
 }
 
 void
@@ -87,7 +589,7 @@ ufree(void *mem)
 	if (mem == NULL)
 		error(1,"ufree: NULL pointer");
 	
-	free(mem);
+	umem_free(mem);
 }
 
 char*
@@ -109,3 +611,121 @@ ustrdup(const char *str)
 	return res;
 }
 
+long
+umalloc_report(void)
+{
+	fprintf(stderr, "heap: profiling disabled at build time" CRLF);
+
+	return 0;
+}
+#endif /* UMALLOC_PROFILE */
+
+
+#if defined(USE_SLAB) && !defined(UMALLOC_PROFILE)
+static void
+slab_refill(struct slab_class *cls, size_t obj_size)
+{
+	struct slab_obj *obj;
+	char *chunk;
+	int i;
+
+	chunk = umalloc(obj_size * SLAB_REFILL);
+
+	for (i = SLAB_REFILL - 1; i >= 0; i--) {
+		obj = (struct slab_obj *)(chunk + i * obj_size);
+		obj->next  = cls->free;
+		cls->free  = obj;
+	}
+
+	cls->refills++;
+}
+
+void*
+uslab_alloc0(size_t size)
+{
+	struct slab_class *cls;
+	struct slab_obj *obj;
+	size_t obj_size;
+
+	if (size == 0 || size > SLAB_MAX)
+		return umalloc0(size);
+
+	cls = &slab[SLAB_CLASS(size)];
+	obj_size = (SLAB_CLASS(size) + 1) * SLAB_GRAIN;
+
+	cls->allocs++;
+
+	if (cls->free == NULL)
+		slab_refill(cls, obj_size);
+	else
+		cls->hits++;
+
+	obj = cls->free;
+	cls->free = obj->next;
+
+	memset(obj, 0, obj_size);
+
+	return obj;
+}
+
+void
+uslab_free(void *mem, size_t size)
+{
+	struct slab_class *cls;
+	struct slab_obj *obj;
+
+	if (mem == NULL)
+		error(1, "uslab_free: NULL pointer");
+
+	if (size == 0 || size > SLAB_MAX) {
+		ufree(mem);
+		return;
+	}
+
+	cls = &slab[SLAB_CLASS(size)];
+	obj = mem;
+
+	obj->next = cls->free;
+	cls->free = obj;
+	cls->frees++;
+}
+
+void
+uslab_stats(void)
+{
+	struct slab_class *cls;
+	int i;
+
+	fprintf(stderr, "slab: class  allocs      hits        refills  frees       hit rate" CRLF);
+
+	for (i = 0; i < SLAB_CLASSES; i++) {
+		cls = &slab[i];
+		
+		if (cls->allocs == 0)
+			continue;
+
+		fprintf(stderr, "slab: %-6d %-11lu %-11lu %-8lu %-11lu %.2f%%" CRLF,
+			(i + 1) * SLAB_GRAIN, cls->allocs, cls->hits,
+			cls->refills, cls->frees,
+			100.0 * cls->hits / cls->allocs);
+	}
+}
+#else
+void*
+uslab_alloc0(size_t size)
+{
+	return umalloc0(size);
+}
+
+void
+uslab_free(void *mem, size_t size)
+{
+	ufree(mem);
+}
+
+void
+uslab_stats(void)
+{
+	fprintf(stderr, "slab: allocator disabled at build time" CRLF);
+}
+#endif
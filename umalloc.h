@@ -19,5 +19,98 @@ ustrdup(const char *str);
 void
 ufree(void *mem);
 
+/* small fixed-size objects, see USE_SLAB in umalloc.c */
+void*
+uslab_alloc0(size_t size);
+
+void
+uslab_free(void *mem, size_t size);
+
+void
+uslab_stats(void);
+
+/*
+ * Memory budget shared by umalloc and the vector/matrix pool.  A budget of
+ * 0 means unlimited.  When a charge would exceed the budget, the reclaim
+ * hook is tried once and then the thread's handler is called with the
+ * requested size; the handler must not return.  With no handler armed
+ * the budget is not enforced.
+ */
+typedef void (*umem_handler_t)(size_t size);
+
+void
+umem_set_budget(size_t bytes);
+
+size_t
+umem_get_budget(void);
+
+size_t
+umem_used(void);
+
+size_t
+umem_peak(void);
+
+void
+umem_set_reclaim(void (*reclaim)(void));
+
+/* returns the previous handler */
+umem_handler_t
+umem_set_handler(umem_handler_t handler);
+
+/* for memory not obtained from umalloc */
+void
+umem_charge(size_t size);
+
+void
+umem_uncharge(size_t size);
+
+/* out of memory: call the handler or exit */
+void
+umem_fail(size_t size);
+
+/* print the allocation-site profile (PROFILE=1 builds) */
+long
+umalloc_report(void);
+
+#ifdef UMALLOC_PROFILE
+struct umalloc_site;
+
+void*
+umalloc_at(size_t size, const char *file, int line);
+
+void*
+umalloc0_at(size_t size, const char *file, int line);
+
+void*
+urealloc_at(void *mem, size_t size, const char *file, int line);
+
+void*
+urealloc0_at(void *mem, size_t old_size, size_t new_size, const char *file, int line);
+
+char*
+ustrdup_at(const char *str, const char *file, int line);
+
+/* accounting for memory that does not come from umalloc (GSL blocks) */
+struct umalloc_site*
+umalloc_site(const char *file, int line);
+
+void
+umalloc_site_alloc(struct umalloc_site *site, size_t size);
+
+void
+umalloc_site_free(struct umalloc_site *site, size_t size);
+
+#ifndef UMALLOC_C_
+#define umalloc(size)		umalloc_at(size, __FILE__, __LINE__)
+#define umalloc0(size)		umalloc0_at(size, __FILE__, __LINE__)
+#define urealloc(mem, size)	urealloc_at(mem, size, __FILE__, __LINE__)
+#define urealloc0(mem, old, new) urealloc0_at(mem, old, new, __FILE__, __LINE__)
+#define ustrdup(str)		ustrdup_at(str, __FILE__, __LINE__)
+/* the slab is bypassed so every small object is charged to its caller */
+#define uslab_alloc0(size)	umalloc0_at(size, __FILE__, __LINE__)
+#define uslab_free(mem, size)	ufree(mem)
+#endif /* UMALLOC_C_ */
+#endif /* UMALLOC_PROFILE */
+
 #endif /*UMALLOC_H_*/
 
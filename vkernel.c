@@ -0,0 +1,1469 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <gsl/gsl_vector.h>
+#include <gsl/gsl_matrix.h>
+
+#include "vkernel.h"
+#include "vmath.h"
+#include "context.h"
+#include "as_tree.h"
+#include "symbol.h"
+#include "eval.h"
+#include "list.h"
+#include "libm.h"
+#include "pool.h"
+#include "umalloc.h"
+#include "macros.h"
+#include "misc.h"
+
+/* elements run through the whole code at a time, the registers stay in cache */
+#define VK_BLOCK	256
+
+/* how deep calls to other functions are inlined */
+#define VK_DEPTH	8
+
+/* iterations of a loop with digits for bounds that are unrolled */
+#define VK_UNROLL	64
+
+/* instructions of a kernel, each takes a block of registers to run */
+#define VK_MAX_CODE	1024
+
+/* statements looked at to tell whether a body takes whole arrays */
+#define VK_BUDGET	1024
+
+typedef enum {
+	VK_ARG,
+	VK_CONST,
+	VK_GLOBAL,
+	VK_OP,
+	VK_CALL,
+	VK_SELECT
+} vk_type_t;
+
+/* register i is set by instruction i */
+struct vk_instr {
+	vk_type_t	type;
+	opcode_type_t	opcode;
+	int		a;		/* operands, the argument of VK_ARG */
+	int		b;
+	int		c;		/* VK_SELECT: a where c, else b */
+	int		live;		/* VK_OP: where errors count, -1 all */
+	double		digit;
+	char		*name;
+	vmath_fn_t	fn;
+};
+
+struct vkernel {
+	int		nargs;
+	int		ninstr;
+	struct vk_instr	*code;
+	int		result;
+};
+
+struct vk_compile {
+	struct bclite_ctx	*ctx;
+	struct vkernel		*kernel;
+	struct function		*stack[VK_DEPTH];
+	int			depth;
+};
+
+/*
+ * The elements on their way through a body.  A branch is taken by all
+ * of them, live tells which are really in it; those that returned keep
+ * their value in ret while the others go on.
+ */
+struct vk_path {
+	int	*regs;		/* of the slots, -1 while unset */
+	int	count;
+	int	live;		/* nonzero for the elements still running, -1 all */
+	int	ret;		/* the value of those that returned, -1 none */
+	int	dead;		/* every element returned */
+};
+
+static int
+emit(struct vkernel *kernel, struct vk_instr *instr)
+{
+	int i;
+
+	if (kernel->ninstr == VK_MAX_CODE)
+		return -1;
+
+	i = kernel->ninstr++;
+
+	kernel->code = urealloc(kernel->code, kernel->ninstr *
+						sizeof(*kernel->code));
+	kernel->code[i] = *instr;
+
+	return i;
+}
+
+static int
+emit_const(struct vk_compile *c, double digit)
+{
+	struct vk_instr instr;
+
+	memset(&instr, 0, sizeof(instr));
+
+	instr.type  = VK_CONST;
+	instr.digit = digit;
+
+	return emit(c->kernel, &instr);
+}
+
+/* a where cond is nonzero, b elsewhere */
+static int
+emit_select(struct vk_compile *c, int cond, int a, int b)
+{
+	struct vk_instr instr;
+
+	if (cond < 0 || a < 0 || b < 0)
+		return -1;
+
+	if (a == b)
+		return a;
+
+	memset(&instr, 0, sizeof(instr));
+
+	instr.type = VK_SELECT;
+	instr.a    = a;
+	instr.b    = b;
+	instr.c    = cond;
+
+	return emit(c->kernel, &instr);
+}
+
+/* the elements of live where cond holds, or where it does not with neg */
+static int
+emit_mask(struct vk_compile *c, int live, int cond, int neg)
+{
+	int zero;
+
+	if (!neg && live < 0)
+		return cond;
+
+	if ((zero = emit_const(c, 0.0)) < 0)
+		return -1;
+
+	if (!neg)
+		return emit_select(c, live, cond, zero);
+
+	if (live < 0 && (live = emit_const(c, 1.0)) < 0)
+		return -1;
+
+	return emit_select(c, cond, zero, live);
+}
+
+static int compile_body(struct vk_compile *c, struct function *func,
+					int *args, int live, int *result);
+
+/* register of the value of node, -1 if it is not a digit expression */
+static int
+compile_expr(struct vk_compile *c, struct ast_node *node,
+						struct vk_path *path)
+{
+	struct ast_node_func_call *call;
+	struct ast_node_const *_const;
+	struct ast_node_id *id;
+	struct ast_node_op *op;
+	struct function *func;
+	struct vk_instr instr;
+	int args[VK_DEPTH], i, reg;
+
+	memset(&instr, 0, sizeof(instr));
+
+	switch(node->type) {
+	case NODE_TYPE_CONST:
+		_const = AST_CONST(node);
+
+		if (_const->v_type != VALUE_TYPE_DIGIT)
+			return -1;
+
+		instr.type  = VK_CONST;
+		instr.digit = _const->digit;
+		break;
+	case NODE_TYPE_ID:
+		id = (struct ast_node_id *)node;
+
+		if (id->slot >= 0)
+			return path->regs[id->slot];
+
+		instr.type = VK_GLOBAL;
+		instr.name = id->name;
+		break;
+	case NODE_TYPE_ADD_OP:
+	case NODE_TYPE_MULT_OP:
+	case NODE_TYPE_REL_OP:
+	case NODE_TYPE_AND_OP:
+	case NODE_TYPE_OR_OP:
+	case NODE_TYPE_EXP_OP:
+		op = (struct ast_node_op *)node;
+
+		instr.type   = VK_OP;
+		instr.opcode = op->opcode;
+		instr.a      = compile_expr(c, op->left, path);
+		instr.b      = compile_expr(c, op->right, path);
+		instr.live   = path->live;
+
+		if (instr.a < 0 || instr.b < 0)
+			return -1;
+		break;
+	case NODE_TYPE_FUNC_CALL:
+		call = (struct ast_node_func_call *)node;
+		func = function_table_lookup(c->ctx, call->name);
+
+		if (func == NULL || func->nargs != call->nargs)
+			return -1;
+
+		if (func->is_lib) {
+			instr.type = VK_CALL;
+			instr.fn   = vmath_builtin(func->name);
+			instr.a    = compile_expr(c, call->args[0], path);
+
+			if (instr.fn == NULL || instr.a < 0)
+				return -1;
+			break;
+		}
+
+		/* inlined, the arguments are registers of the caller */
+		if (c->depth == VK_DEPTH || func->nargs > VK_DEPTH)
+			return -1;
+
+		for (i = 0; i < c->depth; i++)
+			if (c->stack[i] == func)
+				return -1;
+
+		for (i = 0; i < call->nargs; i++) {
+			args[i] = compile_expr(c, call->args[i], path);
+
+			if (args[i] < 0)
+				return -1;
+		}
+
+		if (!compile_body(c, func, args, path->live, &reg))
+			return -1;
+
+		return reg;
+	default:
+		return -1;
+	}
+
+	return emit(c->kernel, &instr);
+}
+
+static int
+is_slot(struct ast_node *node, int slot)
+{
+	return node->type == NODE_TYPE_ID &&
+			((struct ast_node_id *)node)->slot == slot;
+}
+
+static int
+is_digit(struct ast_node *node, double *digit)
+{
+	if (node->type != NODE_TYPE_CONST ||
+				AST_CONST(node)->v_type != VALUE_TYPE_DIGIT)
+		return FALSE;
+
+	*digit = AST_CONST(node)->digit;
+
+	return TRUE;
+}
+
+/* some statement of the list assigns the slot */
+static int
+assigns(struct ast_node *node, int slot)
+{
+	struct ast_node_while *_while;
+	struct ast_node_for *_for;
+	struct ast_node_if *_if;
+
+	for (; node != NULL; node = node->next) {
+		switch(node->type) {
+		case NODE_TYPE_END_SCOPE:
+			return FALSE;
+		case NODE_TYPE_ASSIGN:
+			if (is_slot(((struct ast_node_assign *)node)->left, slot))
+				return TRUE;
+			break;
+		case NODE_TYPE_IF:
+			_if = (struct ast_node_if *)node;
+			if (assigns(_if->stmt, slot) || assigns(_if->_else, slot))
+				return TRUE;
+			break;
+		case NODE_TYPE_WHILE:
+			_while = (struct ast_node_while *)node;
+			if (assigns(_while->stmt, slot))
+				return TRUE;
+			break;
+		case NODE_TYPE_FOR:
+			_for = (struct ast_node_for *)node;
+			if (assigns(_for->expr1, slot) ||
+			    assigns(_for->expr3, slot) ||
+			    assigns(_for->stmt, slot))
+				return TRUE;
+			break;
+		default:
+			break;
+		}
+	}
+
+	return FALSE;
+}
+
+/*
+ * for (i = a; i < b; i = i + s) over a local i, with digits for a, b and
+ * s, any comparison, + or - for the step, and a body that leaves i
+ * alone: the interpreter tests the condition before every statement,
+ * which is then the same as once an iteration.  The number of
+ * iterations, val[k] being i in the k-th and val[n] i after the loop;
+ * -1 for any other loop, or one of more than VK_UNROLL iterations.
+ */
+static int
+loop_trips(struct ast_node_for *_for, int *slot, double *val)
+{
+	struct ast_node_assign *init, *step;
+	struct ast_node_op *cond, *add;
+	double a, b, s, x;
+	int n;
+
+	if (_for->expr1 == NULL || _for->expr2 == NULL || _for->expr3 == NULL)
+		return -1;
+
+	if (_for->expr1->type != NODE_TYPE_ASSIGN ||
+	    _for->expr2->type != NODE_TYPE_REL_OP ||
+	    _for->expr3->type != NODE_TYPE_ASSIGN)
+		return -1;
+
+	init = (struct ast_node_assign *)_for->expr1;
+	cond = (struct ast_node_op *)_for->expr2;
+	step = (struct ast_node_assign *)_for->expr3;
+	add  = (struct ast_node_op *)step->right;
+
+	if (init->left->type != NODE_TYPE_ID)
+		return -1;
+
+	*slot = ((struct ast_node_id *)init->left)->slot;
+
+	if (*slot < 0 || !is_digit(init->right, &a))
+		return -1;
+
+	if (!is_slot(cond->left, *slot) || !is_digit(cond->right, &b))
+		return -1;
+
+	if (!is_slot(step->left, *slot) || add->base.type != NODE_TYPE_ADD_OP ||
+	    !is_slot(add->left, *slot) || !is_digit(add->right, &s))
+		return -1;
+
+	if (assigns(_for->stmt, *slot))
+		return -1;
+
+	for (n = 0, x = a; libm_digit_op(x, b, cond->opcode) != 0.0; n++) {
+		if (n == VK_UNROLL)
+			return -1;
+
+		val[n] = x;
+		x      = libm_digit_op(x, s, add->opcode);
+	}
+
+	val[n] = x;
+
+	return n;
+}
+
+static int compile_stmts(struct vk_compile *c, struct ast_node *node,
+						struct vk_path *path);
+
+/* both branches, each for the elements its condition gives it */
+static int
+compile_if(struct vk_compile *c, struct ast_node_if *_if,
+						struct vk_path *path)
+{
+	struct vk_path br[2];
+	int mask[2], cond, i, ok;
+
+	if ((cond = compile_expr(c, _if->expr, path)) < 0)
+		return FALSE;
+
+	for (i = 0; i < 2; i++) {
+		br[i]      = *path;
+		br[i].regs = umalloc((path->count + 1) * sizeof(int));
+		br[i].live = mask[i] = emit_mask(c, path->live, cond, i);
+
+		memcpy(br[i].regs, path->regs, path->count * sizeof(int));
+	}
+
+	ok = mask[0] >= 0 && mask[1] >= 0 &&
+			compile_stmts(c, _if->stmt, &br[0]) &&
+			compile_stmts(c, _if->_else, &br[1]);
+
+	if (!ok)
+		goto out;
+
+	if (br[0].ret < 0 || br[1].ret < 0)
+		path->ret = MAX(br[0].ret, br[1].ret);
+	else
+		path->ret = emit_select(c, cond, br[0].ret, br[1].ret);
+
+	if (br[0].dead && br[1].dead) {
+		path->dead = TRUE;
+		ok = path->ret >= 0;
+		goto out;
+	}
+
+	/* a branch every element of which returned has nothing to give */
+	for (i = 0; i < path->count && ok; i++) {
+		if (br[0].dead)
+			path->regs[i] = br[1].regs[i];
+		else if (br[1].dead)
+			path->regs[i] = br[0].regs[i];
+		else if (br[0].regs[i] < 0 || br[1].regs[i] < 0)
+			path->regs[i] = -1;
+		else
+			ok = (path->regs[i] = emit_select(c, cond,
+					br[0].regs[i], br[1].regs[i])) >= 0;
+	}
+
+	/* a mask of a branch is never -1, a select of them on no room */
+	if (br[0].dead)
+		path->live = br[1].live;
+	else if (br[1].dead)
+		path->live = br[0].live;
+	else if (br[0].live != mask[0] || br[1].live != mask[1])
+		ok = ok && (path->live = emit_select(c, cond, br[0].live,
+							br[1].live)) >= 0;
+
+	ok = ok && (path->ret >= 0 || (br[0].ret < 0 && br[1].ret < 0));
+out:
+	ufree(br[0].regs);
+	ufree(br[1].regs);
+
+	return ok;
+}
+
+/* unrolled, the loop variable a digit in each copy of the body */
+static int
+compile_for(struct vk_compile *c, struct ast_node_for *_for,
+						struct vk_path *path)
+{
+	double val[VK_UNROLL + 1];
+	int slot, n, k;
+
+	if ((n = loop_trips(_for, &slot, val)) < 0)
+		return FALSE;
+
+	for (k = 0; k < n && !path->dead; k++) {
+		if ((path->regs[slot] = emit_const(c, val[k])) < 0)
+			return FALSE;
+
+		if (!compile_stmts(c, _for->stmt, path))
+			return FALSE;
+	}
+
+	if (!path->dead)
+		path->regs[slot] = emit_const(c, val[n]);
+
+	return path->dead || path->regs[slot] >= 0;
+}
+
+/*
+ * Assignments to locals, returns, if and else, and loops with digits
+ * for bounds; the elements still running after them are in path.
+ */
+static int
+compile_stmts(struct vk_compile *c, struct ast_node *node,
+						struct vk_path *path)
+{
+	struct ast_node_assign *assign;
+	struct ast_node_return *ret;
+	int reg;
+
+	for (; node != NULL && !path->dead; node = node->next) {
+		switch(node->type) {
+		case NODE_TYPE_STUB:
+			break;
+		case NODE_TYPE_END_SCOPE:
+			return TRUE;
+		case NODE_TYPE_ASSIGN:
+			assign = (struct ast_node_assign *)node;
+
+			/* globals are side effects */
+			if (assign->left->type != NODE_TYPE_ID ||
+			    ((struct ast_node_id *)assign->left)->slot < 0)
+				return FALSE;
+
+			if ((reg = compile_expr(c, assign->right, path)) < 0)
+				return FALSE;
+
+			path->regs[((struct ast_node_id *)assign->left)->slot] =
+									reg;
+			break;
+		case NODE_TYPE_RETURN:
+			ret = (struct ast_node_return *)node;
+
+			if (ret->ret_val == NULL)
+				return FALSE;
+
+			if ((reg = compile_expr(c, ret->ret_val, path)) < 0)
+				return FALSE;
+
+			/* those that returned before keep their value */
+			if (path->ret >= 0 && path->live >= 0)
+				reg = emit_select(c, path->live, reg, path->ret);
+
+			path->ret  = reg;
+			path->dead = TRUE;
+
+			if (reg < 0)
+				return FALSE;
+			break;
+		case NODE_TYPE_IF:
+			if (!compile_if(c, (struct ast_node_if *)node, path))
+				return FALSE;
+			break;
+		case NODE_TYPE_FOR:
+			if (!compile_for(c, (struct ast_node_for *)node, path))
+				return FALSE;
+			break;
+		default:
+			return FALSE;
+		}
+	}
+
+	return TRUE;
+}
+
+/* every element must come to a return */
+static int
+compile_body(struct vk_compile *c, struct function *func, int *args,
+						int live, int *result)
+{
+	struct vk_path path;
+	int i, ok;
+
+	if (func->scope == NULL || func->body == NULL)
+		return FALSE;
+
+	path.count = func->scope->count;
+	path.regs  = umalloc((path.count + 1) * sizeof(int));
+	path.live  = live;
+	path.ret   = -1;
+	path.dead  = FALSE;
+
+	for (i = 0; i < path.count; i++)
+		path.regs[i] = (i < func->nargs) ? args[i] : -1;
+
+	c->stack[c->depth++] = func;
+
+	ok = compile_stmts(c, func->body, &path) && path.dead;
+
+	c->depth--;
+
+	*result = path.ret;
+
+	ufree(path.regs);
+
+	return ok;
+}
+
+static struct vkernel*
+vkernel_compile(struct bclite_ctx *ctx, struct function *func)
+{
+	struct vk_compile c;
+	struct vk_instr instr;
+	int args[VK_DEPTH], i;
+
+	if (func->nargs == 0 || func->nargs > VK_DEPTH)
+		return NULL;
+
+	memset(&c, 0, sizeof(c));
+
+	c.ctx    = ctx;
+	c.kernel = umalloc0(sizeof(*c.kernel));
+
+	c.kernel->nargs = func->nargs;
+
+	memset(&instr, 0, sizeof(instr));
+
+	for (i = 0; i < func->nargs; i++) {
+		instr.type = VK_ARG;
+		instr.a    = i;
+		args[i]    = emit(c.kernel, &instr);
+	}
+
+	if (!compile_body(&c, func, args, -1, &c.kernel->result)) {
+		vkernel_destroy(&c.kernel);
+		return NULL;
+	}
+
+	return c.kernel;
+}
+
+void
+vkernel_destroy(struct vkernel **kernel)
+{
+	return_if_fail(kernel != NULL && *kernel != NULL);
+
+	if ((*kernel)->code)
+		ufree((*kernel)->code);
+
+	ufree(*kernel);
+	*kernel = NULL;
+}
+
+/* the shape of the array arguments, FALSE if there is none or they differ */
+static int
+array_shape(struct function *func, value_t *v_type, size_t *rows,
+							size_t *cols)
+{
+	struct symbol *arg;
+	size_t r, c;
+	int i;
+
+	*v_type = VALUE_TYPE_UNKNOWN;
+	*rows   = *cols = 0;
+
+	for (i = 0; i < func->nargs; i++) {
+		arg = func->args[i];
+
+		switch(arg->v_type) {
+		case VALUE_TYPE_DIGIT:
+			continue;
+		case VALUE_TYPE_VECTOR:
+			r = arg->vector->size;
+			c = 1;
+			break;
+		case VALUE_TYPE_MATRIX:
+			r = arg->matrix->size1;
+			c = arg->matrix->size2;
+			break;
+		default:
+			return FALSE;
+		}
+
+		if (*v_type == VALUE_TYPE_UNKNOWN) {
+			*v_type = arg->v_type;
+			*rows   = r;
+			*cols   = c;
+		} else if (*v_type != arg->v_type || *rows != r || *cols != c) {
+			return FALSE;
+		}
+	}
+
+	return *v_type != VALUE_TYPE_UNKNOWN && *rows * *cols > 0;
+}
+
+/* elements [lo, lo + n) of a vector or a matrix, in row order */
+static void
+gather(struct symbol *arg, double *y, size_t lo, size_t n)
+{
+	gsl_matrix *mx;
+	size_t i, r, c;
+
+	if (arg->v_type == VALUE_TYPE_VECTOR) {
+		for (i = 0; i < n; i++)
+			y[i] = gsl_vector_get(arg->vector, lo + i);
+		return;
+	}
+
+	mx = arg->matrix;
+	r  = lo / mx->size2;
+	c  = lo % mx->size2;
+
+	for (i = 0; i < n; i++) {
+		y[i] = mx->data[r * mx->tda + c];
+
+		if (++c == mx->size2) {
+			c = 0;
+			r++;
+		}
+	}
+}
+
+/* operand i of a block: a register, or NULL for a digit in v */
+#define OPERAND(p, i, v)	((p) != NULL ? (p)[i] : (v))
+
+#define OP_LOOP(expr) \
+do { \
+	if (a != NULL && b != NULL) \
+		for (i = 0; i < n; i++) { x = a[i]; z = b[i]; y[i] = (expr); } \
+	else if (a != NULL) \
+		for (i = 0; i < n; i++) { x = a[i]; z = vb; y[i] = (expr); } \
+	else \
+		for (i = 0; i < n; i++) { x = va; z = b[i]; y[i] = (expr); } \
+} while (0)
+
+/*
+ * y = a op b, a NULL operand is the digit next to it; as libm_digit_op()
+ * for the elements of live, the others take no error
+ */
+static void
+op_block(opcode_type_t op, double *y, const double *a, double va,
+		const double *b, double vb, const double *live, double vlive,
+								size_t n)
+{
+	double x, z;
+	size_t i;
+
+	switch(op) {
+	case OPCODE_ADD:
+		OP_LOOP(x + z);
+		break;
+	case OPCODE_SUB:
+		OP_LOOP(x - z);
+		break;
+	case OPCODE_MULT:
+		OP_LOOP(x * z);
+		break;
+	case OPCODE_DIV:
+		OP_LOOP(x / z);
+
+		/* an error and 0 for each zero, as the interpreter gives */
+		for (i = 0; i < n; i++)
+			if (OPERAND(b, i, vb) == 0.0 &&
+			    OPERAND(live, i, vlive) != 0.0)
+				y[i] = libm_digit_op(OPERAND(a, i, va), 0.0, op);
+		break;
+	case OPCODE_LT:
+		OP_LOOP(x < z);
+		break;
+	case OPCODE_GT:
+		OP_LOOP(x > z);
+		break;
+	default:
+		OP_LOOP(libm_digit_op(x, z, op));
+		break;
+	}
+}
+
+/* y = a where c is nonzero, b elsewhere */
+static void
+select_block(double *y, const double *c, double vc, const double *a,
+			double va, const double *b, double vb, size_t n)
+{
+	size_t i;
+
+	for (i = 0; i < n; i++)
+		y[i] = (OPERAND(c, i, vc) != 0.0) ? OPERAND(a, i, va) :
+							OPERAND(b, i, vb);
+}
+
+/* register r of the current block, NULL if it holds one digit */
+#define REG(r)		((r) < 0 || uniform[r] ? NULL : regs[r])
+
+/* and that digit, 1 for the -1 of all elements */
+#define VALUE(r)	((r) < 0 ? 1.0 : value[r])
+
+static void
+run(struct vkernel *kernel, struct function *func, double *out, size_t size,
+	char *uniform, double *value, double **regs)
+{
+	struct vk_instr *in;
+	size_t lo, n, j;
+	int i;
+
+	for (lo = 0; lo < size; lo += VK_BLOCK) {
+		n = MIN(VK_BLOCK, size - lo);
+
+		for (i = 0; i < kernel->ninstr; i++) {
+			if (uniform[i])
+				continue;
+
+			in = &kernel->code[i];
+
+			switch(in->type) {
+			case VK_ARG:
+				gather(func->args[in->a], regs[i], lo, n);
+				break;
+			case VK_OP:
+				op_block(in->opcode, regs[i],
+					REG(in->a), VALUE(in->a),
+					REG(in->b), VALUE(in->b),
+					REG(in->live), VALUE(in->live), n);
+				break;
+			case VK_CALL:
+				in->fn(regs[i], regs[in->a], n);
+				break;
+			case VK_SELECT:
+				select_block(regs[i], REG(in->c), VALUE(in->c),
+					REG(in->a), VALUE(in->a),
+					REG(in->b), VALUE(in->b), n);
+				break;
+			default:
+				SHOULDNT_REACH();
+			}
+		}
+
+		i = kernel->result;
+
+		if (uniform[i])
+			for (j = 0; j < n; j++)
+				out[lo + j] = value[i];
+		else
+			memcpy(out + lo, regs[i], n * sizeof(double));
+	}
+}
+
+static int scalar_func(struct bclite_ctx *ctx, struct function *func);
+
+/*
+ * What the interpreter makes of an expression when the arrays are passed
+ * whole.  Only an error is sure to be one, the other types are followed
+ * as far as they are known.
+ */
+typedef enum {
+	WHOLE_UNKNOWN,
+	WHOLE_DIGIT,
+	WHOLE_ARRAY,		/* of the shape of the arguments */
+	WHOLE_ERROR
+} whole_t;
+
+/* how the interpreter leaves a list of statements */
+typedef enum {
+	WHOLE_ON,		/* past its end, on to what follows */
+	WHOLE_FAILS,		/* by an error on every way through it */
+	WHOLE_RUNS		/* it may work, or something else happens */
+} whole_end_t;
+
+struct vk_whole {
+	struct bclite_ctx	*ctx;
+	value_t			v_type;
+	size_t			rows;
+	size_t			cols;
+	struct function		*stack[VK_DEPTH];
+	int			depth;
+	int			budget;
+};
+
+/* as eval.c gives it */
+static whole_t
+whole_op(struct vk_whole *w, opcode_type_t op, whole_t l, whole_t r)
+{
+	int vector, square;
+
+	vector = w->v_type == VALUE_TYPE_VECTOR;
+	square = !vector && w->rows == w->cols;
+
+	if (l == WHOLE_ERROR || r == WHOLE_ERROR)
+		return WHOLE_ERROR;
+
+	/* a power is a digit, only a square matrix is raised to it */
+	if (op == OPCODE_EXP &&
+	    (r == WHOLE_ARRAY || (l == WHOLE_ARRAY && !square)))
+		return WHOLE_ERROR;
+
+	if (l == WHOLE_UNKNOWN || r == WHOLE_UNKNOWN)
+		return WHOLE_UNKNOWN;
+
+	if (l == WHOLE_DIGIT && r == WHOLE_DIGIT)
+		return WHOLE_DIGIT;
+
+	switch(op) {
+	case OPCODE_ADD:
+	case OPCODE_SUB:
+	case OPCODE_EXP:
+		return WHOLE_ARRAY;
+	case OPCODE_MULT:
+		if (l != r)
+			return WHOLE_ARRAY;
+
+		/* the inner product, or that of matrices */
+		if (vector)
+			return WHOLE_DIGIT;
+
+		return square ? WHOLE_ARRAY : WHOLE_ERROR;
+	case OPCODE_DIV:
+		if (r == WHOLE_DIGIT)
+			return WHOLE_ARRAY;
+
+		/* a digit is not divided by an array, arrays solve */
+		return (l == WHOLE_DIGIT) ? WHOLE_ERROR : WHOLE_UNKNOWN;
+	case OPCODE_AND:
+	case OPCODE_OR:
+		return WHOLE_DIGIT;
+	default:
+		/* there is no vector < digit, see eval_rel_op() */
+		if (vector && r == WHOLE_DIGIT)
+			return WHOLE_ERROR;
+
+		return WHOLE_ARRAY;
+	}
+}
+
+static whole_end_t whole_body(struct vk_whole *w, struct function *func,
+							whole_t *args);
+
+static whole_t
+whole_call(struct vk_whole *w, struct ast_node_func_call *call,
+							whole_t *slots);
+
+static whole_t
+whole_expr(struct vk_whole *w, struct ast_node *node, whole_t *slots)
+{
+	struct ast_node_op *op;
+	struct ast_node_id *id;
+	struct symbol *sym;
+	whole_t l, r;
+
+	switch(node->type) {
+	case NODE_TYPE_CONST:
+		if (AST_CONST(node)->v_type != VALUE_TYPE_DIGIT)
+			return WHOLE_UNKNOWN;
+
+		return WHOLE_DIGIT;
+	case NODE_TYPE_ID:
+		id = (struct ast_node_id *)node;
+
+		if (id->slot >= 0)
+			return slots[id->slot];
+
+		sym = symbol_table_lookup_global(w->ctx, id->name);
+
+		if (sym == NULL || sym->v_type != VALUE_TYPE_DIGIT)
+			return WHOLE_UNKNOWN;
+
+		return WHOLE_DIGIT;
+	case NODE_TYPE_ADD_OP:
+	case NODE_TYPE_MULT_OP:
+	case NODE_TYPE_REL_OP:
+	case NODE_TYPE_AND_OP:
+	case NODE_TYPE_OR_OP:
+	case NODE_TYPE_EXP_OP:
+		op = (struct ast_node_op *)node;
+
+		l = whole_expr(w, op->left, slots);
+		r = whole_expr(w, op->right, slots);
+
+		return whole_op(w, op->opcode, l, r);
+	case NODE_TYPE_FUNC_CALL:
+		return whole_call(w, (struct ast_node_func_call *)node, slots);
+	default:
+		return WHOLE_UNKNOWN;
+	}
+}
+
+/* a call with arrays goes as the call of the body would, see vkernel.h */
+static whole_t
+whole_call(struct vk_whole *w, struct ast_node_func_call *call,
+							whole_t *slots)
+{
+	struct function *func;
+	whole_t args[VK_DEPTH], res;
+	int i, arrays;
+
+	func = function_table_lookup(w->ctx, call->name);
+
+	if (func == NULL || func->nargs != call->nargs ||
+						call->nargs > VK_DEPTH)
+		return WHOLE_UNKNOWN;
+
+	res = WHOLE_DIGIT;
+
+	for (i = arrays = 0; i < call->nargs; i++) {
+		args[i] = whole_expr(w, call->args[i], slots);
+
+		if (args[i] == WHOLE_ERROR)
+			return WHOLE_ERROR;
+
+		if (args[i] == WHOLE_UNKNOWN)
+			res = WHOLE_UNKNOWN;
+
+		arrays += args[i] == WHOLE_ARRAY;
+	}
+
+	/* the builtins of vmath.h map arrays themselves */
+	if (func->is_lib && vmath_builtin(func->name) != NULL)
+		return (res == WHOLE_DIGIT && arrays) ? WHOLE_ARRAY : res;
+
+	if (func->is_lib || res == WHOLE_UNKNOWN || !arrays)
+		return WHOLE_UNKNOWN;
+
+	if (w->depth == VK_DEPTH)
+		return WHOLE_UNKNOWN;
+
+	for (i = 0; i < w->depth; i++)
+		if (w->stack[i] == func)
+			return WHOLE_UNKNOWN;
+
+	if (whole_body(w, func, args) != WHOLE_FAILS)
+		return WHOLE_UNKNOWN;
+
+	return scalar_func(w->ctx, func) ? WHOLE_ARRAY : WHOLE_ERROR;
+}
+
+/* a condition must be a digit */
+static whole_end_t
+whole_cond(whole_t t)
+{
+	return (t == WHOLE_ERROR || t == WHOLE_ARRAY) ? WHOLE_FAILS :
+								WHOLE_RUNS;
+}
+
+static whole_end_t whole_stmts(struct vk_whole *w, struct ast_node *node,
+						whole_t *slots, int count);
+
+/* a digit condition may take either branch */
+static whole_end_t
+whole_if(struct vk_whole *w, struct ast_node_if *_if, whole_t *slots,
+								int count)
+{
+	whole_end_t a, b;
+	whole_t *other, t;
+	int i;
+
+	if ((t = whole_expr(w, _if->expr, slots)) != WHOLE_DIGIT)
+		return whole_cond(t);
+
+	other = umalloc((count + 1) * sizeof(*other));
+	memcpy(other, slots, count * sizeof(*other));
+
+	a = whole_stmts(w, _if->stmt, slots, count);
+	b = whole_stmts(w, _if->_else, other, count);
+
+	if (a == WHOLE_RUNS || b == WHOLE_RUNS) {
+		a = WHOLE_RUNS;
+	} else if (a == WHOLE_FAILS && b == WHOLE_FAILS) {
+		a = WHOLE_FAILS;
+	} else {
+		/* on from the branches that go on */
+		for (i = 0; i < count; i++)
+			if (a == WHOLE_FAILS)
+				slots[i] = other[i];
+			else if (b == WHOLE_ON && slots[i] != other[i])
+				slots[i] = WHOLE_UNKNOWN;
+
+		a = WHOLE_ON;
+	}
+
+	ufree(other);
+
+	return a;
+}
+
+static whole_end_t
+whole_for(struct vk_whole *w, struct ast_node_for *_for, whole_t *slots,
+								int count)
+{
+	double val[VK_UNROLL + 1];
+	whole_t *prev;
+	whole_end_t end;
+	int slot, n, k;
+
+	/* another loop: its first test of the condition */
+	if ((n = loop_trips(_for, &slot, val)) < 0) {
+		if (_for->expr1 != NULL) {
+			end = whole_stmts(w, _for->expr1, slots, count);
+
+			if (end != WHOLE_ON)
+				return end;
+		}
+
+		if (_for->expr2 == NULL)
+			return WHOLE_RUNS;
+
+		return whole_cond(whole_expr(w, _for->expr2, slots));
+	}
+
+	slots[slot] = WHOLE_DIGIT;
+
+	prev = umalloc((count + 1) * sizeof(*prev));
+	end  = WHOLE_ON;
+
+	for (k = 0; k < MIN(n, 2) && end == WHOLE_ON; k++) {
+		memcpy(prev, slots, count * sizeof(*prev));
+
+		end = whole_stmts(w, _for->stmt, slots, count);
+	}
+
+	/* the others go as the last one if it changed no type */
+	if (end == WHOLE_ON && n > 2 &&
+			memcmp(prev, slots, count * sizeof(*prev)) != 0)
+		end = WHOLE_RUNS;
+
+	ufree(prev);
+
+	return end;
+}
+
+/* up to an effect on more than the locals, which may not come */
+static whole_end_t
+whole_stmts(struct vk_whole *w, struct ast_node *node, whole_t *slots,
+								int count)
+{
+	struct ast_node_assign *assign;
+	struct ast_node_return *ret;
+	struct ast_node_id *id;
+	whole_end_t end;
+	whole_t t;
+
+	for (; node != NULL; node = node->next) {
+		if (--w->budget < 0)
+			return WHOLE_RUNS;
+
+		switch(node->type) {
+		case NODE_TYPE_STUB:
+			break;
+		case NODE_TYPE_END_SCOPE:
+			return WHOLE_ON;
+		case NODE_TYPE_ASSIGN:
+			assign = (struct ast_node_assign *)node;
+			id     = (struct ast_node_id *)assign->left;
+
+			if (assign->left->type != NODE_TYPE_ID || id->slot < 0)
+				return WHOLE_RUNS;
+
+			if ((t = whole_expr(w, assign->right, slots)) ==
+								WHOLE_ERROR)
+				return WHOLE_FAILS;
+
+			slots[id->slot] = t;
+			break;
+		case NODE_TYPE_RETURN:
+			ret = (struct ast_node_return *)node;
+
+			if (ret->ret_val != NULL &&
+			    whole_expr(w, ret->ret_val, slots) == WHOLE_ERROR)
+				return WHOLE_FAILS;
+
+			return WHOLE_RUNS;
+		case NODE_TYPE_IF:
+			end = whole_if(w, (struct ast_node_if *)node, slots,
+									count);
+			if (end != WHOLE_ON)
+				return end;
+			break;
+		case NODE_TYPE_WHILE:
+			t = whole_expr(w, ((struct ast_node_while *)node)->expr,
+									slots);
+			return whole_cond(t);
+		case NODE_TYPE_FOR:
+			end = whole_for(w, (struct ast_node_for *)node, slots,
+									count);
+			if (end != WHOLE_ON)
+				return end;
+			break;
+		default:
+			return WHOLE_RUNS;
+		}
+	}
+
+	return WHOLE_ON;
+}
+
+static whole_end_t
+whole_body(struct vk_whole *w, struct function *func, whole_t *args)
+{
+	whole_end_t end;
+	whole_t *slots;
+	int i, count;
+
+	if (func->scope == NULL || func->body == NULL)
+		return WHOLE_RUNS;
+
+	count = func->scope->count;
+	slots = umalloc((count + 1) * sizeof(*slots));
+
+	for (i = 0; i < count; i++)
+		slots[i] = (i < func->nargs) ? args[i] : WHOLE_UNKNOWN;
+
+	w->stack[w->depth++] = func;
+
+	end = whole_stmts(w, func->body, slots, count);
+
+	w->depth--;
+
+	ufree(slots);
+
+	return end;
+}
+
+/* the arguments of func are set, some of them arrays of one shape */
+static int
+whole_fails(struct bclite_ctx *ctx, struct function *func, value_t v_type,
+						size_t rows, size_t cols)
+{
+	struct vk_whole w;
+	whole_t args[VK_DEPTH];
+	int i;
+
+	if (func->nargs > VK_DEPTH)
+		return FALSE;
+
+	memset(&w, 0, sizeof(w));
+
+	w.ctx    = ctx;
+	w.v_type = v_type;
+	w.rows   = rows;
+	w.cols   = cols;
+	w.budget = VK_BUDGET;
+
+	for (i = 0; i < func->nargs; i++)
+		args[i] = (func->args[i]->v_type == VALUE_TYPE_DIGIT) ?
+						WHOLE_DIGIT : WHOLE_ARRAY;
+
+	return whole_body(&w, func, args) == WHOLE_FAILS;
+}
+
+int
+vkernel_call(struct bclite_ctx *ctx, struct function *func)
+{
+	struct vkernel *kernel;
+	struct vk_instr *in;
+	struct symbol *sym;
+	struct eval *eval;
+	gsl_vector *vc;
+	gsl_matrix *mx;
+	value_t v_type;
+	size_t rows, cols;
+	double *value, *out, **regs, *block;
+	char *uniform;
+	void *mem;
+	int i, nregs;
+
+	return_val_if_fail(func != NULL, FALSE);
+
+	if (func->is_lib || !array_shape(func, &v_type, &rows, &cols))
+		return FALSE;
+
+	if (func->kernel_version != ctx->functions_version) {
+		if (func->kernel)
+			vkernel_destroy(&func->kernel);
+
+		func->kernel         = vkernel_compile(ctx, func);
+		func->kernel_version = ctx->functions_version;
+	}
+
+	if ((kernel = func->kernel) == NULL)
+		return FALSE;
+
+	/* globals must be digits, checked before anything changes */
+	for (i = 0; i < kernel->ninstr; i++) {
+		in = &kernel->code[i];
+
+		if (in->type != VK_GLOBAL)
+			continue;
+
+		sym = symbol_table_lookup_global(ctx, in->name);
+
+		if (sym == NULL || sym->v_type != VALUE_TYPE_DIGIT)
+			return FALSE;
+	}
+
+	if (!whole_fails(ctx, func, v_type, rows, cols))
+		return FALSE;
+
+	/* on the stack first: an allocation over the budget frees it */
+	if (v_type == VALUE_TYPE_VECTOR) {
+		vc   = pool_vector_alloc(rows);
+		out  = vc->data;
+		eval = eval_new(TAG_CONST, v_type, vc);
+	} else {
+		mx   = pool_matrix_alloc(rows, cols);
+		out  = mx->data;
+		eval = eval_new(TAG_CONST, v_type, mx);
+	}
+
+	push(ctx, eval);
+
+	mem = umalloc(kernel->ninstr * (sizeof(*uniform) + sizeof(*value) +
+				sizeof(*regs) + VK_BLOCK * sizeof(double)));
+
+	value   = mem;
+	regs    = (double **)(value + kernel->ninstr);
+	block   = (double *)(regs + kernel->ninstr);
+	uniform = (char *)(block + kernel->ninstr * VK_BLOCK);
+
+	/* what does not depend on an array is worked out once */
+	for (i = nregs = 0; i < kernel->ninstr; i++) {
+		in = &kernel->code[i];
+
+		uniform[i] = TRUE;
+
+		switch(in->type) {
+		case VK_ARG:
+			sym = func->args[in->a];
+			uniform[i] = sym->v_type == VALUE_TYPE_DIGIT;
+			value[i]   = sym->digit;
+			break;
+		case VK_CONST:
+			value[i] = in->digit;
+			break;
+		case VK_GLOBAL:
+			value[i] = symbol_table_lookup_global(ctx, in->name)->digit;
+			break;
+		case VK_OP:
+			uniform[i] = uniform[in->a] && uniform[in->b];
+
+			if (!uniform[i])
+				break;
+
+			/* a division reports for the elements that get to it */
+			if (in->opcode == OPCODE_DIV && value[in->b] == 0.0 &&
+			    in->live >= 0 && !uniform[in->live])
+				uniform[i] = FALSE;
+			else if (in->opcode == OPCODE_DIV &&
+					value[in->b] == 0.0 && VALUE(in->live) == 0.0)
+				value[i] = 0.0;
+			else
+				value[i] = libm_digit_op(value[in->a],
+						value[in->b], in->opcode);
+			break;
+		case VK_CALL:
+			uniform[i] = uniform[in->a];
+
+			if (uniform[i])
+				in->fn(&value[i], &value[in->a], 1);
+			break;
+		case VK_SELECT:
+			uniform[i] = uniform[in->c] && uniform[in->a] &&
+							uniform[in->b];
+
+			if (uniform[i])
+				value[i] = (value[in->c] != 0.0) ?
+						value[in->a] : value[in->b];
+			break;
+		}
+
+		if (!uniform[i])
+			regs[i] = block + VK_BLOCK * nregs++;
+	}
+
+	run(kernel, func, out, rows * cols, uniform, value, regs);
+
+	ufree(mem);
+
+	return TRUE;
+}
+
+static int scalar_list(struct vk_compile *c, struct ast_node *node);
+
+/* node works on digits only, whatever the digits are */
+static int
+scalar_node(struct vk_compile *c, struct ast_node *node)
+{
+	struct ast_node_func_call *call;
+	struct ast_node_assign *assign;
+	struct ast_node_return *ret;
+	struct ast_node_while *_while;
+	struct ast_node_for *_for;
+	struct ast_node_if *_if;
+	struct ast_node_op *op;
+	struct function *func;
+	int i, ok;
+
+	if (node == NULL)
+		return TRUE;
+
+	switch(node->type) {
+	case NODE_TYPE_ID:
+	case NODE_TYPE_STUB:
+	case NODE_TYPE_BREAK:
+	case NODE_TYPE_CONTINUE:
+	case NODE_TYPE_END_SCOPE:
+		return TRUE;
+	case NODE_TYPE_CONST:
+		return AST_CONST(node)->v_type == VALUE_TYPE_DIGIT;
+	case NODE_TYPE_ADD_OP:
+	case NODE_TYPE_MULT_OP:
+	case NODE_TYPE_REL_OP:
+	case NODE_TYPE_AND_OP:
+	case NODE_TYPE_OR_OP:
+	case NODE_TYPE_EXP_OP:
+		op = (struct ast_node_op *)node;
+		return scalar_node(c, op->left) && scalar_node(c, op->right);
+	case NODE_TYPE_ASSIGN:
+		assign = (struct ast_node_assign *)node;
+		return assign->left->type == NODE_TYPE_ID &&
+					scalar_node(c, assign->right);
+	case NODE_TYPE_RETURN:
+		ret = (struct ast_node_return *)node;
+		return ret->ret_val != NULL && scalar_node(c, ret->ret_val);
+	case NODE_TYPE_IF:
+		_if = (struct ast_node_if *)node;
+		return scalar_node(c, _if->expr) && scalar_list(c, _if->stmt) &&
+					scalar_list(c, _if->_else);
+	case NODE_TYPE_WHILE:
+		_while = (struct ast_node_while *)node;
+		return scalar_node(c, _while->expr) &&
+					scalar_list(c, _while->stmt);
+	case NODE_TYPE_FOR:
+		_for = (struct ast_node_for *)node;
+		return scalar_node(c, _for->expr1) &&
+			scalar_node(c, _for->expr2) &&
+			scalar_node(c, _for->expr3) && scalar_list(c, _for->stmt);
+	case NODE_TYPE_FUNC_CALL:
+		call = (struct ast_node_func_call *)node;
+		func = function_table_lookup(c->ctx, call->name);
+
+		if (func == NULL || func->nargs != call->nargs)
+			return FALSE;
+
+		for (i = 0; i < call->nargs; i++)
+			if (!scalar_node(c, call->args[i]))
+				return FALSE;
+
+		if (func->is_lib)
+			return vmath_builtin(func->name) != NULL;
+
+		/* a function being checked is scalar if the rest is */
+		for (i = 0; i < c->depth; i++)
+			if (c->stack[i] == func)
+				return TRUE;
+
+		if (c->depth == VK_DEPTH || func->body == NULL)
+			return FALSE;
+
+		c->stack[c->depth++] = func;
+		ok = scalar_list(c, func->body);
+		c->depth--;
+
+		return ok;
+	default:
+		return FALSE;
+	}
+}
+
+static int
+scalar_list(struct vk_compile *c, struct ast_node *node)
+{
+	for (; node != NULL; node = node->next) {
+		if (node->type == NODE_TYPE_END_SCOPE)
+			break;
+
+		if (!scalar_node(c, node))
+			return FALSE;
+	}
+
+	return TRUE;
+}
+
+static int
+scalar_func(struct bclite_ctx *ctx, struct function *func)
+{
+	struct vk_compile c;
+
+	if (func->is_lib || func->body == NULL)
+		return FALSE;
+
+	memset(&c, 0, sizeof(c));
+
+	c.ctx      = ctx;
+	c.stack[0] = func;
+	c.depth    = 1;
+
+	return scalar_list(&c, func->body);
+}
+
+int
+vkernel_scalar(struct bclite_ctx *ctx, struct function *func,
+		value_t *v_type, size_t *rows, size_t *cols)
+{
+	return_val_if_fail(func != NULL, FALSE);
+
+	if (func->is_lib || !array_shape(func, v_type, rows, cols))
+		return FALSE;
+
+	return scalar_func(ctx, func) &&
+			whole_fails(ctx, func, *v_type, *rows, *cols);
+}
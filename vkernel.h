@@ -0,0 +1,48 @@
+#ifndef VKERNEL_H_
+#define VKERNEL_H_
+
+#include "function.h"
+
+struct bclite_ctx;
+struct vkernel;
+
+/*
+ * Element-wise form of a scalar user function.
+ *
+ * A function of digits called with vectors or matrices of one shape is
+ * mapped over them, element i of the result being what it gives for the
+ * digits at i, but only where the call with the whole arrays is sure to
+ * fail: a condition that is not a digit, a digit divided by an array, a
+ * product of arrays that do not conform.  A body that works on arrays,
+ * or may, keeps its meaning: a * b of two vectors is their inner product.
+ *
+ * Assignments to locals, returns, if/else and for loops with digits for
+ * bounds, built from digits, arithmetic, comparisons, the builtins of
+ * vmath.h and calls to other such functions, are compiled into
+ * straight-line code over registers: a branch into selects on the
+ * elements that take it, a loop unrolled.  That code then runs over
+ * blocks of the arrays.
+ */
+
+/*
+ * After the arguments of func are set: if the call is to be mapped and
+ * func compiles, push the result and return TRUE.  FALSE leaves the call
+ * to the interpreter.
+ */
+int
+vkernel_call(struct bclite_ctx *ctx, struct function *func);
+
+/*
+ * After the arguments of func are set: TRUE if the call is to be mapped
+ * though vkernel_call() does not take it, a while loop say.  The last
+ * resort: the interpreter then runs the body once for the digits at
+ * each element.
+ */
+int
+vkernel_scalar(struct bclite_ctx *ctx, struct function *func,
+		value_t *v_type, size_t *rows, size_t *cols);
+
+void
+vkernel_destroy(struct vkernel **kernel);
+
+#endif /* VKERNEL_H_ */
@@ -0,0 +1,317 @@
+/* errno is never read, and fused multiply-adds would round per build */
+#pragma GCC optimize ("no-math-errno", "fp-contract=off")
+
+#include <stdio.h>
+#include <string.h>
+#include <float.h>
+#include <math.h>
+
+#include "vmath.h"
+#include "macros.h"
+
+#if defined(__x86_64__) && !defined(__clang__)
+#define VMATH_CLONES \
+	__attribute__((target_clones("arch=x86-64-v4", "arch=x86-64-v3", "default")))
+#else
+#define VMATH_CLONES
+#endif
+
+typedef double vdouble __attribute__((vector_size(VMATH_WIDTH * sizeof(double))));
+typedef long long vlong __attribute__((vector_size(VMATH_WIDTH * sizeof(long long))));
+
+#define INLINE		static inline __attribute__((always_inline))
+
+/* x + SHIFT rounds x to an integer, kept in the low bits of the sum */
+#define SHIFT		0x1.8p52
+
+/* fdlibm constants, the high parts have trailing zeros so k * hi is exact */
+#define LN2_HI		6.93147180369123816490e-01
+#define LN2_LO		1.90821492927058770002e-10
+#define INV_LN2		1.44269504088896338700e+00
+
+#define TWO_OVER_PI	6.36619772367581382433e-01
+#define PIO2_1		1.57079632673412561417e+00
+#define PIO2_2		6.07710050630396597660e-11
+#define PIO2_3		2.02226624871116645580e-21
+#define PIO2_3T		8.47842766036889956997e-32
+
+#define SIGN		((long long)1 << 63)
+
+INLINE vdouble
+splat(double x)
+{
+	return (vdouble){ 0 } + x;
+}
+
+INLINE vdouble
+select(vlong mask, vdouble a, vdouble b)
+{
+	return (vdouble)((mask & (vlong)a) | (~mask & (vlong)b));
+}
+
+INLINE vdouble
+negate(vlong mask, vdouble a)
+{
+	return (vdouble)((vlong)a ^ (mask & SIGN));
+}
+
+/* the integer x + SHIFT was rounded to */
+INLINE vlong
+shifted(vdouble t)
+{
+	return (vlong)t - (vlong)splat(SHIFT);
+}
+
+INLINE vdouble
+kernel_exp(vdouble x, vlong *ok)
+{
+	vdouble t, k, r, p;
+	vlong scale;
+
+	*ok = (x >= -708.0) & (x <= 709.0);
+
+	/* x = k ln2 + r, |r| <= ln2 / 2 */
+	t = x * INV_LN2 + SHIFT;
+	k = t - SHIFT;
+	r = (x - k * LN2_HI) - k * LN2_LO;
+
+	/* Taylor to r^13 */
+	p = splat(1.0 / 6227020800.0);
+	p = p * r + 1.0 / 479001600.0;
+	p = p * r + 1.0 / 39916800.0;
+	p = p * r + 1.0 / 3628800.0;
+	p = p * r + 1.0 / 362880.0;
+	p = p * r + 1.0 / 40320.0;
+	p = p * r + 1.0 / 5040.0;
+	p = p * r + 1.0 / 720.0;
+	p = p * r + 1.0 / 120.0;
+	p = p * r + 1.0 / 24.0;
+	p = p * r + 1.0 / 6.0;
+	p = p * r + 0.5;
+	p = p * r + 1.0;
+	p = p * r + 1.0;
+
+	scale = (shifted(t) + 1023) << 52;
+
+	return p * (vdouble)scale;
+}
+
+INLINE vdouble
+kernel_ln(vdouble x, vlong *ok)
+{
+	vdouble m, f, s, z, w, t1, t2, r, hfsq, dk;
+	vlong bits, e, big;
+
+	*ok = (x >= DBL_MIN) & (x <= DBL_MAX);
+
+	/* x = 2^e m, sqrt(2) / 2 <= m < sqrt(2) */
+	bits = (vlong)x;
+	e    = ((bits >> 52) & 0x7ff) - 1023;
+	m    = (vdouble)((bits & 0x000fffffffffffffLL) | 0x3ff0000000000000LL);
+	big  = m > M_SQRT2;
+	m    = select(big, m * 0.5, m);
+	e    = e - big;
+	dk   = (vdouble)((vlong)splat(SHIFT) + e) - SHIFT;
+
+	/* fdlibm's log(1 + f) */
+	f  = m - 1.0;
+	s  = f / (2.0 + f);
+	z  = s * s;
+	w  = z * z;
+	t1 = w * (3.999999999940941908e-01 + w * (2.222219843214978396e-01 +
+					w * 1.531383769920937332e-01));
+	t2 = z * (6.666666666666735130e-01 + w * (2.857142874366239149e-01 +
+		w * (1.818357216161805012e-01 + w * 1.479819860511658591e-01)));
+	r  = t2 + t1;
+	hfsq = 0.5 * f * f;
+
+	return dk * LN2_HI - ((hfsq - (s * (hfsq + r) + dk * LN2_LO)) - f);
+}
+
+INLINE vlong
+tiny(vdouble x)
+{
+	return (x > -0x1p-27) & (x < 0x1p-27);
+}
+
+/* x = q pi/2 + r + lo, |r| <= pi/4, lo is what r could not hold */
+INLINE vdouble
+reduce(vdouble x, vdouble *lo, vlong *q, vlong *ok)
+{
+	vdouble t, k, a, w, r;
+
+	*ok = (x >= -1e5) & (x <= 1e5);
+
+	t  = x * TWO_OVER_PI + SHIFT;
+	k  = t - SHIFT;
+	*q = shifted(t);
+
+	/* exact so far, the last two terms are rounded and carried in lo */
+	a = (x - k * PIO2_1) - k * PIO2_2;
+	w = k * PIO2_3;
+	r = a - w;
+	w = ((a - r) - w) - k * PIO2_3T;
+	a = r + w;
+	*lo = w - (a - r);
+
+	return a;
+}
+
+/* sin(r + lo), lo is tiny next to r */
+INLINE vdouble
+kernel_sin_r(vdouble r, vdouble lo)
+{
+	vdouble z, v, p;
+
+	z = r * r;
+	v = z * r;
+	p = 8.33333333332248946124e-03 + z * (-1.98412698298579493134e-04 +
+		z * (2.75573137070700676789e-06 + z * (-2.50507602534068634195e-08 +
+		z * 1.58969099521155010221e-10)));
+
+	return r - ((z * (0.5 * lo - v * p) - lo) -
+		v * -1.66666666666666324348e-01);
+}
+
+/* cos(r + lo) */
+INLINE vdouble
+kernel_cos_r(vdouble r, vdouble lo)
+{
+	vdouble z, hz, w, p;
+
+	z  = r * r;
+	hz = 0.5 * z;
+	w  = 1.0 - hz;
+	p  = 4.16666666666666019037e-02 + z * (-1.38888888888741095749e-03 +
+		z * (2.48015872894767294178e-05 + z * (-2.75573143513906633035e-07 +
+		z * (2.08757232129817482790e-09 + z * -1.13596475577881948265e-11))));
+
+	return w + (((1.0 - w) - hz) + (z * z * p - r * lo));
+}
+
+INLINE vdouble
+kernel_sin(vdouble x, vlong *ok)
+{
+	vdouble r, lo, s, c;
+	vlong q;
+
+	r = reduce(x, &lo, &q, ok);
+	s = kernel_sin_r(r, lo);
+	c = kernel_cos_r(r, lo);
+
+	s = negate(-((q >> 1) & 1), select(-(q & 1), c, s));
+
+	/* keeps the sign of zero */
+	return select(tiny(x), x, s);
+}
+
+INLINE vdouble
+kernel_cos(vdouble x, vlong *ok)
+{
+	vdouble r, lo, s, c;
+	vlong q;
+
+	r = reduce(x, &lo, &q, ok);
+	s = kernel_sin_r(r, lo);
+	c = kernel_cos_r(r, lo);
+
+	return negate(-(((q + 1) >> 1) & 1), select(-(q & 1), s, c));
+}
+
+INLINE vdouble
+kernel_tan(vdouble x, vlong *ok)
+{
+	vdouble r, lo, s, c;
+	vlong odd;
+
+	r   = reduce(x, &lo, &odd, ok);
+	odd = -(odd & 1);
+	s   = kernel_sin_r(r, lo);
+	c   = kernel_cos_r(r, lo);
+
+	return select(tiny(x), x, select(odd, -c / s, s / c));
+}
+
+INLINE vdouble
+kernel_sqrt(vdouble x, vlong *ok)
+{
+	vdouble r;
+	int i;
+
+	/* correctly rounded everywhere */
+	for (i = 0; i < VMATH_WIDTH; i++)
+		r[i] = __builtin_sqrt(x[i]);
+
+	*ok = x == x;
+
+	return r;
+}
+
+/*
+ * A short tail is padded with zeros, so it goes through the same kernel
+ * as the rest of the array.
+ */
+#define VMATH_MAP(name, kernel, libm)					\
+VMATH_CLONES void							\
+vmath_##name(double *y, const double *x, size_t n)			\
+{									\
+	vdouble v, r;							\
+	vlong ok;							\
+	size_t i, j, m;							\
+	long long all;							\
+									\
+	for (i = 0; i < n; i += VMATH_WIDTH) {				\
+		m = MIN(n - i, VMATH_WIDTH);				\
+		v = splat(0.0);						\
+									\
+		memcpy(&v, x + i, m * sizeof(double));			\
+									\
+		r   = kernel(v, &ok);					\
+		all = -1;						\
+									\
+		for (j = 0; j < VMATH_WIDTH; j++)			\
+			all &= ok[j];					\
+									\
+		if (all) {						\
+			memcpy(y + i, &r, m * sizeof(double));		\
+			continue;					\
+		}							\
+									\
+		for (j = 0; j < m; j++)					\
+			y[i + j] = ok[j] ? r[j] : libm(v[j]);		\
+	}								\
+}
+
+VMATH_MAP(sin, kernel_sin, sin)
+VMATH_MAP(cos, kernel_cos, cos)
+VMATH_MAP(tan, kernel_tan, tan)
+VMATH_MAP(exp, kernel_exp, exp)
+VMATH_MAP(ln, kernel_ln, log)
+VMATH_MAP(sqrt, kernel_sqrt, sqrt)
+
+static struct {
+	const char	*name;
+	vmath_fn_t	fn;
+} builtins[] = {
+	{ "sin",	vmath_sin },
+	{ "cos",	vmath_cos },
+	{ "tan",	vmath_tan },
+	{ "exp",	vmath_exp },
+	{ "ln",		vmath_ln },
+	{ "sqrt",	vmath_sqrt },
+	{ NULL,		NULL }
+};
+
+vmath_fn_t
+vmath_builtin(const char *name)
+{
+	int i;
+
+	return_val_if_fail(name != NULL, NULL);
+
+	for (i = 0; builtins[i].name != NULL; i++)
+		if (STREQ(name, builtins[i].name))
+			return builtins[i].fn;
+
+	return NULL;
+}
@@ -0,0 +1,45 @@
+#ifndef VMATH_H_
+#define VMATH_H_
+
+#include <stddef.h>
+
+/*
+ * y[i] = f(x[i]) for n doubles, y may be x.
+ *
+ * The kernels are polynomial approximations written once for vectors of
+ * VMATH_WIDTH doubles and built for AVX-512, AVX2 and plain x86-64; the
+ * loader picks the best one the processor has.  They round the same way
+ * on every build, so a result depends neither on the machine nor on the
+ * position of the element: f(x) is the same digit as element i of
+ * f(vector).  Arguments a kernel does not cover (NaN, infinities,
+ * overflow, angles beyond 1e5) go to libm.  Measured against long
+ * double, tan stays within 3 ulp and the others within 1.5.
+ */
+
+#define VMATH_WIDTH	8
+
+typedef void (*vmath_fn_t)(double *y, const double *x, size_t n);
+
+/* the kernel of the builtin of one digit called name, NULL if none */
+vmath_fn_t
+vmath_builtin(const char *name);
+
+void
+vmath_sin(double *y, const double *x, size_t n);
+
+void
+vmath_cos(double *y, const double *x, size_t n);
+
+void
+vmath_tan(double *y, const double *x, size_t n);
+
+void
+vmath_exp(double *y, const double *x, size_t n);
+
+void
+vmath_ln(double *y, const double *x, size_t n);
+
+void
+vmath_sqrt(double *y, const double *x, size_t n);
+
+#endif /* VMATH_H_ */